@@ -97,6 +97,74 @@ public:
      * @return false
      */
     virtual bool QueryBuffer(const char* key, size_t keySize, std::string& value) = 0;
+
+    /**
+     * @brief query a batch of keys of the same size
+     *
+     * @param keyList the keys (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param valueList the values of the found keys (valueSize bytes each, NULL: not needed)
+     * @param valueSize the value size
+     * @param foundList whether each key is found (1: found, 0: not found)
+     * @return uint32_t the number of found keys
+     */
+    virtual uint32_t MultiQuery(const char* keyList, uint32_t keyNum, size_t keySize,
+        char* valueList, size_t valueSize, uint8_t* foundList);
+
+    /**
+     * @brief insert a batch of (key, value) pairs of the same size
+     *
+     * @param keyList the keys (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param valueList the values (valueSize bytes each)
+     * @param valueSize the value size
+     * @return true success
+     * @return false fail
+     */
+    virtual bool MultiInsert(const char* keyList, uint32_t keyNum, size_t keySize,
+        const char* valueList, size_t valueSize);
+
+    /**
+     * @brief whether the pairs are persisted only after their values (containers)
+     * are durable, see HoldValue and CommitValue
+     *
+     * @return true the writer of a value syncs it and then commits it
+     * @return false the pairs are persisted on their own
+     */
+    virtual bool NeedDurableValue() { return false; }
+
+    /**
+     * @brief hold a value (a container) which is not durable yet, before any pair
+     * of it is inserted, its pairs are queried but not persisted until it is committed
+     *
+     * @param value the value
+     * @param valueSize the value size
+     */
+    virtual void HoldValue(const char* value, size_t valueSize) { return; }
+
+    /**
+     * @brief commit a durable value, persist its pairs
+     *
+     * @param keyList the keys of the value (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param value the value
+     * @param valueSize the value size
+     */
+    virtual void CommitValue(const char* keyList, uint32_t keyNum, size_t keySize,
+        const char* value, size_t valueSize) { return; }
+
+    /**
+     * @brief visit all (key, value) pairs in the database, the pairs inserted
+     * during the traversal may be missed
+     *
+     * @param visitor the function called on each pair
+     * @return true success
+     * @return false fail
+     */
+    virtual bool Traverse(std::function<void(const std::string& key, const std::string& value)> visitor) = 0;
 };
 
 #endif // !BASICDEDUP_ABS_DATABASE_H
@@ -17,10 +17,18 @@
 #include "cryptoPrimitive.h"
 #include "storageCore.h"
 #include "clientVar.h"
+#include "fingerprintFilter.h"
+#include "hashPool.h"
 #include <lz4.h>
 
 extern Configure config;
 
+typedef struct {
+    std::mutex stripeLck;
+    std::condition_variable stripeCond;
+    unordered_set<string> fpSet;
+} InflightStripe_t;
+
 class AbsIndex {
 protected:
     // the pointer to the abs database
@@ -37,18 +45,54 @@ protected:
 
     // for crypto
     CryptoPrimitive* cryptoObj_;
+    // the workers to fingerprint the chunks of a batch, shared by the sessions
+    HashPool* hashPoolObj_;
+    // the duplicate chunks below the threshold of the sample rng are verified
+    uint64_t fpSampleThreshold_;
+
+    // the new chunks being stored, only one session stores a new chunk
+    InflightStripe_t inflightList_[INFLIGHT_STRIPE_NUM];
+
+    /**
+     * @brief reserve a new chunk before storing it, wait if another session
+     * is storing the same chunk
+     *
+     * @param key the fingerprint
+     */
+    void ReserveChunk(const string& key);
+
+    /**
+     * @brief release the reservation of a chunk
+     *
+     * @param key the fingerprint
+     */
+    void ReleaseChunk(const string& key);
+
+    // the filter of the fingerprints published to the edges
+    FingerprintFilter* fpFilter_ = NULL;
+    boost::thread* filterThread_ = NULL;
+
+    /**
+     * @brief rebuild the fingerprint filter from the index store in the background
+     *
+     */
+    void RefreshFilter();
 
     // for statistic
-    uint64_t totalRecvDataSize_ = 0;
-    uint64_t totalBatchNum_ = 0;
+    boost::atomic<uint64_t> totalRecvDataSize_;
+    boost::atomic<uint64_t> totalBatchNum_;
+    boost::atomic<uint64_t> inflightWaitNum_;
 
 public:
     // for statistic
-    uint64_t _logicalChunkNum = 0;
-    uint64_t _logicalDataSize = 0;
-    uint64_t _uniqueChunkNum = 0;
-    uint64_t _uniqueDataSize = 0;
-    uint64_t _compressedDataSize = 0;
+    boost::atomic<uint64_t> _logicalChunkNum;
+    boost::atomic<uint64_t> _logicalDataSize;
+    boost::atomic<uint64_t> _uniqueChunkNum;
+    boost::atomic<uint64_t> _uniqueDataSize;
+    boost::atomic<uint64_t> _compressedDataSize;
+    boost::atomic<uint64_t> _skippedChunkNum;
+    boost::atomic<uint64_t> _verifiedChunkNum;
+    boost::atomic<uint64_t> _trustedChunkNum;
 
     /**
      * @brief Construct a new Abs Index object
@@ -73,6 +117,59 @@ public:
 
     virtual void ProcessRecipeBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient) = 0;
 
+    /**
+     * @brief answer which chunks of a batch of fingerprints need to be uploaded
+     *
+     * @param recvChunkBuf the recv chunk buffer (turned into the reply)
+     * @param curClient the current client var
+     */
+    virtual void ProcessChunkQuery(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient) = 0;
+
+    /**
+     * @brief query the index for a batch of secure recipe entries
+     *
+     * @param entryBase the fingerprints of the entries
+     * @param entryNum the number of entries
+     * @param statusList the status of each entry (0: duplicate, 1: unique), it
+     * can overlap the fingerprints since the i-th status is written after the
+     * i-th fingerprint is read
+     */
+    virtual void QueryRecipeBatch(uint8_t* entryBase, uint32_t entryNum,
+        uint8_t* statusList) = 0;
+
+    /**
+     * @brief the current file of a session ends, i.e., a new file starts or the
+     * session ends
+     *
+     * @param curClient the current client var
+     */
+    virtual void ProcessFileEnd(ClientVar* curClient)
+    {
+        return;
+    }
+
+    /**
+     * @brief encode the status list of a query reply in the smallest format the edge accepts
+     *
+     * @param statusList the status of each entry (0: duplicate, 1: unique)
+     * @param entryNum the number of entries
+     * @param replyCap the reply formats the edge accepts (0: one byte per entry, no format byte)
+     * @param replyBuffer the output buffer (at least entryNum + 1 bytes)
+     * @return uint32_t the size of the encoded list
+     */
+    uint32_t EncodeQueryReply(const uint8_t* statusList, uint32_t entryNum, uint32_t replyCap,
+        uint8_t* replyBuffer);
+
+    /**
+     * @brief Get the Fingerprint Filter object
+     *
+     * @return FingerprintFilter* the filter (NULL: disabled)
+     */
+    FingerprintFilter* GetFingerprintFilter()
+    {
+        return fpFilter_;
+    }
+
     /**
      * @brief Set the Storage Core Obj object
      *
@@ -115,6 +212,42 @@ public:
      */
     bool UpdateIndexStore(const string& key, const char* buffer,
         size_t bufferSize);
+
+    /**
+     * @brief read a batch of fingerprints from the index store
+     *
+     * @param keyList the fingerprints (CHUNK_HASH_SIZE bytes each)
+     * @param keyNum the number of fingerprints
+     * @param valueList the container names of the found ones (CONTAINER_ID_LENGTH
+     * bytes each, NULL: not needed)
+     * @param foundList whether each fingerprint is found (1: found, 0: not found)
+     * @return uint32_t the number of found fingerprints
+     */
+    uint32_t ReadIndexStoreBatch(const uint8_t* keyList, uint32_t keyNum,
+        uint8_t* valueList, uint8_t* foundList);
+
+    /**
+     * @brief update the index store with a batch of new fingerprints
+     *
+     * @param keyList the fingerprints (CHUNK_HASH_SIZE bytes each)
+     * @param keyNum the number of fingerprints
+     * @param valueList the container names (CONTAINER_ID_LENGTH bytes each)
+     * @return true success
+     * @return false fail
+     */
+    bool UpdateIndexStoreBatch(const uint8_t* keyList, uint32_t keyNum,
+        const uint8_t* valueList);
+
+    /**
+     * @brief verify the fingerprints sent with the chunks of a batch, i.e.,
+     * the chunks to store and a random sample of the duplicate ones
+     *
+     * @param curClient the current client var (with the located chunks, the
+     * fingerprints from the edge and their index lookup)
+     * @return true all verified chunks match their fingerprints
+     * @return false otherwise
+     */
+    bool VerifyBatchFp(ClientVar* curClient);
 };
 
 #endif // !1
\ No newline at end of file
@@ -0,0 +1,239 @@
+/**
+ * @file cachedDatabase.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement an index on leveldb with an in-memory cache, a negative filter
+ * and a write-back buffer
+ * @version 0.1
+ * @date 2022-07-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef CACHED_DATABASE_H
+#define CACHED_DATABASE_H
+
+#include "absDatabase.h"
+#include "leveldbDatabase.h"
+#include "configure.h"
+#include "lruCache.h"
+#include "murmurHash.h"
+
+#include <boost/atomic.hpp>
+
+typedef lru11::Cache<string, string, std::mutex> PairCache_t;
+
+class CachedDatabase : public AbsDatabase {
+protected:
+    string myName_ = "CachedDatabase";
+    LeveldbDatabase* diskDB_ = NULL;
+
+    // the recently used pairs, sharded to spread the locks
+    PairCache_t* cacheList_[INDEX_SHARD_NUM];
+
+    // the bloom filter of all keys in the index (no false negative)
+    uint8_t* filterBitArray_ = NULL;
+    uint64_t filterBitNum_ = 0;
+
+    // the new pairs not in leveldb yet, guarded by bufLck_ (flushLck_ is taken before it)
+    std::mutex bufLck_;
+    std::mutex flushLck_;
+    unordered_map<string, string> dirtyBuf_;
+    // the pairs under writing to leveldb, still visible to the queries
+    unordered_map<string, string> flushingBuf_;
+
+    // for statistic
+    boost::atomic<uint64_t> queryNum_;
+    boost::atomic<uint64_t> batchNum_;
+    boost::atomic<uint64_t> cacheHitNum_;
+    boost::atomic<uint64_t> filterSkipNum_;
+    boost::atomic<uint64_t> bufferHitNum_;
+    boost::atomic<uint64_t> diskReadNum_;
+    boost::atomic<uint64_t> diskHitNum_;
+    uint64_t flushNum_ = 0;
+
+    /**
+     * @brief get the cache shard of a key
+     *
+     * @param key the key
+     * @return PairCache_t* the cache shard
+     */
+    inline PairCache_t* GetCache(const string& key)
+    {
+        return cacheList_[std::hash<string>()(key) % INDEX_SHARD_NUM];
+    }
+
+    /**
+     * @brief get the two hashes of a key for the filter
+     *
+     * @param key the key
+     * @param keySize the key size
+     * @param hash1 the first hash
+     * @param hash2 the second hash
+     */
+    inline void GetFilterHash(const char* key, size_t keySize, uint64_t& hash1, uint64_t& hash2)
+    {
+        uint64_t hashList[2];
+        MurmurHash3_x64_128(key, keySize, 0, hashList);
+        hash1 = hashList[0];
+        hash2 = hashList[1] | 1;
+    }
+
+    /**
+     * @brief add a key to the filter
+     *
+     * @param key the key
+     * @param keySize the key size
+     */
+    void AddToFilter(const char* key, size_t keySize);
+
+    /**
+     * @brief check whether a key may be in the index
+     *
+     * @param key the key
+     * @param keySize the key size
+     * @return true it may be in the index
+     * @return false it is not in the index
+     */
+    bool MayContain(const char* key, size_t keySize);
+
+    /**
+     * @brief load the filter saved on exit, or rebuild it from leveldb
+     *
+     */
+    void LoadFilter();
+
+    /**
+     * @brief save the filter for the next startup
+     *
+     */
+    void SaveFilter();
+
+    /**
+     * @brief write the buffered new pairs to leveldb with one write batch
+     *
+     * @return true success
+     * @return false fail
+     */
+    bool Flush();
+
+public:
+    /**
+     * @brief Construct a new Cached Database object
+     *
+     * @param dbName the path of the db
+     */
+    CachedDatabase(std::string dbName);
+
+    /**
+     * @brief Destroy the Cached Database object
+     *
+     */
+    virtual ~CachedDatabase();
+
+    /**
+     * @brief open a database
+     *
+     * @param dbName the db path
+     * @return true success
+     * @return false fail
+     */
+    bool OpenDB(std::string dbName);
+
+    /**
+     * @brief execute query over database
+     *
+     * @param key key
+     * @param value value
+     * @return true success
+     * @return false fail
+     */
+    bool Query(const std::string& key, std::string& value);
+
+    /**
+     * @brief insert the (key, value) pair
+     *
+     * @param key key
+     * @param value value
+     * @return true success
+     * @return false fail
+     */
+    bool Insert(const std::string& key, const std::string& value);
+
+    /**
+     * @brief insert the (key, value) pair
+     *
+     * @param key
+     * @param buffer
+     * @param bufferSize
+     * @return true
+     * @return false
+     */
+    bool InsertBuffer(const std::string& key, const char* buffer, size_t bufferSize);
+
+    /**
+     * @brief insert the (key, value) pair
+     *
+     * @param key
+     * @param keySize
+     * @param buffer
+     * @param bufferSize
+     * @return true
+     * @return false
+     */
+    bool InsertBothBuffer(const char* key, size_t keySize, const char* buffer,
+        size_t bufferSize);
+
+    /**
+     * @brief query the (key, value) pair
+     *
+     * @param key
+     * @param keySize
+     * @param value
+     * @return true
+     * @return false
+     */
+    bool QueryBuffer(const char* key, size_t keySize, std::string& value);
+
+    /**
+     * @brief query a batch of keys of the same size, the keys missing the cache,
+     * the filter and the buffer read leveldb in one batch
+     *
+     * @param keyList the keys (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param valueList the values of the found keys (valueSize bytes each, NULL: not needed)
+     * @param valueSize the value size
+     * @param foundList whether each key is found (1: found, 0: not found)
+     * @return uint32_t the number of found keys
+     */
+    uint32_t MultiQuery(const char* keyList, uint32_t keyNum, size_t keySize,
+        char* valueList, size_t valueSize, uint8_t* foundList);
+
+    /**
+     * @brief insert a batch of (key, value) pairs of the same size into the buffer,
+     * the buffer is written back once it is full
+     *
+     * @param keyList the keys (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param valueList the values (valueSize bytes each)
+     * @param valueSize the value size
+     * @return true success
+     * @return false fail
+     */
+    bool MultiInsert(const char* keyList, uint32_t keyNum, size_t keySize,
+        const char* valueList, size_t valueSize);
+
+    /**
+     * @brief visit all (key, value) pairs in the database, the buffer is written
+     * back first
+     *
+     * @param visitor the function called on each pair
+     * @return true success
+     * @return false fail
+     */
+    bool Traverse(std::function<void(const std::string& key, const std::string& value)> visitor);
+};
+
+#endif
@@ -25,6 +25,13 @@ typedef struct {
     uint64_t totalChunkNum;
 } FileRecipeHead_t;
 
+typedef struct {
+    uint32_t epoch;
+    uint32_t hashNum;
+    uint64_t seqNum;
+    uint64_t bitNum;
+} FilterHead_t;
+
 typedef struct {
     union {
         Chunk_t chunk;
@@ -90,15 +90,47 @@ public:
     SendMsgBuffer_t _recvChunkBuf;
     uint64_t _fileSize;
     uint64_t _totalChunkNum;
+    // the reply formats the edge accepts (EDGE_CAPABILITY)
+    uint32_t _replyCap = 0;
+    vector<uint8_t> _queryStatusList;
+    // the chunks which the edge is asked to upload after the chunk query
+    bool _chunkQueried = false;
+    unordered_set<string> _pendingChunkSet;
+    uint64_t _unexpectedChunkNum = 0;
+    // the chunks of the current batch and their fingerprints
+    vector<uint8_t*> _chunkAddrList;
+    vector<uint32_t> _chunkSizeList;
+    vector<uint8_t> _chunkHashList;
+    // the chunks whose fingerprints from the edge are verified
+    vector<uint8_t> _chunkVerifyList;
+    vector<uint8_t*> _verifyAddrList;
+    vector<uint32_t> _verifySizeList;
+    vector<uint8_t> _verifyHashList;
+    std::mt19937 _sampleRng;
+    std::atomic<bool> _fpRejected{ false };
+    uint64_t _fpMismatchNum = 0;
+    // the index lookup of the current batch (the found flags and container names)
+    vector<uint8_t> _indexFoundList;
+    vector<uint8_t> _indexValueList;
+    // the new chunks of the current batch (reserved, then stored)
+    vector<uint32_t> _newChunkList;
+    vector<uint8_t> _reservedHashList;
+    vector<uint8_t> _reservedFoundList;
+    vector<uint8_t> _newHashList;
+    vector<uint8_t> _newValueList;
 
     // download recipe buffer parameters
     SendMsgBuffer_t _sendRecipeBuf;
+    int _recipeStage = SEND_PLAIN_RECIPE;
+    // the recipe batches the edge can receive now
+    uint32_t _recipeCredit = 0;
 
     // restore buffer parameters
     ReqContainer_t _reqContainer;
     ReadCache* _containerCache;
     SendMsgBuffer_t _sendChunkBuf;
     DownloadChunkEntry_t* _downloadChunkBase;
+    bool _restoreReady = false;
 
     SSL* _clientSSL; // connection
 
@@ -124,6 +156,16 @@ public:
     ~ClientVar();
 
     void ChangeFile(string newFileName, uint64_t fileSize, uint64_t totalChunkNum);
+
+    /**
+     * @brief Get the operation type
+     *
+     * @return int the operation type (upload / download)
+     */
+    inline int GetOptType()
+    {
+        return optType_;
+    }
 };
 
 #endif
\ No newline at end of file
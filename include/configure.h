@@ -37,6 +37,20 @@ private:
     string containerRootPath_;
     string containerSuffix_ = "-container";
     string fp2ChunkDBName_;
+    uint32_t fp2ChunkDBType_ = 3;
+    uint32_t indexType_ = 0;
+    bool indexDedupLossCheck_ = false;
+    uint32_t indexLogCommitMs_ = 100;
+    uint32_t indexSnapshotSec_ = 600;
+    uint32_t indexWarmUpThreadNum_ = 4;
+    uint64_t levelDBCacheMiB_ = 256;
+    uint32_t levelDBBloomBits_ = 10;
+    uint64_t levelDBWriteBufferMiB_ = 64;
+    uint32_t levelDBBlockSizeKiB_ = 4;
+    bool levelDBCompression_ = false;
+    uint64_t indexCacheMiB_ = 256;
+    uint64_t indexStashKeyNum_ = 1048576;
+    uint32_t localityCacheContainerNum_ = 0;
 
     // restore setting
     uint64_t readCacheSize_;
@@ -57,6 +71,24 @@ private:
     string keyServerIp_;
     int keyServerPort_;
 
+    // for cloud server
+    uint32_t serverMode_ = THREAD_PER_CONNECTION;
+    uint32_t reactorThreadNum_ = 0;
+    uint32_t reactorWorkerNum_ = 0;
+    uint32_t listenBacklog_ = 10;
+    uint32_t listenerThreadNum_ = 1;
+    uint32_t handshakeThreadNum_ = 0;
+    uint32_t handshakeTimeoutSec_ = 10;
+    uint32_t sessionCacheSize_ = 20480;
+    uint32_t sessionTimeout_ = 7200;
+    bool enableKTLS_ = false;
+    uint32_t queryThreadNum_ = 0;
+    uint32_t recvBufferNum_ = 2;
+    uint32_t hashThreadNum_ = 0;
+    uint32_t filterBitsPerKey_ = 10;
+    uint32_t filterRefreshSec_ = 60;
+    double fpSampleRate_ = 1.0;
+
     /**
      * @brief read the configure file
      *
@@ -138,6 +170,76 @@ public:
         return fp2ChunkDBName_;
     }
 
+    uint32_t GetFp2ChunkDBType()
+    {
+        return fp2ChunkDBType_;
+    }
+
+    uint32_t GetIndexType()
+    {
+        return indexType_;
+    }
+
+    bool GetIndexDedupLossCheck()
+    {
+        return indexDedupLossCheck_;
+    }
+
+    uint32_t GetIndexLogCommitMs()
+    {
+        return indexLogCommitMs_;
+    }
+
+    uint32_t GetIndexSnapshotSec()
+    {
+        return indexSnapshotSec_;
+    }
+
+    uint32_t GetIndexWarmUpThreadNum()
+    {
+        return indexWarmUpThreadNum_;
+    }
+
+    uint64_t GetLevelDBCacheMiB()
+    {
+        return levelDBCacheMiB_;
+    }
+
+    uint32_t GetLevelDBBloomBits()
+    {
+        return levelDBBloomBits_;
+    }
+
+    uint64_t GetLevelDBWriteBufferMiB()
+    {
+        return levelDBWriteBufferMiB_;
+    }
+
+    uint32_t GetLevelDBBlockSizeKiB()
+    {
+        return levelDBBlockSizeKiB_;
+    }
+
+    bool GetLevelDBCompression()
+    {
+        return levelDBCompression_;
+    }
+
+    uint64_t GetIndexCacheMiB()
+    {
+        return indexCacheMiB_;
+    }
+
+    uint64_t GetIndexStashKeyNum()
+    {
+        return indexStashKeyNum_;
+    }
+
+    uint32_t GetLocalityCacheContainerNum()
+    {
+        return localityCacheContainerNum_;
+    }
+
     uint64_t GetReadCacheSize()
     {
         return readCacheSize_;
@@ -184,6 +286,87 @@ public:
         return keyServerPort_;
     }
 
+    // cloud server config
+    inline uint32_t GetServerMode()
+    {
+        return serverMode_;
+    }
+
+    inline uint32_t GetReactorThreadNum()
+    {
+        return reactorThreadNum_;
+    }
+
+    inline uint32_t GetReactorWorkerNum()
+    {
+        return reactorWorkerNum_;
+    }
+
+    inline uint32_t GetListenBacklog()
+    {
+        return listenBacklog_;
+    }
+
+    inline uint32_t GetListenerThreadNum()
+    {
+        return listenerThreadNum_;
+    }
+
+    inline uint32_t GetHandshakeThreadNum()
+    {
+        return handshakeThreadNum_;
+    }
+
+    inline uint32_t GetHandshakeTimeoutSec()
+    {
+        return handshakeTimeoutSec_;
+    }
+
+    inline uint32_t GetSessionCacheSize()
+    {
+        return sessionCacheSize_;
+    }
+
+    inline uint32_t GetSessionTimeout()
+    {
+        return sessionTimeout_;
+    }
+
+    inline bool GetEnableKTLS()
+    {
+        return enableKTLS_;
+    }
+
+    inline uint32_t GetQueryThreadNum()
+    {
+        return queryThreadNum_;
+    }
+
+    inline uint32_t GetHashThreadNum()
+    {
+        return hashThreadNum_;
+    }
+
+    inline uint32_t GetRecvBufferNum()
+    {
+        return recvBufferNum_;
+    }
+
+    inline uint32_t GetFilterBitsPerKey()
+    {
+        return filterBitsPerKey_;
+    }
+
+    inline uint32_t GetFilterRefreshSec()
+    {
+        return filterRefreshSec_;
+    }
+
+    inline double GetFpSampleRate()
+    {
+        return fpSampleRate_;
+    }
+
     inline string GetSecureRecipeSuffix()
     {
         return secureRecipeSuffix_;
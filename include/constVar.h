@@ -34,6 +34,16 @@ enum ENCRYPT_SET { AES_256_GCM = 0,
 enum HASH_SET { SHA_256 = 0,
     MD5 = 1,
     SHA_1 = 2 };
+// the kernel of the batch hash (SHA_256 only)
+enum HASH_KERNEL { HASH_KERNEL_OPENSSL = 0,
+    HASH_KERNEL_AVX2 = 1,
+    HASH_KERNEL_SHA_NI = 2 };
+// the min number of buffers to fill the lanes of the AVX2 kernel
+static const uint32_t AVX2_HASH_MIN_NUM = 4;
+// the buffers (number, size) and the rounds to measure the AVX2 kernel against OpenSSL
+static const uint32_t AVX2_PROBE_NUM = 64;
+static const uint32_t AVX2_PROBE_SIZE = 8192;
+static const uint32_t AVX2_PROBE_ROUND = 3;
 static const uint32_t CRYPTO_BLOCK_SIZE = 16;
 static const uint32_t CHUNK_HASH_SIZE = 32;
 static const uint32_t MLE_KEY_SIZE = 32;
@@ -69,10 +79,16 @@ enum DATA_TYPE_SET { DATA_CHUNK = 0,
     RECIPE_END,
     DATA_SEGMENT_END_FLAG };
 
-// configure for sparse index
+// configure for sparse index (a fingerprint is a hook with a chance of 1/2^SPARSE_SAMPLE_RATE,
+// a hook keeps the latest SPARSE_MANIFIEST_CAP_NUM manifests, the recently used manifests are cached)
 static const uint32_t SPARSE_SAMPLE_RATE = 6;
 static const uint32_t SPARSE_CHAMPION_NUM = 10;
 static const uint32_t SPARSE_MANIFIEST_CAP_NUM = 10;
+static const uint32_t SPARSE_MANIFEST_CACHE_NUM = 256;
+
+// configure for extreme binning (the bin file is compacted once the old versions of
+// the bins take more space than both the latest ones and EXTREME_BIN_COMPACT_SIZE)
+static const uint64_t EXTREME_BIN_COMPACT_SIZE = 64 * 1024 * 1024;
 
 enum INDEX_TYPE_SET { OUT_ENCLAVE = 0,
     IN_ENCLAVE,
@@ -83,12 +99,23 @@ enum INDEX_TYPE_SET { OUT_ENCLAVE = 0,
 enum SSL_CONNECTION_TYPE { IN_SERVERSIDE = 0,
     IN_CLIENTSIDE };
 
+// the status of the non-blocking ssl io
+enum SSL_IO_STATUS { SSL_IO_DONE = 0,
+    SSL_IO_WANT,
+    SSL_IO_FAIL };
+
+// the max plaintext size of a TLS record, the framing layer coalesces the
+// messages into the records of this size
+static const uint32_t SSL_FRAME_SIZE = 16 * 1024;
+
 // for SSL connection
 static const char SERVER_CERT[] = "../key/server/server.crt";
 static const char SERVER_KEY[] = "../key/server/server.key";
 static const char CLIENT_CERT[] = "../key/client/client.crt";
 static const char CLIENT_KEY[] = "../key/client/client.key";
 static const char CA_CERT[] = "../key/ca/ca.crt";
+// the id context of the resumable server sessions
+static const char SSL_SESSION_ID_CONTEXT[] = "CloudServer";
 
 static const char KEYMANGER_PRIVATE_KEY[] = "../key/RSAkey/server.key";
 static const char KEYMANGER_PUBLIC_KEY_FILE[] = "../key/RSAkey/serverpub.key";
@@ -138,7 +165,23 @@ enum EDGE_PROTCOL_CODE_SET {
     EDGE_DOWNLOAD_CHUNK_LOGIN,
     EDGE_DOWNLOAD_CHUNK_READY,
     CLOUD_SEND_CHUNK,
-    CLOUD_SEND_CHUNK_END
+    CLOUD_SEND_CHUNK_END,
+
+    // for pipelined secure recipe query
+    EDGE_UPLOAD_SEC_RECIPE_PIPE,
+    CLOUD_QUERY_RETURN_PIPE,
+
+    // for chunk query before upload
+    EDGE_MIGRATION_CHUNK_QUERY,
+    CLOUD_CHUNK_QUERY_RETURN,
+
+    // for fingerprint filter download
+    EDGE_DOWNLOAD_FILTER,
+    CLOUD_SEND_FILTER,
+    CLOUD_SEND_FILTER_DELTA,
+
+    // for the chunk upload with the fingerprints of the edge
+    EDGE_MIGRATION_CHUNK_FP
 };
 
 static const uint32_t CHUNK_QUEUE_SIZE = 8192;
@@ -161,12 +204,74 @@ static const uint32_t MAX_SGX_MESSAGE_SIZE = 4 * 1024;
 #define TEST_IN_CSE 0
 
 static const uint32_t THREAD_STACK_SIZE = 8 * 1024 * 1024;
+
+// for the server mode
+enum SERVER_MODE_SET { THREAD_PER_CONNECTION = 0,
+    EVENT_DRIVEN };
+static const uint32_t REACTOR_MAX_EVENT_NUM = 64;
+static const int REACTOR_LOCK_RETRY_MS = 10;
+static const int ACCEPT_RETRY_MS = 10;
+// the interval to drop the handshakes over the deadline
+static const int HANDSHAKE_CHECK_MS = 1000;
 static const uint32_t SESSION_KEY_BUFFER_SIZE = 65;
 
 enum OPT_TYPE { UPLOAD_OPT = 0,
     DOWNLOAD_RECIPE_OPT,
     DOWNLOAD_CHUNK_OPT };
 
+// the stage of sending recipes
+enum RECIPE_SEND_STAGE { SEND_PLAIN_RECIPE = 0,
+    SEND_SECURE_RECIPE,
+    SEND_KEY_RECIPE,
+    SEND_RECIPE_END };
+// the capabilities of an edge, set in the currentItemNum of the login message
+enum EDGE_CAPABILITY { EDGE_CAP_BITMAP_REPLY = 0x1,
+    EDGE_CAP_RLE_REPLY = 0x2 };
+static const uint32_t EDGE_CAP_SUPPORTED = EDGE_CAP_BITMAP_REPLY | EDGE_CAP_RLE_REPLY;
+// the encoding of the status list in a query reply (the first byte of the list)
+enum QUERY_REPLY_FORMAT { REPLY_STATUS_BYTE = 0,
+    REPLY_STATUS_BITMAP,
+    REPLY_STATUS_RLE };
+// the fingerprint filter: the bytes of a fingerprint used as the key, the min capacity
+static const uint32_t FILTER_KEY_SIZE = 16;
+static const uint64_t FILTER_MIN_KEY_NUM = 64 * 1024;
+// the max pipelined query batches in flight of a session
+static const uint32_t QUERY_PIPELINE_DEPTH = 32;
+// the shards of the in-memory index, selected by the fingerprint prefix
+static const uint32_t INDEX_SHARD_NUM = 64;
+// the flat index: the slots of a probe group, the initial groups of a shard, the tag of an empty slot
+static const uint32_t FLAT_GROUP_SIZE = 16;
+static const uint64_t FLAT_INIT_GROUP_NUM = 64;
+static const uint8_t FLAT_EMPTY_TAG = 0x80;
+// the keys of a batch lookup probed ahead of the current one in the flat index
+static const uint32_t FLAT_PREFETCH_DIST = 8;
+// the max key or value size in the index log and the index file
+static const uint32_t INDEX_LOG_MAX_ITEM_SIZE = 4096;
+// the image of the flat index: the magic ("FLATIMG1"), the version, the alignment of the header and the tables
+static const uint64_t FLAT_IMAGE_MAGIC = 0x31474d4954414c46;
+static const uint32_t FLAT_IMAGE_VERSION = 1;
+static const uint64_t FLAT_IMAGE_ALIGN = 4096;
+// the read size of the warm-up of the flat index image
+static const uint64_t FLAT_WARM_UP_READ_SIZE = 1 << 20;
+// the cached index: the memory of a cached pair, the share (1/N) of the memory for the
+// negative filter, the hashes of the filter, the buffered new pairs written back at once
+static const uint64_t INDEX_CACHE_ENTRY_SIZE = 256;
+static const uint32_t INDEX_CACHE_FILTER_SHARE = 4;
+static const uint32_t INDEX_CACHE_HASH_NUM = 7;
+static const uint32_t INDEX_CACHE_FLUSH_NUM = 8192;
+// the log-structured index: the buffered records written to the log at once, the records
+// read at once in a log scan, the min slots of a shard, the record id of an empty slot
+static const uint64_t STASH_WRITE_BUFFER_SIZE = 64 * 1024;
+static const uint64_t STASH_SCAN_RECORD_NUM = 32768;
+static const uint64_t STASH_INIT_SLOT_NUM = 1024;
+static const uint32_t STASH_EMPTY_ID = UINT32_MAX;
+// the stripes of the new chunks being stored by the sessions
+static const uint32_t INFLIGHT_STRIPE_NUM = 16;
+// the chunks fingerprinted by one task of the hash pool
+static const uint32_t HASH_TASK_CHUNK_NUM = 64;
+// the recipe batches read ahead of the send window
+static const uint32_t RECIPE_PREFETCH_NUM = 8;
+
 enum LOCK_TYPE { SESSION_LCK_WRITE = 0,
     SESSION_LCK_READ,
     TOP_K_LCK_WRITE,
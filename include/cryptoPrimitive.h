@@ -15,6 +15,7 @@
 #include <openssl/crypto.h>
 #include "chunkStructure.h"
 #include "configure.h"
+#include "sha256Kernel.h"
 
 using namespace std;
 
@@ -29,10 +30,21 @@ private:
     ENCRYPT_SET cipherType_;
     // the type of hash
     HASH_SET hashType_;
+    // the kernel of the batch hash
+    HASH_KERNEL hashKernel_;
 
     // initialized vector
     uint8_t* iv_;
 
+    /**
+     * @brief measure whether the AVX2 kernel hashes a batch faster than OpenSSL
+     * (which may use the SHA extensions or tuned assembly of the cpu)
+     *
+     * @return true the AVX2 kernel is faster
+     * @return false otherwise
+     */
+    bool IsAVX2Faster();
+
 public:
     /**
      * @brief Construct a new Crypto Primitive object
@@ -58,6 +70,37 @@ public:
      */
     void GenerateHash(EVP_MD_CTX* mdCtx, uint8_t* dataBuffer, const int dataSize, uint8_t* hash);
 
+    /**
+     * @brief Generate the hashes of a batch of input data with the batch kernel
+     *
+     * @param mdCtx hasher ctx (for the openssl kernel)
+     * @param dataBufferList input data buffers
+     * @param dataSizeList input data sizes
+     * @param dataNum the number of input data buffers
+     * @param hashList output hashes (dataNum * CHUNK_HASH_SIZE)
+     */
+    void GenerateHashBatch(EVP_MD_CTX* mdCtx, uint8_t** dataBufferList,
+        const uint32_t* dataSizeList, uint32_t dataNum, uint8_t* hashList);
+
+    /**
+     * @brief Set the kernel of the batch hash
+     *
+     * @param hashKernel the kernel (HASH_KERNEL)
+     * @return true the kernel is used
+     * @return false the cpu or the hash type does not support it
+     */
+    bool SetHashKernel(int hashKernel);
+
+    /**
+     * @brief Get the kernel of the batch hash
+     *
+     * @return int the kernel (HASH_KERNEL)
+     */
+    int GetHashKernel()
+    {
+        return hashKernel_;
+    }
+
     /**
      * @brief Encrypt the data with the encryption key
      *
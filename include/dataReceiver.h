@@ -16,9 +16,30 @@
 #include "clientVar.h"
 #include "sslConnection.h"
 #include "absIndex.h"
+#include "messageQueue.h"
+
+#include <poll.h>
+#include <sys/eventfd.h>
 
 #define CLIENT_LOG_FILE "client-time.log"
 
+typedef struct {
+    // signaled by the query threads when a reply is ready
+    int wakeFd;
+    std::mutex replyLck;
+    vector<vector<uint8_t>*> replyList;
+    // only accessed by the session thread
+    vector<vector<uint8_t>*> freeList;
+    uint32_t pendingNum;
+    // the reply formats the edge accepts
+    uint32_t replyCap;
+} RecipeQuerySession_t;
+
+typedef struct {
+    RecipeQuerySession_t* querySession;
+    vector<uint8_t>* queryMsg;
+} RecipeQueryJob_t;
+
 class DataReceiver {
 private:
     string myName_ = "DataReceiver";
@@ -29,12 +50,88 @@ private:
     uint64_t recipeEndNum_ = 0;
     uint64_t recipeBatchNum_ = 0;
 
+    // the chunk batch buffers of a session
+    uint32_t recvBufferNum_;
+    uint64_t recvBufferSize_;
+
     // to pass the data to the index thread
     AbsIndex* absIndexObj_;
 
     // pass the storage cor obj
     StorageCore* storageCoreObj_;
 
+    // the query threads of the pipelined secure recipe query
+    uint32_t queryThreadNum_;
+    vector<boost::thread*> queryThList_;
+    std::mutex queryJobLck_;
+    std::condition_variable queryJobCond_;
+    deque<RecipeQueryJob_t> queryJobList_;
+    bool queryDone_ = false;
+
+    /**
+     * @brief the main loop of a query thread
+     *
+     */
+    void RunQueryThread();
+
+    /**
+     * @brief check a pipelined query batch and write its secure recipe in order
+     *
+     * @param curClient the ptr to the current client
+     * @param queryMsg the query message (header + seq id + fingerprints)
+     */
+    void WriteQueryRecipe(ClientVar* curClient, uint8_t* queryMsg);
+
+    /**
+     * @brief answer a pipelined query batch in place
+     *
+     * @param queryMsg the query message, turned into the reply (header + seq id + status)
+     * @param replyCap the reply formats the edge accepts
+     * @param statusList the buffer of the status list (reused by the caller)
+     * @return uint32_t the size of the reply
+     */
+    uint32_t ProcessRecipeQuery(uint8_t* queryMsg, uint32_t replyCap,
+        vector<uint8_t>& statusList);
+
+    /**
+     * @brief hand over a pipelined query batch to the query threads
+     *
+     * @param curClient the ptr to the current client
+     * @param querySession the query state of the session
+     * @param recvChunkBuf the buffer of the received message
+     * @param recvSize the size of the received message
+     */
+    void DispatchRecipeQuery(ClientVar* curClient, RecipeQuerySession_t* querySession,
+        SendMsgBuffer_t* recvChunkBuf, uint32_t recvSize);
+
+    /**
+     * @brief the processing stage of a session, process the received chunk batches in order
+     *
+     * @param curClient the ptr to the current client
+     * @param readyMQ the received batches
+     * @param freeMQ the processed batch buffers
+     */
+    void RunProcessStage(ClientVar* curClient, MessageQueue<SendMsgBuffer_t*>* readyMQ,
+        MessageQueue<SendMsgBuffer_t*>* freeMQ);
+
+    /**
+     * @brief wait until the connection is readable, the ready replies are sent meanwhile
+     *
+     * @param clientSSL the client ssl
+     * @param querySession the query state of the session
+     * @return true the connection is readable
+     * @return false only some replies are sent
+     */
+    bool WaitQueryEvent(SSL* clientSSL, RecipeQuerySession_t* querySession);
+
+    /**
+     * @brief send the ready replies of the session
+     *
+     * @param clientSSL the client ssl (NULL: drop the replies)
+     * @param querySession the query state of the session
+     */
+    void SendQueryReplies(SSL* clientSSL, RecipeQuerySession_t* querySession);
+
 public:
     /**
      * @brief Construct a new DataReceiver object
@@ -58,6 +155,29 @@ public:
      */
     void Run(ClientVar* curClient, EnclaveInfo_t* enclaveInfo);
 
+    /**
+     * @brief prepare the statistic of a new upload session
+     *
+     * @param curClient the ptr to the current client
+     */
+    void StartSession(ClientVar* curClient);
+
+    /**
+     * @brief process a received message
+     *
+     * @param curClient the ptr to the current client
+     * @param recvChunkBuf the buffer of the received message
+     */
+    void ProcessMessage(ClientVar* curClient, SendMsgBuffer_t* recvChunkBuf);
+
+    /**
+     * @brief finalize the upload session after the connection is closed
+     *
+     * @param curClient the ptr to the current client
+     * @param enclaveInfo the ptr to the enclave info
+     */
+    void FinishSession(ClientVar* curClient, EnclaveInfo_t* enclaveInfo);
+
     /**
      * @brief Set the Storage Core Obj object
      *
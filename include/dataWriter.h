@@ -15,6 +15,7 @@
 #include "messageQueue.h"
 #include "configure.h"
 #include "chunkStructure.h"
+#include "absDatabase.h"
 
 #include <string>
 #include <bits/stdc++.h>
@@ -33,6 +34,17 @@ private:
     // the num of the written containers
     uint64_t containerNum_ = 0;
 
+    // the index committing the entries of a container after it is durable
+    AbsDatabase* indexStore_ = NULL;
+
+    /**
+     * @brief commit the fingerprints in the metadata section of a durable
+     * container to the index
+     *
+     * @param newContainer the container
+     */
+    void CommitContainer(Container_t& newContainer);
+
 #if (DATAWRITER_BREAKDOWN == 1)
     // the time of writing container
     double writeTime_ = 0;
@@ -53,6 +65,16 @@ public:
      */
     ~DataWriter();
 
+    /**
+     * @brief set the index which commits a container after it is written
+     *
+     * @param indexStore the index
+     */
+    void SetIndexStore(AbsDatabase* indexStore) {
+        indexStore_ = indexStore;
+        return;
+    }
+
     /**
      * @brief the main process of data writer
      *
@@ -60,6 +82,13 @@ public:
      */
     void Run(MessageQueue<Container_t>* inputMQ);
 
+    /**
+     * @brief write all the containers in the MQ in the caller thread
+     *
+     * @param inputMQ the input MQ
+     */
+    void SaveQueuedContainers(MessageQueue<Container_t>* inputMQ);
+
     /**
      * @brief write the container to the storage backend
      *
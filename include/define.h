@@ -14,6 +14,7 @@
 #include <sys/time.h>
 #include <sys/resource.h>
 #include <sys/stat.h>
+#include <fcntl.h>
 #include <iomanip>
 #include <bits/stdc++.h>
 #include <getopt.h>
@@ -181,6 +182,50 @@ inline bool FileExist(std::string filePath)
     return std::filesystem::is_regular_file(filePath);
 }
 
+/**
+ * @brief sync the directory of a file, so that its creation or rename survives a crash
+ *
+ * @param filePath the file path
+ */
+inline void SyncParentDir(std::string filePath)
+{
+    std::string dirPath = std::filesystem::path(filePath).parent_path().string();
+    int dirFd = open(dirPath.empty() ? "." : dirPath.c_str(), O_RDONLY | O_DIRECTORY);
+    if (dirFd >= 0) {
+        fsync(dirFd);
+        close(dirFd);
+    }
+    return;
+}
+
+/**
+ * @brief get a 64-bit checksum of a buffer, a buffer split at multiples of
+ * 8 bytes can be fed in order with the checksum of the previous part as the seed
+ *
+ * @param data the buffer
+ * @param size the buffer size
+ * @param seed the seed
+ * @return uint64_t the checksum
+ */
+inline uint64_t GetChecksum(const void* data, size_t size, uint64_t seed)
+{
+    const uint8_t* pos = (const uint8_t*)data;
+    uint64_t checksum = seed;
+    uint64_t word;
+    for (; size >= sizeof(word); size -= sizeof(word), pos += sizeof(word)) {
+        memcpy(&word, pos, sizeof(word));
+        checksum ^= word;
+        checksum = ((checksum << 31) | (checksum >> 33)) * 0x9e3779b97f4a7c15;
+    }
+    if (size != 0) {
+        word = 0;
+        memcpy(&word, pos, size);
+        checksum ^= word;
+        checksum = ((checksum << 31) | (checksum >> 33)) * 0x9e3779b97f4a7c15;
+    }
+    return checksum;
+}
+
 inline uint64_t GetStrongSeed()
 {
 
@@ -222,5 +267,17 @@ inline uint64_t GetStrongSeed()
     return c;
 }
 
+/**
+ * @brief get the time of the monotonic clock
+ *
+ * @return uint64_t the time (ms)
+ */
+inline uint64_t GetMonotonicMs()
+{
+    struct timespec currentTime;
+    clock_gettime(CLOCK_MONOTONIC, &currentTime);
+    return (uint64_t)currentTime.tv_sec * 1000 + currentTime.tv_nsec / 1000000;
+}
+
 } // namespace tool
 #endif
\ No newline at end of file
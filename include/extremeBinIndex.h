@@ -0,0 +1,183 @@
+/**
+ * @file extremeBinIndex.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief define the interfaces of extreme binning: the memory only keeps the
+ * representative (minimum) fingerprint of each bin, a file is deduplicated against
+ * the bin of its representative
+ * @version 0.1
+ * @date 2022-07-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef EXTREME_BIN_INDEX_H
+#define EXTREME_BIN_INDEX_H
+
+#include "plainIndex.h"
+
+// the position of the latest version of a bin in the bin file
+typedef struct {
+    uint64_t offset;
+    uint32_t fpNum;
+} BinMeta_t;
+
+// the bin of the file under upload in a session
+typedef struct {
+    // the representative fingerprint (empty: not looked up yet)
+    string rep;
+    // the version of the bin loaded (UINT64_MAX: a new bin), and the compaction
+    // epoch of the bin file it is loaded from
+    uint64_t binOffset;
+    uint64_t binEpoch;
+    unordered_set<string> binSet;
+    // the chunks of the file stored or deduplicated
+    unordered_set<string> fileSet;
+} FileBin_t;
+
+class ExtremeBinIndex : public PlainIndex {
+private:
+    string myName_ = "ExtremeBinIndex";
+
+    // the primary index: representative -> bin, guarded by binLck_
+    std::mutex binLck_;
+    unordered_map<string, BinMeta_t> primaryIndex_;
+    string binFileName_;
+    int binFd_ = -1;
+    uint64_t binFileSize_ = 0;
+    // the size of the latest versions of the bins, the others are dead
+    uint64_t liveBinSize_ = 0;
+
+    // the bin file is read and written under the read lock, and compacted under
+    // the write lock, which moves the bins and starts a new epoch
+    pthread_rwlock_t binFileLck_;
+    uint64_t binEpoch_ = 0;
+
+    // the bins of the files under upload
+    std::mutex fileLck_;
+    unordered_map<ClientVar*, FileBin_t*> fileBinMap_;
+
+    // for statistic
+    boost::atomic<uint64_t> lookupBatchNum_;
+    boost::atomic<uint64_t> binLoadNum_;
+    boost::atomic<uint64_t> foundDupNum_;
+    boost::atomic<uint64_t> missedDupNum_;
+    uint64_t fileNum_ = 0;
+    uint64_t binUpdateNum_ = 0;
+    uint64_t binCompactNum_ = 0;
+
+    /**
+     * @brief load the bin file and rebuild the primary index from it
+     *
+     */
+    void LoadBins();
+
+    /**
+     * @brief rewrite the latest version of each bin to a new bin file and replace
+     * the bin file with it, the caller holds the write lock of the bin file
+     *
+     * @param isFiltered whether to drop the fingerprints missing from the full index
+     */
+    void RewriteBins(bool isFiltered);
+
+    /**
+     * @brief check whether the dead versions of the bins take too much space,
+     * the caller holds the lock of the primary index
+     *
+     * @return true the bin file needs the compaction
+     * @return false otherwise
+     */
+    inline bool NeedCompaction()
+    {
+        uint64_t deadSize = binFileSize_ - liveBinSize_;
+        return deadSize > liveBinSize_ && deadSize > EXTREME_BIN_COMPACT_SIZE;
+    }
+
+    /**
+     * @brief write a buffer to the bin file at an offset
+     *
+     * @param fd the file descriptor
+     * @param buffer the buffer
+     * @param bufferSize the buffer size
+     * @param offset the file offset
+     */
+    void WriteBinFile(int fd, const uint8_t* buffer, size_t bufferSize, uint64_t offset);
+
+    /**
+     * @brief read the fingerprints of a bin and append them to a buffer
+     *
+     * @param binMeta the position of the bin
+     * @param fpBuffer the buffer
+     */
+    void ReadBinBuffer(const BinMeta_t& binMeta, vector<uint8_t>& fpBuffer);
+
+    /**
+     * @brief read a bin from the bin file
+     *
+     * @param binMeta the position of the bin
+     * @param binSet the fingerprints of the bin
+     */
+    void ReadBin(const BinMeta_t& binMeta, unordered_set<string>& binSet);
+
+    /**
+     * @brief pick the representative of a file and load its bin
+     *
+     * @param fileBin the bin of the file
+     * @param fpList the fingerprints of the first batch of the file (CHUNK_HASH_SIZE bytes each)
+     * @param fpNum the number of fingerprints
+     */
+    void LoadFileBin(FileBin_t* fileBin, const uint8_t* fpList, uint32_t fpNum);
+
+    /**
+     * @brief get the bin of the file under upload in a session
+     *
+     * @param curClient the current client var
+     * @return FileBin_t* the bin of the file
+     */
+    FileBin_t* GetFileBin(ClientVar* curClient);
+
+protected:
+    /**
+     * @brief look up a batch of fingerprints against the bin of its file
+     *
+     * @param fpList the fingerprints (CHUNK_HASH_SIZE bytes each)
+     * @param fpNum the number of fingerprints
+     * @param foundList whether each fingerprint is a duplicate (1: duplicate, 0: new),
+     * the i-th one is written after the i-th fingerprint is read
+     * @param curClient the current client var (NULL: the batch is looked up as a file)
+     * @return uint32_t the number of duplicates
+     */
+    uint32_t LookupBatch(const uint8_t* fpList, uint32_t fpNum, uint8_t* foundList,
+        ClientVar* curClient);
+
+public:
+    /**
+     * @brief Construct a new Extreme Bin Index object
+     *
+     * @param indexStore the reference to the index store
+     */
+    ExtremeBinIndex(AbsDatabase* indexStore);
+
+    /**
+     * @brief Destroy the Extreme Bin Index object
+     *
+     */
+    ~ExtremeBinIndex();
+
+    /**
+     * @brief process one batch of the current file
+     *
+     * @param recvChunkBuf the recv chunk buffer
+     * @param curClient the current client var
+     */
+    void ProcessOneBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient);
+
+    /**
+     * @brief merge the chunks of the finished file into its bin
+     *
+     * @param curClient the current client var
+     */
+    void ProcessFileEnd(ClientVar* curClient);
+};
+
+#endif
@@ -15,9 +15,15 @@
 #include "absDatabase.h"
 #include "leveldbDatabase.h"
 #include "inMemoryDatabase.h"
+#include "flatDatabase.h"
+#include "cachedDatabase.h"
+#include "stashDatabase.h"
 
 #define LEVEL_DB 1
 #define IN_MEMORY 3
+#define FLAT_TABLE 4
+#define CACHED_LEVEL_DB 5
+#define STASH_LOG 6
 
 class DatabaseFactory {
 private:
@@ -0,0 +1,115 @@
+/**
+ * @file fingerprintFilter.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief define the versioned bloom filter of the fingerprint index published to the edges
+ * @version 0.1
+ * @date 2022-06-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef FINGERPRINT_FILTER_H
+#define FINGERPRINT_FILTER_H
+
+#include "configure.h"
+#include "chunkStructure.h"
+
+class FingerprintFilter {
+private:
+    string myName_ = "FingerprintFilter";
+    uint32_t bitsPerKey_;
+    uint32_t hashNum_;
+
+    // the current filter, guarded by filterLck_
+    std::mutex filterLck_;
+    uint32_t epoch_ = 0;
+    uint64_t bitNum_ = 0;
+    uint64_t capacity_ = 0;
+    uint64_t baseKeyNum_ = 0;
+    vector<uint8_t> bitArray_;
+    // the keys added since the last rebuild, the position is the seq number
+    vector<uint8_t> deltaLog_;
+
+    // the filter under rebuild, only accessed by the rebuild thread
+    vector<uint8_t> newBitArray_;
+    uint64_t newBitNum_ = 0;
+    uint64_t newCapacity_ = 0;
+    uint64_t newKeyNum_ = 0;
+    uint64_t rebuildLogMark_ = 0;
+
+    // for statistic
+    uint64_t rebuildNum_ = 0;
+    uint64_t fullSendNum_ = 0;
+    uint64_t deltaSendNum_ = 0;
+
+    /**
+     * @brief set the bits of a key
+     *
+     * @param bitArray the bit array
+     * @param bitNum the number of bits
+     * @param key the key (FILTER_KEY_SIZE bytes)
+     */
+    void SetKeyBits(uint8_t* bitArray, uint64_t bitNum, const uint8_t* key);
+
+public:
+    /**
+     * @brief Construct a new Fingerprint Filter object
+     *
+     * @param bitsPerKey the number of bits per key
+     */
+    FingerprintFilter(uint32_t bitsPerKey);
+
+    /**
+     * @brief Destroy the Fingerprint Filter object
+     *
+     */
+    ~FingerprintFilter();
+
+    /**
+     * @brief add a new fingerprint to the current filter
+     *
+     * @param fp the fingerprint
+     */
+    void Insert(const string& fp);
+
+    /**
+     * @brief check whether the filter should be rebuilt with a larger size
+     *
+     * @return true the keys exceed the capacity of the filter
+     * @return false otherwise
+     */
+    bool NeedRebuild();
+
+    /**
+     * @brief start to rebuild the filter for a given number of keys
+     *
+     * @param keyNum the number of keys in the index
+     */
+    void BeginRebuild(uint64_t keyNum);
+
+    /**
+     * @brief add a key of the index to the filter under rebuild
+     *
+     * @param fp the fingerprint
+     */
+    void AddRebuildKey(const string& fp);
+
+    /**
+     * @brief replace the current filter with the rebuilt one (a new epoch)
+     *
+     */
+    void FinishRebuild();
+
+    /**
+     * @brief build the filter message for an edge, a delta if the edge is in
+     * the current epoch and the delta is smaller than the filter
+     *
+     * @param edgeHead the filter version of the edge
+     * @param msgBuffer the message (filter head + bit array or delta keys)
+     * @return int CLOUD_SEND_FILTER or CLOUD_SEND_FILTER_DELTA
+     */
+    int GetFilterMsg(FilterHead_t* edgeHead, vector<uint8_t>& msgBuffer);
+};
+
+#endif
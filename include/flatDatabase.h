@@ -0,0 +1,412 @@
+/**
+ * @file flatDatabase.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement an in-memory index on flat open-addressing tables
+ * @version 0.1
+ * @date 2022-06-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef FLAT_DATABASE_H
+#define FLAT_DATABASE_H
+
+#include "absDatabase.h"
+#include "configure.h"
+#include "indexLog.h"
+
+#include <boost/atomic.hpp>
+#include <boost/thread/thread.hpp>
+#include <sys/mman.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+// a slot keeps the fingerprint and the container name inline
+static const uint32_t FLAT_KEY_SIZE = CHUNK_HASH_SIZE;
+static const uint32_t FLAT_VALUE_SIZE = CONTAINER_ID_LENGTH;
+static const uint32_t FLAT_SLOT_SIZE = FLAT_KEY_SIZE + FLAT_VALUE_SIZE;
+
+typedef struct {
+    pthread_rwlock_t shardLck;
+    // one tag byte per slot (FLAT_EMPTY_TAG: empty), grouped by FLAT_GROUP_SIZE
+    uint8_t* tagList;
+    uint8_t* slotList;
+    uint64_t groupNum;
+    uint64_t keyNum;
+    // the tables are in the mapped image (not allocated)
+    bool isMapped;
+} FlatShard_t;
+
+// the tables of a shard in the image
+typedef struct {
+    uint64_t groupNum;
+    uint64_t keyNum;
+    uint64_t tagOffset;
+    uint64_t slotOffset;
+    // the checksum of the tags followed by the slots
+    uint64_t checksum;
+} FlatImageShard_t;
+
+// the header of the image, in the first page of the file
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t keySize;
+    uint32_t valueSize;
+    uint32_t groupSize;
+    uint32_t shardNum;
+    uint32_t reserved;
+    FlatImageShard_t shardList[INDEX_SHARD_NUM];
+    // the checksum of the fields above
+    uint64_t headerChecksum;
+} FlatImageHeader_t;
+
+static_assert(sizeof(FlatImageHeader_t) <= FLAT_IMAGE_ALIGN, "the image header exceeds a page");
+
+class FlatDatabase : public AbsDatabase {
+protected:
+    string myName_ = "FlatDatabase";
+    FlatShard_t shardList_[INDEX_SHARD_NUM];
+
+    // the inserts since the last snapshot (NULL: persist the index on exit only)
+    IndexLog* indexLog_ = NULL;
+
+    // the mapped image of the db file (NULL: loaded from a pair file)
+    uint8_t* imageAddr_ = NULL;
+    uint64_t imageSize_ = 0;
+    int imageFd_ = -1;
+    FlatImageHeader_t imageHeader_;
+    vector<boost::thread*> warmUpThreadList_;
+
+    // for statistic
+    boost::atomic<uint64_t> resizeNum_;
+    boost::atomic<uint64_t> warmUpSize_;
+
+    /**
+     * @brief get the shard of a key (the same prefix as the in-memory index)
+     *
+     * @param key the key (FLAT_KEY_SIZE bytes)
+     * @return FlatShard_t* the shard
+     */
+    inline FlatShard_t* GetShard(const char* key)
+    {
+        uint32_t prefix;
+        memcpy(&prefix, key, sizeof(prefix));
+        return &shardList_[prefix % INDEX_SHARD_NUM];
+    }
+
+    /**
+     * @brief get the probe hash of a key, the bytes after the shard prefix
+     *
+     * @param key the key (FLAT_KEY_SIZE bytes)
+     * @return uint64_t the hash (low 7 bits: tag, the others: group)
+     */
+    inline uint64_t GetHash(const char* key)
+    {
+        uint64_t hash;
+        memcpy(&hash, key + sizeof(uint32_t), sizeof(hash));
+        return hash;
+    }
+
+    /**
+     * @brief get the slots of a group whose tag equals a given one
+     *
+     * @param groupTag the tags of the group
+     * @param tag the tag
+     * @return uint32_t the bitmap of the matched slots
+     */
+    inline uint32_t MatchTag(const uint8_t* groupTag, uint8_t tag)
+    {
+#ifdef __SSE2__
+        __m128i tagVec = _mm_loadu_si128((const __m128i*)groupTag);
+        return _mm_movemask_epi8(_mm_cmpeq_epi8(tagVec, _mm_set1_epi8((char)tag)));
+#else
+        uint32_t matchMask = 0;
+        for (uint32_t i = 0; i < FLAT_GROUP_SIZE; i++) {
+            matchMask |= (uint32_t)(groupTag[i] == tag) << i;
+        }
+        return matchMask;
+#endif
+    }
+
+    /**
+     * @brief find the slot of a key in a shard
+     *
+     * @param shard the shard
+     * @param key the key (FLAT_KEY_SIZE bytes)
+     * @return int64_t the slot index, -1 if the key does not exist
+     */
+    int64_t FindSlot(FlatShard_t* shard, const char* key);
+
+    /**
+     * @brief put a new key into the first empty slot of its probe sequence
+     *
+     * @param tagList the tags of the table
+     * @param slotList the slots of the table
+     * @param groupNum the number of groups of the table
+     * @param slot the key and the value (FLAT_SLOT_SIZE bytes)
+     */
+    void PutSlot(uint8_t* tagList, uint8_t* slotList, uint64_t groupNum, const char* slot);
+
+    /**
+     * @brief move all keys of a shard to a table of a given size
+     *
+     * @param shard the shard
+     * @param groupNum the number of groups of the new table
+     */
+    void ResizeShard(FlatShard_t* shard, uint64_t groupNum);
+
+    /**
+     * @brief insert a (key, value) pair, the caller holds the write lock of the shard
+     *
+     * @param shard the shard of the key
+     * @param key the key (FLAT_KEY_SIZE bytes)
+     * @param value the value (FLAT_VALUE_SIZE bytes)
+     */
+    void InsertSlot(FlatShard_t* shard, const char* key, const char* value);
+
+    /**
+     * @brief group a batch of keys by their shards, the keys of a shard keep their order
+     *
+     * @param keyList the keys (FLAT_KEY_SIZE bytes each)
+     * @param keyNum the number of keys
+     * @param orderList the key ids grouped by the shards
+     * @param shardBeginList the first position of each shard in the order list
+     */
+    void GroupByShard(const char* keyList, uint32_t keyNum, vector<uint32_t>& orderList,
+        vector<uint32_t>& shardBeginList);
+
+    /**
+     * @brief check the header of an image
+     *
+     * @param header the header
+     * @param fileSize the size of the image file
+     * @return true the header is valid
+     * @return false the header is corrupted
+     */
+    static bool CheckImageHeader(const FlatImageHeader_t* header, uint64_t fileSize);
+
+    /**
+     * @brief drop the slots of the held values from a copy of a shard table, the
+     * table is rebuilt only if a slot is dropped (to keep the probe sequences)
+     *
+     * @param tagBuf the tags of the table
+     * @param slotBuf the slots of the table
+     * @param groupNum the number of groups of the table
+     * @param heldValueSet the held values
+     * @return uint64_t the number of keys left
+     */
+    uint64_t DropHeldSlots(vector<uint8_t>& tagBuf, vector<uint8_t>& slotBuf,
+        uint64_t groupNum, const unordered_set<string>& heldValueSet);
+
+    /**
+     * @brief map the image in the db file, the shards use the mapped tables
+     *
+     * @return true success
+     * @return false the db file is not a valid image
+     */
+    bool MapImageFile();
+
+    /**
+     * @brief write the tables of all shards to an image file, a shard is copied
+     * under its read lock and written after the lock is released
+     *
+     * @param fileName the file name
+     * @return true success
+     * @return false fail
+     */
+    bool WriteImageFile(string fileName);
+
+    /**
+     * @brief write a buffer at an offset of a file
+     *
+     * @param fd the file descriptor
+     * @param buf the buffer
+     * @param bufSize the buffer size
+     * @param offset the offset
+     * @return true success
+     * @return false fail
+     */
+    static bool WriteAt(int fd, const uint8_t* buf, uint64_t bufSize, uint64_t offset);
+
+    /**
+     * @brief read the tables of a part of the shards in the image to fill the
+     * page cache, and verify their checksums
+     *
+     * @param threadId the id of the warm-up thread
+     * @param threadNum the number of the warm-up threads
+     */
+    void WarmUpImage(uint32_t threadId, uint32_t threadNum);
+
+public:
+    /**
+     * @brief Construct a new Flat Database object
+     *
+     * @param dbName the path of the db file
+     */
+    FlatDatabase(std::string dbName);
+
+    /**
+     * @brief Destroy the Flat Database object
+     *
+     */
+    virtual ~FlatDatabase();
+
+    /**
+     * @brief open a database
+     *
+     * @param dbName the db path
+     * @return true success
+     * @return false fails
+     */
+    bool OpenDB(std::string dbName);
+
+    /**
+     * @brief execute query over database
+     *
+     * @param key key
+     * @param value value
+     * @return true success
+     * @return false fail
+     */
+    bool Query(const std::string& key, std::string& value);
+
+    /**
+     * @brief insert the (key, value) pair
+     *
+     * @param key key
+     * @param value value
+     * @return true success
+     * @return false fail
+     */
+    bool Insert(const std::string& key, const std::string& value);
+
+    /**
+     * @brief insert the (key, value) pair
+     *
+     * @param key
+     * @param buffer
+     * @param bufferSize
+     * @return true
+     * @return false
+     */
+    bool InsertBuffer(const std::string& key, const char* buffer, size_t bufferSize);
+
+    /**
+     * @brief insert the (key, value) pair
+     *
+     * @param key
+     * @param keySize
+     * @param buffer
+     * @param bufferSize
+     * @return true
+     * @return false
+     */
+    bool InsertBothBuffer(const char* key, size_t keySize, const char* buffer,
+        size_t bufferSize);
+
+    /**
+     * @brief query the (key, value) pair
+     *
+     * @param key
+     * @param keySize
+     * @param value
+     * @return true
+     * @return false
+     */
+    bool QueryBuffer(const char* key, size_t keySize, std::string& value);
+
+    /**
+     * @brief query a batch of keys of the same size, each shard is locked once and the
+     * probes of the following keys are prefetched
+     *
+     * @param keyList the keys (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param valueList the values of the found keys (valueSize bytes each, NULL: not needed)
+     * @param valueSize the value size
+     * @param foundList whether each key is found (1: found, 0: not found)
+     * @return uint32_t the number of found keys
+     */
+    uint32_t MultiQuery(const char* keyList, uint32_t keyNum, size_t keySize,
+        char* valueList, size_t valueSize, uint8_t* foundList);
+
+    /**
+     * @brief insert a batch of (key, value) pairs of the same size, each shard is locked once
+     *
+     * @param keyList the keys (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param valueList the values (valueSize bytes each)
+     * @param valueSize the value size
+     * @return true success
+     * @return false fail
+     */
+    bool MultiInsert(const char* keyList, uint32_t keyNum, size_t keySize,
+        const char* valueList, size_t valueSize);
+
+    /**
+     * @brief whether the pairs are persisted only after their values (containers)
+     * are durable, see HoldValue and CommitValue
+     *
+     * @return true the writer of a value syncs it and then commits it
+     * @return false the pairs are persisted on their own
+     */
+    bool NeedDurableValue();
+
+    /**
+     * @brief hold a value (a container) which is not durable yet, before any pair
+     * of it is inserted, its pairs are queried but not persisted until it is committed
+     *
+     * @param value the value
+     * @param valueSize the value size
+     */
+    void HoldValue(const char* value, size_t valueSize);
+
+    /**
+     * @brief commit a durable value, log its pairs (a pair missing in the index
+     * is inserted first, so that a logged pair is always in the later snapshots)
+     *
+     * @param keyList the keys of the value (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param value the value
+     * @param valueSize the value size
+     */
+    void CommitValue(const char* keyList, uint32_t keyNum, size_t keySize,
+        const char* value, size_t valueSize);
+
+    /**
+     * @brief visit all (key, value) pairs in the database, a shard is locked
+     * while it is visited (the inserts to the other shards go on)
+     *
+     * @param visitor the function called on each pair
+     * @return true success
+     * @return false fail
+     */
+    bool Traverse(std::function<void(const std::string& key, const std::string& value)> visitor);
+
+    /**
+     * @brief check whether a file is an image of the flat index
+     *
+     * @param fileName the file name
+     * @return true it is an image
+     * @return false it is not (e.g., a pair file)
+     */
+    static bool IsImageFile(string fileName);
+
+    /**
+     * @brief read all (key, value) pairs in an image, the checksums are verified
+     *
+     * @param fileName the file name
+     * @param visitor the function called on each pair
+     * @return uint64_t the number of pairs
+     */
+    static uint64_t ReadImageFile(string fileName,
+        std::function<void(const string& key, const string& value)> visitor);
+};
+
+#endif
@@ -0,0 +1,98 @@
+/**
+ * @file hashPool.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief define the shared worker pool to compute the chunk fingerprints of a batch
+ * @version 0.1
+ * @date 2022-06-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef HASH_POOL_H
+#define HASH_POOL_H
+
+#include "configure.h"
+#include "cryptoPrimitive.h"
+
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+
+typedef struct {
+    uint8_t** chunkAddrList;
+    uint32_t* chunkSizeList;
+    uint8_t* hashList;
+    uint32_t chunkNum;
+    uint32_t taskNum;
+    boost::atomic<uint32_t> nextTask;
+    // the workers which hold the batch, guarded by doneLck
+    uint32_t workerRefNum;
+    std::mutex doneLck;
+    std::condition_variable doneCond;
+} HashJob_t;
+
+class HashPool {
+private:
+    string myName_ = "HashPool";
+    CryptoPrimitive* cryptoObj_;
+
+    // the worker threads
+    uint32_t workerNum_;
+    vector<boost::thread*> thList_;
+
+    // the batches which still have tasks to claim
+    std::mutex jobLck_;
+    std::condition_variable jobCond_;
+    deque<HashJob_t*> jobList_;
+    bool done_ = false;
+
+    // for statistic
+    boost::atomic<uint64_t> parallelBatchNum_;
+    boost::atomic<uint64_t> inlineBatchNum_;
+    boost::atomic<uint64_t> workerTaskNum_;
+
+    /**
+     * @brief the main loop of a worker thread
+     *
+     */
+    void RunWorker();
+
+    /**
+     * @brief claim and hash the tasks of a batch until no task is left
+     *
+     * @param hashJob the batch
+     * @param mdCtx the hash ctx of the caller
+     * @return uint32_t the number of tasks done by the caller
+     */
+    uint32_t RunTasks(HashJob_t* hashJob, EVP_MD_CTX* mdCtx);
+
+public:
+    /**
+     * @brief Construct a new Hash Pool object
+     *
+     * @param cryptoObj the crypto primitive
+     * @param workerNum the number of worker threads (0: one per core)
+     */
+    HashPool(CryptoPrimitive* cryptoObj, uint32_t workerNum);
+
+    /**
+     * @brief Destroy the Hash Pool object
+     *
+     */
+    ~HashPool();
+
+    /**
+     * @brief compute the fingerprints of a batch of chunks, the caller works
+     * on the batch together with the workers and returns when all are done
+     *
+     * @param chunkAddrList the address of each chunk
+     * @param chunkSizeList the size of each chunk
+     * @param chunkNum the number of chunks
+     * @param hashList the output fingerprints (chunkNum * CHUNK_HASH_SIZE)
+     * @param mdCtx the hash ctx of the caller
+     */
+    void HashBatch(uint8_t** chunkAddrList, uint32_t* chunkSizeList, uint32_t chunkNum,
+        uint8_t* hashList, EVP_MD_CTX* mdCtx);
+};
+
+#endif
@@ -14,18 +14,79 @@
 
 #include "absDatabase.h"
 #include "configure.h"
+#include "indexLog.h"
+#include "flatDatabase.h"
+
+typedef struct {
+    pthread_rwlock_t shardLck;
+    unordered_map<string, string> indexObj;
+} IndexShard_t;
 
 class InMemoryDatabase : public AbsDatabase {
 protected:
     /*data*/
-    unordered_map<string, string> indexObj_;
+    string myName_ = "InMemoryDatabase";
+    IndexShard_t shardList_[INDEX_SHARD_NUM];
+
+    // the inserts since the last snapshot (NULL: persist the index on exit only)
+    IndexLog* indexLog_ = NULL;
+
+    /**
+     * @brief get the shard of a key
+     *
+     * @param key the key
+     * @param keySize the key size
+     * @return IndexShard_t* the shard
+     */
+    inline IndexShard_t* GetShard(const char* key, size_t keySize)
+    {
+        // the fingerprints are uniform, their prefix is enough
+        uint32_t prefix;
+        if (keySize >= sizeof(prefix)) {
+            memcpy(&prefix, key, sizeof(prefix));
+        } else {
+            prefix = std::hash<string>()(string(key, keySize));
+        }
+        return &shardList_[prefix % INDEX_SHARD_NUM];
+    }
+
+    /**
+     * @brief init the locks of the shards
+     *
+     */
+    void InitShards();
+
+    /**
+     * @brief group a batch of keys by their shards, the keys of a shard keep their order
+     *
+     * @param keyList the keys (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param orderList the key ids grouped by the shards
+     * @param shardBeginList the first position of each shard in the order list
+     */
+    void GroupByShard(const char* keyList, uint32_t keyNum, size_t keySize,
+        vector<uint32_t>& orderList, vector<uint32_t>& shardBeginList);
+
+    /**
+     * @brief write all pairs to a file, a shard is copied under its read lock
+     * and written after the lock is released
+     *
+     * @param fileName the file name
+     * @return true success
+     * @return false fail
+     */
+    bool WritePairFile(string fileName);
 
 public:
     /**
      * @brief Construct a new In Memory Database object
      *
      */
-    InMemoryDatabase() { };
+    InMemoryDatabase()
+    {
+        this->InitShards();
+    };
 
     /**
      * @brief Construct a new In Memory Database object
@@ -103,6 +164,75 @@ public:
      * @return false
      */
     bool QueryBuffer(const char* key, size_t keySize, std::string& value);
+
+    /**
+     * @brief query a batch of keys of the same size, each shard is locked once
+     *
+     * @param keyList the keys (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param valueList the values of the found keys (valueSize bytes each, NULL: not needed)
+     * @param valueSize the value size
+     * @param foundList whether each key is found (1: found, 0: not found)
+     * @return uint32_t the number of found keys
+     */
+    uint32_t MultiQuery(const char* keyList, uint32_t keyNum, size_t keySize,
+        char* valueList, size_t valueSize, uint8_t* foundList);
+
+    /**
+     * @brief insert a batch of (key, value) pairs of the same size, each shard is locked once
+     *
+     * @param keyList the keys (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param valueList the values (valueSize bytes each)
+     * @param valueSize the value size
+     * @return true success
+     * @return false fail
+     */
+    bool MultiInsert(const char* keyList, uint32_t keyNum, size_t keySize,
+        const char* valueList, size_t valueSize);
+
+    /**
+     * @brief whether the pairs are persisted only after their values (containers)
+     * are durable, see HoldValue and CommitValue
+     *
+     * @return true the writer of a value syncs it and then commits it
+     * @return false the pairs are persisted on their own
+     */
+    bool NeedDurableValue();
+
+    /**
+     * @brief hold a value (a container) which is not durable yet, before any pair
+     * of it is inserted, its pairs are queried but not persisted until it is committed
+     *
+     * @param value the value
+     * @param valueSize the value size
+     */
+    void HoldValue(const char* value, size_t valueSize);
+
+    /**
+     * @brief commit a durable value, log its pairs (a pair missing in the index
+     * is inserted first, so that a logged pair is always in the later snapshots)
+     *
+     * @param keyList the keys of the value (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param value the value
+     * @param valueSize the value size
+     */
+    void CommitValue(const char* keyList, uint32_t keyNum, size_t keySize,
+        const char* value, size_t valueSize);
+
+    /**
+     * @brief visit all (key, value) pairs in the database, a shard is locked
+     * while it is visited (the inserts to the other shards go on)
+     *
+     * @param visitor the function called on each pair
+     * @return true success
+     * @return false fail
+     */
+    bool Traverse(std::function<void(const std::string& key, const std::string& value)> visitor);
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,188 @@
+/**
+ * @file indexLog.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief define the append-only log and the snapshots of an in-memory index
+ * @version 0.1
+ * @date 2022-06-30
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef INDEX_LOG_H
+#define INDEX_LOG_H
+
+#include "configure.h"
+
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+
+class IndexLog {
+private:
+    string myName_ = "IndexLog";
+    // the snapshot is <dbName_>, the log files are <logPrefix_><generation>
+    string dbName_;
+    string logPrefix_;
+    uint32_t commitMs_;
+    uint32_t snapshotSec_;
+    std::function<bool(const string& fileName)> snapshotWriter_;
+
+    // the records appended since the last commit
+    std::mutex bufLck_;
+    vector<char> pendingBuf_;
+
+    // the values (containers) not durable yet, their pairs are logged once they
+    // are durable and skipped by the snapshots until then
+    std::mutex holdLck_;
+    unordered_set<string> heldValueSet_;
+
+    // the current log file, guarded by fileLck_ (taken before bufLck_)
+    std::mutex fileLck_;
+    int logFd_ = -1;
+    uint64_t curGen_ = 0;
+    boost::atomic<uint64_t> curLogSize_;
+
+    boost::thread* commitThread_ = NULL;
+    boost::thread* snapshotThread_ = NULL;
+
+    // for statistic
+    uint64_t commitNum_ = 0;
+    uint64_t commitSize_ = 0;
+    uint64_t snapshotNum_ = 0;
+    uint64_t replayNum_ = 0;
+
+    /**
+     * @brief write the pending records to the current log file and sync it,
+     * the caller holds fileLck_
+     *
+     */
+    void Commit();
+
+    /**
+     * @brief the loop of the group commit thread
+     *
+     */
+    void CommitLoop();
+
+    /**
+     * @brief open a new log file of the next generation, the caller holds fileLck_
+     *
+     */
+    void OpenNextLog();
+
+    /**
+     * @brief close the current log file and continue in a new one
+     *
+     * @return uint64_t the generation of the closed log file
+     */
+    uint64_t Rotate();
+
+    /**
+     * @brief remove the log files covered by a snapshot
+     *
+     * @param gen the last generation covered by the snapshot
+     */
+    void RemoveUpTo(uint64_t gen);
+
+    /**
+     * @brief rotate the log and replace the snapshot with a new one covering
+     * the closed log files
+     *
+     */
+    void WriteSnapshot();
+
+    /**
+     * @brief the loop of the snapshot thread
+     *
+     */
+    void SnapshotLoop();
+
+    /**
+     * @brief list the generations of the existing log files
+     *
+     * @return vector<uint64_t> the generations in the ascending order
+     */
+    vector<uint64_t> ListLogGens();
+
+public:
+    /**
+     * @brief Construct a new Index Log object
+     *
+     * @param dbName the path of the db file (the snapshot)
+     * @param commitMs the interval (ms) of the group commit
+     * @param snapshotSec the interval (sec) of the snapshots
+     * @param snapshotWriter the function writing all pairs of the index to a file
+     */
+    IndexLog(string dbName, uint32_t commitMs, uint32_t snapshotSec,
+        std::function<bool(const string& fileName)> snapshotWriter);
+
+    /**
+     * @brief Destroy the Index Log object, stop the snapshots and commit the log tail
+     *
+     */
+    ~IndexLog();
+
+    /**
+     * @brief read a file of (key, value) pairs, a torn pair at the end is ignored
+     *
+     * @param fileName the file name
+     * @param visitor the function called on each pair
+     * @return uint64_t the number of pairs
+     */
+    static uint64_t ReadPairFile(string fileName,
+        std::function<void(const string& key, const string& value)> visitor);
+
+    /**
+     * @brief write a (key, value) pair in the format of the pair files
+     *
+     * @param outBuf the output buffer
+     * @param key the key
+     * @param keySize the key size
+     * @param value the value
+     * @param valueSize the value size
+     */
+    static void EncodePair(vector<char>& outBuf, const char* key, size_t keySize,
+        const char* value, size_t valueSize);
+
+    /**
+     * @brief replay the existing log files in order, then start a new log file,
+     * the group commit and the snapshots
+     *
+     * @param visitor the function called on each logged pair
+     * @return uint64_t the number of replayed pairs
+     */
+    uint64_t Replay(std::function<void(const string& key, const string& value)> visitor);
+
+    /**
+     * @brief hold a value which is not durable yet, before any pair of it is inserted
+     *
+     * @param value the value
+     * @param valueSize the value size
+     */
+    void HoldValue(const char* value, size_t valueSize);
+
+    /**
+     * @brief release a durable value and append its pairs to the log, they are
+     * durable after the next group commit
+     *
+     * @param keyList the keys of the value (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param value the value
+     * @param valueSize the value size
+     */
+    void AppendDurable(const char* keyList, uint32_t keyNum, size_t keySize,
+        const char* value, size_t valueSize);
+
+    /**
+     * @brief get the values held now, a snapshot writer skips their pairs (it
+     * takes the set after locking a part of the index, so that all pairs in the
+     * part are either of a durable value or of a held value)
+     *
+     * @return unordered_set<string> the held values
+     */
+    unordered_set<string> GetHeldValueSet();
+
+};
+
+#endif
@@ -14,12 +14,15 @@
 #include "absDatabase.h"
 #include <leveldb/db.h>
 #include <leveldb/cache.h>
+#include <leveldb/write_batch.h>
+#include <leveldb/filter_policy.h>
 #include "configure.h"
 #include <bits/stdc++.h>
 
 class LeveldbDatabase : public AbsDatabase {
 protected:
     /* data */
+    string myName_ = "LeveldbDatabase";
     leveldb::DB* levelDBObj_ = NULL;
     leveldb::Options options_;
 
@@ -104,6 +107,54 @@ public:
      * @return false
      */
     bool QueryBuffer(const char* key, size_t keySize, std::string& value);
+
+    /**
+     * @brief query a batch of keys of the same size in the key order on one snapshot,
+     * so that the neighbouring keys hit the same blocks
+     *
+     * @param keyList the keys (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param valueList the values of the found keys (valueSize bytes each, NULL: not needed)
+     * @param valueSize the value size
+     * @param foundList whether each key is found (1: found, 0: not found)
+     * @return uint32_t the number of found keys
+     */
+    uint32_t MultiQuery(const char* keyList, uint32_t keyNum, size_t keySize,
+        char* valueList, size_t valueSize, uint8_t* foundList);
+
+    /**
+     * @brief insert a batch of (key, value) pairs of the same size with one write batch
+     *
+     * @param keyList the keys (keySize bytes each)
+     * @param keyNum the number of keys
+     * @param keySize the key size
+     * @param valueList the values (valueSize bytes each)
+     * @param valueSize the value size
+     * @return true success
+     * @return false fail
+     */
+    bool MultiInsert(const char* keyList, uint32_t keyNum, size_t keySize,
+        const char* valueList, size_t valueSize);
+
+    /**
+     * @brief apply a write batch of (key, value) pairs of any size
+     *
+     * @param writeBatch the write batch
+     * @return true success
+     * @return false fail
+     */
+    bool Write(leveldb::WriteBatch* writeBatch);
+
+    /**
+     * @brief visit all (key, value) pairs in the database, the pairs inserted
+     * during the traversal may be missed
+     *
+     * @param visitor the function called on each pair
+     * @return true success
+     * @return false fail
+     */
+    bool Traverse(std::function<void(const std::string& key, const std::string& value)> visitor);
 };
 
 #endif // !BASICDEDUP_LEVELDB_H
\ No newline at end of file
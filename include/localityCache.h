@@ -0,0 +1,102 @@
+/**
+ * @file localityCache.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief define the interfaces of the locality cache: a lookup hitting a container
+ * in the full index prefetches the fingerprints in the metadata section of the
+ * container, so that the lookups of its neighbours skip the full index
+ * @version 0.1
+ * @date 2022-07-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef LOCALITY_CACHE_H
+#define LOCALITY_CACHE_H
+
+#include "configure.h"
+#include "chunkStructure.h"
+#include <boost/atomic.hpp>
+
+extern Configure config;
+
+// a cached container
+typedef struct {
+    // its fingerprints (CHUNK_HASH_SIZE bytes each)
+    vector<uint8_t> fpList;
+    // the batch of the last hit, updated under the read lock
+    boost::atomic<uint64_t> hitStamp;
+} CachedContainer_t;
+
+class LocalityCache {
+private:
+    string myName_ = "LocalityCache";
+    string containerNamePrefix_;
+    string containerNameTail_;
+    uint32_t maxContainerNum_;
+
+    // the lookups only take the read lock, the prefetches take the write lock
+    pthread_rwlock_t cacheLck_;
+    // container name -> the cached container
+    unordered_map<string, CachedContainer_t*> containerMap_;
+    // fingerprint -> the latest cached container holding it
+    unordered_map<string, CachedContainer_t*> fpMap_;
+    // the stamp of the next lookup batch
+    boost::atomic<uint64_t> batchStamp_;
+
+    // for statistic
+    boost::atomic<uint64_t> lookupNum_;
+    boost::atomic<uint64_t> hitNum_;
+    boost::atomic<uint64_t> prefetchNum_;
+    boost::atomic<uint64_t> unwrittenNum_;
+    uint64_t evictNum_ = 0;
+
+    /**
+     * @brief read the fingerprints in the metadata section of a container
+     *
+     * @param containerName the container name
+     * @param fpList the fingerprints (CHUNK_HASH_SIZE bytes each)
+     * @return true the container is read
+     * @return false the container is not on the disk yet (or not a valid container)
+     */
+    bool ReadContainerMeta(const string& containerName, vector<uint8_t>& fpList);
+
+    /**
+     * @brief evict the least recently hit container, the caller holds the write lock
+     *
+     */
+    void EvictContainer();
+
+public:
+    /**
+     * @brief Construct a new Locality Cache object
+     *
+     * @param maxContainerNum the max number of cached containers
+     */
+    LocalityCache(uint32_t maxContainerNum);
+
+    /**
+     * @brief Destroy the Locality Cache object
+     *
+     */
+    ~LocalityCache();
+
+    /**
+     * @brief look up a batch of fingerprints in the cache
+     *
+     * @param fpList the fingerprints (CHUNK_HASH_SIZE bytes each)
+     * @param fpNum the number of fingerprints
+     * @param foundList whether each fingerprint is cached (1: cached, 0: not)
+     * @return uint32_t the number of cached fingerprints
+     */
+    uint32_t LookupBatch(const uint8_t* fpList, uint32_t fpNum, uint8_t* foundList);
+
+    /**
+     * @brief prefetch the fingerprints of the containers into the cache
+     *
+     * @param containerNameSet the container names
+     */
+    void Prefetch(const unordered_set<string>& containerNameSet);
+};
+
+#endif
@@ -17,6 +17,7 @@
 #include "messageQueue/readerwriterqueue.h"
 #include <boost/atomic.hpp>
 #include <boost/lockfree/queue.hpp>
+#include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 #include <boost/thread/thread.hpp>
 
@@ -29,6 +30,24 @@ private:
     // moodycamel::ConcurrentQueue<T>* lockFreeQueue_;
     moodycamel::ReaderWriterQueue<T>* lockFreeQueue_;
 
+    // to wake up the consumer blocked in PopWait
+    boost::mutex waitLck_;
+    boost::condition_variable waitCond_;
+    boost::atomic<uint32_t> waiterNum_;
+
+    /**
+     * @brief wake up the consumer if it is blocked in PopWait
+     *
+     */
+    void NotifyWaiter()
+    {
+        boost::atomic_thread_fence(boost::memory_order_seq_cst);
+        if (waiterNum_.load() != 0) {
+            boost::mutex::scoped_lock lock(waitLck_);
+            waitCond_.notify_all();
+        }
+    }
+
 public:
     // to show whether the whole process is done
     boost::atomic<bool> done_;
@@ -43,6 +62,7 @@ public:
         // lockFreeQueue_ = new moodycamel::ConcurrentQueue<T>(QUEUE_SIZE);
         lockFreeQueue_ = new moodycamel::ReaderWriterQueue<T>(maxQueueSize);
         done_ = false;
+        waiterNum_ = 0;
     }
 
     /**
@@ -74,6 +94,7 @@ public:
         while (!lockFreeQueue_->try_enqueue(data)) {
             ;
         }
+        this->NotifyWaiter();
         return true;
     }
 
@@ -90,6 +111,34 @@ public:
         return lockFreeQueue_->try_dequeue(data);
     }
 
+    /**
+     * @brief pop data from the queue, block until the data comes or the job is done
+     *
+     * @param data the original data
+     * @return true success
+     * @return false the job is done and the queue is empty
+     */
+    bool PopWait(T& data)
+    {
+        while (!lockFreeQueue_->try_dequeue(data)) {
+            boost::mutex::scoped_lock lock(waitLck_);
+            waiterNum_++;
+            boost::atomic_thread_fence(boost::memory_order_seq_cst);
+            // check again after the waiter is announced, a push in between is not missed
+            if (lockFreeQueue_->try_dequeue(data)) {
+                waiterNum_--;
+                return true;
+            }
+            if (done_) {
+                waiterNum_--;
+                return lockFreeQueue_->try_dequeue(data);
+            }
+            waitCond_.wait(lock);
+            waiterNum_--;
+        }
+        return true;
+    }
+
     /**
      * @brief Set the Job Done Flag object
      *
@@ -99,6 +148,7 @@ public:
     void SetJobDoneFlag()
     {
         done_ = true;
+        this->NotifyWaiter();
     }
 
     /**
@@ -15,12 +15,54 @@
 #include "absIndex.h"
 #include "clientVar.h"
 #include "clientVar.h"
+#include "localityCache.h"
 #include <lz4.h>
 
 class PlainIndex : public AbsIndex {
 private:
     string myName_ = "DedupIndex";
-    pthread_rwlock_t outIdxLck_;
+
+protected:
+    // the chunks stored again by an index without the full lookup (counted
+    // only with the dedup loss check, which probes the full index)
+    bool dedupLossCheck_ = false;
+    boost::atomic<uint64_t> redundantChunkNum_;
+    boost::atomic<uint64_t> redundantDataSize_;
+
+    // the fingerprints of the recently hit containers (NULL: no cache)
+    LocalityCache* localityCache_ = NULL;
+
+    /**
+     * @brief look up a batch of fingerprints for deduplication
+     *
+     * @param fpList the fingerprints (CHUNK_HASH_SIZE bytes each)
+     * @param fpNum the number of fingerprints
+     * @param foundList whether each fingerprint is a duplicate (1: duplicate, 0: new),
+     * the i-th one is written after the i-th fingerprint is read
+     * @param curClient the current client var (NULL: a query without the session)
+     * @return uint32_t the number of duplicates
+     */
+    virtual uint32_t LookupBatch(const uint8_t* fpList, uint32_t fpNum, uint8_t* foundList,
+        ClientVar* curClient);
+
+    /**
+     * @brief locate, fingerprint and look up the chunks of a batch, and list
+     * its new chunks in the fingerprint order (each one once)
+     *
+     * @param recvChunkBuf the recv chunk buffer
+     * @param curClient the current client var
+     * @return true the new chunks are listed
+     * @return false the session is rejected
+     */
+    bool PrepareBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient);
+
+    /**
+     * @brief store the new chunks listed by PrepareBatch without the reservation,
+     * a chunk is stored again if the lookup misses it
+     *
+     * @param curClient the current client var
+     */
+    void StoreNewChunks(ClientVar* curClient);
 
 public:
     /**
@@ -51,6 +93,23 @@ public:
      * @param curClient the current client var
      */
     void ProcessRecipeBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient);
+
+    /**
+     * @brief answer which chunks of a batch of fingerprints need to be uploaded
+     *
+     * @param recvChunkBuf the recv chunk buffer (turned into the reply)
+     * @param curClient the current client var
+     */
+    void ProcessChunkQuery(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient);
+
+    /**
+     * @brief query the index for a batch of secure recipe entries
+     *
+     * @param entryBase the fingerprints of the entries
+     * @param entryNum the number of entries
+     * @param statusList the status of each entry (0: duplicate, 1: unique)
+     */
+    void QueryRecipeBatch(uint8_t* entryBase, uint32_t entryNum, uint8_t* statusList);
 };
 
 #endif
\ No newline at end of file
@@ -4,12 +4,46 @@
 #include "configure.h"
 #include "clientVar.h"
 #include "sslConnection.h"
+#include "messageQueue.h"
 
 class RecipeSender {
 private:
     string myName_ = "RecipeSender";
     SSLConnection* serverChannel_;
     uint64_t sendRecipeBatchSize_;
+    // the size of a recipe batch message (header + entries)
+    uint64_t batchMsgSize_;
+
+    /**
+     * @brief read the next batch of recipes (or the end flag) into a message
+     *
+     * @param curClient the current client var
+     * @param msgBuffer the message buffer (header + data)
+     * @return uint32_t the size of the message
+     */
+    uint32_t ReadNextBatch(ClientVar* curClient, uint8_t* msgBuffer);
+
+    /**
+     * @brief read the recipe batches ahead of the send window
+     *
+     * @param curClient the current client var
+     * @param readyMQ the batches ready to send
+     * @param freeMQ the free batch buffers
+     */
+    void PrefetchBatches(ClientVar* curClient, MessageQueue<uint8_t*>* readyMQ,
+        MessageQueue<uint8_t*>* freeMQ);
+
+    /**
+     * @brief Get the credits returned by a ready message of the edge
+     *
+     * @param readyHeader the header of the ready message
+     * @return uint32_t the number of batches the edge can receive
+     */
+    inline uint32_t GetCredit(NetworkHead_t* readyHeader)
+    {
+        // the edge which acknowledges every batch sends 0
+        return (readyHeader->currentItemNum == 0) ? 1 : readyHeader->currentItemNum;
+    }
 
 public:
     RecipeSender(SSLConnection* serverChannel);
@@ -17,6 +51,29 @@ public:
     ~RecipeSender();
 
     void Run(ClientVar* curClient);
+
+    /**
+     * @brief prepare a new download-recipe session
+     *
+     * @param curClient the current client var
+     */
+    void StartSession(ClientVar* curClient);
+
+    /**
+     * @brief process a received message in the recipe buffer of the client
+     *
+     * @param curClient the current client var
+     */
+    void ProcessMessage(ClientVar* curClient);
+
+    /**
+     * @brief send the next batch of recipes (or the end flag)
+     *
+     * @param curClient the current client var
+     * @return true a batch is sent
+     * @return false all recipes are sent, the end flag is sent
+     */
+    bool SendNextBatch(ClientVar* curClient);
 };
 
 #endif
\ No newline at end of file
@@ -49,6 +49,29 @@ private:
     void ProcessRecipeBatch(uint8_t* recipeBuffer, size_t recipeNum,
         ClientVar* curClient);
 
+    /**
+     * @brief process a batch of recipe with kernel TLS, the chunks are sent
+     * from the container files without copying them to the user space
+     *
+     * @param recipeBuffer the read recipe buffer
+     * @param recipeNum the read recipe num
+     * @param curClient the current client var
+     */
+    void ProcessRecipeBatchByFile(uint8_t* recipeBuffer, size_t recipeNum,
+        ClientVar* curClient);
+
+    /**
+     * @brief read the metadata section of a container file to locate its chunks
+     *
+     * @param containerFd the container file
+     * @param containerId the id of the container in the batch
+     * @param restoreIndex the restore index (fp + container id -> offset/length in the file)
+     * @return true success
+     * @return false the container is broken
+     */
+    bool LoadContainerIndex(int containerFd, uint32_t containerId,
+        unordered_map<string, RestoreIndexEntry_t>& restoreIndex);
+
     /**
      * @brief process the tail batch of the recipe
      *
@@ -95,6 +118,13 @@ public:
      * @param curClient the current client ptr
      */
     void Run(ClientVar* curClient);
+
+    /**
+     * @brief process a received message in the chunk buffer of the client
+     *
+     * @param curClient the current client ptr
+     */
+    void ProcessMessage(ClientVar* curClient);
 };
 
 #endif
\ No newline at end of file
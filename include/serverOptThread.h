@@ -17,6 +17,8 @@
 #include "dataReceiver.h"
 #include "absIndex.h"
 #include "plainIndex.h"
+#include "sparseIndex.h"
+#include "extremeBinIndex.h"
 
 // for basice build block
 #include "factoryDatabase.h"
@@ -84,6 +86,14 @@ private:
 
     void EdgeDownloadChunkThread(SendMsgBuffer_t& recvBuf, SSL* clientSSL);
 
+    /**
+     * @brief Get the lock of the client ID (create it if not exist)
+     *
+     * @param clientID the client ID
+     * @return boost::mutex* the lock of this client ID
+     */
+    boost::mutex* GetClientLock(uint32_t clientID);
+
 public:
     /**
      * @brief Construct a new Server Opt Thread object
@@ -106,6 +116,55 @@ public:
      * @param clientSSL the client ssl
      */
     void Run(SSL* clientSSL);
+
+    /**
+     * @brief try to lock the client ID without blocking (for the event-driven mode)
+     *
+     * @param clientID the client ID
+     * @return true the client ID is locked by the caller
+     * @return false another session of this client ID is running
+     */
+    bool TryLockClient(uint32_t clientID);
+
+    /**
+     * @brief unlock the client ID (for the event-driven mode)
+     *
+     * @param clientID the client ID
+     */
+    void UnlockClient(uint32_t clientID);
+
+    /**
+     * @brief process the login message and open a session (for the event-driven mode)
+     *
+     * @param recvBuf the buffer of the login message
+     * @param clientSSL the client ssl
+     * @return ClientVar* the session of the client, NULL if the login is rejected
+     */
+    ClientVar* OpenSession(SendMsgBuffer_t& recvBuf, SSL* clientSSL);
+
+    /**
+     * @brief Get the receive buffer of a session
+     *
+     * @param curClient the current client var
+     * @return uint8_t* the buffer to receive the next message
+     */
+    uint8_t* GetSessionRecvBuffer(ClientVar* curClient);
+
+    /**
+     * @brief process a received message of a session (for the event-driven mode)
+     *
+     * @param curClient the current client var
+     * @return true the session goes on
+     * @return false the session is rejected
+     */
+    bool ProcessSessionMessage(ClientVar* curClient);
+
+    /**
+     * @brief close a session after its connection is closed (for the event-driven mode)
+     *
+     * @param curClient the current client var
+     */
+    void CloseSession(ClientVar* curClient);
 };
 
 #endif
\ No newline at end of file
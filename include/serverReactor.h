@@ -0,0 +1,193 @@
+/**
+ * @file serverReactor.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief define the epoll reactor to run the client sessions on a fixed set of threads
+ * @version 0.1
+ * @date 2022-06-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SERVER_REACTOR_H
+#define SERVER_REACTOR_H
+
+#include "configure.h"
+#include "sslConnection.h"
+#include "serverOptThread.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+
+enum REACTOR_SESSION_STATUS { SESSION_WAIT_LOGIN = 0,
+    SESSION_WAIT_LOCK,
+    SESSION_ACTIVE,
+    SESSION_REJECTED };
+
+typedef struct {
+    SSL* clientSSL;
+    int clientFd;
+    SSLSessionState_t sessionState;
+    // the buffer of the login message
+    SendMsgBuffer_t loginBuf;
+    uint32_t clientID;
+    int status;
+    uint32_t events;
+    ClientVar* curClient;
+    // a message or the close of the session runs on a worker thread, the
+    // reactor does not touch the session until it is handed back
+    bool isBusy;
+    bool isClosing;
+    bool isRejected;
+} ReactorSession_t;
+
+typedef struct {
+    int epollFd;
+    int wakeFd;
+    std::mutex newSessionLck;
+    vector<ReactorSession_t*> newSessionList;
+    vector<ReactorSession_t*> waitLockList;
+    unordered_set<ReactorSession_t*> sessionSet;
+    // the sessions handed back by the worker threads
+    std::mutex doneSessionLck;
+    vector<ReactorSession_t*> doneSessionList;
+} ReactorThread_t;
+
+// a session to process on a worker thread
+typedef struct {
+    ReactorThread_t* reactor;
+    ReactorSession_t* session;
+} ReactorTask_t;
+
+class ServerReactor {
+private:
+    string myName_ = "ServerReactor";
+
+    // handlers passed from outside
+    SSLConnection* serverChannel_;
+    ServerOptThread* serverThreadObj_;
+
+    // the reactor threads
+    uint32_t threadNum_;
+    vector<ReactorThread_t*> reactorList_;
+    vector<boost::thread*> thList_;
+    boost::atomic<uint64_t> nextReactor_;
+    boost::atomic<bool> done_;
+
+    // the worker threads run the messages and the session close, which write and
+    // sync the containers and read them for the restore, off the reactor threads
+    uint32_t workerNum_;
+    vector<boost::thread*> workerList_;
+    std::mutex taskLck_;
+    std::condition_variable taskCond_;
+    deque<ReactorTask_t> taskList_;
+    bool taskDone_ = false;
+
+    // for statistic
+    boost::atomic<uint64_t> totalSessionNum_;
+    boost::atomic<uint64_t> totalTaskNum_;
+
+    /**
+     * @brief the event loop of a reactor thread
+     *
+     * @param reactor the reactor of this thread
+     */
+    void RunLoop(ReactorThread_t* reactor);
+
+    /**
+     * @brief the main loop of a worker thread
+     *
+     */
+    void RunWorker();
+
+    /**
+     * @brief hand over a session to the worker threads
+     *
+     * @param reactor the current reactor
+     * @param session the session
+     */
+    void SubmitTask(ReactorThread_t* reactor, ReactorSession_t* session);
+
+    /**
+     * @brief resume the sessions handed back by the worker threads
+     *
+     * @param reactor the current reactor
+     */
+    void FinishTasks(ReactorThread_t* reactor);
+
+    /**
+     * @brief register the new sessions handed over by the acceptor
+     *
+     * @param reactor the current reactor
+     */
+    void AcceptNewSessions(ReactorThread_t* reactor);
+
+    /**
+     * @brief handle the events of a session
+     *
+     * @param reactor the current reactor
+     * @param session the session
+     * @return true the session is alive
+     * @return false the session is closed
+     */
+    bool HandleSession(ReactorThread_t* reactor, ReactorSession_t* session);
+
+    /**
+     * @brief process a complete message of a session
+     *
+     * @param reactor the current reactor
+     * @param session the session
+     */
+    void DispatchMessage(ReactorThread_t* reactor, ReactorSession_t* session);
+
+    /**
+     * @brief update the interested events of a session
+     *
+     * @param reactor the current reactor
+     * @param session the session
+     */
+    void UpdateEvents(ReactorThread_t* reactor, ReactorSession_t* session);
+
+    /**
+     * @brief close a session, the session of a client is closed on a worker thread
+     *
+     * @param reactor the current reactor
+     * @param session the session
+     */
+    void CloseSession(ReactorThread_t* reactor, ReactorSession_t* session);
+
+    /**
+     * @brief release the resource of a closed session
+     *
+     * @param reactor the current reactor
+     * @param session the session
+     */
+    void ReleaseSession(ReactorThread_t* reactor, ReactorSession_t* session);
+
+public:
+    /**
+     * @brief Construct a new Server Reactor object
+     *
+     * @param serverChannel server communication channel
+     * @param serverThreadObj the server main thread obj
+     * @param threadNum the number of reactor threads (0: one per core)
+     * @param workerNum the number of worker threads (0: one per core)
+     */
+    ServerReactor(SSLConnection* serverChannel, ServerOptThread* serverThreadObj,
+        uint32_t threadNum, uint32_t workerNum);
+
+    /**
+     * @brief Destroy the Server Reactor object
+     *
+     */
+    ~ServerReactor();
+
+    /**
+     * @brief hand over an accepted connection to a reactor thread
+     *
+     * @param clientSSL the client ssl
+     */
+    void AddSession(SSL* clientSSL);
+};
+
+#endif
@@ -0,0 +1,51 @@
+/**
+ * @file sha256Kernel.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief define the batch SHA-256 kernels (SHA-NI and multi-buffer AVX2)
+ * @version 0.1
+ * @date 2022-06-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SHA256_KERNEL_H
+#define SHA256_KERNEL_H
+
+#include <stdint.h>
+
+namespace sha256Kernel {
+/**
+ * @brief check whether the cpu can run a kernel
+ *
+ * @param hashKernel the kernel (HASH_KERNEL)
+ * @return true the kernel is supported
+ * @return false otherwise
+ */
+bool IsSupported(int hashKernel);
+
+/**
+ * @brief hash a batch of buffers one by one with the SHA-NI instructions
+ *
+ * @param dataBufferList the input data buffers
+ * @param dataSizeList the input data sizes
+ * @param dataNum the number of buffers
+ * @param hashList the output hashes (dataNum * 32 bytes)
+ */
+void HashBatchSHANI(uint8_t** dataBufferList, const uint32_t* dataSizeList, uint32_t dataNum,
+    uint8_t* hashList);
+
+/**
+ * @brief hash a batch of buffers in the 8 lanes of AVX2, a lane takes the
+ * next buffer as soon as its current one is done
+ *
+ * @param dataBufferList the input data buffers
+ * @param dataSizeList the input data sizes
+ * @param dataNum the number of buffers
+ * @param hashList the output hashes (dataNum * 32 bytes)
+ */
+void HashBatchAVX2(uint8_t** dataBufferList, const uint32_t* dataSizeList, uint32_t dataNum,
+    uint8_t* hashList);
+} // namespace sha256Kernel
+
+#endif
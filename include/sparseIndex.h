@@ -0,0 +1,147 @@
+/**
+ * @file sparseIndex.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief define the interfaces of sparse index: the memory only keeps the sampled
+ * fingerprints (hooks), a batch is deduplicated against the manifests of the few
+ * earlier segments sharing the most hooks with it
+ * @version 0.1
+ * @date 2022-07-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SPARSE_INDEX_H
+#define SPARSE_INDEX_H
+
+#include "plainIndex.h"
+#include "lruCache.h"
+
+// the fingerprints of a segment
+typedef unordered_set<string> Manifest_t;
+typedef lru11::Cache<uint32_t, std::shared_ptr<Manifest_t>, std::mutex> ManifestCache_t;
+
+// the position of a manifest in the manifest file
+typedef struct {
+    uint64_t offset;
+    uint32_t fpNum;
+} ManifestMeta_t;
+
+class SparseIndex : public PlainIndex {
+private:
+    string myName_ = "SparseIndex";
+
+    // hook -> the latest manifests holding it (at most SPARSE_MANIFIEST_CAP_NUM)
+    pthread_rwlock_t hookLck_;
+    unordered_map<string, vector<uint32_t>> hookIndex_;
+    uint32_t sampleMask_ = 0;
+
+    // the manifests appended to one file, guarded by manifestLck_
+    std::mutex manifestLck_;
+    string manifestFileName_;
+    int manifestFd_ = -1;
+    uint64_t manifestFileSize_ = 0;
+    vector<ManifestMeta_t> manifestList_;
+    ManifestCache_t* manifestCache_ = NULL;
+
+    // for statistic
+    boost::atomic<uint64_t> lookupBatchNum_;
+    boost::atomic<uint64_t> championLoadNum_;
+    boost::atomic<uint64_t> manifestReadNum_;
+    boost::atomic<uint64_t> sparseDupNum_;
+    boost::atomic<uint64_t> missedDupNum_;
+
+    /**
+     * @brief check whether a fingerprint is sampled as a hook
+     *
+     * @param fp the fingerprint (CHUNK_HASH_SIZE bytes)
+     * @return true it is a hook
+     * @return false otherwise
+     */
+    inline bool IsHook(const uint8_t* fp)
+    {
+        uint32_t sampleBits;
+        memcpy(&sampleBits, fp + CHUNK_HASH_SIZE - sizeof(sampleBits), sizeof(sampleBits));
+        return (sampleBits & sampleMask_) == 0;
+    }
+
+    /**
+     * @brief index the hooks of a manifest, the caller holds the write lock of the hooks
+     *
+     * @param fpList the fingerprints of the manifest (CHUNK_HASH_SIZE bytes each)
+     * @param fpNum the number of fingerprints
+     * @param manifestId the manifest id
+     */
+    void IndexHooks(const uint8_t* fpList, uint32_t fpNum, uint32_t manifestId);
+
+    /**
+     * @brief write a buffer to the manifest file at an offset
+     *
+     * @param fd the file descriptor
+     * @param buffer the buffer
+     * @param bufferSize the buffer size
+     * @param offset the file offset
+     */
+    void WriteManifestFile(int fd, const uint8_t* buffer, size_t bufferSize, uint64_t offset);
+
+    /**
+     * @brief load the manifest file and rebuild the hooks from it, the fingerprints
+     * missing from the full index are dropped
+     *
+     */
+    void LoadManifests();
+
+    /**
+     * @brief get a manifest from the cache or the manifest file
+     *
+     * @param manifestId the manifest id
+     * @return std::shared_ptr<Manifest_t> the manifest
+     */
+    std::shared_ptr<Manifest_t> GetManifest(uint32_t manifestId);
+
+    /**
+     * @brief save the manifest of a segment and index its hooks
+     *
+     * @param fpList the fingerprints of the segment (CHUNK_HASH_SIZE bytes each)
+     * @param fpNum the number of fingerprints
+     */
+    void AddManifest(const uint8_t* fpList, uint32_t fpNum);
+
+protected:
+    /**
+     * @brief look up a batch of fingerprints against the champion manifests of its hooks
+     *
+     * @param fpList the fingerprints (CHUNK_HASH_SIZE bytes each)
+     * @param fpNum the number of fingerprints
+     * @param foundList whether each fingerprint is a duplicate (1: duplicate, 0: new),
+     * the i-th one is written after the i-th fingerprint is read
+     * @param curClient the current client var (NULL: a query without the session)
+     * @return uint32_t the number of duplicates
+     */
+    uint32_t LookupBatch(const uint8_t* fpList, uint32_t fpNum, uint8_t* foundList,
+        ClientVar* curClient);
+
+public:
+    /**
+     * @brief Construct a new Sparse Index object
+     *
+     * @param indexStore the reference to the index store
+     */
+    SparseIndex(AbsDatabase* indexStore);
+
+    /**
+     * @brief Destroy the Sparse Index object
+     *
+     */
+    ~SparseIndex();
+
+    /**
+     * @brief process one batch as a segment
+     *
+     * @param recvChunkBuf the recv chunk buffer
+     * @param curClient the current client var
+     */
+    void ProcessOneBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient);
+};
+
+#endif
@@ -0,0 +1,125 @@
+/**
+ * @file sslAcceptor.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief define the acceptor stage (accept threads + non-blocking handshake pool)
+ * @version 0.1
+ * @date 2022-06-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef SSL_ACCEPTOR_H
+#define SSL_ACCEPTOR_H
+
+#include "configure.h"
+#include "sslConnection.h"
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <boost/thread/thread.hpp>
+#include <boost/atomic.hpp>
+#include <boost/function.hpp>
+
+typedef struct {
+    int epollFd;
+    int wakeFd;
+    // the new connections and their accept time (ms), guarded by newConnLck
+    std::mutex newConnLck;
+    vector<pair<SSL*, uint64_t>> newConnList;
+    // the connections in the handshake -> their accept time (ms)
+    unordered_map<SSL*, uint64_t> connMap;
+    uint64_t lastCheckTime;
+} HandshakeThread_t;
+
+class SSLAcceptor {
+private:
+    string myName_ = "SSLAcceptor";
+
+    // handlers passed from outside
+    SSLConnection* serverChannel_;
+    boost::function<void(SSL*)> sessionHandler_;
+
+    // the accept threads, each owns a listen socket of the port
+    uint32_t listenerNum_;
+    vector<int> listenFdList_;
+    vector<boost::thread*> listenerList_;
+
+    // the handshake threads
+    uint32_t handshakeThreadNum_;
+    vector<HandshakeThread_t*> handshakeList_;
+    vector<boost::thread*> thList_;
+    boost::atomic<uint64_t> nextHandshake_;
+    // the deadline of a handshake from the accept (0: no deadline)
+    uint64_t handshakeTimeoutMs_;
+    boost::atomic<bool> done_;
+
+    // for statistic
+    boost::atomic<uint64_t> acceptNum_;
+    boost::atomic<uint64_t> fullHandshakeNum_;
+    boost::atomic<uint64_t> resumedHandshakeNum_;
+    boost::atomic<uint64_t> handshakeFailNum_;
+
+    /**
+     * @brief the accept loop of a listen socket
+     *
+     * @param listenFd the listen socket
+     */
+    void AcceptLoop(int listenFd);
+
+    /**
+     * @brief the event loop of a handshake thread
+     *
+     * @param handshakeThread the handshake thread
+     */
+    void HandshakeLoop(HandshakeThread_t* handshakeThread);
+
+    /**
+     * @brief register the new connections handed over by the accept threads
+     *
+     * @param handshakeThread the current handshake thread
+     */
+    void AddNewConns(HandshakeThread_t* handshakeThread);
+
+    /**
+     * @brief continue the handshake of a connection
+     *
+     * @param handshakeThread the current handshake thread
+     * @param clientSSL the client ssl
+     */
+    void DoHandshake(HandshakeThread_t* handshakeThread, SSL* clientSSL);
+
+    /**
+     * @brief drop the connections over the handshake deadline
+     *
+     * @param handshakeThread the current handshake thread
+     */
+    void DropExpiredConns(HandshakeThread_t* handshakeThread);
+
+public:
+    /**
+     * @brief Construct a new SSLAcceptor object
+     *
+     * @param serverChannel server communication channel
+     * @param sessionHandler the handler of the connections which finish the handshake
+     * @param listenerNum the number of accept threads
+     * @param handshakeThreadNum the number of handshake threads (0: one per core)
+     * @param handshakeTimeoutSec the deadline of a handshake from the accept (0: no deadline)
+     */
+    SSLAcceptor(SSLConnection* serverChannel, boost::function<void(SSL*)> sessionHandler,
+        uint32_t listenerNum, uint32_t handshakeThreadNum, uint32_t handshakeTimeoutSec);
+
+    /**
+     * @brief Destroy the SSLAcceptor object
+     *
+     */
+    ~SSLAcceptor();
+
+    /**
+     * @brief run the acceptor, the caller thread serves as the first accept thread
+     *
+     */
+    void Run();
+};
+
+#endif
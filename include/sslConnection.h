@@ -20,9 +20,30 @@
 #include <arpa/inet.h>
 #include <unistd.h>
 
+#include <fcntl.h>
+
 #include <openssl/ssl.h>
 #include <openssl/err.h>
 
+extern Configure config;
+
+typedef struct {
+    // the progress of the message under receiving
+    int recvLen;
+    uint32_t recvHeadSize;
+    uint32_t recvDataSize;
+    // the pending output of the connection
+    vector<uint8_t> sendBuffer;
+    size_t sendOffset;
+    bool corked;
+} SSLSessionState_t;
+
+typedef struct {
+    // the framed output which is not written to the blocking connection
+    vector<uint8_t> buffer;
+    bool corked;
+} SSLFrameBuffer_t;
+
 class SSLConnection {
 private:
     string myName_ = "SSLConnection";
@@ -41,6 +62,49 @@ private:
     // the listen file descriptor
     int listenFd_;
 
+    /**
+     * @brief enable the session cache and session tickets of the server ctx
+     *
+     */
+    void InitSessionResumption();
+
+    /**
+     * @brief Get the frame buffer of a blocking connection (create it if not exist)
+     *
+     * @param connection the pointer to the connection
+     * @return SSLFrameBuffer_t* the frame buffer, released with the connection
+     */
+    SSLFrameBuffer_t* GetFrameBuffer(SSL* connection);
+
+    /**
+     * @brief free the frame buffer when its connection is freed
+     *
+     */
+    static void FreeFrameBuffer(void* parent, void* ptr, CRYPTO_EX_DATA* ad,
+        int idx, long argl, void* argp);
+
+    /**
+     * @brief write the whole buffer to a blocking connection
+     *
+     * @param connection the pointer to the connection
+     * @param data the pointer to the data buffer
+     * @param dataSize the size of the data
+     * @return true success
+     * @return false fail
+     */
+    bool WriteAll(SSL* connection, uint8_t* data, size_t dataSize);
+
+    /**
+     * @brief read the given size of data from a blocking connection
+     *
+     * @param connection the pointer to the connection
+     * @param data the pointer to the data buffer
+     * @param dataSize the size of the data
+     * @return true success
+     * @return false fail
+     */
+    bool ReadAll(SSL* connection, uint8_t* data, size_t dataSize);
+
 public:
     /**
      * @brief Construct a new SSLConnection object
@@ -85,6 +149,22 @@ public:
      */
     pair<int, SSL*> ListenSSL();
 
+    /**
+     * @brief init a listen socket on the server port, the port is shared
+     * (SO_REUSEPORT) so that each accept thread can own a listen socket
+     *
+     * @return int the listen fd (owned by the caller)
+     */
+    int InitListenFd();
+
+    /**
+     * @brief create the server-side SSL of an accepted socket without the handshake
+     *
+     * @param socketFd the accepted socket
+     * @return SSL* the SSL of the connection
+     */
+    SSL* InitAcceptedSSL(int socketFd);
+
     /**
      * @brief send the data to the given connection
      *
@@ -96,6 +176,58 @@ public:
      */
     bool SendData(SSL* connection, uint8_t* data, uint32_t dataSize);
 
+    /**
+     * @brief start to batch the following messages of the connection, the
+     * small messages are coalesced into one record until UncorkData
+     *
+     * @param connection the pointer to the connection
+     */
+    void CorkData(SSL* connection);
+
+    /**
+     * @brief stop batching and write the batched messages of the connection
+     *
+     * @param connection the pointer to the connection
+     * @return true success
+     * @return false fail
+     */
+    bool UncorkData(SSL* connection);
+
+    /**
+     * @brief check whether the connection sends through kernel TLS, only
+     * for the blocking connections
+     *
+     * @param connection the pointer to the connection
+     * @return true the record layer of the send side is in the kernel
+     * @return false otherwise
+     */
+    bool IsKernelTLSSend(SSL* connection);
+
+    /**
+     * @brief send the data without the length prefix (the caller frames the
+     * message), the data is batched with the following SendFileData
+     *
+     * @param connection the pointer to the connection
+     * @param data the pointer to the data buffer
+     * @param dataSize the size of the data
+     * @return true success
+     * @return false fail
+     */
+    bool SendRawData(SSL* connection, uint8_t* data, uint32_t dataSize);
+
+    /**
+     * @brief send a range of a file through kernel TLS without copying it to
+     * the user space
+     *
+     * @param connection the pointer to the connection
+     * @param fileFd the file
+     * @param offset the offset of the range
+     * @param size the size of the range
+     * @return true success
+     * @return false fail
+     */
+    bool SendFileData(SSL* connection, int fileFd, off_t offset, size_t size);
+
     /**
      * @brief receive the data from the given connection
      *
@@ -107,6 +239,46 @@ public:
      */
     bool ReceiveData(SSL* connection, uint8_t* data, uint32_t& receiveDataSize);
 
+    /**
+     * @brief switch the connection to the non-blocking mode, the following
+     * SendData only appends the message to the session state
+     *
+     * @param connection the pointer to the connection
+     * @param sessionState the state of the session (owned by the caller)
+     * @return true success
+     * @return false fail
+     */
+    bool SetNonBlocking(SSL* connection, SSLSessionState_t* sessionState);
+
+    /**
+     * @brief try to receive a message from a non-blocking connection
+     *
+     * @param connection the pointer to the connection
+     * @param data the pointer to the data buffer
+     * @param receiveDataSize the size of received data
+     * @return int SSL_IO_DONE: a message is ready, SSL_IO_WANT: wait for more
+     * data, SSL_IO_FAIL: the connection is closed
+     */
+    int TryReceiveData(SSL* connection, uint8_t* data, uint32_t& receiveDataSize);
+
+    /**
+     * @brief flush the pending output of a non-blocking connection
+     *
+     * @param connection the pointer to the connection
+     * @return int SSL_IO_DONE: all flushed, SSL_IO_WANT: wait for writable,
+     * SSL_IO_FAIL: the connection is broken
+     */
+    int FlushData(SSL* connection);
+
+    /**
+     * @brief check whether a non-blocking connection has pending output
+     *
+     * @param connection the pointer to the connection
+     * @return true has pending output
+     * @return false no pending output
+     */
+    bool HasPendingData(SSL* connection);
+
     /**
      * @brief Get the Listen Fd object
      *
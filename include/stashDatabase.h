@@ -0,0 +1,247 @@
+/**
+ * @file stashDatabase.h
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement a log-structured index on flash (ChunkStash-style): the pairs are
+ * appended to a log, the memory only keeps a short signature and the log position of a key
+ * @version 0.1
+ * @date 2022-07-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#ifndef STASH_DATABASE_H
+#define STASH_DATABASE_H
+
+#include "absDatabase.h"
+#include "configure.h"
+
+#include <boost/atomic.hpp>
+
+// a record of the log keeps the fingerprint and the container name
+static const uint32_t STASH_KEY_SIZE = CHUNK_HASH_SIZE;
+static const uint32_t STASH_VALUE_SIZE = CONTAINER_ID_LENGTH;
+static const uint32_t STASH_RECORD_SIZE = STASH_KEY_SIZE + STASH_VALUE_SIZE;
+
+// an entry of the signature table (8 bytes), the signature also picks the home
+// slot, so a table is resized without reading the keys back from the log
+typedef struct {
+    uint32_t sig;
+    // the record id in the log (STASH_EMPTY_ID: empty)
+    uint32_t recordId;
+} StashEntry_t;
+
+typedef struct {
+    pthread_rwlock_t shardLck;
+    StashEntry_t* entryList;
+    uint64_t slotNum;
+    uint64_t keyNum;
+} StashShard_t;
+
+class StashDatabase : public AbsDatabase {
+protected:
+    string myName_ = "StashDatabase";
+    StashShard_t shardList_[INDEX_SHARD_NUM];
+    int logFd_ = -1;
+
+    // the records not in the log file yet, guarded by bufLck_ (flushLck_ is taken before it)
+    std::mutex bufLck_;
+    std::mutex flushLck_;
+    vector<char> pendingBuf_;
+    // the records under writing to the log file, still readable
+    vector<char> flushingBuf_;
+    // the records in the log file, and all records
+    uint64_t flushedNum_ = 0;
+    uint64_t recordNum_ = 0;
+
+    // for statistic
+    boost::atomic<uint64_t> queryNum_;
+    boost::atomic<uint64_t> flashReadNum_;
+    boost::atomic<uint64_t> sigMissNum_;
+    uint64_t flushNum_ = 0;
+    boost::atomic<uint64_t> resizeNum_;
+
+    /**
+     * @brief get the shard of a key
+     *
+     * @param key the key (STASH_KEY_SIZE bytes)
+     * @return StashShard_t* the shard
+     */
+    inline StashShard_t* GetShard(const char* key)
+    {
+        uint32_t prefix;
+        memcpy(&prefix, key, sizeof(prefix));
+        return &shardList_[prefix % INDEX_SHARD_NUM];
+    }
+
+    /**
+     * @brief get the signature of a key, the bytes after the shard prefix
+     *
+     * @param key the key (STASH_KEY_SIZE bytes)
+     * @return uint32_t the signature (low bits: home slot)
+     */
+    inline uint32_t GetSig(const char* key)
+    {
+        uint32_t sig;
+        memcpy(&sig, key + sizeof(uint32_t), sizeof(sig));
+        return sig;
+    }
+
+    /**
+     * @brief read a record from the buffers or the log file
+     *
+     * @param recordId the record id
+     * @param record the record (STASH_RECORD_SIZE bytes)
+     */
+    void ReadRecord(uint64_t recordId, char* record);
+
+    /**
+     * @brief find the slot of a key in a shard, the log is read only when the
+     * signature matches
+     *
+     * @param shard the shard
+     * @param key the key (STASH_KEY_SIZE bytes)
+     * @param record the record of the key if found (STASH_RECORD_SIZE bytes)
+     * @return int64_t the slot id, -1 if the key does not exist
+     */
+    int64_t FindSlot(StashShard_t* shard, const char* key, char* record);
+
+    /**
+     * @brief put a record into a shard, the caller holds the write lock of the shard
+     *
+     * @param shard the shard
+     * @param sig the signature of the key
+     * @param recordId the record id
+     */
+    void PutRecord(StashShard_t* shard, uint32_t sig, uint32_t recordId);
+
+    /**
+     * @brief append a record to the write buffer
+     *
+     * @param record the record (STASH_RECORD_SIZE bytes)
+     * @param recordId the record id
+     * @return true the buffer is full
+     * @return false otherwise
+     */
+    bool AppendRecord(const char* record, uint32_t& recordId);
+
+    /**
+     * @brief write the buffered records to the log file
+     *
+     * @return true success
+     * @return false fail
+     */
+    bool Flush();
+
+    /**
+     * @brief visit the records in the log order, the file part with large reads
+     *
+     * @param recordNum the number of records to visit
+     * @param visitor the function called on each record
+     */
+    void ScanRecords(uint64_t recordNum, std::function<void(uint64_t recordId, const char* record)> visitor);
+
+    /**
+     * @brief rebuild the signature tables of a given size from the log on startup
+     *
+     * @param slotNum the number of slots of a shard
+     */
+    void RebuildTables(uint64_t slotNum);
+
+    /**
+     * @brief double the signature table of a shard if it is too full
+     *
+     * @param shard the shard
+     */
+    void Resize(StashShard_t* shard);
+
+public:
+    /**
+     * @brief Construct a new Stash Database object
+     *
+     * @param dbName the path of the log file
+     */
+    StashDatabase(std::string dbName);
+
+    /**
+     * @brief Destroy the Stash Database object
+     *
+     */
+    virtual ~StashDatabase();
+
+    /**
+     * @brief open a database
+     *
+     * @param dbName the db path
+     * @return true success
+     * @return false fail
+     */
+    bool OpenDB(std::string dbName);
+
+    /**
+     * @brief execute query over database
+     *
+     * @param key key
+     * @param value value
+     * @return true success
+     * @return false fail
+     */
+    bool Query(const std::string& key, std::string& value);
+
+    /**
+     * @brief insert the (key, value) pair
+     *
+     * @param key key
+     * @param value value
+     * @return true success
+     * @return false fail
+     */
+    bool Insert(const std::string& key, const std::string& value);
+
+    /**
+     * @brief insert the (key, value) pair
+     *
+     * @param key
+     * @param buffer
+     * @param bufferSize
+     * @return true
+     * @return false
+     */
+    bool InsertBuffer(const std::string& key, const char* buffer, size_t bufferSize);
+
+    /**
+     * @brief insert the (key, value) pair
+     *
+     * @param key
+     * @param keySize
+     * @param buffer
+     * @param bufferSize
+     * @return true
+     * @return false
+     */
+    bool InsertBothBuffer(const char* key, size_t keySize, const char* buffer,
+        size_t bufferSize);
+
+    /**
+     * @brief query the (key, value) pair
+     *
+     * @param key
+     * @param keySize
+     * @param value
+     * @return true
+     * @return false
+     */
+    bool QueryBuffer(const char* key, size_t keySize, std::string& value);
+
+    /**
+     * @brief visit all records in the log order, an updated key is visited
+     * once per record (the last one holds its value)
+     *
+     * @param visitor the function called on each pair
+     * @return true success
+     * @return false fail
+     */
+    bool Traverse(std::function<void(const std::string& key, const std::string& value)> visitor);
+};
+
+#endif
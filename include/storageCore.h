@@ -4,6 +4,7 @@
 #include "configure.h"
 #include "clientVar.h"
 #include "storeOCall.h"
+#include "absDatabase.h"
 
 using namespace std;
 
@@ -11,9 +12,12 @@ class StorageCore {
 private:
     string myName_ = "StorageCore";
 
-    // written data size
-    uint64_t writtenDataSize_ = 0;
-    uint64_t writtenChunkNum_ = 0;
+    // written data size (the sessions append their containers concurrently)
+    boost::atomic<uint64_t> writtenDataSize_;
+    boost::atomic<uint64_t> writtenChunkNum_;
+
+    // the index holding the containers until they are durable
+    AbsDatabase* indexStore_ = NULL;
 
     /**
      * @brief write the data to a container according to the given metadata
@@ -39,6 +43,17 @@ public:
      */
     ~StorageCore();
 
+    /**
+     * @brief set the index which holds a container from its first chunk until
+     * the data writer commits it
+     *
+     * @param indexStore the index
+     */
+    void SetIndexStore(AbsDatabase* indexStore) {
+        indexStore_ = indexStore;
+        return;
+    }
+
     /**
      * @brief save the chunk to the storage server
      *
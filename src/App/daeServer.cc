@@ -16,6 +16,8 @@
 
 // for main server thread
 #include "../../include/serverOptThread.h"
+#include "../../include/serverReactor.h"
+#include "../../include/sslAcceptor.h"
 
 // to receive the interrupt
 #include <signal.h>
@@ -30,8 +32,11 @@ SSLConnection* serverChannelObj;
 DatabaseFactory dbFactory;
 AbsDatabase* fp2ChunkDB;
 vector<boost::thread*> thList;
+std::mutex thListLck;
 
 ServerOptThread* serverThreadObj;
+ServerReactor* serverReactorObj = NULL;
+SSLAcceptor* serverAcceptorObj = NULL;
 
 void Usage()
 {
@@ -39,10 +44,31 @@ void Usage()
     return;
 }
 
+/**
+ * @brief run a session on a dedicated thread (thread-per-connection mode)
+ *
+ * @param clientSSL the client ssl after the handshake
+ */
+void StartSessionThread(SSL* clientSSL)
+{
+    boost::thread_attributes attrs;
+    attrs.set_stack_size(THREAD_STACK_SIZE);
+    boost::thread* thTmp = new boost::thread(attrs, boost::bind(&ServerOptThread::Run,
+        serverThreadObj, clientSSL));
+    lock_guard<mutex> lock(thListLck);
+    thList.push_back(thTmp);
+    return;
+}
+
 void CTRLC(int s)
 {
     // tool::Logging(myName.c_str(), "terminate the server with ctrl+c interrupt\n");
     //  ------ clean up ------
+    // stop accepting the new sessions first
+    if (serverAcceptorObj != NULL) {
+        delete serverAcceptorObj;
+    }
+
     for (auto it : thList) {
         it->join();
     }
@@ -51,6 +77,9 @@ void CTRLC(int s)
         delete it;
     }
 
+    if (serverReactorObj != NULL) {
+        delete serverReactorObj;
+    }
     delete serverThreadObj;
     // tool::Logging(myName.c_str(), "clear all server thread the object.\n");
 
@@ -77,16 +106,17 @@ int main(int argc, char* argv[])
 
     srand(tool::GetStrongSeed());
 
-    boost::thread* thTmp;
-    boost::thread_attributes attrs;
-    attrs.set_stack_size(THREAD_STACK_SIZE);
-
-    fp2ChunkDB = dbFactory.CreateDatabase(IN_MEMORY, config.GetFp2ChunkDBName());
+    fp2ChunkDB = dbFactory.CreateDatabase(config.GetFp2ChunkDBType(), config.GetFp2ChunkDBName());
+    if (fp2ChunkDB == NULL) {
+        tool::Logging(myName.c_str(), "cannot create the index of type %u.\n",
+            config.GetFp2ChunkDBType());
+        exit(EXIT_FAILURE);
+    }
     serverChannelObj = new SSLConnection(config.GetStorageServerIP(),
         config.GetStoragePort(), IN_SERVERSIDE);
 
     // init
-    int indexType = 0;
+    int indexType = config.GetIndexType();
     serverThreadObj = new ServerOptThread(serverChannelObj, fp2ChunkDB, indexType);
 
     /**
@@ -95,12 +125,22 @@ int main(int argc, char* argv[])
      * |---------------------------------------|
      */
 
-    while (true) {
-        tool::Logging(myName.c_str(), "waiting the request from the edge.\n");
-        SSL* clientSSL = serverChannelObj->ListenSSL().second;
-        thTmp = new boost::thread(attrs, boost::bind(&ServerOptThread::Run, serverThreadObj, clientSSL));
-        thList.push_back(thTmp);
+    // the acceptor only hands over the connections which finish the handshake
+    boost::function<void(SSL*)> sessionHandler;
+    if (config.GetServerMode() == EVENT_DRIVEN) {
+        // run the sessions on a fixed set of epoll reactor threads
+        serverReactorObj = new ServerReactor(serverChannelObj, serverThreadObj,
+            config.GetReactorThreadNum(), config.GetReactorWorkerNum());
+        sessionHandler = boost::bind(&ServerReactor::AddSession, serverReactorObj, _1);
+    } else {
+        sessionHandler = StartSessionThread;
     }
+    serverAcceptorObj = new SSLAcceptor(serverChannelObj, sessionHandler,
+        config.GetListenerThreadNum(), config.GetHandshakeThreadNum(),
+        config.GetHandshakeTimeoutSec());
+
+    tool::Logging(myName.c_str(), "waiting the request from the edge.\n");
+    serverAcceptorObj->Run();
 
     return 0;
 }
\ No newline at end of file
@@ -0,0 +1,121 @@
+/**
+ * @file hashBench.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief compare the batch hash kernels with the per-chunk hash
+ * @version 0.1
+ * @date 2022-06-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/configure.h"
+#include "../../include/cryptoPrimitive.h"
+
+#include <sys/time.h>
+
+using namespace std;
+
+Configure config("config.json");
+string myName = "HashBench";
+
+void Usage()
+{
+    fprintf(stderr, "./HashBench -n [chunk num] -r [round num]\n");
+    return;
+}
+
+int main(int argc, char* argv[])
+{
+    uint32_t chunkNum = 4096;
+    uint32_t roundNum = 5;
+    int option;
+    while ((option = getopt(argc, argv, "n:r:h")) != -1) {
+        switch (option) {
+        case 'n':
+            chunkNum = atoi(optarg);
+            break;
+        case 'r':
+            roundNum = atoi(optarg);
+            break;
+        default:
+            Usage();
+            exit(EXIT_FAILURE);
+        }
+    }
+    if (chunkNum == 0 || roundNum == 0) {
+        Usage();
+        exit(EXIT_FAILURE);
+    }
+
+    // the chunks, the first ones cover the padding corner cases
+    srand(tool::GetStrongSeed());
+    vector<uint8_t*> chunkAddrList(chunkNum);
+    vector<uint32_t> chunkSizeList(chunkNum);
+    uint64_t totalSize = 0;
+    for (size_t i = 0; i < chunkNum; i++) {
+        if (i < 2 * 64 + 1) {
+            chunkSizeList[i] = i;
+        } else {
+            chunkSizeList[i] = MIN_CHUNK_SIZE + rand() % (MAX_CHUNK_SIZE - MIN_CHUNK_SIZE + 1);
+        }
+        chunkAddrList[i] = (uint8_t*)malloc(chunkSizeList[i] + 1);
+        for (size_t j = 0; j < chunkSizeList[i]; j++) {
+            chunkAddrList[i][j] = rand();
+        }
+        totalSize += chunkSizeList[i];
+    }
+
+    CryptoPrimitive* cryptoObj = new CryptoPrimitive(CIPHER_TYPE, HASH_TYPE);
+    EVP_MD_CTX* mdCtx = EVP_MD_CTX_new();
+    vector<uint8_t> refHashList(chunkNum * CHUNK_HASH_SIZE);
+    vector<uint8_t> hashList(chunkNum * CHUNK_HASH_SIZE);
+    struct timeval sTime;
+    struct timeval eTime;
+    double totalTime;
+
+    // the current per-chunk path
+    totalTime = 0;
+    for (size_t r = 0; r < roundNum; r++) {
+        gettimeofday(&sTime, NULL);
+        for (size_t i = 0; i < chunkNum; i++) {
+            cryptoObj->GenerateHash(mdCtx, chunkAddrList[i], chunkSizeList[i],
+                &refHashList[i * CHUNK_HASH_SIZE]);
+        }
+        gettimeofday(&eTime, NULL);
+        totalTime += tool::GetTimeDiff(sTime, eTime);
+    }
+    fprintf(stderr, "%-12s %10.2f MiB/s\n", "per-chunk",
+        (double)totalSize * roundNum / (1024 * 1024) / totalTime);
+
+    const char* kernelName[] = { "openssl", "avx2", "sha-ni" };
+    for (int kernel = HASH_KERNEL_OPENSSL; kernel <= HASH_KERNEL_SHA_NI; kernel++) {
+        if (!cryptoObj->SetHashKernel(kernel)) {
+            fprintf(stderr, "%-12s unsupported\n", kernelName[kernel]);
+            continue;
+        }
+        totalTime = 0;
+        for (size_t r = 0; r < roundNum; r++) {
+            memset(hashList.data(), 0, hashList.size());
+            gettimeofday(&sTime, NULL);
+            cryptoObj->GenerateHashBatch(mdCtx, chunkAddrList.data(), chunkSizeList.data(),
+                chunkNum, hashList.data());
+            gettimeofday(&eTime, NULL);
+            totalTime += tool::GetTimeDiff(sTime, eTime);
+            if (hashList != refHashList) {
+                tool::Logging(myName.c_str(), "the %s kernel mismatches the per-chunk hash.\n",
+                    kernelName[kernel]);
+                exit(EXIT_FAILURE);
+            }
+        }
+        fprintf(stderr, "%-12s %10.2f MiB/s\n", kernelName[kernel],
+            (double)totalSize * roundNum / (1024 * 1024) / totalTime);
+    }
+
+    EVP_MD_CTX_free(mdCtx);
+    delete cryptoObj;
+    for (auto it : chunkAddrList) {
+        free(it);
+    }
+    return 0;
+}
@@ -0,0 +1,352 @@
+/**
+ * @file sslAcceptor.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement the acceptor stage
+ * @version 0.1
+ * @date 2022-06-17
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/sslAcceptor.h"
+
+/**
+ * @brief Construct a new SSLAcceptor object
+ *
+ * @param serverChannel server communication channel
+ * @param sessionHandler the handler of the connections which finish the handshake
+ * @param listenerNum the number of accept threads
+ * @param handshakeThreadNum the number of handshake threads (0: one per core)
+ * @param handshakeTimeoutSec the deadline of a handshake from the accept (0: no deadline)
+ */
+SSLAcceptor::SSLAcceptor(SSLConnection* serverChannel,
+    boost::function<void(SSL*)> sessionHandler, uint32_t listenerNum,
+    uint32_t handshakeThreadNum, uint32_t handshakeTimeoutSec)
+{
+    serverChannel_ = serverChannel;
+    sessionHandler_ = sessionHandler;
+    listenerNum_ = listenerNum;
+    if (listenerNum_ == 0) {
+        listenerNum_ = 1;
+    }
+    handshakeThreadNum_ = handshakeThreadNum;
+    if (handshakeThreadNum_ == 0) {
+        handshakeThreadNum_ = boost::thread::hardware_concurrency();
+        if (handshakeThreadNum_ == 0) {
+            handshakeThreadNum_ = 1;
+        }
+    }
+    nextHandshake_ = 0;
+    handshakeTimeoutMs_ = (uint64_t)handshakeTimeoutSec * 1000;
+    done_ = false;
+    acceptNum_ = 0;
+    fullHandshakeNum_ = 0;
+    resumedHandshakeNum_ = 0;
+    handshakeFailNum_ = 0;
+
+    // the kernel spreads the incoming connections over the listen sockets
+    listenFdList_.push_back(serverChannel_->GetListenFd());
+    for (size_t i = 1; i < listenerNum_; i++) {
+        listenFdList_.push_back(serverChannel_->InitListenFd());
+    }
+
+    for (size_t i = 0; i < handshakeThreadNum_; i++) {
+        HandshakeThread_t* handshakeThread = new HandshakeThread_t();
+        handshakeThread->lastCheckTime = tool::GetMonotonicMs();
+        handshakeThread->epollFd = epoll_create1(0);
+        handshakeThread->wakeFd = eventfd(0, EFD_NONBLOCK);
+        if (handshakeThread->epollFd < 0 || handshakeThread->wakeFd < 0) {
+            tool::Logging(myName_.c_str(), "cannot init the epoll: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        struct epoll_event wakeEvent;
+        wakeEvent.events = EPOLLIN;
+        wakeEvent.data.ptr = NULL;
+        if (epoll_ctl(handshakeThread->epollFd, EPOLL_CTL_ADD, handshakeThread->wakeFd,
+                &wakeEvent)
+            < 0) {
+            tool::Logging(myName_.c_str(), "cannot add the wake fd: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        handshakeList_.push_back(handshakeThread);
+        thList_.push_back(new boost::thread(boost::bind(&SSLAcceptor::HandshakeLoop,
+            this, handshakeThread)));
+    }
+
+    tool::Logging(myName_.c_str(), "start %u accept threads and %u handshake threads.\n",
+        listenerNum_, handshakeThreadNum_);
+}
+
+/**
+ * @brief Destroy the SSLAcceptor object
+ *
+ */
+SSLAcceptor::~SSLAcceptor()
+{
+    done_ = true;
+    // unblock the accept threads
+    for (auto listenFd : listenFdList_) {
+        shutdown(listenFd, SHUT_RDWR);
+    }
+    for (auto it : listenerList_) {
+        it->join();
+        delete it;
+    }
+
+    uint64_t wakeSignal = 1;
+    for (auto handshakeThread : handshakeList_) {
+        if (write(handshakeThread->wakeFd, &wakeSignal, sizeof(wakeSignal)) < 0) {
+            tool::Logging(myName_.c_str(), "cannot wake up the handshake thread: %s\n",
+                strerror(errno));
+        }
+    }
+    for (auto it : thList_) {
+        it->join();
+        delete it;
+    }
+
+    // drop the connections which are still in the handshake
+    for (auto handshakeThread : handshakeList_) {
+        for (auto& newConn : handshakeThread->newConnList) {
+            serverChannel_->ClearAcceptedClientSd(newConn.first);
+        }
+        for (auto& conn : handshakeThread->connMap) {
+            serverChannel_->ClearAcceptedClientSd(conn.first);
+        }
+        close(handshakeThread->wakeFd);
+        close(handshakeThread->epollFd);
+        delete handshakeThread;
+    }
+
+    // the first listen socket belongs to the server channel
+    for (size_t i = 1; i < listenFdList_.size(); i++) {
+        close(listenFdList_[i]);
+    }
+
+    fprintf(stderr, "========SSLAcceptor Info========\n");
+    fprintf(stderr, "accept thread num: %u\n", listenerNum_);
+    fprintf(stderr, "handshake thread num: %u\n", handshakeThreadNum_);
+    fprintf(stderr, "accepted connection num: %lu\n", acceptNum_.load());
+    fprintf(stderr, "full handshake num: %lu\n", fullHandshakeNum_.load());
+    fprintf(stderr, "resumed handshake num: %lu\n", resumedHandshakeNum_.load());
+    fprintf(stderr, "handshake fail num: %lu\n", handshakeFailNum_.load());
+    fprintf(stderr, "================================\n");
+}
+
+/**
+ * @brief run the acceptor, the caller thread serves as the first accept thread
+ *
+ */
+void SSLAcceptor::Run()
+{
+    for (size_t i = 1; i < listenFdList_.size(); i++) {
+        listenerList_.push_back(new boost::thread(boost::bind(&SSLAcceptor::AcceptLoop,
+            this, listenFdList_[i])));
+    }
+    this->AcceptLoop(listenFdList_[0]);
+    return;
+}
+
+/**
+ * @brief the accept loop of a listen socket
+ *
+ * @param listenFd the listen socket
+ */
+void SSLAcceptor::AcceptLoop(int listenFd)
+{
+    struct sockaddr_in clientAddr;
+    socklen_t clientAddrLen;
+    uint64_t wakeSignal = 1;
+
+    while (!done_) {
+        clientAddrLen = sizeof(clientAddr);
+        int socketFd = accept4(listenFd, (struct sockaddr*)&clientAddr, &clientAddrLen,
+            SOCK_NONBLOCK);
+        if (socketFd < 0) {
+            if (done_) {
+                break;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            if (errno == EMFILE || errno == ENFILE) {
+                // leave the connections in the backlog until some sessions exit
+                tool::Logging(myName_.c_str(), "socket accept fails: %s\n", strerror(errno));
+                usleep(ACCEPT_RETRY_MS * 1000);
+                continue;
+            }
+            tool::Logging(myName_.c_str(), "socket listen fails: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        acceptNum_++;
+
+        // round-robin over the handshake threads
+        SSL* clientSSL = serverChannel_->InitAcceptedSSL(socketFd);
+        uint64_t acceptTime = tool::GetMonotonicMs();
+        HandshakeThread_t* handshakeThread = handshakeList_[nextHandshake_++ % handshakeThreadNum_];
+        {
+            lock_guard<mutex> lock(handshakeThread->newConnLck);
+            handshakeThread->newConnList.push_back({ clientSSL, acceptTime });
+        }
+        if (write(handshakeThread->wakeFd, &wakeSignal, sizeof(wakeSignal)) < 0) {
+            tool::Logging(myName_.c_str(), "cannot wake up the handshake thread: %s\n",
+                strerror(errno));
+        }
+    }
+    return;
+}
+
+/**
+ * @brief the event loop of a handshake thread
+ *
+ * @param handshakeThread the handshake thread
+ */
+void SSLAcceptor::HandshakeLoop(HandshakeThread_t* handshakeThread)
+{
+    struct epoll_event eventList[REACTOR_MAX_EVENT_NUM];
+    uint64_t wakeSignal;
+    // wake up in time to drop the connections over the deadline
+    int waitTimeout = (handshakeTimeoutMs_ == 0) ? -1 : HANDSHAKE_CHECK_MS;
+
+    while (!done_) {
+        int eventNum = epoll_wait(handshakeThread->epollFd, eventList,
+            REACTOR_MAX_EVENT_NUM, waitTimeout);
+        if (eventNum < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tool::Logging(myName_.c_str(), "epoll wait fails: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < eventNum && !done_; i++) {
+            SSL* clientSSL = (SSL*)eventList[i].data.ptr;
+            if (clientSSL == NULL) {
+                // new connections from the accept threads
+                while (read(handshakeThread->wakeFd, &wakeSignal, sizeof(wakeSignal)) > 0) {
+                    ;
+                }
+                this->AddNewConns(handshakeThread);
+                continue;
+            }
+            this->DoHandshake(handshakeThread, clientSSL);
+        }
+
+        if (handshakeTimeoutMs_ != 0
+            && tool::GetMonotonicMs() - handshakeThread->lastCheckTime >= (uint64_t)HANDSHAKE_CHECK_MS) {
+            this->DropExpiredConns(handshakeThread);
+        }
+    }
+    return;
+}
+
+/**
+ * @brief drop the connections over the handshake deadline
+ *
+ * @param handshakeThread the current handshake thread
+ */
+void SSLAcceptor::DropExpiredConns(HandshakeThread_t* handshakeThread)
+{
+    uint64_t nowTime = tool::GetMonotonicMs();
+    handshakeThread->lastCheckTime = nowTime;
+    auto it = handshakeThread->connMap.begin();
+    while (it != handshakeThread->connMap.end()) {
+        if (nowTime - it->second < handshakeTimeoutMs_) {
+            it++;
+            continue;
+        }
+        // an idle or a too slow client only holds its slot until the deadline
+        SSL* clientSSL = it->first;
+        epoll_ctl(handshakeThread->epollFd, EPOLL_CTL_DEL, SSL_get_fd(clientSSL), NULL);
+        it = handshakeThread->connMap.erase(it);
+        handshakeFailNum_++;
+        serverChannel_->ClearAcceptedClientSd(clientSSL);
+    }
+    return;
+}
+
+/**
+ * @brief register the new connections handed over by the accept threads
+ *
+ * @param handshakeThread the current handshake thread
+ */
+void SSLAcceptor::AddNewConns(HandshakeThread_t* handshakeThread)
+{
+    vector<pair<SSL*, uint64_t>> newConnList;
+    {
+        lock_guard<mutex> lock(handshakeThread->newConnLck);
+        newConnList.swap(handshakeThread->newConnList);
+    }
+
+    for (auto& newConn : newConnList) {
+        SSL* clientSSL = newConn.first;
+        struct epoll_event connEvent;
+        connEvent.events = EPOLLIN;
+        connEvent.data.ptr = clientSSL;
+        if (epoll_ctl(handshakeThread->epollFd, EPOLL_CTL_ADD, SSL_get_fd(clientSSL),
+                &connEvent)
+            < 0) {
+            tool::Logging(myName_.c_str(), "cannot add the connection: %s\n", strerror(errno));
+            handshakeFailNum_++;
+            serverChannel_->ClearAcceptedClientSd(clientSSL);
+            continue;
+        }
+        handshakeThread->connMap[clientSSL] = newConn.second;
+        // the client hello may be already in the socket
+        this->DoHandshake(handshakeThread, clientSSL);
+    }
+    return;
+}
+
+/**
+ * @brief continue the handshake of a connection
+ *
+ * @param handshakeThread the current handshake thread
+ * @param clientSSL the client ssl
+ */
+void SSLAcceptor::DoHandshake(HandshakeThread_t* handshakeThread, SSL* clientSSL)
+{
+    int clientFd = SSL_get_fd(clientSSL);
+    int ret = SSL_do_handshake(clientSSL);
+    if (ret != 1) {
+        int errorCode = SSL_get_error(clientSSL, ret);
+        if (errorCode == SSL_ERROR_WANT_READ || errorCode == SSL_ERROR_WANT_WRITE) {
+            struct epoll_event connEvent;
+            connEvent.events = (errorCode == SSL_ERROR_WANT_READ) ? EPOLLIN : EPOLLOUT;
+            connEvent.data.ptr = clientSSL;
+            if (epoll_ctl(handshakeThread->epollFd, EPOLL_CTL_MOD, clientFd, &connEvent) == 0) {
+                return;
+            }
+            tool::Logging(myName_.c_str(), "cannot update the connection: %s\n", strerror(errno));
+        } else {
+            // only drop this connection, the others are not affected
+            tool::Logging(myName_.c_str(), "accept the connection fails.\n");
+            ERR_print_errors_fp(stderr);
+        }
+        epoll_ctl(handshakeThread->epollFd, EPOLL_CTL_DEL, clientFd, NULL);
+        handshakeThread->connMap.erase(clientSSL);
+        handshakeFailNum_++;
+        serverChannel_->ClearAcceptedClientSd(clientSSL);
+        return;
+    }
+
+    epoll_ctl(handshakeThread->epollFd, EPOLL_CTL_DEL, clientFd, NULL);
+    handshakeThread->connMap.erase(clientSSL);
+    if (SSL_session_reused(clientSSL)) {
+        resumedHandshakeNum_++;
+    } else {
+        fullHandshakeNum_++;
+    }
+
+    // hand over a blocking connection, the session owner decides its io mode
+    int flags = fcntl(clientFd, F_GETFL, 0);
+    if (flags < 0 || fcntl(clientFd, F_SETFL, flags & ~O_NONBLOCK) < 0) {
+        tool::Logging(myName_.c_str(), "cannot set the connection blocking: %s\n",
+            strerror(errno));
+        serverChannel_->ClearAcceptedClientSd(clientSSL);
+        return;
+    }
+    sessionHandler_(clientSSL);
+    return;
+}
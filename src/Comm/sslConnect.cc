@@ -23,7 +23,6 @@ SSLConnection::SSLConnection(string ip, int port, int type)
 
     serverIP_ = ip;
     port_ = port;
-    listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
 
     // init the SSL lib
     SSL_library_init();
@@ -39,7 +38,6 @@ SSLConnection::SSLConnection(string ip, int port, int type)
     string caFileStr;
 
     caFileStr.assign(CA_CERT);
-    int enable = 1;
     switch (type) {
     case IN_SERVERSIDE:
         sslCtx_ = SSL_CTX_new(TLS_server_method());
@@ -47,25 +45,22 @@ SSLConnection::SSLConnection(string ip, int port, int type)
         SSL_CTX_set_mode(sslCtx_, SSL_MODE_AUTO_RETRY); // handle for multiple time hand shakes
         keyFileStr.assign(SERVER_KEY);
         crtFileStr.assign(SERVER_CERT);
-        socketAddr_.sin_addr.s_addr = htons(INADDR_ANY);
-        if (setsockopt(listenFd_, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0) {
-            tool::Logging(myName_.c_str(), "cannot set the port reusable.\n");
-            exit(EXIT_FAILURE);
-        }
-        if (bind(listenFd_, (struct sockaddr*)&socketAddr_, sizeof(socketAddr_)) == -1) {
-            tool::Logging(myName_.c_str(), "cannot not bind to socketFd\n"
-                                           "\tMay cause by shutdown server before client\n"
-                                           "\tWait for 1 min and try again\n");
-            tool::Logging(myName_.c_str(), "%s\n", strerror(errno));
-            exit(EXIT_FAILURE);
-        }
-        if (listen(listenFd_, 10) == -1) {
-            tool::Logging(myName_.c_str(), "cannot listen this socket.\n");
-            tool::Logging(myName_.c_str(), "%s\n", strerror(errno));
-            exit(EXIT_FAILURE);
+        this->InitSessionResumption();
+        // fetch the following records with the same read syscall
+        SSL_CTX_set_read_ahead(sslCtx_, 1);
+        if (config.GetEnableKTLS()) {
+#ifdef SSL_OP_ENABLE_KTLS
+            // openssl falls back to the user space if the kernel cannot take the cipher
+            SSL_CTX_set_options(sslCtx_, SSL_OP_ENABLE_KTLS);
+#else
+            tool::Logging(myName_.c_str(), "kernel TLS is not supported by this openssl.\n");
+#endif
         }
+        socketAddr_.sin_addr.s_addr = htons(INADDR_ANY);
+        listenFd_ = this->InitListenFd();
         break;
     case IN_CLIENTSIDE:
+        listenFd_ = socket(AF_INET, SOCK_STREAM, 0);
         sslCtx_ = SSL_CTX_new(TLS_client_method());
         keyFileStr.assign(CLIENT_KEY);
         crtFileStr.assign(CLIENT_CERT);
@@ -114,6 +109,67 @@ SSLConnection::SSLConnection(string ip, int port, int type)
     }
 }
 
+/**
+ * @brief enable the session resumption of the server ctx, a reconnecting
+ * edge resumes with a session ticket (stateless) or the session cache
+ *
+ */
+void SSLConnection::InitSessionResumption()
+{
+    uint32_t cacheSize = config.GetSessionCacheSize();
+    if (cacheSize == 0) {
+        SSL_CTX_set_session_cache_mode(sslCtx_, SSL_SESS_CACHE_OFF);
+        SSL_CTX_set_options(sslCtx_, SSL_OP_NO_TICKET);
+        return;
+    }
+
+    // the id context is mandatory to resume the sessions with client certificates
+    if (!SSL_CTX_set_session_id_context(sslCtx_, (const uint8_t*)SSL_SESSION_ID_CONTEXT,
+            strlen(SSL_SESSION_ID_CONTEXT))) {
+        tool::Logging(myName_.c_str(), "set the session id context error.\n");
+        ERR_print_errors_fp(stderr);
+        exit(EXIT_FAILURE);
+    }
+    SSL_CTX_set_session_cache_mode(sslCtx_, SSL_SESS_CACHE_SERVER);
+    SSL_CTX_sess_set_cache_size(sslCtx_, cacheSize);
+    SSL_CTX_set_timeout(sslCtx_, config.GetSessionTimeout());
+    SSL_CTX_clear_options(sslCtx_, SSL_OP_NO_TICKET);
+    return;
+}
+
+/**
+ * @brief init a listen socket on the server port, the port is shared
+ * (SO_REUSEPORT) so that each accept thread can own a listen socket
+ *
+ * @return int the listen fd
+ */
+int SSLConnection::InitListenFd()
+{
+    int listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int enable = 1;
+    if (setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &enable, sizeof(int)) < 0) {
+        tool::Logging(myName_.c_str(), "cannot set the port reusable.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (setsockopt(listenFd, SOL_SOCKET, SO_REUSEPORT, &enable, sizeof(int)) < 0) {
+        tool::Logging(myName_.c_str(), "cannot set the port shareable.\n");
+        exit(EXIT_FAILURE);
+    }
+    if (bind(listenFd, (struct sockaddr*)&socketAddr_, sizeof(socketAddr_)) == -1) {
+        tool::Logging(myName_.c_str(), "cannot not bind to socketFd\n"
+                                       "\tMay cause by shutdown server before client\n"
+                                       "\tWait for 1 min and try again\n");
+        tool::Logging(myName_.c_str(), "%s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    if (listen(listenFd, config.GetListenBacklog()) == -1) {
+        tool::Logging(myName_.c_str(), "cannot listen this socket.\n");
+        tool::Logging(myName_.c_str(), "%s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return listenFd;
+}
+
 /**
  * @brief Destroy the SSLConnection object
  *
@@ -242,6 +298,25 @@ pair<int, SSL*> SSLConnection::ListenSSL()
     return make_pair(socketFd, sslConnectionPtr);
 }
 
+/**
+ * @brief create the server-side SSL of an accepted socket, the handshake is
+ * left to the caller
+ *
+ * @param socketFd the accepted socket
+ * @return SSL* the SSL of the connection
+ */
+SSL* SSLConnection::InitAcceptedSSL(int socketFd)
+{
+    SSL* sslConnectionPtr = SSL_new(sslCtx_);
+    if (!SSL_set_fd(sslConnectionPtr, socketFd)) {
+        tool::Logging(myName_.c_str(), "cannot combine the fd and ssl.\n");
+        ERR_print_errors_fp(stderr);
+        exit(EXIT_FAILURE);
+    }
+    SSL_set_accept_state(sslConnectionPtr);
+    return sslConnectionPtr;
+}
+
 /**
  * @brief send the data to the given connection
  *
@@ -253,19 +328,272 @@ pair<int, SSL*> SSLConnection::ListenSSL()
  */
 bool SSLConnection::SendData(SSL* connection, uint8_t* data, uint32_t dataSize)
 {
-    int writeStatus;
-    writeStatus = SSL_write(connection, (char*)&dataSize, sizeof(uint32_t));
-    if (writeStatus <= 0) {
-        tool::Logging(myName_.c_str(), "write the data fails. ret: %d\n", SSL_get_error(connection, writeStatus));
-        ERR_print_errors_fp(stderr);
+    SSLSessionState_t* sessionState = (SSLSessionState_t*)SSL_get_app_data(connection);
+    if (sessionState != NULL) {
+        // non-blocking connection: queue the message and flush as much as possible
+        vector<uint8_t>& sendBuffer = sessionState->sendBuffer;
+        sendBuffer.insert(sendBuffer.end(), (uint8_t*)&dataSize,
+            (uint8_t*)&dataSize + sizeof(uint32_t));
+        sendBuffer.insert(sendBuffer.end(), data, data + dataSize);
+        if (sessionState->corked
+            && sendBuffer.size() - sessionState->sendOffset < SSL_FRAME_SIZE) {
+            return true;
+        }
+        return (this->FlushData(connection) != SSL_IO_FAIL);
+    }
+
+    SSLFrameBuffer_t* frameBuf = this->GetFrameBuffer(connection);
+    vector<uint8_t>& buffer = frameBuf->buffer;
+    if (buffer.size() + sizeof(uint32_t) + dataSize <= SSL_FRAME_SIZE) {
+        // the message fits in the current record
+        buffer.insert(buffer.end(), (uint8_t*)&dataSize, (uint8_t*)&dataSize + sizeof(uint32_t));
+        buffer.insert(buffer.end(), data, data + dataSize);
+        if (frameBuf->corked) {
+            return true;
+        }
+        bool writeStatus = this->WriteAll(connection, buffer.data(), buffer.size());
+        buffer.clear();
+        return writeStatus;
+    }
+
+    // a large message: fill the current record with the length and the head
+    // of the payload, the remaining payload is written directly
+    buffer.insert(buffer.end(), (uint8_t*)&dataSize, (uint8_t*)&dataSize + sizeof(uint32_t));
+    uint32_t headSize = 0;
+    if (buffer.size() < SSL_FRAME_SIZE) {
+        headSize = min(dataSize, (uint32_t)(SSL_FRAME_SIZE - buffer.size()));
+        buffer.insert(buffer.end(), data, data + headSize);
+    }
+    bool writeStatus = this->WriteAll(connection, buffer.data(), buffer.size());
+    buffer.clear();
+    if (!writeStatus) {
+        return false;
+    }
+    return this->WriteAll(connection, data + headSize, dataSize - headSize);
+}
+
+/**
+ * @brief start to batch the following messages of the connection, the
+ * small messages are coalesced into one record until UncorkData
+ *
+ * @param connection the pointer to the connection
+ */
+void SSLConnection::CorkData(SSL* connection)
+{
+    SSLSessionState_t* sessionState = (SSLSessionState_t*)SSL_get_app_data(connection);
+    if (sessionState != NULL) {
+        sessionState->corked = true;
+        return;
+    }
+    this->GetFrameBuffer(connection)->corked = true;
+    return;
+}
+
+/**
+ * @brief stop batching and write the batched messages of the connection
+ *
+ * @param connection the pointer to the connection
+ * @return true success
+ * @return false fail
+ */
+bool SSLConnection::UncorkData(SSL* connection)
+{
+    SSLSessionState_t* sessionState = (SSLSessionState_t*)SSL_get_app_data(connection);
+    if (sessionState != NULL) {
+        sessionState->corked = false;
+        return (this->FlushData(connection) != SSL_IO_FAIL);
+    }
+
+    SSLFrameBuffer_t* frameBuf = this->GetFrameBuffer(connection);
+    frameBuf->corked = false;
+    if (frameBuf->buffer.empty()) {
+        return true;
+    }
+    bool writeStatus = this->WriteAll(connection, frameBuf->buffer.data(),
+        frameBuf->buffer.size());
+    frameBuf->buffer.clear();
+    return writeStatus;
+}
+
+/**
+ * @brief check whether the connection sends through kernel TLS, only
+ * for the blocking connections
+ *
+ * @param connection the pointer to the connection
+ * @return true the record layer of the send side is in the kernel
+ * @return false otherwise
+ */
+bool SSLConnection::IsKernelTLSSend(SSL* connection)
+{
+#if !defined(OPENSSL_NO_KTLS) && OPENSSL_VERSION_NUMBER >= 0x30000000L
+    if (SSL_get_app_data(connection) != NULL) {
+        // the non-blocking sessions keep the buffered output
         return false;
     }
+    return BIO_get_ktls_send(SSL_get_wbio(connection));
+#else
+    return false;
+#endif
+}
 
-    int sendedSize = 0;
+/**
+ * @brief send the data without the length prefix (the caller frames the
+ * message), the data is batched with the following SendFileData
+ *
+ * @param connection the pointer to the connection
+ * @param data the pointer to the data buffer
+ * @param dataSize the size of the data
+ * @return true success
+ * @return false fail
+ */
+bool SSLConnection::SendRawData(SSL* connection, uint8_t* data, uint32_t dataSize)
+{
+    vector<uint8_t>& buffer = this->GetFrameBuffer(connection)->buffer;
+    buffer.insert(buffer.end(), data, data + dataSize);
+    if (buffer.size() < SSL_FRAME_SIZE) {
+        return true;
+    }
+    bool writeStatus = this->WriteAll(connection, buffer.data(), buffer.size());
+    buffer.clear();
+    return writeStatus;
+}
+
+/**
+ * @brief send a range of a file through kernel TLS without copying it to
+ * the user space
+ *
+ * @param connection the pointer to the connection
+ * @param fileFd the file
+ * @param offset the offset of the range
+ * @param size the size of the range
+ * @return true success
+ * @return false fail
+ */
+bool SSLConnection::SendFileData(SSL* connection, int fileFd, off_t offset, size_t size)
+{
+#if !defined(OPENSSL_NO_KTLS) && OPENSSL_VERSION_NUMBER >= 0x30000000L
+    // step-1: the batched bytes go first, the kernel keeps the record open
+    // (MSG_MORE) so that they share the record with the file data
+    vector<uint8_t>& buffer = this->GetFrameBuffer(connection)->buffer;
+    int socketFd = SSL_get_fd(connection);
+    size_t sendedSize = 0;
+    while (sendedSize < buffer.size()) {
+        ssize_t ret = send(socketFd, buffer.data() + sendedSize, buffer.size() - sendedSize,
+            MSG_MORE);
+        if (ret < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tool::Logging(myName_.c_str(), "write the data fails: %s\n", strerror(errno));
+            return false;
+        }
+        sendedSize += ret;
+    }
+    buffer.clear();
+
+    // step-2: the file range
+    sendedSize = 0;
+    while (sendedSize < size) {
+        ossl_ssize_t ret = SSL_sendfile(connection, fileFd, offset + sendedSize,
+            size - sendedSize, 0);
+        if (ret <= 0) {
+            tool::Logging(myName_.c_str(), "sendfile fails. ret: %d\n",
+                SSL_get_error(connection, ret));
+            ERR_print_errors_fp(stderr);
+            return false;
+        }
+        sendedSize += ret;
+    }
+    return true;
+#else
+    tool::Logging(myName_.c_str(), "kernel TLS is not supported by this openssl.\n");
+    return false;
+#endif
+}
+
+/**
+ * @brief Get the frame buffer of a blocking connection (create it if not exist)
+ *
+ * @param connection the pointer to the connection
+ * @return SSLFrameBuffer_t* the frame buffer, released with the connection
+ */
+SSLFrameBuffer_t* SSLConnection::GetFrameBuffer(SSL* connection)
+{
+    static int frameBufIdx = SSL_get_ex_new_index(0, NULL, NULL, NULL,
+        SSLConnection::FreeFrameBuffer);
+    SSLFrameBuffer_t* frameBuf = (SSLFrameBuffer_t*)SSL_get_ex_data(connection, frameBufIdx);
+    if (frameBuf == NULL) {
+        frameBuf = new SSLFrameBuffer_t();
+        frameBuf->buffer.reserve(SSL_FRAME_SIZE);
+        frameBuf->corked = false;
+        SSL_set_ex_data(connection, frameBufIdx, frameBuf);
+    }
+    return frameBuf;
+}
+
+/**
+ * @brief free the frame buffer when its connection is freed
+ *
+ */
+void SSLConnection::FreeFrameBuffer(void* parent, void* ptr, CRYPTO_EX_DATA* ad,
+    int idx, long argl, void* argp)
+{
+    delete (SSLFrameBuffer_t*)ptr;
+    return;
+}
+
+/**
+ * @brief write the whole buffer to a blocking connection
+ *
+ * @param connection the pointer to the connection
+ * @param data the pointer to the data buffer
+ * @param dataSize the size of the data
+ * @return true success
+ * @return false fail
+ */
+bool SSLConnection::WriteAll(SSL* connection, uint8_t* data, size_t dataSize)
+{
+    size_t sendedSize = 0;
+    int writeStatus;
     while (sendedSize < dataSize) {
-        sendedSize += SSL_write(connection, data + sendedSize, dataSize - sendedSize);
+        writeStatus = SSL_write(connection, data + sendedSize, dataSize - sendedSize);
+        if (writeStatus <= 0) {
+            tool::Logging(myName_.c_str(), "write the data fails. ret: %d\n",
+                SSL_get_error(connection, writeStatus));
+            ERR_print_errors_fp(stderr);
+            return false;
+        }
+        sendedSize += writeStatus;
     }
+    return true;
+}
 
+/**
+ * @brief read the given size of data from a blocking connection
+ *
+ * @param connection the pointer to the connection
+ * @param data the pointer to the data buffer
+ * @param dataSize the size of the data
+ * @return true success
+ * @return false fail
+ */
+bool SSLConnection::ReadAll(SSL* connection, uint8_t* data, size_t dataSize)
+{
+    size_t receivedSize = 0;
+    int readStatus;
+    while (receivedSize < dataSize) {
+        readStatus = SSL_read(connection, data + receivedSize, dataSize - receivedSize);
+        if (readStatus <= 0) {
+            if (SSL_get_error(connection, readStatus) == SSL_ERROR_ZERO_RETURN) {
+                // tool::Logging(myName_.c_str(), "TLS/SSL peer has closed the connection.\n");
+                //  also close this connection
+                SSL_shutdown(connection);
+            }
+            ERR_print_errors_fp(stderr);
+            return false;
+        }
+        receivedSize += readStatus;
+    }
     return true;
 }
 
@@ -280,27 +608,152 @@ bool SSLConnection::SendData(SSL* connection, uint8_t* data, uint32_t dataSize)
  */
 bool SSLConnection::ReceiveData(SSL* connection, uint8_t* data, uint32_t& receiveDataSize)
 {
-    int receivedSize = 0;
+    // the length may cross two records when the peer batches the messages
     int len = 0;
-    int readStatus;
-    readStatus = SSL_read(connection, (char*)&len, sizeof(int));
-    if (readStatus <= 0) {
-        if (SSL_get_error(connection, readStatus) == SSL_ERROR_ZERO_RETURN) {
-            // tool::Logging(myName_.c_str(), "TLS/SSL peer has closed the connection.\n");
-            //  also close this connection
-            SSL_shutdown(connection);
-        }
-        ERR_print_errors_fp(stderr);
+    if (!this->ReadAll(connection, (uint8_t*)&len, sizeof(int))) {
         return false;
     }
-
-    while (receivedSize < len) {
-        receivedSize += SSL_read(connection, data + receivedSize, len - receivedSize);
+    if (len < 0 || !this->ReadAll(connection, data, len)) {
+        return false;
     }
     receiveDataSize = len;
     return true;
 }
 
+/**
+ * @brief switch the connection to the non-blocking mode, the following
+ * SendData only appends the message to the session state
+ *
+ * @param connection the pointer to the connection
+ * @param sessionState the state of the session (owned by the caller)
+ * @return true success
+ * @return false fail
+ */
+bool SSLConnection::SetNonBlocking(SSL* connection, SSLSessionState_t* sessionState)
+{
+    int fd = SSL_get_fd(connection);
+    int flags = fcntl(fd, F_GETFL, 0);
+    if (flags < 0 || fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0) {
+        tool::Logging(myName_.c_str(), "cannot set the socket non-blocking: %s\n",
+            strerror(errno));
+        return false;
+    }
+
+    sessionState->recvLen = 0;
+    sessionState->recvHeadSize = 0;
+    sessionState->recvDataSize = 0;
+    sessionState->sendBuffer.clear();
+    sessionState->sendOffset = 0;
+    sessionState->corked = false;
+
+    // the send buffer can grow between two retries of the same write
+    SSL_set_mode(connection, SSL_MODE_ENABLE_PARTIAL_WRITE | SSL_MODE_ACCEPT_MOVING_WRITE_BUFFER);
+    SSL_clear_mode(connection, SSL_MODE_AUTO_RETRY);
+    SSL_set_app_data(connection, sessionState);
+    return true;
+}
+
+/**
+ * @brief try to receive a message from a non-blocking connection
+ *
+ * @param connection the pointer to the connection
+ * @param data the pointer to the data buffer
+ * @param receiveDataSize the size of received data
+ * @return int SSL_IO_DONE: a message is ready, SSL_IO_WANT: wait for more
+ * data, SSL_IO_FAIL: the connection is closed
+ */
+int SSLConnection::TryReceiveData(SSL* connection, uint8_t* data, uint32_t& receiveDataSize)
+{
+    SSLSessionState_t* sessionState = (SSLSessionState_t*)SSL_get_app_data(connection);
+    int readStatus;
+
+    // step-1: the length of the message
+    while (sessionState->recvHeadSize < sizeof(int)) {
+        readStatus = SSL_read(connection, (uint8_t*)&sessionState->recvLen + sessionState->recvHeadSize,
+            sizeof(int) - sessionState->recvHeadSize);
+        if (readStatus <= 0) {
+            int errorCode = SSL_get_error(connection, readStatus);
+            if (errorCode == SSL_ERROR_WANT_READ || errorCode == SSL_ERROR_WANT_WRITE) {
+                return SSL_IO_WANT;
+            }
+            if (errorCode == SSL_ERROR_ZERO_RETURN) {
+                SSL_shutdown(connection);
+            }
+            ERR_clear_error();
+            return SSL_IO_FAIL;
+        }
+        sessionState->recvHeadSize += readStatus;
+    }
+
+    // step-2: the message body
+    while (sessionState->recvDataSize < (uint32_t)sessionState->recvLen) {
+        readStatus = SSL_read(connection, data + sessionState->recvDataSize,
+            sessionState->recvLen - sessionState->recvDataSize);
+        if (readStatus <= 0) {
+            int errorCode = SSL_get_error(connection, readStatus);
+            if (errorCode == SSL_ERROR_WANT_READ || errorCode == SSL_ERROR_WANT_WRITE) {
+                return SSL_IO_WANT;
+            }
+            ERR_clear_error();
+            return SSL_IO_FAIL;
+        }
+        sessionState->recvDataSize += readStatus;
+    }
+
+    receiveDataSize = sessionState->recvLen;
+    sessionState->recvLen = 0;
+    sessionState->recvHeadSize = 0;
+    sessionState->recvDataSize = 0;
+    return SSL_IO_DONE;
+}
+
+/**
+ * @brief flush the pending output of a non-blocking connection
+ *
+ * @param connection the pointer to the connection
+ * @return int SSL_IO_DONE: all flushed, SSL_IO_WANT: wait for writable,
+ * SSL_IO_FAIL: the connection is broken
+ */
+int SSLConnection::FlushData(SSL* connection)
+{
+    SSLSessionState_t* sessionState = (SSLSessionState_t*)SSL_get_app_data(connection);
+    vector<uint8_t>& sendBuffer = sessionState->sendBuffer;
+    int writeStatus;
+    while (sessionState->sendOffset < sendBuffer.size()) {
+        writeStatus = SSL_write(connection, &sendBuffer[sessionState->sendOffset],
+            sendBuffer.size() - sessionState->sendOffset);
+        if (writeStatus <= 0) {
+            int errorCode = SSL_get_error(connection, writeStatus);
+            if (errorCode == SSL_ERROR_WANT_READ || errorCode == SSL_ERROR_WANT_WRITE) {
+                return SSL_IO_WANT;
+            }
+            tool::Logging(myName_.c_str(), "write the data fails. ret: %d\n", errorCode);
+            ERR_print_errors_fp(stderr);
+            return SSL_IO_FAIL;
+        }
+        sessionState->sendOffset += writeStatus;
+    }
+    sendBuffer.clear();
+    sessionState->sendOffset = 0;
+    return SSL_IO_DONE;
+}
+
+/**
+ * @brief check whether a non-blocking connection has pending output
+ *
+ * @param connection the pointer to the connection
+ * @return true has pending output
+ * @return false no pending output
+ */
+bool SSLConnection::HasPendingData(SSL* connection)
+{
+    SSLSessionState_t* sessionState = (SSLSessionState_t*)SSL_get_app_data(connection);
+    if (sessionState == NULL) {
+        return false;
+    }
+    return (sessionState->sendOffset < sessionState->sendBuffer.size());
+}
+
 /**
  * @brief Get the Client Ip object
  *
@@ -19,3 +19,54 @@ AbsDatabase::AbsDatabase()
 {
     // fprintf(stderr, "AbsDatabase: Initial an abstract database.\n");
 }
+
+
+/**
+ * @brief query a batch of keys of the same size
+ *
+ * @param keyList the keys (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param valueList the values of the found keys (valueSize bytes each, NULL: not needed)
+ * @param valueSize the value size
+ * @param foundList whether each key is found (1: found, 0: not found)
+ * @return uint32_t the number of found keys
+ */
+uint32_t AbsDatabase::MultiQuery(const char* keyList, uint32_t keyNum, size_t keySize,
+    char* valueList, size_t valueSize, uint8_t* foundList)
+{
+    uint32_t foundNum = 0;
+    string value;
+    for (size_t i = 0; i < keyNum; i++) {
+        foundList[i] = this->QueryBuffer(keyList + i * keySize, keySize, value);
+        if (foundList[i]) {
+            if (valueList != NULL) {
+                memcpy(valueList + i * valueSize, value.c_str(), min(valueSize, value.size()));
+            }
+            foundNum++;
+        }
+    }
+    return foundNum;
+}
+
+/**
+ * @brief insert a batch of (key, value) pairs of the same size
+ *
+ * @param keyList the keys (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param valueList the values (valueSize bytes each)
+ * @param valueSize the value size
+ * @return true success
+ * @return false fail
+ */
+bool AbsDatabase::MultiInsert(const char* keyList, uint32_t keyNum, size_t keySize,
+    const char* valueList, size_t valueSize)
+{
+    bool status = true;
+    for (size_t i = 0; i < keyNum; i++) {
+        status &= this->InsertBothBuffer(keyList + i * keySize, keySize,
+            valueList + i * valueSize, valueSize);
+    }
+    return status;
+}
\ No newline at end of file
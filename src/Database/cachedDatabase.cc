@@ -0,0 +1,467 @@
+/**
+ * @file cachedDatabase.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement the interface of the index on leveldb with an in-memory cache
+ * @version 0.1
+ * @date 2022-07-02
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/cachedDatabase.h"
+
+extern Configure config;
+
+/**
+ * @brief Construct a new Cached Database object
+ *
+ * @param dbName the path of the db
+ */
+CachedDatabase::CachedDatabase(std::string dbName)
+{
+    queryNum_ = 0;
+    batchNum_ = 0;
+    cacheHitNum_ = 0;
+    filterSkipNum_ = 0;
+    bufferHitNum_ = 0;
+    diskReadNum_ = 0;
+    diskHitNum_ = 0;
+
+    // split the memory between the cache and the filter
+    uint64_t memorySize = max(config.GetIndexCacheMiB(), (uint64_t)1) * MiB_2_B;
+    uint64_t filterSize = memorySize / INDEX_CACHE_FILTER_SHARE;
+    uint64_t shardKeyNum = (memorySize - filterSize) / INDEX_CACHE_ENTRY_SIZE / INDEX_SHARD_NUM;
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        cacheList_[i] = new PairCache_t(max(shardKeyNum, (uint64_t)1));
+    }
+    filterBitNum_ = filterSize * 8;
+    filterBitArray_ = new uint8_t[filterSize];
+    memset(filterBitArray_, 0, filterSize);
+
+    this->OpenDB(dbName);
+}
+
+/**
+ * @brief Destroy the Cached Database object
+ *
+ */
+CachedDatabase::~CachedDatabase()
+{
+    this->Flush();
+    this->SaveFilter();
+    delete diskDB_;
+
+    uint64_t cacheKeyNum = 0;
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        cacheKeyNum += cacheList_[i]->size();
+        delete cacheList_[i];
+    }
+    delete[] filterBitArray_;
+
+    uint64_t queryNum = queryNum_.load();
+    uint64_t diskReadNum = diskReadNum_.load();
+    fprintf(stderr, "========CachedDatabase Info========\n");
+    fprintf(stderr, "cached key num: %lu\n", cacheKeyNum);
+    fprintf(stderr, "filter size (MiB): %.2f\n", (double)filterBitNum_ / 8 / 1024 / 1024);
+    fprintf(stderr, "query num: %lu\n", queryNum);
+    fprintf(stderr, "cache hit num: %lu\n", cacheHitNum_.load());
+    fprintf(stderr, "filter skip num: %lu\n", filterSkipNum_.load());
+    fprintf(stderr, "buffer hit num: %lu\n", bufferHitNum_.load());
+    fprintf(stderr, "disk read num: %lu\n", diskReadNum);
+    fprintf(stderr, "disk hit num: %lu\n", diskHitNum_.load());
+    fprintf(stderr, "cache hit ratio: %.4f\n",
+        queryNum == 0 ? 0 : (double)cacheHitNum_.load() / queryNum);
+    fprintf(stderr, "disk read ratio: %.4f\n", queryNum == 0 ? 0 : (double)diskReadNum / queryNum);
+    fprintf(stderr, "disk reads saved per batch: %.2f\n",
+        batchNum_.load() == 0 ? 0 : (double)(queryNum - diskReadNum) / batchNum_.load());
+    fprintf(stderr, "write-back num: %lu\n", flushNum_);
+    fprintf(stderr, "===================================\n");
+}
+
+/**
+ * @brief open a database
+ *
+ * @param dbName the db path
+ * @return true success
+ * @return false fail
+ */
+bool CachedDatabase::OpenDB(std::string dbName)
+{
+    dbName_ = dbName;
+    diskDB_ = new LeveldbDatabase(dbName_);
+    this->LoadFilter();
+    return true;
+}
+
+/**
+ * @brief add a key to the filter
+ *
+ * @param key the key
+ * @param keySize the key size
+ */
+void CachedDatabase::AddToFilter(const char* key, size_t keySize)
+{
+    uint64_t hash1;
+    uint64_t hash2;
+    this->GetFilterHash(key, keySize, hash1, hash2);
+    for (size_t i = 0; i < INDEX_CACHE_HASH_NUM; i++) {
+        uint64_t bitPos = (hash1 + i * hash2) % filterBitNum_;
+        __atomic_fetch_or(&filterBitArray_[bitPos >> 3], (uint8_t)(1 << (bitPos & 0x7)),
+            __ATOMIC_RELAXED);
+    }
+    return;
+}
+
+/**
+ * @brief check whether a key may be in the index
+ *
+ * @param key the key
+ * @param keySize the key size
+ * @return true it may be in the index
+ * @return false it is not in the index
+ */
+bool CachedDatabase::MayContain(const char* key, size_t keySize)
+{
+    uint64_t hash1;
+    uint64_t hash2;
+    this->GetFilterHash(key, keySize, hash1, hash2);
+    for (size_t i = 0; i < INDEX_CACHE_HASH_NUM; i++) {
+        uint64_t bitPos = (hash1 + i * hash2) % filterBitNum_;
+        if ((__atomic_load_n(&filterBitArray_[bitPos >> 3], __ATOMIC_RELAXED)
+                & (1 << (bitPos & 0x7)))
+            == 0) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief load the filter saved on exit, or rebuild it from leveldb
+ *
+ */
+void CachedDatabase::LoadFilter()
+{
+    string filterName = dbName_ + "-filter";
+    ifstream filterFile;
+    filterFile.open(filterName, ios_base::in | ios_base::binary);
+    uint64_t bitNum = 0;
+    bool status = false;
+    if (filterFile.is_open()) {
+        status = filterFile.read((char*)&bitNum, sizeof(bitNum)) && bitNum == filterBitNum_
+            && filterFile.read((char*)filterBitArray_, filterBitNum_ / 8);
+        filterFile.close();
+        // the file is stale once new keys are inserted, a crash rebuilds the filter
+        remove(filterName.c_str());
+    }
+    if (!status) {
+        memset(filterBitArray_, 0, filterBitNum_ / 8);
+        uint64_t keyNum = 0;
+        diskDB_->Traverse([this, &keyNum](const string& key, const string& value) {
+            this->AddToFilter(key.c_str(), key.size());
+            keyNum++;
+        });
+        tool::Logging(myName_.c_str(), "rebuild the filter with %lu keys.\n", keyNum);
+    }
+    return;
+}
+
+/**
+ * @brief save the filter for the next startup
+ *
+ */
+void CachedDatabase::SaveFilter()
+{
+    string filterName = dbName_ + "-filter";
+    ofstream filterFile;
+    filterFile.open(filterName, ios_base::trunc | ios_base::binary);
+    filterFile.write((char*)&filterBitNum_, sizeof(filterBitNum_));
+    filterFile.write((char*)filterBitArray_, filterBitNum_ / 8);
+    filterFile.close();
+    if (!filterFile) {
+        tool::Logging(myName_.c_str(), "cannot save the filter.\n");
+        remove(filterName.c_str());
+    }
+    return;
+}
+
+/**
+ * @brief write the buffered new pairs to leveldb with one write batch
+ *
+ * @return true success
+ * @return false fail
+ */
+bool CachedDatabase::Flush()
+{
+    lock_guard<mutex> flushLock(flushLck_);
+    {
+        lock_guard<mutex> lock(bufLck_);
+        if (dirtyBuf_.empty()) {
+            return true;
+        }
+        flushingBuf_.swap(dirtyBuf_);
+    }
+
+    // the queries still find the pairs in flushingBuf_ until they are in leveldb
+    leveldb::WriteBatch writeBatch;
+    for (auto& it : flushingBuf_) {
+        writeBatch.Put(it.first, it.second);
+    }
+    bool status = diskDB_->Write(&writeBatch);
+    if (!status) {
+        tool::Logging(myName_.c_str(), "cannot write back %lu pairs.\n", flushingBuf_.size());
+    }
+    {
+        lock_guard<mutex> lock(bufLck_);
+        flushingBuf_.clear();
+    }
+    flushNum_++;
+    return status;
+}
+
+/**
+ * @brief execute query over database
+ *
+ * @param key key
+ * @param value value
+ * @return true success
+ * @return false fail
+ */
+bool CachedDatabase::Query(const std::string& key, std::string& value)
+{
+    return this->QueryBuffer(key.c_str(), key.size(), value);
+}
+
+/**
+ * @brief insert the (key, value) pair
+ *
+ * @param key key
+ * @param value value
+ * @return true success
+ * @return false fail
+ */
+bool CachedDatabase::Insert(const std::string& key, const std::string& value)
+{
+    return this->MultiInsert(key.c_str(), 1, key.size(), value.c_str(), value.size());
+}
+
+/**
+ * @brief insert the (key, value) pair
+ *
+ * @param key
+ * @param buffer
+ * @param bufferSize
+ * @return true
+ * @return false
+ */
+bool CachedDatabase::InsertBuffer(const std::string& key, const char* buffer, size_t bufferSize)
+{
+    return this->MultiInsert(key.c_str(), 1, key.size(), buffer, bufferSize);
+}
+
+/**
+ * @brief insert the (key, value) pair
+ *
+ * @param key
+ * @param keySize
+ * @param buffer
+ * @param bufferSize
+ * @return true
+ * @return false
+ */
+bool CachedDatabase::InsertBothBuffer(const char* key, size_t keySize, const char* buffer,
+    size_t bufferSize)
+{
+    return this->MultiInsert(key, 1, keySize, buffer, bufferSize);
+}
+
+/**
+ * @brief query the (key, value) pair
+ *
+ * @param key
+ * @param keySize
+ * @param value
+ * @return true
+ * @return false
+ */
+bool CachedDatabase::QueryBuffer(const char* key, size_t keySize, std::string& value)
+{
+    string keyStr(key, keySize);
+    queryNum_++;
+    batchNum_++;
+    if (this->GetCache(keyStr)->tryGet(keyStr, value)) {
+        cacheHitNum_++;
+        return true;
+    }
+    if (!this->MayContain(key, keySize)) {
+        filterSkipNum_++;
+        return false;
+    }
+    {
+        lock_guard<mutex> lock(bufLck_);
+        auto findResult = dirtyBuf_.find(keyStr);
+        bool isFound = (findResult != dirtyBuf_.end());
+        if (!isFound) {
+            findResult = flushingBuf_.find(keyStr);
+            isFound = (findResult != flushingBuf_.end());
+        }
+        if (isFound) {
+            value = findResult->second;
+            bufferHitNum_++;
+            return true;
+        }
+    }
+    diskReadNum_++;
+    if (!diskDB_->QueryBuffer(key, keySize, value)) {
+        return false;
+    }
+    diskHitNum_++;
+    this->GetCache(keyStr)->insert(keyStr, value);
+    return true;
+}
+
+/**
+ * @brief query a batch of keys of the same size, the keys missing the cache,
+ * the filter and the buffer read leveldb in one batch
+ *
+ * @param keyList the keys (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param valueList the values of the found keys (valueSize bytes each, NULL: not needed)
+ * @param valueSize the value size
+ * @param foundList whether each key is found (1: found, 0: not found)
+ * @return uint32_t the number of found keys
+ */
+uint32_t CachedDatabase::MultiQuery(const char* keyList, uint32_t keyNum, size_t keySize,
+    char* valueList, size_t valueSize, uint8_t* foundList)
+{
+    uint32_t foundNum = 0;
+    auto setFound = [&](uint32_t keyId, const string& value) {
+        if (valueList != NULL) {
+            memcpy(valueList + keyId * valueSize, value.c_str(), min(valueSize, value.size()));
+        }
+        foundList[keyId] = 1;
+        foundNum++;
+    };
+
+    // the cache, then the filter
+    string key;
+    string value;
+    vector<uint32_t> missList;
+    for (size_t i = 0; i < keyNum; i++) {
+        foundList[i] = 0;
+        key.assign(keyList + i * keySize, keySize);
+        if (this->GetCache(key)->tryGet(key, value)) {
+            cacheHitNum_++;
+            setFound(i, value);
+        } else if (!this->MayContain(key.c_str(), keySize)) {
+            filterSkipNum_++;
+        } else {
+            missList.push_back(i);
+        }
+    }
+
+    // the buffer, locked once
+    if (!missList.empty()) {
+        lock_guard<mutex> lock(bufLck_);
+        size_t remainNum = 0;
+        for (auto keyId : missList) {
+            key.assign(keyList + keyId * keySize, keySize);
+            auto findResult = dirtyBuf_.find(key);
+            bool isFound = (findResult != dirtyBuf_.end());
+            if (!isFound) {
+                findResult = flushingBuf_.find(key);
+                isFound = (findResult != flushingBuf_.end());
+            }
+            if (isFound) {
+                bufferHitNum_++;
+                setFound(keyId, findResult->second);
+            } else {
+                missList[remainNum++] = keyId;
+            }
+        }
+        missList.resize(remainNum);
+    }
+
+    // the rest read leveldb in one batch, the found pairs are cached
+    if (!missList.empty()) {
+        uint32_t missNum = missList.size();
+        vector<char> missKeyList(missNum * keySize);
+        vector<char> missValueList(missNum * valueSize);
+        vector<uint8_t> missFoundList(missNum);
+        for (size_t i = 0; i < missNum; i++) {
+            memcpy(missKeyList.data() + i * keySize, keyList + missList[i] * keySize, keySize);
+        }
+        diskReadNum_ += missNum;
+        diskHitNum_ += diskDB_->MultiQuery(missKeyList.data(), missNum, keySize,
+            missValueList.data(), valueSize, missFoundList.data());
+        for (size_t i = 0; i < missNum; i++) {
+            if (missFoundList[i]) {
+                key.assign(missKeyList.data() + i * keySize, keySize);
+                value.assign(missValueList.data() + i * valueSize, valueSize);
+                this->GetCache(key)->insert(key, value);
+                setFound(missList[i], value);
+            }
+        }
+    }
+    queryNum_ += keyNum;
+    batchNum_++;
+    return foundNum;
+}
+
+/**
+ * @brief insert a batch of (key, value) pairs of the same size into the buffer,
+ * the buffer is written back once it is full
+ *
+ * @param keyList the keys (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param valueList the values (valueSize bytes each)
+ * @param valueSize the value size
+ * @return true success
+ * @return false fail
+ */
+bool CachedDatabase::MultiInsert(const char* keyList, uint32_t keyNum, size_t keySize,
+    const char* valueList, size_t valueSize)
+{
+    // the filter first, a query passing the filter then finds the pair in the buffer
+    for (size_t i = 0; i < keyNum; i++) {
+        this->AddToFilter(keyList + i * keySize, keySize);
+    }
+    string key;
+    string value;
+    bool needFlush = false;
+    {
+        lock_guard<mutex> lock(bufLck_);
+        for (size_t i = 0; i < keyNum; i++) {
+            key.assign(keyList + i * keySize, keySize);
+            dirtyBuf_[key].assign(valueList + i * valueSize, valueSize);
+        }
+        needFlush = (dirtyBuf_.size() >= INDEX_CACHE_FLUSH_NUM);
+    }
+    // a new fingerprint is likely to be queried again soon
+    for (size_t i = 0; i < keyNum; i++) {
+        key.assign(keyList + i * keySize, keySize);
+        value.assign(valueList + i * valueSize, valueSize);
+        this->GetCache(key)->insert(key, value);
+    }
+    if (needFlush) {
+        return this->Flush();
+    }
+    return true;
+}
+
+/**
+ * @brief visit all (key, value) pairs in the database, the buffer is written
+ * back first
+ *
+ * @param visitor the function called on each pair
+ * @return true success
+ * @return false fail
+ */
+bool CachedDatabase::Traverse(std::function<void(const std::string& key, const std::string& value)> visitor)
+{
+    this->Flush();
+    return diskDB_->Traverse(visitor);
+}
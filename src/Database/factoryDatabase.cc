@@ -22,6 +22,17 @@ AbsDatabase* DatabaseFactory::CreateDatabase(int type, string path)
         // fprintf(stderr, "Database: using In-Memory Index.\n");
         return new InMemoryDatabase(path);
         break;
+    case FLAT_TABLE:
+        return new FlatDatabase(path);
+        break;
+    case CACHED_LEVEL_DB:
+        fprintf(stderr, "Database: using LevelDB with an in-memory cache.\n");
+        return new CachedDatabase(path);
+        break;
+    case STASH_LOG:
+        fprintf(stderr, "Database: using the log-structured index on flash.\n");
+        return new StashDatabase(path);
+        break;
     default:
         break;
     }
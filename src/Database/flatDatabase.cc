@@ -0,0 +1,941 @@
+/**
+ * @file flatDatabase.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement the interface of the flat in-memory index
+ * @version 0.1
+ * @date 2022-06-28
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/flatDatabase.h"
+
+extern Configure config;
+
+/**
+ * @brief Construct a new Flat Database object
+ *
+ * @param dbName the path of the db file
+ */
+FlatDatabase::FlatDatabase(std::string dbName)
+{
+    resizeNum_ = 0;
+    warmUpSize_ = 0;
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        pthread_rwlock_init(&shardList_[i].shardLck, NULL);
+        shardList_[i].tagList = NULL;
+        shardList_[i].slotList = NULL;
+        shardList_[i].groupNum = 0;
+        shardList_[i].keyNum = 0;
+        shardList_[i].isMapped = false;
+    }
+    this->OpenDB(dbName);
+}
+
+/**
+ * @brief Destroy the Flat Database object
+ *
+ */
+FlatDatabase::~FlatDatabase()
+{
+    for (auto warmUpThread : warmUpThreadList_) {
+        warmUpThread->interrupt();
+        warmUpThread->join();
+        delete warmUpThread;
+    }
+    if (indexLog_ != NULL) {
+        // the snapshot and the log already hold the index, only commit the log tail
+        delete indexLog_;
+    } else {
+        // persist the index as an image, the mapped db file is replaced instead of overwritten
+        string tmpName = dbName_ + ".tmp";
+        if (this->WriteImageFile(tmpName)) {
+            if (rename(tmpName.c_str(), dbName_.c_str()) != 0) {
+                tool::Logging(myName_.c_str(), "cannot replace the db file: %s\n", strerror(errno));
+            }
+            tool::SyncParentDir(dbName_);
+        }
+    }
+    uint64_t keyNum = 0;
+    uint64_t slotNum = 0;
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        FlatShard_t* shard = &shardList_[i];
+        keyNum += shard->keyNum;
+        slotNum += shard->groupNum * FLAT_GROUP_SIZE;
+        if (!shard->isMapped) {
+            delete[] shard->tagList;
+            delete[] shard->slotList;
+        }
+        pthread_rwlock_destroy(&shard->shardLck);
+    }
+    if (imageAddr_ != NULL) {
+        munmap(imageAddr_, imageSize_);
+    }
+    if (imageFd_ >= 0) {
+        close(imageFd_);
+    }
+
+    fprintf(stderr, "========FlatDatabase Info========\n");
+    fprintf(stderr, "key num: %lu\n", keyNum);
+    fprintf(stderr, "slot num: %lu\n", slotNum);
+    fprintf(stderr, "table size (MiB): %.2f\n",
+        (double)slotNum * (FLAT_SLOT_SIZE + 1) / 1024 / 1024);
+    fprintf(stderr, "resize num: %lu\n", resizeNum_.load());
+    fprintf(stderr, "mapped image size (MiB): %.2f\n", (double)imageSize_ / 1024 / 1024);
+    fprintf(stderr, "warm-up read size (MiB): %.2f\n", (double)warmUpSize_.load() / 1024 / 1024);
+    fprintf(stderr, "=================================\n");
+}
+
+/**
+ * @brief open a database
+ *
+ * @param dbName the db path
+ * @return true success
+ * @return false fails
+ */
+bool FlatDatabase::OpenDB(std::string dbName)
+{
+    dbName_ = dbName;
+    auto loadPair = [this](const string& key, const string& value) {
+        if (key.size() != FLAT_KEY_SIZE || value.size() != FLAT_VALUE_SIZE) {
+            tool::Logging(myName_.c_str(), "skip a pair of wrong size in the db file.\n");
+            return;
+        }
+        this->InsertSlot(this->GetShard(key.c_str()), key.c_str(), value.c_str());
+    };
+
+    // load the last snapshot, then the inserts logged after it
+    if (IsImageFile(dbName_)) {
+        if (!this->MapImageFile()) {
+            tool::Logging(myName_.c_str(), "the image %s is corrupted.\n", dbName_.c_str());
+            exit(EXIT_FAILURE);
+        }
+    } else {
+        // a pair file (e.g., of the in-memory hash map), size the tables for its keys at once
+        ifstream dbFile;
+        dbFile.open(dbName_, ios_base::in | ios_base::binary);
+        uint64_t fileSize = 0;
+        if (dbFile.is_open()) {
+            dbFile.seekg(0, ios_base::end);
+            fileSize = dbFile.tellg();
+        }
+        dbFile.close();
+        uint64_t shardKeyNum = fileSize / (2 * sizeof(int) + FLAT_SLOT_SIZE) / INDEX_SHARD_NUM;
+        uint64_t groupNum = FLAT_INIT_GROUP_NUM;
+        while (groupNum * FLAT_GROUP_SIZE * 7 / 8 < shardKeyNum) {
+            groupNum <<= 1;
+        }
+        for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+            this->ResizeShard(&shardList_[i], groupNum);
+        }
+        resizeNum_ = 0;
+        IndexLog::ReadPairFile(dbName_, loadPair);
+    }
+    if (config.GetIndexLogCommitMs() != 0) {
+        indexLog_ = new IndexLog(dbName_, config.GetIndexLogCommitMs(),
+            config.GetIndexSnapshotSec(), [this](const string& fileName) {
+                return this->WriteImageFile(fileName);
+            });
+        indexLog_->Replay(loadPair);
+    }
+    return true;
+}
+
+/**
+ * @brief check the header of an image
+ *
+ * @param header the header
+ * @param fileSize the size of the image file
+ * @return true the header is valid
+ * @return false the header is corrupted
+ */
+bool FlatDatabase::CheckImageHeader(const FlatImageHeader_t* header, uint64_t fileSize)
+{
+    if (header->magic != FLAT_IMAGE_MAGIC || header->version != FLAT_IMAGE_VERSION
+        || header->keySize != FLAT_KEY_SIZE || header->valueSize != FLAT_VALUE_SIZE
+        || header->groupSize != FLAT_GROUP_SIZE || header->shardNum != INDEX_SHARD_NUM) {
+        return false;
+    }
+    if (tool::GetChecksum(header, offsetof(FlatImageHeader_t, headerChecksum), FLAT_IMAGE_MAGIC)
+        != header->headerChecksum) {
+        return false;
+    }
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        const FlatImageShard_t* imageShard = &header->shardList[i];
+        uint64_t groupNum = imageShard->groupNum;
+        if (groupNum == 0 || (groupNum & (groupNum - 1)) != 0 || groupNum > fileSize) {
+            return false;
+        }
+        uint64_t slotNum = groupNum * FLAT_GROUP_SIZE;
+        if (imageShard->keyNum > slotNum
+            || imageShard->tagOffset % FLAT_IMAGE_ALIGN != 0
+            || imageShard->slotOffset % FLAT_IMAGE_ALIGN != 0
+            || imageShard->tagOffset > fileSize || fileSize - imageShard->tagOffset < slotNum
+            || imageShard->slotOffset > fileSize
+            || (fileSize - imageShard->slotOffset) / FLAT_SLOT_SIZE < slotNum) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief map the image in the db file, the shards use the mapped tables
+ *
+ * @return true success
+ * @return false the db file is not a valid image
+ */
+bool FlatDatabase::MapImageFile()
+{
+    imageFd_ = open(dbName_.c_str(), O_RDONLY);
+    struct stat fileStat;
+    if (imageFd_ < 0 || fstat(imageFd_, &fileStat) != 0
+        || (uint64_t)fileStat.st_size < sizeof(FlatImageHeader_t)) {
+        return false;
+    }
+    // private pages: an insert copies the page it changes, the file is never changed
+    void* imageAddr = mmap(NULL, fileStat.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+        imageFd_, 0);
+    if (imageAddr == MAP_FAILED) {
+        tool::Logging(myName_.c_str(), "cannot map the image: %s\n", strerror(errno));
+        return false;
+    }
+    imageAddr_ = (uint8_t*)imageAddr;
+    imageSize_ = fileStat.st_size;
+    memcpy(&imageHeader_, imageAddr_, sizeof(imageHeader_));
+    if (!CheckImageHeader(&imageHeader_, imageSize_)) {
+        return false;
+    }
+
+    // a probe faults in the pages it touches only, without reading ahead around them
+    madvise(imageAddr_, imageSize_, MADV_RANDOM);
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        FlatShard_t* shard = &shardList_[i];
+        const FlatImageShard_t* imageShard = &imageHeader_.shardList[i];
+        shard->tagList = imageAddr_ + imageShard->tagOffset;
+        shard->slotList = imageAddr_ + imageShard->slotOffset;
+        shard->groupNum = imageShard->groupNum;
+        shard->keyNum = imageShard->keyNum;
+        shard->isMapped = true;
+    }
+
+    uint32_t threadNum = min(config.GetIndexWarmUpThreadNum(), INDEX_SHARD_NUM);
+    for (uint32_t i = 0; i < threadNum; i++) {
+        warmUpThreadList_.push_back(new boost::thread(
+            boost::bind(&FlatDatabase::WarmUpImage, this, i, threadNum)));
+    }
+    return true;
+}
+
+/**
+ * @brief write a buffer at an offset of a file
+ *
+ * @param fd the file descriptor
+ * @param buf the buffer
+ * @param bufSize the buffer size
+ * @param offset the offset
+ * @return true success
+ * @return false fail
+ */
+bool FlatDatabase::WriteAt(int fd, const uint8_t* buf, uint64_t bufSize, uint64_t offset)
+{
+    while (bufSize != 0) {
+        ssize_t writeSize = pwrite(fd, buf, bufSize, offset);
+        if (writeSize < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        buf += writeSize;
+        bufSize -= writeSize;
+        offset += writeSize;
+    }
+    return true;
+}
+
+/**
+ * @brief write the tables of all shards to an image file, a shard is copied
+ * under its read lock and written after the lock is released
+ *
+ * @param fileName the file name
+ * @return true success
+ * @return false fail
+ */
+bool FlatDatabase::WriteImageFile(string fileName)
+{
+    int imageFd = open(fileName.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (imageFd < 0) {
+        tool::Logging(myName_.c_str(), "cannot open the db file %s.\n", fileName.c_str());
+        return false;
+    }
+    auto alignUp = [](uint64_t offset) {
+        return (offset + FLAT_IMAGE_ALIGN - 1) / FLAT_IMAGE_ALIGN * FLAT_IMAGE_ALIGN;
+    };
+
+    FlatImageHeader_t header;
+    memset(&header, 0, sizeof(header));
+    header.magic = FLAT_IMAGE_MAGIC;
+    header.version = FLAT_IMAGE_VERSION;
+    header.keySize = FLAT_KEY_SIZE;
+    header.valueSize = FLAT_VALUE_SIZE;
+    header.groupSize = FLAT_GROUP_SIZE;
+    header.shardNum = INDEX_SHARD_NUM;
+
+    vector<uint8_t> tagBuf;
+    vector<uint8_t> slotBuf;
+    unordered_set<string> heldValueSet;
+    uint64_t fileSize = FLAT_IMAGE_ALIGN;
+    bool status = true;
+    for (size_t i = 0; i < INDEX_SHARD_NUM && status; i++) {
+        FlatShard_t* shard = &shardList_[i];
+        FlatImageShard_t* imageShard = &header.shardList[i];
+        pthread_rwlock_rdlock(&shard->shardLck);
+        uint64_t slotNum = shard->groupNum * FLAT_GROUP_SIZE;
+        tagBuf.assign(shard->tagList, shard->tagList + slotNum);
+        slotBuf.assign(shard->slotList, shard->slotList + slotNum * FLAT_SLOT_SIZE);
+        imageShard->groupNum = shard->groupNum;
+        imageShard->keyNum = shard->keyNum;
+        if (indexLog_ != NULL) {
+            heldValueSet = indexLog_->GetHeldValueSet();
+        }
+        pthread_rwlock_unlock(&shard->shardLck);
+
+        // the pairs of the containers not durable yet are logged later
+        if (!heldValueSet.empty()) {
+            imageShard->keyNum = this->DropHeldSlots(tagBuf, slotBuf, imageShard->groupNum,
+                heldValueSet);
+        }
+
+        imageShard->tagOffset = fileSize;
+        imageShard->slotOffset = alignUp(fileSize + tagBuf.size());
+        fileSize = alignUp(imageShard->slotOffset + slotBuf.size());
+        imageShard->checksum = tool::GetChecksum(tagBuf.data(), tagBuf.size(), FLAT_IMAGE_MAGIC);
+        imageShard->checksum = tool::GetChecksum(slotBuf.data(), slotBuf.size(),
+            imageShard->checksum);
+        status = WriteAt(imageFd, tagBuf.data(), tagBuf.size(), imageShard->tagOffset)
+            && WriteAt(imageFd, slotBuf.data(), slotBuf.size(), imageShard->slotOffset);
+    }
+    header.headerChecksum = tool::GetChecksum(&header, offsetof(FlatImageHeader_t, headerChecksum),
+        FLAT_IMAGE_MAGIC);
+    status = status && WriteAt(imageFd, (uint8_t*)&header, sizeof(header), 0)
+        && ftruncate(imageFd, fileSize) == 0 && fsync(imageFd) == 0;
+    close(imageFd);
+    if (!status) {
+        tool::Logging(myName_.c_str(), "cannot write the db file %s.\n", fileName.c_str());
+    }
+    return status;
+}
+
+/**
+ * @brief drop the slots of the held values from a copy of a shard table, the
+ * table is rebuilt only if a slot is dropped (to keep the probe sequences)
+ *
+ * @param tagBuf the tags of the table
+ * @param slotBuf the slots of the table
+ * @param groupNum the number of groups of the table
+ * @param heldValueSet the held values
+ * @return uint64_t the number of keys left
+ */
+uint64_t FlatDatabase::DropHeldSlots(vector<uint8_t>& tagBuf, vector<uint8_t>& slotBuf,
+    uint64_t groupNum, const unordered_set<string>& heldValueSet)
+{
+    uint64_t slotNum = groupNum * FLAT_GROUP_SIZE;
+    vector<uint64_t> keepList;
+    bool isDropped = false;
+    string valueStr;
+    for (uint64_t i = 0; i < slotNum; i++) {
+        if (tagBuf[i] == FLAT_EMPTY_TAG) {
+            continue;
+        }
+        valueStr.assign((char*)slotBuf.data() + i * FLAT_SLOT_SIZE + FLAT_KEY_SIZE,
+            FLAT_VALUE_SIZE);
+        if (heldValueSet.count(valueStr) != 0) {
+            isDropped = true;
+        } else {
+            keepList.push_back(i);
+        }
+    }
+    if (!isDropped) {
+        return keepList.size();
+    }
+
+    vector<uint8_t> newTagBuf(slotNum, FLAT_EMPTY_TAG);
+    vector<uint8_t> newSlotBuf(slotNum * FLAT_SLOT_SIZE, 0);
+    for (auto slotId : keepList) {
+        this->PutSlot(newTagBuf.data(), newSlotBuf.data(), groupNum,
+            (char*)slotBuf.data() + slotId * FLAT_SLOT_SIZE);
+    }
+    tagBuf.swap(newTagBuf);
+    slotBuf.swap(newSlotBuf);
+    return keepList.size();
+}
+
+/**
+ * @brief read the tables of a part of the shards in the image to fill the
+ * page cache, and verify their checksums
+ *
+ * @param threadId the id of the warm-up thread
+ * @param threadNum the number of the warm-up threads
+ */
+void FlatDatabase::WarmUpImage(uint32_t threadId, uint32_t threadNum)
+{
+    vector<uint8_t> readBuf(FLAT_WARM_UP_READ_SIZE);
+    try {
+        for (uint32_t i = threadId; i < INDEX_SHARD_NUM; i += threadNum) {
+            // read the file instead of the mapping, which the inserts may have changed
+            const FlatImageShard_t* imageShard = &imageHeader_.shardList[i];
+            uint64_t slotNum = imageShard->groupNum * FLAT_GROUP_SIZE;
+            uint64_t rangeList[2][2] = { { imageShard->tagOffset, slotNum },
+                { imageShard->slotOffset, slotNum * FLAT_SLOT_SIZE } };
+            uint64_t checksum = FLAT_IMAGE_MAGIC;
+            for (auto& range : rangeList) {
+                for (uint64_t readOffset = 0; readOffset < range[1]; readOffset += FLAT_WARM_UP_READ_SIZE) {
+                    boost::this_thread::interruption_point();
+                    uint64_t readSize = min(FLAT_WARM_UP_READ_SIZE, range[1] - readOffset);
+                    if (pread(imageFd_, readBuf.data(), readSize, range[0] + readOffset)
+                        != (ssize_t)readSize) {
+                        tool::Logging(myName_.c_str(), "cannot read the image: %s\n",
+                            strerror(errno));
+                        exit(EXIT_FAILURE);
+                    }
+                    checksum = tool::GetChecksum(readBuf.data(), readSize, checksum);
+                    warmUpSize_ += readSize;
+                }
+            }
+            if (checksum != imageShard->checksum) {
+                tool::Logging(myName_.c_str(), "the image of shard %u is corrupted.\n", i);
+                exit(EXIT_FAILURE);
+            }
+        }
+    } catch (boost::thread_interrupted&) {
+        // the server exits before the warm-up ends
+    }
+    return;
+}
+
+/**
+ * @brief find the slot of a key in a shard
+ *
+ * @param shard the shard
+ * @param key the key (FLAT_KEY_SIZE bytes)
+ * @return int64_t the slot index, -1 if the key does not exist
+ */
+int64_t FlatDatabase::FindSlot(FlatShard_t* shard, const char* key)
+{
+    uint64_t hash = this->GetHash(key);
+    uint8_t tag = hash & 0x7f;
+    uint64_t groupMask = shard->groupNum - 1;
+    uint64_t groupId = (hash >> 7) & groupMask;
+
+    // triangular probing over the groups, it visits each group once
+    for (uint64_t step = 1; step <= shard->groupNum; step++) {
+        uint8_t* groupTag = shard->tagList + groupId * FLAT_GROUP_SIZE;
+        uint32_t matchMask = this->MatchTag(groupTag, tag);
+        while (matchMask != 0) {
+            uint64_t slotId = groupId * FLAT_GROUP_SIZE + __builtin_ctz(matchMask);
+            if (memcmp(shard->slotList + slotId * FLAT_SLOT_SIZE, key, FLAT_KEY_SIZE) == 0) {
+                return slotId;
+            }
+            matchMask &= matchMask - 1;
+        }
+        // no key is deleted, a group with an empty slot ends the probe sequence
+        if (this->MatchTag(groupTag, FLAT_EMPTY_TAG) != 0) {
+            return -1;
+        }
+        groupId = (groupId + step) & groupMask;
+    }
+    return -1;
+}
+
+/**
+ * @brief put a new key into the first empty slot of its probe sequence
+ *
+ * @param tagList the tags of the table
+ * @param slotList the slots of the table
+ * @param groupNum the number of groups of the table
+ * @param slot the key and the value (FLAT_SLOT_SIZE bytes)
+ */
+void FlatDatabase::PutSlot(uint8_t* tagList, uint8_t* slotList, uint64_t groupNum,
+    const char* slot)
+{
+    uint64_t hash = this->GetHash(slot);
+    uint64_t groupMask = groupNum - 1;
+    uint64_t groupId = (hash >> 7) & groupMask;
+
+    for (uint64_t step = 1;; step++) {
+        uint32_t emptyMask = this->MatchTag(tagList + groupId * FLAT_GROUP_SIZE, FLAT_EMPTY_TAG);
+        if (emptyMask != 0) {
+            uint64_t slotId = groupId * FLAT_GROUP_SIZE + __builtin_ctz(emptyMask);
+            tagList[slotId] = hash & 0x7f;
+            memcpy(slotList + slotId * FLAT_SLOT_SIZE, slot, FLAT_SLOT_SIZE);
+            return;
+        }
+        groupId = (groupId + step) & groupMask;
+    }
+}
+
+/**
+ * @brief move all keys of a shard to a table of a given size
+ *
+ * @param shard the shard
+ * @param groupNum the number of groups of the new table
+ */
+void FlatDatabase::ResizeShard(FlatShard_t* shard, uint64_t groupNum)
+{
+    uint64_t slotNum = groupNum * FLAT_GROUP_SIZE;
+    uint8_t* tagList = new uint8_t[slotNum];
+    uint8_t* slotList = new uint8_t[slotNum * FLAT_SLOT_SIZE];
+    memset(tagList, FLAT_EMPTY_TAG, slotNum);
+
+    uint64_t oldSlotNum = shard->groupNum * FLAT_GROUP_SIZE;
+    for (uint64_t i = 0; i < oldSlotNum; i++) {
+        if (shard->tagList[i] != FLAT_EMPTY_TAG) {
+            this->PutSlot(tagList, slotList, groupNum,
+                (char*)shard->slotList + i * FLAT_SLOT_SIZE);
+        }
+    }
+
+    if (!shard->isMapped) {
+        delete[] shard->tagList;
+        delete[] shard->slotList;
+    }
+    shard->tagList = tagList;
+    shard->slotList = slotList;
+    shard->groupNum = groupNum;
+    shard->isMapped = false;
+    resizeNum_++;
+    return;
+}
+
+/**
+ * @brief insert a (key, value) pair, the caller holds the write lock of the shard
+ *
+ * @param shard the shard of the key
+ * @param key the key (FLAT_KEY_SIZE bytes)
+ * @param value the value (FLAT_VALUE_SIZE bytes)
+ */
+void FlatDatabase::InsertSlot(FlatShard_t* shard, const char* key, const char* value)
+{
+    int64_t slotId = this->FindSlot(shard, key);
+    if (slotId >= 0) {
+        memcpy(shard->slotList + slotId * FLAT_SLOT_SIZE + FLAT_KEY_SIZE, value,
+            FLAT_VALUE_SIZE);
+    } else {
+        // keep the load factor under 7/8, double the table in one pass
+        if ((shard->keyNum + 1) * 8 > shard->groupNum * FLAT_GROUP_SIZE * 7) {
+            this->ResizeShard(shard, shard->groupNum * 2);
+        }
+        char slot[FLAT_SLOT_SIZE];
+        memcpy(slot, key, FLAT_KEY_SIZE);
+        memcpy(slot + FLAT_KEY_SIZE, value, FLAT_VALUE_SIZE);
+        this->PutSlot(shard->tagList, shard->slotList, shard->groupNum, slot);
+        shard->keyNum++;
+    }
+    return;
+}
+
+/**
+ * @brief group a batch of keys by their shards, the keys of a shard keep their order
+ *
+ * @param keyList the keys (FLAT_KEY_SIZE bytes each)
+ * @param keyNum the number of keys
+ * @param orderList the key ids grouped by the shards
+ * @param shardBeginList the first position of each shard in the order list
+ */
+void FlatDatabase::GroupByShard(const char* keyList, uint32_t keyNum,
+    vector<uint32_t>& orderList, vector<uint32_t>& shardBeginList)
+{
+    vector<uint8_t> shardIdList(keyNum);
+    shardBeginList.assign(INDEX_SHARD_NUM + 1, 0);
+    for (size_t i = 0; i < keyNum; i++) {
+        shardIdList[i] = this->GetShard(keyList + i * FLAT_KEY_SIZE) - shardList_;
+        shardBeginList[shardIdList[i] + 1]++;
+    }
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        shardBeginList[i + 1] += shardBeginList[i];
+    }
+    vector<uint32_t> posList(shardBeginList.begin(), shardBeginList.end() - 1);
+    orderList.resize(keyNum);
+    for (size_t i = 0; i < keyNum; i++) {
+        orderList[posList[shardIdList[i]]++] = i;
+    }
+    return;
+}
+
+/**
+ * @brief execute query over database
+ *
+ * @param key key
+ * @param value value
+ * @return true success
+ * @return false fail
+ */
+bool FlatDatabase::Query(const std::string& key, std::string& value)
+{
+    return this->QueryBuffer(key.c_str(), key.size(), value);
+}
+
+/**
+ * @brief insert the (key, value) pair
+ *
+ * @param key key
+ * @param value value
+ * @return true success
+ * @return false fail
+ */
+bool FlatDatabase::Insert(const std::string& key, const std::string& value)
+{
+    return this->InsertBothBuffer(key.c_str(), key.size(), value.c_str(), value.size());
+}
+
+/**
+ * @brief insert the (key, value) pair
+ *
+ * @param key
+ * @param buffer
+ * @param bufferSize
+ * @return true
+ * @return false
+ */
+bool FlatDatabase::InsertBuffer(const std::string& key, const char* buffer, size_t bufferSize)
+{
+    return this->InsertBothBuffer(key.c_str(), key.size(), buffer, bufferSize);
+}
+
+/**
+ * @brief insert the (key, value) pair
+ *
+ * @param key
+ * @param keySize
+ * @param buffer
+ * @param bufferSize
+ * @return true
+ * @return false
+ */
+bool FlatDatabase::InsertBothBuffer(const char* key, size_t keySize, const char* buffer,
+    size_t bufferSize)
+{
+    if (keySize != FLAT_KEY_SIZE || bufferSize != FLAT_VALUE_SIZE) {
+        tool::Logging(myName_.c_str(), "wrong key size %lu or value size %lu.\n",
+            keySize, bufferSize);
+        return false;
+    }
+    FlatShard_t* shard = this->GetShard(key);
+    pthread_rwlock_wrlock(&shard->shardLck);
+    this->InsertSlot(shard, key, buffer);
+    pthread_rwlock_unlock(&shard->shardLck);
+    return true;
+}
+
+/**
+ * @brief query the (key, value) pair
+ *
+ * @param key
+ * @param keySize
+ * @param value
+ * @return true
+ * @return false
+ */
+bool FlatDatabase::QueryBuffer(const char* key, size_t keySize, std::string& value)
+{
+    if (keySize != FLAT_KEY_SIZE) {
+        return false;
+    }
+    FlatShard_t* shard = this->GetShard(key);
+    bool status = false;
+    pthread_rwlock_rdlock(&shard->shardLck);
+    int64_t slotId = this->FindSlot(shard, key);
+    if (slotId >= 0) {
+        value.assign((char*)shard->slotList + slotId * FLAT_SLOT_SIZE + FLAT_KEY_SIZE,
+            FLAT_VALUE_SIZE);
+        status = true;
+    }
+    pthread_rwlock_unlock(&shard->shardLck);
+    return status;
+}
+
+/**
+ * @brief query a batch of keys of the same size, each shard is locked once and the
+ * probes of the following keys are prefetched
+ *
+ * @param keyList the keys (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param valueList the values of the found keys (valueSize bytes each, NULL: not needed)
+ * @param valueSize the value size
+ * @param foundList whether each key is found (1: found, 0: not found)
+ * @return uint32_t the number of found keys
+ */
+uint32_t FlatDatabase::MultiQuery(const char* keyList, uint32_t keyNum, size_t keySize,
+    char* valueList, size_t valueSize, uint8_t* foundList)
+{
+    if (keySize != FLAT_KEY_SIZE) {
+        memset(foundList, 0, keyNum);
+        return 0;
+    }
+    vector<uint32_t> orderList;
+    vector<uint32_t> shardBeginList;
+    this->GroupByShard(keyList, keyNum, orderList, shardBeginList);
+
+    uint32_t foundNum = 0;
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        uint32_t beginPos = shardBeginList[i];
+        uint32_t endPos = shardBeginList[i + 1];
+        if (beginPos == endPos) {
+            continue;
+        }
+        FlatShard_t* shard = &shardList_[i];
+        pthread_rwlock_rdlock(&shard->shardLck);
+        // a concurrent insert may resize the table until the lock is taken
+        uint64_t groupMask = shard->groupNum - 1;
+        for (uint32_t j = beginPos; j < endPos; j++) {
+            // two stages ahead: fetch the tags of the home group, then the matched slot
+            if (j + 2 * FLAT_PREFETCH_DIST < endPos) {
+                uint64_t hash = this->GetHash(keyList + orderList[j + 2 * FLAT_PREFETCH_DIST] * FLAT_KEY_SIZE);
+                __builtin_prefetch(shard->tagList + ((hash >> 7) & groupMask) * FLAT_GROUP_SIZE);
+            }
+            if (j + FLAT_PREFETCH_DIST < endPos) {
+                uint64_t hash = this->GetHash(keyList + orderList[j + FLAT_PREFETCH_DIST] * FLAT_KEY_SIZE);
+                uint64_t groupId = (hash >> 7) & groupMask;
+                uint32_t matchMask = this->MatchTag(shard->tagList + groupId * FLAT_GROUP_SIZE,
+                    hash & 0x7f);
+                if (matchMask != 0) {
+                    __builtin_prefetch(shard->slotList
+                        + (groupId * FLAT_GROUP_SIZE + __builtin_ctz(matchMask)) * FLAT_SLOT_SIZE);
+                }
+            }
+
+            uint32_t keyId = orderList[j];
+            int64_t slotId = this->FindSlot(shard, keyList + keyId * FLAT_KEY_SIZE);
+            foundList[keyId] = (slotId >= 0);
+            if (slotId >= 0) {
+                if (valueList != NULL) {
+                    memcpy(valueList + keyId * valueSize,
+                        shard->slotList + slotId * FLAT_SLOT_SIZE + FLAT_KEY_SIZE,
+                        min(valueSize, (size_t)FLAT_VALUE_SIZE));
+                }
+                foundNum++;
+            }
+        }
+        pthread_rwlock_unlock(&shard->shardLck);
+    }
+    return foundNum;
+}
+
+/**
+ * @brief insert a batch of (key, value) pairs of the same size, each shard is locked once
+ *
+ * @param keyList the keys (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param valueList the values (valueSize bytes each)
+ * @param valueSize the value size
+ * @return true success
+ * @return false fail
+ */
+bool FlatDatabase::MultiInsert(const char* keyList, uint32_t keyNum, size_t keySize,
+    const char* valueList, size_t valueSize)
+{
+    if (keySize != FLAT_KEY_SIZE || valueSize != FLAT_VALUE_SIZE) {
+        tool::Logging(myName_.c_str(), "wrong key size %lu or value size %lu.\n",
+            keySize, valueSize);
+        return false;
+    }
+    vector<uint32_t> orderList;
+    vector<uint32_t> shardBeginList;
+    this->GroupByShard(keyList, keyNum, orderList, shardBeginList);
+
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        if (shardBeginList[i] == shardBeginList[i + 1]) {
+            continue;
+        }
+        FlatShard_t* shard = &shardList_[i];
+        pthread_rwlock_wrlock(&shard->shardLck);
+        for (size_t j = shardBeginList[i]; j < shardBeginList[i + 1]; j++) {
+            uint32_t keyId = orderList[j];
+            this->InsertSlot(shard, keyList + keyId * FLAT_KEY_SIZE,
+                valueList + keyId * FLAT_VALUE_SIZE);
+        }
+        pthread_rwlock_unlock(&shard->shardLck);
+    }
+    return true;
+}
+
+/**
+ * @brief whether the pairs are persisted only after their values (containers)
+ * are durable, see HoldValue and CommitValue
+ *
+ * @return true the writer of a value syncs it and then commits it
+ * @return false the pairs are persisted on their own
+ */
+bool FlatDatabase::NeedDurableValue()
+{
+    // without the log, the index is saved on exit after all containers are written
+    return indexLog_ != NULL;
+}
+
+/**
+ * @brief hold a value (a container) which is not durable yet, before any pair
+ * of it is inserted, its pairs are queried but not persisted until it is committed
+ *
+ * @param value the value
+ * @param valueSize the value size
+ */
+void FlatDatabase::HoldValue(const char* value, size_t valueSize)
+{
+    if (indexLog_ != NULL) {
+        indexLog_->HoldValue(value, valueSize);
+    }
+    return;
+}
+
+/**
+ * @brief commit a durable value, log its pairs (a pair missing in the index
+ * is inserted first, so that a logged pair is always in the later snapshots)
+ *
+ * @param keyList the keys of the value (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param value the value
+ * @param valueSize the value size
+ */
+void FlatDatabase::CommitValue(const char* keyList, uint32_t keyNum, size_t keySize,
+    const char* value, size_t valueSize)
+{
+    if (indexLog_ == NULL) {
+        return;
+    }
+    if (keySize != FLAT_KEY_SIZE || valueSize != FLAT_VALUE_SIZE) {
+        tool::Logging(myName_.c_str(), "wrong key size %lu or value size %lu.\n",
+            keySize, valueSize);
+        return;
+    }
+    vector<uint32_t> orderList;
+    vector<uint32_t> shardBeginList;
+    this->GroupByShard(keyList, keyNum, orderList, shardBeginList);
+
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        if (shardBeginList[i] == shardBeginList[i + 1]) {
+            continue;
+        }
+        FlatShard_t* shard = &shardList_[i];
+        pthread_rwlock_wrlock(&shard->shardLck);
+        for (size_t j = shardBeginList[i]; j < shardBeginList[i + 1]; j++) {
+            const char* key = keyList + orderList[j] * FLAT_KEY_SIZE;
+            // a later value of the key stays, both hold the chunk
+            if (this->FindSlot(shard, key) < 0) {
+                this->InsertSlot(shard, key, value);
+            }
+        }
+        pthread_rwlock_unlock(&shard->shardLck);
+    }
+    indexLog_->AppendDurable(keyList, keyNum, keySize, value, valueSize);
+    return;
+}
+
+/**
+ * @brief visit all (key, value) pairs in the database, a shard is locked
+ * while it is visited (the inserts to the other shards go on)
+ *
+ * @param visitor the function called on each pair
+ * @return true success
+ * @return false fail
+ */
+bool FlatDatabase::Traverse(std::function<void(const std::string& key, const std::string& value)> visitor)
+{
+    string key;
+    string value;
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        FlatShard_t* shard = &shardList_[i];
+        pthread_rwlock_rdlock(&shard->shardLck);
+        uint64_t slotNum = shard->groupNum * FLAT_GROUP_SIZE;
+        for (uint64_t j = 0; j < slotNum; j++) {
+            if (shard->tagList[j] == FLAT_EMPTY_TAG) {
+                continue;
+            }
+            char* slot = (char*)shard->slotList + j * FLAT_SLOT_SIZE;
+            key.assign(slot, FLAT_KEY_SIZE);
+            value.assign(slot + FLAT_KEY_SIZE, FLAT_VALUE_SIZE);
+            visitor(key, value);
+        }
+        pthread_rwlock_unlock(&shard->shardLck);
+    }
+    return true;
+}
+
+/**
+ * @brief check whether a file is an image of the flat index
+ *
+ * @param fileName the file name
+ * @return true it is an image
+ * @return false it is not (e.g., a pair file)
+ */
+bool FlatDatabase::IsImageFile(string fileName)
+{
+    int imageFd = open(fileName.c_str(), O_RDONLY);
+    if (imageFd < 0) {
+        return false;
+    }
+    uint64_t magic = 0;
+    bool status = (pread(imageFd, &magic, sizeof(magic), 0) == sizeof(magic)
+        && magic == FLAT_IMAGE_MAGIC);
+    close(imageFd);
+    return status;
+}
+
+/**
+ * @brief read all (key, value) pairs in an image, the checksums are verified
+ *
+ * @param fileName the file name
+ * @param visitor the function called on each pair
+ * @return uint64_t the number of pairs
+ */
+uint64_t FlatDatabase::ReadImageFile(string fileName,
+    std::function<void(const string& key, const string& value)> visitor)
+{
+    int imageFd = open(fileName.c_str(), O_RDONLY);
+    if (imageFd < 0) {
+        return 0;
+    }
+    struct stat fileStat;
+    void* imageAddr = MAP_FAILED;
+    if (fstat(imageFd, &fileStat) == 0 && (uint64_t)fileStat.st_size >= sizeof(FlatImageHeader_t)) {
+        imageAddr = mmap(NULL, fileStat.st_size, PROT_READ, MAP_PRIVATE, imageFd, 0);
+    }
+    close(imageFd);
+    const FlatImageHeader_t* header = (const FlatImageHeader_t*)imageAddr;
+    if (imageAddr == MAP_FAILED || !CheckImageHeader(header, fileStat.st_size)) {
+        tool::Logging("FlatDatabase", "the image %s is corrupted.\n", fileName.c_str());
+        exit(EXIT_FAILURE);
+    }
+    madvise(imageAddr, fileStat.st_size, MADV_SEQUENTIAL);
+
+    uint64_t pairNum = 0;
+    string key;
+    string value;
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        const FlatImageShard_t* imageShard = &header->shardList[i];
+        uint64_t slotNum = imageShard->groupNum * FLAT_GROUP_SIZE;
+        const uint8_t* tagList = (const uint8_t*)imageAddr + imageShard->tagOffset;
+        const char* slotList = (const char*)imageAddr + imageShard->slotOffset;
+        uint64_t checksum = tool::GetChecksum(tagList, slotNum, FLAT_IMAGE_MAGIC);
+        checksum = tool::GetChecksum(slotList, slotNum * FLAT_SLOT_SIZE, checksum);
+        if (checksum != imageShard->checksum) {
+            tool::Logging("FlatDatabase", "the image of shard %lu is corrupted.\n", i);
+            exit(EXIT_FAILURE);
+        }
+        for (uint64_t j = 0; j < slotNum; j++) {
+            if (tagList[j] == FLAT_EMPTY_TAG) {
+                continue;
+            }
+            key.assign(slotList + j * FLAT_SLOT_SIZE, FLAT_KEY_SIZE);
+            value.assign(slotList + j * FLAT_SLOT_SIZE + FLAT_KEY_SIZE, FLAT_VALUE_SIZE);
+            visitor(key, value);
+            pairNum++;
+        }
+    }
+    munmap(imageAddr, fileStat.st_size);
+    return pairNum;
+}
\ No newline at end of file
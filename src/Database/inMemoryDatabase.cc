@@ -11,6 +11,8 @@
 
 #include "../../include/inMemoryDatabase.h"
 
+extern Configure config;
+
 /**
  * @brief Construct a new In Memory Database object
  *
@@ -18,31 +20,38 @@
  */
 InMemoryDatabase::InMemoryDatabase(std::string dbName)
 {
+    this->InitShards();
     this->OpenDB(dbName);
 }
 
+/**
+ * @brief init the locks of the shards
+ *
+ */
+void InMemoryDatabase::InitShards()
+{
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        pthread_rwlock_init(&shardList_[i].shardLck, NULL);
+    }
+    return;
+}
+
 /**
  * @brief Destroy the In Memory Database object
  *
  */
 InMemoryDatabase::~InMemoryDatabase()
 {
-    // perisistent the indexFile to the disk
-    ofstream dbFile;
-    dbFile.open(dbName_, ios_base::trunc | ios_base::binary);
-    int itemSize = 0;
-    for (auto it = indexObj_.begin(); it != indexObj_.end(); it++) {
-        // write the key
-        itemSize = it->first.size();
-        dbFile.write((char*)&itemSize, sizeof(itemSize));
-        dbFile.write(it->first.c_str(), itemSize);
-
-        // write the value
-        itemSize = it->second.size();
-        dbFile.write((char*)&itemSize, sizeof(itemSize));
-        dbFile.write(it->second.c_str(), itemSize);
+    if (indexLog_ != NULL) {
+        // the snapshot and the log already hold the index, only commit the log tail
+        delete indexLog_;
+    } else {
+        // perisistent the indexFile to the disk
+        this->WritePairFile(dbName_);
+    }
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        pthread_rwlock_destroy(&shardList_[i].shardLck);
     }
-    dbFile.close();
 }
 
 /**
@@ -55,52 +64,71 @@ InMemoryDatabase::~InMemoryDatabase()
 bool InMemoryDatabase::OpenDB(std::string dbName)
 {
     dbName_ = dbName;
-    // check whether there exists the index
-    ifstream dbFile;
-    dbFile.open(dbName_, ios_base::in | ios_base::binary);
-    if (!dbFile.is_open()) {
-        // fprintf(stderr, "InMemoryDatabase: cannot open the db file.\n");
+    auto loadPair = [this](const string& key, const string& value) {
+        this->GetShard(key.c_str(), key.size())->indexObj[key] = value;
+    };
+    // load the last snapshot (a pair file, or the image of the flat index), then the
+    // inserts logged after it
+    if (FlatDatabase::IsImageFile(dbName_)) {
+        FlatDatabase::ReadImageFile(dbName_, loadPair);
+    } else {
+        IndexLog::ReadPairFile(dbName_, loadPair);
     }
+    if (config.GetIndexLogCommitMs() != 0) {
+        indexLog_ = new IndexLog(dbName_, config.GetIndexLogCommitMs(),
+            config.GetIndexSnapshotSec(), [this](const string& fileName) {
+                return this->WritePairFile(fileName);
+            });
+        indexLog_->Replay(loadPair);
+    }
+    return true;
+}
 
-    size_t beginSize = dbFile.tellg();
-    dbFile.seekg(0, ios_base::end);
-    size_t fileSize = dbFile.tellg();
-    fileSize = fileSize - beginSize;
-
-    if (fileSize == 0) {
-        // db file not exist
-        // fprintf(stderr, "InMemoryDatabase: db file file is not exists, create a new one.\n");
-    } else {
-        // db file exist, load
-        dbFile.seekg(0, ios_base::beg);
-        bool isEnd = false;
-        int itemSize = 0;
-        string key;
-        string value;
-        while (!isEnd) {
-            // read key
-            dbFile.read((char*)&itemSize, sizeof(itemSize));
-            if (itemSize == 0) {
-                break;
+/**
+ * @brief write all pairs to a file, a shard is copied under its read lock
+ * and written after the lock is released
+ *
+ * @param fileName the file name
+ * @return true success
+ * @return false fail
+ */
+bool InMemoryDatabase::WritePairFile(string fileName)
+{
+    FILE* dbFile = fopen(fileName.c_str(), "wb");
+    if (dbFile == NULL) {
+        tool::Logging(myName_.c_str(), "cannot open the db file %s.\n", fileName.c_str());
+        return false;
+    }
+    vector<char> shardBuf;
+    unordered_set<string> heldValueSet;
+    bool status = true;
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        shardBuf.clear();
+        pthread_rwlock_rdlock(&shardList_[i].shardLck);
+        // the pairs of the containers not durable yet are logged later
+        if (indexLog_ != NULL) {
+            heldValueSet = indexLog_->GetHeldValueSet();
+        }
+        for (auto it = shardList_[i].indexObj.begin(); it != shardList_[i].indexObj.end(); it++) {
+            if (!heldValueSet.empty() && heldValueSet.count(it->second) != 0) {
+                continue;
             }
-            key.resize(itemSize, 0);
-            dbFile.read((char*)&key[0], itemSize);
-
-            // read value
-            dbFile.read((char*)&itemSize, sizeof(itemSize));
-            value.resize(itemSize, 0);
-            dbFile.read((char*)&value[0], itemSize);
-
-            // update the index
-            indexObj_.insert(make_pair(key, value));
-            itemSize = 0;
-            // update the read flag
-            isEnd = dbFile.eof();
+            IndexLog::EncodePair(shardBuf, it->first.c_str(), it->first.size(),
+                it->second.c_str(), it->second.size());
+        }
+        pthread_rwlock_unlock(&shardList_[i].shardLck);
+        if (fwrite(shardBuf.data(), 1, shardBuf.size(), dbFile) != shardBuf.size()) {
+            status = false;
         }
     }
-    dbFile.close();
-    // fprintf(stderr, "InMemoryDatabase: loaded index size: %lu\n", indexObj_.size());
-    return true;
+    if (fflush(dbFile) != 0 || fsync(fileno(dbFile)) != 0) {
+        status = false;
+    }
+    fclose(dbFile);
+    if (!status) {
+        tool::Logging(myName_.c_str(), "cannot write the db file %s.\n", fileName.c_str());
+    }
+    return status;
 }
 
 /**
@@ -113,13 +141,17 @@ bool InMemoryDatabase::OpenDB(std::string dbName)
  */
 bool InMemoryDatabase::Query(const std::string& key, std::string& value)
 {
-    auto findResult = indexObj_.find(key);
-    if (findResult != indexObj_.end()) {
+    IndexShard_t* shard = this->GetShard(key.c_str(), key.size());
+    bool status = false;
+    pthread_rwlock_rdlock(&shard->shardLck);
+    auto findResult = shard->indexObj.find(key);
+    if (findResult != shard->indexObj.end()) {
         // it exists in the index
         value.assign(findResult->second);
-        return true;
+        status = true;
     }
-    return false;
+    pthread_rwlock_unlock(&shard->shardLck);
+    return status;
 }
 
 /**
@@ -132,7 +164,10 @@ bool InMemoryDatabase::Query(const std::string& key, std::string& value)
  */
 bool InMemoryDatabase::Insert(const std::string& key, const std::string& value)
 {
-    indexObj_[key] = value;
+    IndexShard_t* shard = this->GetShard(key.c_str(), key.size());
+    pthread_rwlock_wrlock(&shard->shardLck);
+    shard->indexObj[key] = value;
+    pthread_rwlock_unlock(&shard->shardLck);
     return true;
 }
 
@@ -149,8 +184,7 @@ bool InMemoryDatabase::InsertBuffer(const std::string& key, const char* buffer,
 {
     string valueStr;
     valueStr.assign(buffer, bufferSize);
-    indexObj_[key] = valueStr;
-    return true;
+    return this->Insert(key, valueStr);
 }
 
 /**
@@ -170,8 +204,7 @@ bool InMemoryDatabase::InsertBothBuffer(const char* key, size_t keySize, const c
     string valueStr;
     keyStr.assign(key, keySize);
     valueStr.assign(buffer, bufferSize);
-    indexObj_[keyStr] = valueStr;
-    return true;
+    return this->Insert(keyStr, valueStr);
 }
 
 /**
@@ -187,11 +220,199 @@ bool InMemoryDatabase::QueryBuffer(const char* key, size_t keySize, std::string&
 {
     string keyStr;
     keyStr.assign(key, keySize);
-    auto findResult = indexObj_.find(keyStr);
-    if (findResult != indexObj_.end()) {
-        // it exists in the index
-        value.assign(findResult->second);
-        return true;
+    return this->Query(keyStr, value);
+}
+
+/**
+ * @brief group a batch of keys by their shards, the keys of a shard keep their order
+ *
+ * @param keyList the keys (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param orderList the key ids grouped by the shards
+ * @param shardBeginList the first position of each shard in the order list
+ */
+void InMemoryDatabase::GroupByShard(const char* keyList, uint32_t keyNum, size_t keySize,
+    vector<uint32_t>& orderList, vector<uint32_t>& shardBeginList)
+{
+    vector<uint8_t> shardIdList(keyNum);
+    shardBeginList.assign(INDEX_SHARD_NUM + 1, 0);
+    for (size_t i = 0; i < keyNum; i++) {
+        shardIdList[i] = this->GetShard(keyList + i * keySize, keySize) - shardList_;
+        shardBeginList[shardIdList[i] + 1]++;
     }
-    return false;
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        shardBeginList[i + 1] += shardBeginList[i];
+    }
+    vector<uint32_t> posList(shardBeginList.begin(), shardBeginList.end() - 1);
+    orderList.resize(keyNum);
+    for (size_t i = 0; i < keyNum; i++) {
+        orderList[posList[shardIdList[i]]++] = i;
+    }
+    return;
+}
+
+/**
+ * @brief query a batch of keys of the same size, each shard is locked once
+ *
+ * @param keyList the keys (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param valueList the values of the found keys (valueSize bytes each, NULL: not needed)
+ * @param valueSize the value size
+ * @param foundList whether each key is found (1: found, 0: not found)
+ * @return uint32_t the number of found keys
+ */
+uint32_t InMemoryDatabase::MultiQuery(const char* keyList, uint32_t keyNum, size_t keySize,
+    char* valueList, size_t valueSize, uint8_t* foundList)
+{
+    vector<uint32_t> orderList;
+    vector<uint32_t> shardBeginList;
+    this->GroupByShard(keyList, keyNum, keySize, orderList, shardBeginList);
+
+    uint32_t foundNum = 0;
+    string keyStr;
+    keyStr.resize(keySize, 0);
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        if (shardBeginList[i] == shardBeginList[i + 1]) {
+            continue;
+        }
+        IndexShard_t* shard = &shardList_[i];
+        pthread_rwlock_rdlock(&shard->shardLck);
+        for (size_t j = shardBeginList[i]; j < shardBeginList[i + 1]; j++) {
+            uint32_t keyId = orderList[j];
+            memcpy(&keyStr[0], keyList + keyId * keySize, keySize);
+            auto findResult = shard->indexObj.find(keyStr);
+            foundList[keyId] = (findResult != shard->indexObj.end());
+            if (foundList[keyId]) {
+                if (valueList != NULL) {
+                    memcpy(valueList + keyId * valueSize, findResult->second.c_str(),
+                        min(valueSize, findResult->second.size()));
+                }
+                foundNum++;
+            }
+        }
+        pthread_rwlock_unlock(&shard->shardLck);
+    }
+    return foundNum;
+}
+
+/**
+ * @brief insert a batch of (key, value) pairs of the same size, each shard is locked once
+ *
+ * @param keyList the keys (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param valueList the values (valueSize bytes each)
+ * @param valueSize the value size
+ * @return true success
+ * @return false fail
+ */
+bool InMemoryDatabase::MultiInsert(const char* keyList, uint32_t keyNum, size_t keySize,
+    const char* valueList, size_t valueSize)
+{
+    vector<uint32_t> orderList;
+    vector<uint32_t> shardBeginList;
+    this->GroupByShard(keyList, keyNum, keySize, orderList, shardBeginList);
+
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        if (shardBeginList[i] == shardBeginList[i + 1]) {
+            continue;
+        }
+        IndexShard_t* shard = &shardList_[i];
+        pthread_rwlock_wrlock(&shard->shardLck);
+        for (size_t j = shardBeginList[i]; j < shardBeginList[i + 1]; j++) {
+            uint32_t keyId = orderList[j];
+            shard->indexObj[string(keyList + keyId * keySize, keySize)].assign(
+                valueList + keyId * valueSize, valueSize);
+        }
+        pthread_rwlock_unlock(&shard->shardLck);
+    }
+    return true;
+}
+
+/**
+ * @brief whether the pairs are persisted only after their values (containers)
+ * are durable, see HoldValue and CommitValue
+ *
+ * @return true the writer of a value syncs it and then commits it
+ * @return false the pairs are persisted on their own
+ */
+bool InMemoryDatabase::NeedDurableValue()
+{
+    // without the log, the index is saved on exit after all containers are written
+    return indexLog_ != NULL;
+}
+
+/**
+ * @brief hold a value (a container) which is not durable yet, before any pair
+ * of it is inserted, its pairs are queried but not persisted until it is committed
+ *
+ * @param value the value
+ * @param valueSize the value size
+ */
+void InMemoryDatabase::HoldValue(const char* value, size_t valueSize)
+{
+    if (indexLog_ != NULL) {
+        indexLog_->HoldValue(value, valueSize);
+    }
+    return;
+}
+
+/**
+ * @brief commit a durable value, log its pairs (a pair missing in the index
+ * is inserted first, so that a logged pair is always in the later snapshots)
+ *
+ * @param keyList the keys of the value (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param value the value
+ * @param valueSize the value size
+ */
+void InMemoryDatabase::CommitValue(const char* keyList, uint32_t keyNum, size_t keySize,
+    const char* value, size_t valueSize)
+{
+    if (indexLog_ == NULL) {
+        return;
+    }
+    vector<uint32_t> orderList;
+    vector<uint32_t> shardBeginList;
+    this->GroupByShard(keyList, keyNum, keySize, orderList, shardBeginList);
+
+    string valueStr(value, valueSize);
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        if (shardBeginList[i] == shardBeginList[i + 1]) {
+            continue;
+        }
+        IndexShard_t* shard = &shardList_[i];
+        pthread_rwlock_wrlock(&shard->shardLck);
+        for (size_t j = shardBeginList[i]; j < shardBeginList[i + 1]; j++) {
+            uint32_t keyId = orderList[j];
+            // a later value of the key stays, both hold the chunk
+            shard->indexObj.emplace(string(keyList + keyId * keySize, keySize), valueStr);
+        }
+        pthread_rwlock_unlock(&shard->shardLck);
+    }
+    indexLog_->AppendDurable(keyList, keyNum, keySize, value, valueSize);
+    return;
+}
+
+/**
+ * @brief visit all (key, value) pairs in the database, a shard is locked
+ * while it is visited (the inserts to the other shards go on)
+ *
+ * @param visitor the function called on each pair
+ * @return true success
+ * @return false fail
+ */
+bool InMemoryDatabase::Traverse(std::function<void(const std::string& key, const std::string& value)> visitor)
+{
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        pthread_rwlock_rdlock(&shardList_[i].shardLck);
+        for (auto it = shardList_[i].indexObj.begin(); it != shardList_[i].indexObj.end(); it++) {
+            visitor(it->first, it->second);
+        }
+        pthread_rwlock_unlock(&shardList_[i].shardLck);
+    }
+    return true;
 }
\ No newline at end of file
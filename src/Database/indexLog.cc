@@ -0,0 +1,393 @@
+/**
+ * @file indexLog.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement the append-only log and the snapshots of an in-memory index
+ * @version 0.1
+ * @date 2022-06-30
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/indexLog.h"
+
+/**
+ * @brief Construct a new Index Log object
+ *
+ * @param dbName the path of the db file (the snapshot)
+ * @param commitMs the interval (ms) of the group commit
+ * @param snapshotSec the interval (sec) of the snapshots
+ * @param snapshotWriter the function writing all pairs of the index to a file
+ */
+IndexLog::IndexLog(string dbName, uint32_t commitMs, uint32_t snapshotSec,
+    std::function<bool(const string& fileName)> snapshotWriter)
+{
+    dbName_ = dbName;
+    logPrefix_ = dbName + "-log-";
+    commitMs_ = max(commitMs, (uint32_t)1);
+    snapshotSec_ = max(snapshotSec, (uint32_t)1);
+    snapshotWriter_ = snapshotWriter;
+    curLogSize_ = 0;
+}
+
+/**
+ * @brief Destroy the Index Log object, stop the snapshots and commit the log tail
+ *
+ */
+IndexLog::~IndexLog()
+{
+    if (snapshotThread_ != NULL) {
+        // a running snapshot is finished first
+        snapshotThread_->interrupt();
+        snapshotThread_->join();
+        delete snapshotThread_;
+    }
+    if (commitThread_ != NULL) {
+        commitThread_->interrupt();
+        commitThread_->join();
+        delete commitThread_;
+    }
+    if (logFd_ >= 0) {
+        lock_guard<mutex> lock(fileLck_);
+        this->Commit();
+        close(logFd_);
+    }
+
+    fprintf(stderr, "========IndexLog Info========\n");
+    fprintf(stderr, "replayed pair num: %lu\n", replayNum_);
+    fprintf(stderr, "group commit num: %lu\n", commitNum_);
+    fprintf(stderr, "committed log size (MiB): %.2f\n", (double)commitSize_ / 1024 / 1024);
+    fprintf(stderr, "snapshot num: %lu\n", snapshotNum_);
+    fprintf(stderr, "=============================\n");
+}
+
+/**
+ * @brief read a file of (key, value) pairs, a torn pair at the end is ignored
+ *
+ * @param fileName the file name
+ * @param visitor the function called on each pair
+ * @return uint64_t the number of pairs
+ */
+uint64_t IndexLog::ReadPairFile(string fileName,
+    std::function<void(const string& key, const string& value)> visitor)
+{
+    ifstream pairFile;
+    pairFile.open(fileName, ios_base::in | ios_base::binary);
+    if (!pairFile.is_open()) {
+        return 0;
+    }
+
+    uint64_t pairNum = 0;
+    int keySize = 0;
+    int valueSize = 0;
+    string key;
+    string value;
+    while (pairFile.read((char*)&keySize, sizeof(keySize))) {
+        if (keySize <= 0 || keySize > (int)INDEX_LOG_MAX_ITEM_SIZE) {
+            break;
+        }
+        key.resize(keySize, 0);
+        if (!pairFile.read(&key[0], keySize)
+            || !pairFile.read((char*)&valueSize, sizeof(valueSize))
+            || valueSize < 0 || valueSize > (int)INDEX_LOG_MAX_ITEM_SIZE) {
+            break;
+        }
+        value.resize(valueSize, 0);
+        if (!pairFile.read(&value[0], valueSize)) {
+            break;
+        }
+        visitor(key, value);
+        pairNum++;
+    }
+    pairFile.close();
+    return pairNum;
+}
+
+/**
+ * @brief write a (key, value) pair in the format of the pair files
+ *
+ * @param outBuf the output buffer
+ * @param key the key
+ * @param keySize the key size
+ * @param value the value
+ * @param valueSize the value size
+ */
+void IndexLog::EncodePair(vector<char>& outBuf, const char* key, size_t keySize,
+    const char* value, size_t valueSize)
+{
+    int itemSize = keySize;
+    outBuf.insert(outBuf.end(), (char*)&itemSize, (char*)&itemSize + sizeof(itemSize));
+    outBuf.insert(outBuf.end(), key, key + keySize);
+    itemSize = valueSize;
+    outBuf.insert(outBuf.end(), (char*)&itemSize, (char*)&itemSize + sizeof(itemSize));
+    outBuf.insert(outBuf.end(), value, value + valueSize);
+    return;
+}
+
+/**
+ * @brief list the generations of the existing log files
+ *
+ * @return vector<uint64_t> the generations in the ascending order
+ */
+vector<uint64_t> IndexLog::ListLogGens()
+{
+    std::filesystem::path prefixPath(logPrefix_);
+    std::filesystem::path logDir = prefixPath.parent_path();
+    if (logDir.empty()) {
+        logDir = ".";
+    }
+    string namePrefix = prefixPath.filename().string();
+
+    vector<uint64_t> genList;
+    for (auto& entry : std::filesystem::directory_iterator(logDir)) {
+        string fileName = entry.path().filename().string();
+        if (fileName.size() <= namePrefix.size()
+            || fileName.compare(0, namePrefix.size(), namePrefix) != 0) {
+            continue;
+        }
+        string genStr = fileName.substr(namePrefix.size());
+        if (genStr.find_first_not_of("0123456789") == string::npos) {
+            genList.push_back(stoull(genStr));
+        }
+    }
+    sort(genList.begin(), genList.end());
+    return genList;
+}
+
+/**
+ * @brief replay the existing log files in order, then start a new log file,
+ * the group commit and the snapshots
+ *
+ * @param visitor the function called on each logged pair
+ * @return uint64_t the number of replayed pairs
+ */
+uint64_t IndexLog::Replay(std::function<void(const string& key, const string& value)> visitor)
+{
+    vector<uint64_t> genList = this->ListLogGens();
+    for (auto gen : genList) {
+        replayNum_ += ReadPairFile(logPrefix_ + to_string(gen), visitor);
+    }
+    if (!genList.empty()) {
+        curGen_ = genList.back();
+    }
+
+    {
+        lock_guard<mutex> lock(fileLck_);
+        this->OpenNextLog();
+    }
+    commitThread_ = new boost::thread(boost::bind(&IndexLog::CommitLoop, this));
+    snapshotThread_ = new boost::thread(boost::bind(&IndexLog::SnapshotLoop, this));
+    return replayNum_;
+}
+
+/**
+ * @brief open a new log file of the next generation, the caller holds fileLck_
+ *
+ */
+void IndexLog::OpenNextLog()
+{
+    curGen_++;
+    string logName = logPrefix_ + to_string(curGen_);
+    logFd_ = open(logName.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+    if (logFd_ < 0) {
+        tool::Logging(myName_.c_str(), "cannot open the log file %s: %s\n", logName.c_str(),
+            strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    // the new file is found after a crash only if its directory entry is durable
+    tool::SyncParentDir(logName);
+    return;
+}
+
+/**
+ * @brief hold a value which is not durable yet, before any pair of it is inserted
+ *
+ * @param value the value
+ * @param valueSize the value size
+ */
+void IndexLog::HoldValue(const char* value, size_t valueSize)
+{
+    lock_guard<mutex> lock(holdLck_);
+    heldValueSet_.emplace(value, valueSize);
+    return;
+}
+
+/**
+ * @brief release a durable value and append its pairs to the log, they are
+ * durable after the next group commit
+ *
+ * @param keyList the keys of the value (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param value the value
+ * @param valueSize the value size
+ */
+void IndexLog::AppendDurable(const char* keyList, uint32_t keyNum, size_t keySize,
+    const char* value, size_t valueSize)
+{
+    // release first: a snapshot skipping the value still sees the pairs in a later log
+    {
+        lock_guard<mutex> lock(holdLck_);
+        heldValueSet_.erase(string(value, valueSize));
+    }
+    lock_guard<mutex> lock(bufLck_);
+    for (size_t i = 0; i < keyNum; i++) {
+        EncodePair(pendingBuf_, keyList + i * keySize, keySize, value, valueSize);
+    }
+    curLogSize_ += keyNum * (2 * sizeof(int) + keySize + valueSize);
+    return;
+}
+
+/**
+ * @brief get the values held now, a snapshot writer skips their pairs (it
+ * takes the set after locking a part of the index, so that all pairs in the
+ * part are either of a durable value or of a held value)
+ *
+ * @return unordered_set<string> the held values
+ */
+unordered_set<string> IndexLog::GetHeldValueSet()
+{
+    lock_guard<mutex> lock(holdLck_);
+    return heldValueSet_;
+}
+
+/**
+ * @brief write the pending records to the current log file and sync it,
+ * the caller holds fileLck_
+ *
+ */
+void IndexLog::Commit()
+{
+    vector<char> commitBuf;
+    {
+        lock_guard<mutex> lock(bufLck_);
+        commitBuf.swap(pendingBuf_);
+    }
+    if (commitBuf.empty()) {
+        return;
+    }
+
+    size_t writeOffset = 0;
+    while (writeOffset < commitBuf.size()) {
+        ssize_t writeSize = write(logFd_, commitBuf.data() + writeOffset,
+            commitBuf.size() - writeOffset);
+        if (writeSize < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tool::Logging(myName_.c_str(), "cannot write the log: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        writeOffset += writeSize;
+    }
+    if (fdatasync(logFd_) != 0) {
+        tool::Logging(myName_.c_str(), "cannot sync the log: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    commitNum_++;
+    commitSize_ += commitBuf.size();
+    return;
+}
+
+/**
+ * @brief the loop of the group commit thread
+ *
+ */
+void IndexLog::CommitLoop()
+{
+    try {
+        while (true) {
+            boost::this_thread::sleep(boost::posix_time::milliseconds(commitMs_));
+            lock_guard<mutex> lock(fileLck_);
+            this->Commit();
+        }
+    } catch (boost::thread_interrupted&) {
+        // the tail is committed by the destructor
+    }
+    return;
+}
+
+/**
+ * @brief close the current log file and continue in a new one
+ *
+ * @return uint64_t the generation of the closed log file
+ */
+uint64_t IndexLog::Rotate()
+{
+    lock_guard<mutex> lock(fileLck_);
+    uint64_t closedGen = curGen_;
+    {
+        // the records after this point belong to the new log file
+        lock_guard<mutex> bufLock(bufLck_);
+        curLogSize_ = 0;
+    }
+    this->Commit();
+    close(logFd_);
+    this->OpenNextLog();
+    return closedGen;
+}
+
+/**
+ * @brief remove the log files covered by a snapshot
+ *
+ * @param gen the last generation covered by the snapshot
+ */
+void IndexLog::RemoveUpTo(uint64_t gen)
+{
+    for (auto logGen : this->ListLogGens()) {
+        if (logGen > gen) {
+            break;
+        }
+        string logName = logPrefix_ + to_string(logGen);
+        if (remove(logName.c_str()) != 0) {
+            tool::Logging(myName_.c_str(), "cannot remove the log file %s.\n", logName.c_str());
+        }
+    }
+    return;
+}
+
+/**
+ * @brief rotate the log and replace the snapshot with a new one covering
+ * the closed log files
+ *
+ */
+void IndexLog::WriteSnapshot()
+{
+    // a pair is logged only after its value is durable and the pair is in the
+    // index, so the pairs in the closed log files are all in the snapshot. The
+    // snapshot skips the pairs of the held values, which are logged after the
+    // rotation. The pairs logged during the snapshot may be in both, the
+    // replay is idempotent.
+    uint64_t closedGen = this->Rotate();
+    string tmpName = dbName_ + ".tmp";
+    if (!snapshotWriter_(tmpName)) {
+        return;
+    }
+    if (rename(tmpName.c_str(), dbName_.c_str()) != 0) {
+        tool::Logging(myName_.c_str(), "cannot replace the snapshot: %s\n", strerror(errno));
+        return;
+    }
+    tool::SyncParentDir(dbName_);
+    this->RemoveUpTo(closedGen);
+    snapshotNum_++;
+    return;
+}
+
+/**
+ * @brief the loop of the snapshot thread
+ *
+ */
+void IndexLog::SnapshotLoop()
+{
+    try {
+        while (true) {
+            boost::this_thread::sleep(boost::posix_time::seconds(snapshotSec_));
+            if (curLogSize_ != 0) {
+                this->WriteSnapshot();
+            }
+        }
+    } catch (boost::thread_interrupted&) {
+        // the server exits
+    }
+    return;
+}
\ No newline at end of file
@@ -11,6 +11,8 @@
 
 #include "../../include/leveldbDatabase.h"
 
+extern Configure config;
+
 /**
  * @brief Construct a new Database object
  *
@@ -70,14 +72,22 @@ bool LeveldbDatabase::OpenDB(std::string dbName)
     dbName_ = dbName;
 
     options_.create_if_missing = true;
-    options_.block_cache = leveldb::NewLRUCache(256 * 1024 * 1024); // 256MB cache
+    options_.block_cache = leveldb::NewLRUCache(config.GetLevelDBCacheMiB() * MiB_2_B);
+    // a lookup of a new fingerprint mostly skips the disk reads of the tables
+    if (config.GetLevelDBBloomBits() != 0) {
+        options_.filter_policy = leveldb::NewBloomFilterPolicy(config.GetLevelDBBloomBits());
+    }
+    options_.write_buffer_size = config.GetLevelDBWriteBufferMiB() * MiB_2_B;
+    options_.block_size = config.GetLevelDBBlockSizeKiB() * KiB_2_B;
+    options_.compression = config.GetLevelDBCompression() ? leveldb::kSnappyCompression
+                                                          : leveldb::kNoCompression;
     leveldb::Status status = leveldb::DB::Open(options_, dbName, &this->levelDBObj_);
-    assert(status.ok());
-    if (status.ok()) {
-        return true;
-    } else {
-        return false;
+    if (!status.ok()) {
+        tool::Logging(myName_.c_str(), "cannot open the db %s: %s\n", dbName.c_str(),
+            status.ToString().c_str());
+        exit(EXIT_FAILURE);
     }
+    return true;
 }
 
 /**
@@ -90,6 +100,7 @@ LeveldbDatabase::~LeveldbDatabase()
     remove(name.c_str());
     delete levelDBObj_;
     delete options_.block_cache;
+    delete options_.filter_policy;
 }
 
 /**
@@ -140,4 +151,101 @@ bool LeveldbDatabase::QueryBuffer(const char* key, size_t keySize, std::string&
     leveldb::Status queryStatus = this->levelDBObj_->Get(leveldb::ReadOptions(),
         leveldb::Slice(key, keySize), &value);
     return queryStatus.ok();
+}
+
+/**
+ * @brief query a batch of keys of the same size in the key order on one snapshot,
+ * so that the neighbouring keys hit the same blocks
+ *
+ * @param keyList the keys (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param valueList the values of the found keys (valueSize bytes each, NULL: not needed)
+ * @param valueSize the value size
+ * @param foundList whether each key is found (1: found, 0: not found)
+ * @return uint32_t the number of found keys
+ */
+uint32_t LeveldbDatabase::MultiQuery(const char* keyList, uint32_t keyNum, size_t keySize,
+    char* valueList, size_t valueSize, uint8_t* foundList)
+{
+    vector<uint32_t> orderList(keyNum);
+    for (size_t i = 0; i < keyNum; i++) {
+        orderList[i] = i;
+    }
+    sort(orderList.begin(), orderList.end(), [keyList, keySize](uint32_t a, uint32_t b) {
+        return memcmp(keyList + a * keySize, keyList + b * keySize, keySize) < 0;
+    });
+
+    leveldb::ReadOptions readOptions;
+    readOptions.snapshot = this->levelDBObj_->GetSnapshot();
+    uint32_t foundNum = 0;
+    string value;
+    for (auto keyId : orderList) {
+        leveldb::Status queryStatus = this->levelDBObj_->Get(readOptions,
+            leveldb::Slice(keyList + keyId * keySize, keySize), &value);
+        foundList[keyId] = queryStatus.ok();
+        if (queryStatus.ok()) {
+            if (valueList != NULL) {
+                memcpy(valueList + keyId * valueSize, value.c_str(), min(valueSize, value.size()));
+            }
+            foundNum++;
+        }
+    }
+    this->levelDBObj_->ReleaseSnapshot(readOptions.snapshot);
+    return foundNum;
+}
+
+/**
+ * @brief insert a batch of (key, value) pairs of the same size with one write batch
+ *
+ * @param keyList the keys (keySize bytes each)
+ * @param keyNum the number of keys
+ * @param keySize the key size
+ * @param valueList the values (valueSize bytes each)
+ * @param valueSize the value size
+ * @return true success
+ * @return false fail
+ */
+bool LeveldbDatabase::MultiInsert(const char* keyList, uint32_t keyNum, size_t keySize,
+    const char* valueList, size_t valueSize)
+{
+    leveldb::WriteBatch writeBatch;
+    for (size_t i = 0; i < keyNum; i++) {
+        writeBatch.Put(leveldb::Slice(keyList + i * keySize, keySize),
+            leveldb::Slice(valueList + i * valueSize, valueSize));
+    }
+    leveldb::Status insertStatus = this->levelDBObj_->Write(leveldb::WriteOptions(), &writeBatch);
+    return insertStatus.ok();
+}
+
+/**
+ * @brief apply a write batch of (key, value) pairs of any size
+ *
+ * @param writeBatch the write batch
+ * @return true success
+ * @return false fail
+ */
+bool LeveldbDatabase::Write(leveldb::WriteBatch* writeBatch)
+{
+    leveldb::Status insertStatus = this->levelDBObj_->Write(leveldb::WriteOptions(), writeBatch);
+    return insertStatus.ok();
+}
+
+/**
+ * @brief visit all (key, value) pairs in the database, the pairs inserted
+ * during the traversal may be missed
+ *
+ * @param visitor the function called on each pair
+ * @return true success
+ * @return false fail
+ */
+bool LeveldbDatabase::Traverse(std::function<void(const std::string& key, const std::string& value)> visitor)
+{
+    leveldb::Iterator* it = this->levelDBObj_->NewIterator(leveldb::ReadOptions());
+    for (it->SeekToFirst(); it->Valid(); it->Next()) {
+        visitor(it->key().ToString(), it->value().ToString());
+    }
+    bool status = it->status().ok();
+    delete it;
+    return status;
 }
\ No newline at end of file
@@ -0,0 +1,495 @@
+/**
+ * @file stashDatabase.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement the interface of the log-structured index on flash
+ * @version 0.1
+ * @date 2022-07-04
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/stashDatabase.h"
+
+extern Configure config;
+
+/**
+ * @brief Construct a new Stash Database object
+ *
+ * @param dbName the path of the log file
+ */
+StashDatabase::StashDatabase(std::string dbName)
+{
+    queryNum_ = 0;
+    flashReadNum_ = 0;
+    sigMissNum_ = 0;
+    resizeNum_ = 0;
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        pthread_rwlock_init(&shardList_[i].shardLck, NULL);
+        shardList_[i].entryList = NULL;
+        shardList_[i].slotNum = 0;
+        shardList_[i].keyNum = 0;
+    }
+    this->OpenDB(dbName);
+}
+
+/**
+ * @brief Destroy the Stash Database object
+ *
+ */
+StashDatabase::~StashDatabase()
+{
+    this->Flush();
+    if (logFd_ >= 0) {
+        close(logFd_);
+    }
+
+    uint64_t keyNum = 0;
+    uint64_t slotNum = 0;
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        keyNum += shardList_[i].keyNum;
+        slotNum += shardList_[i].slotNum;
+        delete[] shardList_[i].entryList;
+        pthread_rwlock_destroy(&shardList_[i].shardLck);
+    }
+
+    uint64_t queryNum = queryNum_.load();
+    fprintf(stderr, "========StashDatabase Info========\n");
+    fprintf(stderr, "key num: %lu\n", keyNum);
+    fprintf(stderr, "log size (MiB): %.2f\n", (double)recordNum_ * STASH_RECORD_SIZE / 1024 / 1024);
+    fprintf(stderr, "signature table size (MiB): %.2f\n",
+        (double)slotNum * sizeof(StashEntry_t) / 1024 / 1024);
+    fprintf(stderr, "memory per key (B): %.2f\n",
+        keyNum == 0 ? 0 : (double)slotNum * sizeof(StashEntry_t) / keyNum);
+    fprintf(stderr, "query num: %lu\n", queryNum);
+    fprintf(stderr, "flash read num: %lu\n", flashReadNum_.load());
+    fprintf(stderr, "signature miss num: %lu\n", sigMissNum_.load());
+    fprintf(stderr, "flash reads per query: %.4f\n",
+        queryNum == 0 ? 0 : (double)flashReadNum_.load() / queryNum);
+    fprintf(stderr, "log flush num: %lu\n", flushNum_);
+    fprintf(stderr, "resize num: %lu\n", resizeNum_.load());
+    fprintf(stderr, "==================================\n");
+}
+
+/**
+ * @brief open a database
+ *
+ * @param dbName the db path
+ * @return true success
+ * @return false fail
+ */
+bool StashDatabase::OpenDB(std::string dbName)
+{
+    dbName_ = dbName;
+    logFd_ = open(dbName_.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat fileStat;
+    if (logFd_ < 0 || fstat(logFd_, &fileStat) != 0) {
+        tool::Logging(myName_.c_str(), "cannot open the log %s: %s\n", dbName_.c_str(),
+            strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    recordNum_ = fileStat.st_size / STASH_RECORD_SIZE;
+    if (fileStat.st_size % STASH_RECORD_SIZE != 0) {
+        tool::Logging(myName_.c_str(), "drop a torn record at the end of the log.\n");
+        if (ftruncate(logFd_, recordNum_ * STASH_RECORD_SIZE) != 0) {
+            tool::Logging(myName_.c_str(), "cannot truncate the log: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    flushedNum_ = recordNum_;
+
+    // size the tables for the expected keys at once
+    uint64_t shardKeyNum = max(config.GetIndexStashKeyNum(), recordNum_) / INDEX_SHARD_NUM;
+    uint64_t slotNum = STASH_INIT_SLOT_NUM;
+    while (slotNum * 7 / 8 < shardKeyNum) {
+        slotNum <<= 1;
+    }
+    this->RebuildTables(slotNum);
+    return true;
+}
+
+/**
+ * @brief read a record from the buffers or the log file
+ *
+ * @param recordId the record id
+ * @param record the record (STASH_RECORD_SIZE bytes)
+ */
+void StashDatabase::ReadRecord(uint64_t recordId, char* record)
+{
+    {
+        lock_guard<mutex> lock(bufLck_);
+        if (recordId >= flushedNum_) {
+            uint64_t bufOffset = (recordId - flushedNum_) * STASH_RECORD_SIZE;
+            if (bufOffset < flushingBuf_.size()) {
+                memcpy(record, flushingBuf_.data() + bufOffset, STASH_RECORD_SIZE);
+            } else {
+                memcpy(record, pendingBuf_.data() + bufOffset - flushingBuf_.size(),
+                    STASH_RECORD_SIZE);
+            }
+            return;
+        }
+    }
+    if (pread(logFd_, record, STASH_RECORD_SIZE, recordId * STASH_RECORD_SIZE)
+        != STASH_RECORD_SIZE) {
+        tool::Logging(myName_.c_str(), "cannot read the log: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    flashReadNum_++;
+    return;
+}
+
+/**
+ * @brief find the slot of a key in a shard, the log is read only when the
+ * signature matches
+ *
+ * @param shard the shard
+ * @param key the key (STASH_KEY_SIZE bytes)
+ * @param record the record of the key if found (STASH_RECORD_SIZE bytes)
+ * @return int64_t the slot id, -1 if the key does not exist
+ */
+int64_t StashDatabase::FindSlot(StashShard_t* shard, const char* key, char* record)
+{
+    uint32_t sig = this->GetSig(key);
+    uint64_t slotMask = shard->slotNum - 1;
+
+    // linear probing, the load is under 7/8 so an empty slot ends the probe, the
+    // entries of other home slots never match the signature
+    for (uint64_t slotId = sig & slotMask;; slotId = (slotId + 1) & slotMask) {
+        StashEntry_t* entry = &shard->entryList[slotId];
+        if (entry->recordId == STASH_EMPTY_ID) {
+            return -1;
+        }
+        if (entry->sig == sig) {
+            this->ReadRecord(entry->recordId, record);
+            if (memcmp(record, key, STASH_KEY_SIZE) == 0) {
+                return slotId;
+            }
+            sigMissNum_++;
+        }
+    }
+}
+
+/**
+ * @brief put a record into a shard, the caller holds the write lock of the shard
+ *
+ * @param shard the shard
+ * @param sig the signature of the key
+ * @param recordId the record id
+ */
+void StashDatabase::PutRecord(StashShard_t* shard, uint32_t sig, uint32_t recordId)
+{
+    uint64_t slotMask = shard->slotNum - 1;
+    for (uint64_t slotId = sig & slotMask;; slotId = (slotId + 1) & slotMask) {
+        StashEntry_t* entry = &shard->entryList[slotId];
+        if (entry->recordId == STASH_EMPTY_ID) {
+            entry->sig = sig;
+            entry->recordId = recordId;
+            return;
+        }
+    }
+}
+
+/**
+ * @brief append a record to the write buffer
+ *
+ * @param record the record (STASH_RECORD_SIZE bytes)
+ * @param recordId the record id
+ * @return true the buffer is full
+ * @return false otherwise
+ */
+bool StashDatabase::AppendRecord(const char* record, uint32_t& recordId)
+{
+    lock_guard<mutex> lock(bufLck_);
+    if (recordNum_ >= STASH_EMPTY_ID) {
+        tool::Logging(myName_.c_str(), "the log reaches the max record num.\n");
+        exit(EXIT_FAILURE);
+    }
+    recordId = recordNum_++;
+    pendingBuf_.insert(pendingBuf_.end(), record, record + STASH_RECORD_SIZE);
+    return pendingBuf_.size() >= STASH_WRITE_BUFFER_SIZE;
+}
+
+/**
+ * @brief write the buffered records to the log file
+ *
+ * @return true success
+ * @return false fail
+ */
+bool StashDatabase::Flush()
+{
+    lock_guard<mutex> flushLock(flushLck_);
+    {
+        lock_guard<mutex> lock(bufLck_);
+        if (pendingBuf_.empty()) {
+            return true;
+        }
+        flushingBuf_.swap(pendingBuf_);
+    }
+
+    // flushedNum_ only changes here under flushLck_, the lookups read flushingBuf_ meanwhile
+    uint64_t writeOffset = flushedNum_ * STASH_RECORD_SIZE;
+    size_t bufOffset = 0;
+    while (bufOffset < flushingBuf_.size()) {
+        ssize_t writeSize = pwrite(logFd_, flushingBuf_.data() + bufOffset,
+            flushingBuf_.size() - bufOffset, writeOffset + bufOffset);
+        if (writeSize < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tool::Logging(myName_.c_str(), "cannot write the log: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        bufOffset += writeSize;
+    }
+    if (fdatasync(logFd_) != 0) {
+        tool::Logging(myName_.c_str(), "cannot sync the log: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    {
+        lock_guard<mutex> lock(bufLck_);
+        flushedNum_ += flushingBuf_.size() / STASH_RECORD_SIZE;
+        flushingBuf_.clear();
+    }
+    flushNum_++;
+    return true;
+}
+
+/**
+ * @brief visit the records in the log order, the file part with large reads
+ *
+ * @param recordNum the number of records to visit
+ * @param visitor the function called on each record
+ */
+void StashDatabase::ScanRecords(uint64_t recordNum,
+    std::function<void(uint64_t recordId, const char* record)> visitor)
+{
+    uint64_t flushedNum;
+    {
+        lock_guard<mutex> lock(bufLck_);
+        flushedNum = min(flushedNum_, recordNum);
+    }
+    vector<char> readBuf(STASH_SCAN_RECORD_NUM * STASH_RECORD_SIZE);
+    for (uint64_t beginId = 0; beginId < flushedNum; beginId += STASH_SCAN_RECORD_NUM) {
+        uint64_t readSize = min((uint64_t)STASH_SCAN_RECORD_NUM, flushedNum - beginId)
+            * STASH_RECORD_SIZE;
+        if (pread(logFd_, readBuf.data(), readSize, beginId * STASH_RECORD_SIZE)
+            != (ssize_t)readSize) {
+            tool::Logging(myName_.c_str(), "cannot read the log: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        for (uint64_t offset = 0; offset < readSize; offset += STASH_RECORD_SIZE) {
+            visitor(beginId + offset / STASH_RECORD_SIZE, readBuf.data() + offset);
+        }
+    }
+    char record[STASH_RECORD_SIZE];
+    for (uint64_t recordId = flushedNum; recordId < recordNum; recordId++) {
+        this->ReadRecord(recordId, record);
+        visitor(recordId, record);
+    }
+    return;
+}
+
+/**
+ * @brief rebuild the signature tables of a given size from the log on startup
+ *
+ * @param slotNum the number of slots of a shard
+ */
+void StashDatabase::RebuildTables(uint64_t slotNum)
+{
+    for (size_t i = 0; i < INDEX_SHARD_NUM; i++) {
+        delete[] shardList_[i].entryList;
+        shardList_[i].entryList = new StashEntry_t[slotNum];
+        memset(shardList_[i].entryList, 0xff, slotNum * sizeof(StashEntry_t));
+        shardList_[i].slotNum = slotNum;
+        shardList_[i].keyNum = 0;
+    }
+
+    // no record is appended meanwhile, a later record of a key replaces the earlier one
+    char record[STASH_RECORD_SIZE];
+    this->ScanRecords(recordNum_, [this, &record](uint64_t recordId, const char* logRecord) {
+        StashShard_t* shard = this->GetShard(logRecord);
+        int64_t slotId = this->FindSlot(shard, logRecord, record);
+        if (slotId >= 0) {
+            shard->entryList[slotId].recordId = recordId;
+        } else {
+            this->PutRecord(shard, this->GetSig(logRecord), recordId);
+            shard->keyNum++;
+            if (shard->keyNum * 8 > shard->slotNum * 7) {
+                this->Resize(shard);
+            }
+        }
+    });
+    return;
+}
+
+/**
+ * @brief double the signature table of a shard if it is too full
+ *
+ * @param shard the shard
+ */
+void StashDatabase::Resize(StashShard_t* shard)
+{
+    pthread_rwlock_wrlock(&shard->shardLck);
+    // another insert may resize it meanwhile
+    if (shard->keyNum * 8 > shard->slotNum * 7) {
+        // the signature holds the home slot bits, the entries move without the log
+        StashEntry_t* oldEntryList = shard->entryList;
+        uint64_t oldSlotNum = shard->slotNum;
+        shard->slotNum = oldSlotNum * 2;
+        shard->entryList = new StashEntry_t[shard->slotNum];
+        memset(shard->entryList, 0xff, shard->slotNum * sizeof(StashEntry_t));
+        for (uint64_t slotId = 0; slotId < oldSlotNum; slotId++) {
+            if (oldEntryList[slotId].recordId != STASH_EMPTY_ID) {
+                this->PutRecord(shard, oldEntryList[slotId].sig, oldEntryList[slotId].recordId);
+            }
+        }
+        delete[] oldEntryList;
+        resizeNum_++;
+    }
+    pthread_rwlock_unlock(&shard->shardLck);
+    return;
+}
+
+/**
+ * @brief execute query over database
+ *
+ * @param key key
+ * @param value value
+ * @return true success
+ * @return false fail
+ */
+bool StashDatabase::Query(const std::string& key, std::string& value)
+{
+    return this->QueryBuffer(key.c_str(), key.size(), value);
+}
+
+/**
+ * @brief insert the (key, value) pair
+ *
+ * @param key key
+ * @param value value
+ * @return true success
+ * @return false fail
+ */
+bool StashDatabase::Insert(const std::string& key, const std::string& value)
+{
+    return this->InsertBothBuffer(key.c_str(), key.size(), value.c_str(), value.size());
+}
+
+/**
+ * @brief insert the (key, value) pair
+ *
+ * @param key
+ * @param buffer
+ * @param bufferSize
+ * @return true
+ * @return false
+ */
+bool StashDatabase::InsertBuffer(const std::string& key, const char* buffer, size_t bufferSize)
+{
+    return this->InsertBothBuffer(key.c_str(), key.size(), buffer, bufferSize);
+}
+
+/**
+ * @brief insert the (key, value) pair
+ *
+ * @param key
+ * @param keySize
+ * @param buffer
+ * @param bufferSize
+ * @return true
+ * @return false
+ */
+bool StashDatabase::InsertBothBuffer(const char* key, size_t keySize, const char* buffer,
+    size_t bufferSize)
+{
+    if (keySize != STASH_KEY_SIZE || bufferSize != STASH_VALUE_SIZE) {
+        tool::Logging(myName_.c_str(), "wrong key size %lu or value size %lu.\n",
+            keySize, bufferSize);
+        return false;
+    }
+    char record[STASH_RECORD_SIZE];
+    char oldRecord[STASH_RECORD_SIZE];
+    memcpy(record, key, STASH_KEY_SIZE);
+    memcpy(record + STASH_KEY_SIZE, buffer, STASH_VALUE_SIZE);
+
+    StashShard_t* shard = this->GetShard(key);
+    bool needFlush = false;
+    pthread_rwlock_wrlock(&shard->shardLck);
+    int64_t slotId = this->FindSlot(shard, key, oldRecord);
+    if (slotId < 0 || memcmp(oldRecord + STASH_KEY_SIZE, buffer, STASH_VALUE_SIZE) != 0) {
+        uint32_t recordId;
+        needFlush = this->AppendRecord(record, recordId);
+        if (slotId >= 0) {
+            shard->entryList[slotId].recordId = recordId;
+        } else {
+            this->PutRecord(shard, this->GetSig(key), recordId);
+            shard->keyNum++;
+        }
+    }
+    bool needResize = (shard->keyNum * 8 > shard->slotNum * 7);
+    pthread_rwlock_unlock(&shard->shardLck);
+
+    // write the log and resize without holding the shard
+    bool status = true;
+    if (needFlush) {
+        status = this->Flush();
+    }
+    if (needResize) {
+        this->Resize(shard);
+    }
+    return status;
+}
+
+/**
+ * @brief query the (key, value) pair
+ *
+ * @param key
+ * @param keySize
+ * @param value
+ * @return true
+ * @return false
+ */
+bool StashDatabase::QueryBuffer(const char* key, size_t keySize, std::string& value)
+{
+    if (keySize != STASH_KEY_SIZE) {
+        return false;
+    }
+    queryNum_++;
+    char record[STASH_RECORD_SIZE];
+    StashShard_t* shard = this->GetShard(key);
+    pthread_rwlock_rdlock(&shard->shardLck);
+    int64_t slotId = this->FindSlot(shard, key, record);
+    pthread_rwlock_unlock(&shard->shardLck);
+    if (slotId < 0) {
+        return false;
+    }
+    value.assign(record + STASH_KEY_SIZE, STASH_VALUE_SIZE);
+    return true;
+}
+
+/**
+ * @brief visit all records in the log order, an updated key is visited
+ * once per record (the last one holds its value)
+ *
+ * @param visitor the function called on each pair
+ * @return true success
+ * @return false fail
+ */
+bool StashDatabase::Traverse(std::function<void(const std::string& key, const std::string& value)> visitor)
+{
+    uint64_t recordNum;
+    {
+        lock_guard<mutex> lock(bufLck_);
+        recordNum = recordNum_;
+    }
+    string key;
+    string value;
+    this->ScanRecords(recordNum, [&](uint64_t recordId, const char* record) {
+        key.assign(record, STASH_KEY_SIZE);
+        value.assign(record + STASH_KEY_SIZE, STASH_VALUE_SIZE);
+        visitor(key, value);
+    });
+    return true;
+}
@@ -20,9 +20,19 @@ AbsIndex::AbsIndex(AbsDatabase* indexStore)
 {
     indexStore_ = indexStore;
     cryptoObj_ = new CryptoPrimitive(CIPHER_TYPE, HASH_TYPE);
+    hashPoolObj_ = new HashPool(cryptoObj_, config.GetHashThreadNum());
+    fpSampleThreshold_ = (uint64_t)(config.GetFpSampleRate() * ((uint64_t)std::mt19937::max() + 1));
     sendChunkBatchSize_ = config.GetSendChunkBatchSize();
     sendRecipeBatchSize_ = config.GetSendRecipeBatchSize();
+    totalRecvDataSize_ = 0;
+    totalBatchNum_ = 0;
+    inflightWaitNum_ = 0;
+    _skippedChunkNum = 0;
+    _verifiedChunkNum = 0;
+    _trustedChunkNum = 0;
 
+    // logical data size, logical chunk num, unique data size, unique chunk num, compressed size
+    uint64_t statList[5] = { 0 };
     if (tool::FileExist(persistentFileName_)) {
         // the stat file exists
         ifstream previousStatFile;
@@ -31,13 +41,19 @@ AbsIndex::AbsIndex(AbsDatabase* indexStore)
             tool::Logging(myName_.c_str(), "cannot open the stat file.\n");
             exit(EXIT_FAILURE);
         } else {
-            previousStatFile.read((char*)&_logicalDataSize, sizeof(uint64_t));
-            previousStatFile.read((char*)&_logicalChunkNum, sizeof(uint64_t));
-            previousStatFile.read((char*)&_uniqueDataSize, sizeof(uint64_t));
-            previousStatFile.read((char*)&_uniqueChunkNum, sizeof(uint64_t));
-            previousStatFile.read((char*)&_compressedDataSize, sizeof(uint64_t));
+            previousStatFile.read((char*)statList, sizeof(statList));
         }
     }
+    _logicalDataSize = statList[0];
+    _logicalChunkNum = statList[1];
+    _uniqueDataSize = statList[2];
+    _uniqueChunkNum = statList[3];
+    _compressedDataSize = statList[4];
+
+    if (config.GetFilterBitsPerKey() != 0) {
+        fpFilter_ = new FingerprintFilter(config.GetFilterBitsPerKey());
+        filterThread_ = new boost::thread(boost::bind(&AbsIndex::RefreshFilter, this));
+    }
 }
 
 /**
@@ -46,17 +62,23 @@ AbsIndex::AbsIndex(AbsDatabase* indexStore)
  */
 AbsIndex::~AbsIndex()
 {
+    if (filterThread_ != NULL) {
+        filterThread_->interrupt();
+        filterThread_->join();
+        delete filterThread_;
+        delete fpFilter_;
+    }
+
     ofstream previousStatFile;
     previousStatFile.open(persistentFileName_, ios_base::trunc);
     if (!previousStatFile.is_open()) {
         tool::Logging(myName_.c_str(), "cannot open the stat file.\n");
     } else {
-        previousStatFile.write((char*)&_logicalDataSize, sizeof(uint64_t));
-        previousStatFile.write((char*)&_logicalChunkNum, sizeof(uint64_t));
-        previousStatFile.write((char*)&_uniqueDataSize, sizeof(uint64_t));
-        previousStatFile.write((char*)&_uniqueChunkNum, sizeof(uint64_t));
-        previousStatFile.write((char*)&_compressedDataSize, sizeof(uint64_t));
+        uint64_t statList[5] = { _logicalDataSize, _logicalChunkNum, _uniqueDataSize,
+            _uniqueChunkNum, _compressedDataSize };
+        previousStatFile.write((char*)statList, sizeof(statList));
     }
+    delete hashPoolObj_;
     delete cryptoObj_;
 }
 
@@ -83,7 +105,11 @@ bool AbsIndex::ReadIndexStore(const string& key, string& value)
  */
 bool AbsIndex::UpdateIndexStore(const string& key, const string& value)
 {
-    return indexStore_->Insert(key, value);
+    bool status = indexStore_->Insert(key, value);
+    if (status && fpFilter_ != NULL) {
+        fpFilter_->Insert(key);
+    }
+    return status;
 }
 
 /**
@@ -97,5 +123,251 @@ bool AbsIndex::UpdateIndexStore(const string& key, const string& value)
  */
 bool AbsIndex::UpdateIndexStore(const string& key, const char* buffer, size_t bufferSize)
 {
-    return indexStore_->InsertBuffer(key, buffer, bufferSize);
+    bool status = indexStore_->InsertBuffer(key, buffer, bufferSize);
+    if (status && fpFilter_ != NULL) {
+        fpFilter_->Insert(key);
+    }
+    return status;
+}
+
+/**
+ * @brief read a batch of fingerprints from the index store
+ *
+ * @param keyList the fingerprints (CHUNK_HASH_SIZE bytes each)
+ * @param keyNum the number of fingerprints
+ * @param valueList the container names of the found ones (CONTAINER_ID_LENGTH
+ * bytes each, NULL: not needed)
+ * @param foundList whether each fingerprint is found (1: found, 0: not found)
+ * @return uint32_t the number of found fingerprints
+ */
+uint32_t AbsIndex::ReadIndexStoreBatch(const uint8_t* keyList, uint32_t keyNum,
+    uint8_t* valueList, uint8_t* foundList)
+{
+    return indexStore_->MultiQuery((const char*)keyList, keyNum, CHUNK_HASH_SIZE,
+        (char*)valueList, CONTAINER_ID_LENGTH, foundList);
+}
+
+/**
+ * @brief update the index store with a batch of new fingerprints
+ *
+ * @param keyList the fingerprints (CHUNK_HASH_SIZE bytes each)
+ * @param keyNum the number of fingerprints
+ * @param valueList the container names (CONTAINER_ID_LENGTH bytes each)
+ * @return true success
+ * @return false fail
+ */
+bool AbsIndex::UpdateIndexStoreBatch(const uint8_t* keyList, uint32_t keyNum,
+    const uint8_t* valueList)
+{
+    bool status = indexStore_->MultiInsert((const char*)keyList, keyNum, CHUNK_HASH_SIZE,
+        (const char*)valueList, CONTAINER_ID_LENGTH);
+    if (status && fpFilter_ != NULL) {
+        string key;
+        for (size_t i = 0; i < keyNum; i++) {
+            key.assign((const char*)keyList + i * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+            fpFilter_->Insert(key);
+        }
+    }
+    return status;
+}
+
+/**
+ * @brief encode the status list of a query reply in the smallest format the edge accepts
+ *
+ * @param statusList the status of each entry (0: duplicate, 1: unique)
+ * @param entryNum the number of entries
+ * @param replyCap the reply formats the edge accepts (0: one byte per entry, no format byte)
+ * @param replyBuffer the output buffer (at least entryNum + 1 bytes)
+ * @return uint32_t the size of the encoded list
+ */
+uint32_t AbsIndex::EncodeQueryReply(const uint8_t* statusList, uint32_t entryNum,
+    uint32_t replyCap, uint8_t* replyBuffer)
+{
+    if (replyCap == 0) {
+        // the legacy edge
+        memcpy(replyBuffer, statusList, entryNum);
+        return entryNum;
+    }
+
+    // the size of each format (without the format byte)
+    uint32_t byteSize = entryNum;
+    uint32_t bitmapSize = UINT32_MAX;
+    uint32_t rleSize = UINT32_MAX;
+    if (replyCap & EDGE_CAP_BITMAP_REPLY) {
+        bitmapSize = (entryNum + 7) / 8;
+    }
+    if ((replyCap & EDGE_CAP_RLE_REPLY) && entryNum != 0) {
+        // the first status, then the varint length of each run
+        rleSize = 1;
+        uint32_t runLen = 1;
+        for (size_t i = 1; i <= entryNum; i++) {
+            if (i < entryNum && statusList[i] == statusList[i - 1]) {
+                runLen++;
+                continue;
+            }
+            do {
+                rleSize++;
+                runLen >>= 7;
+            } while (runLen != 0);
+            runLen = 1;
+        }
+    }
+
+    uint8_t* outBase = replyBuffer + 1;
+    if (rleSize < bitmapSize && rleSize < byteSize) {
+        replyBuffer[0] = REPLY_STATUS_RLE;
+        *outBase++ = statusList[0];
+        uint32_t runLen = 1;
+        for (size_t i = 1; i <= entryNum; i++) {
+            if (i < entryNum && statusList[i] == statusList[i - 1]) {
+                runLen++;
+                continue;
+            }
+            while (runLen >= 0x80) {
+                *outBase++ = (uint8_t)(runLen | 0x80);
+                runLen >>= 7;
+            }
+            *outBase++ = (uint8_t)runLen;
+            runLen = 1;
+        }
+        return 1 + rleSize;
+    }
+
+    if (bitmapSize < byteSize) {
+        // bit i%8 of byte i/8 is the status of entry i
+        replyBuffer[0] = REPLY_STATUS_BITMAP;
+        memset(outBase, 0, bitmapSize);
+        for (size_t i = 0; i < entryNum; i++) {
+            outBase[i >> 3] |= (statusList[i] & 0x1) << (i & 0x7);
+        }
+        return 1 + bitmapSize;
+    }
+
+    replyBuffer[0] = REPLY_STATUS_BYTE;
+    memcpy(outBase, statusList, entryNum);
+    return 1 + byteSize;
+}
+
+/**
+ * @brief rebuild the fingerprint filter from the index store in the background
+ *
+ */
+void AbsIndex::RefreshFilter()
+{
+    uint32_t refreshSec = max(config.GetFilterRefreshSec(), (uint32_t)1);
+    try {
+        while (true) {
+            if (fpFilter_->NeedRebuild()) {
+                // a key reaches the filter log after the index store, the
+                // ones missed by the traversal are replayed from the log
+                fpFilter_->BeginRebuild(_uniqueChunkNum);
+                bool status = indexStore_->Traverse([this](const string& key, const string& value) {
+                    fpFilter_->AddRebuildKey(key);
+                });
+                if (!status) {
+                    tool::Logging(myName_.c_str(), "cannot traverse the index store.\n");
+                } else {
+                    fpFilter_->FinishRebuild();
+                }
+            }
+            boost::this_thread::sleep(boost::posix_time::seconds(refreshSec));
+        }
+    } catch (boost::thread_interrupted&) {
+        // the server exits
+    }
+    return;
+}
+
+/**
+ * @brief verify the fingerprints sent with the chunks of a batch, i.e.,
+ * the chunks to store and a random sample of the duplicate ones
+ *
+ * @param curClient the current client var (with the located chunks, the
+ * fingerprints from the edge and their index lookup)
+ * @return true all verified chunks match their fingerprints
+ * @return false otherwise
+ */
+bool AbsIndex::VerifyBatchFp(ClientVar* curClient)
+{
+    uint32_t chunkNum = curClient->_chunkAddrList.size();
+    uint8_t* fpList = curClient->_chunkHashList.data();
+    vector<uint8_t>& chunkVerifyList = curClient->_chunkVerifyList;
+    vector<uint8_t*>& verifyAddrList = curClient->_verifyAddrList;
+    vector<uint32_t>& verifySizeList = curClient->_verifySizeList;
+    vector<uint8_t>& verifyHashList = curClient->_verifyHashList;
+    chunkVerifyList.assign(chunkNum, 0);
+    verifyAddrList.clear();
+    verifySizeList.clear();
+
+    // pick the chunks to verify, a chunk missing the index will be stored
+    for (size_t i = 0; i < chunkNum; i++) {
+        if (curClient->_sampleRng() < fpSampleThreshold_
+            || curClient->_indexFoundList[i] == 0) {
+            chunkVerifyList[i] = 1;
+            verifyAddrList.push_back(curClient->_chunkAddrList[i]);
+            verifySizeList.push_back(curClient->_chunkSizeList[i]);
+        }
+    }
+
+    verifyHashList.resize(verifyAddrList.size() * CHUNK_HASH_SIZE);
+    hashPoolObj_->HashBatch(verifyAddrList.data(), verifySizeList.data(), verifyAddrList.size(),
+        verifyHashList.data(), curClient->_mdCtx);
+    _verifiedChunkNum += verifyAddrList.size();
+    _trustedChunkNum += chunkNum - verifyAddrList.size();
+
+    uint32_t verifyIdx = 0;
+    bool isMatch = true;
+    for (size_t i = 0; i < chunkNum; i++) {
+        if (chunkVerifyList[i] == 0) {
+            continue;
+        }
+        if (memcmp(verifyHashList.data() + verifyIdx * CHUNK_HASH_SIZE,
+                fpList + i * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE)
+            != 0) {
+            curClient->_fpMismatchNum++;
+            isMatch = false;
+        }
+        verifyIdx++;
+    }
+    return isMatch;
+}
+
+/**
+ * @brief reserve a new chunk before storing it, wait if another session
+ * is storing the same chunk
+ *
+ * @param key the fingerprint
+ */
+void AbsIndex::ReserveChunk(const string& key)
+{
+    uint32_t prefix;
+    memcpy(&prefix, key.c_str(), sizeof(prefix));
+    InflightStripe_t* stripe = &inflightList_[prefix % INFLIGHT_STRIPE_NUM];
+    unique_lock<mutex> lock(stripe->stripeLck);
+    if (stripe->fpSet.find(key) != stripe->fpSet.end()) {
+        inflightWaitNum_++;
+        stripe->stripeCond.wait(lock, [stripe, &key] {
+            return stripe->fpSet.find(key) == stripe->fpSet.end();
+        });
+    }
+    stripe->fpSet.insert(key);
+    return;
+}
+
+/**
+ * @brief release the reservation of a chunk
+ *
+ * @param key the fingerprint
+ */
+void AbsIndex::ReleaseChunk(const string& key)
+{
+    uint32_t prefix;
+    memcpy(&prefix, key.c_str(), sizeof(prefix));
+    InflightStripe_t* stripe = &inflightList_[prefix % INFLIGHT_STRIPE_NUM];
+    {
+        lock_guard<mutex> lock(stripe->stripeLck);
+        stripe->fpSet.erase(key);
+    }
+    stripe->stripeCond.notify_all();
+    return;
 }
\ No newline at end of file
@@ -0,0 +1,524 @@
+/**
+ * @file extremeBinIndex.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement extreme binning
+ * @version 0.1
+ * @date 2022-07-08
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/extremeBinIndex.h"
+
+/**
+ * @brief Construct a new Extreme Bin Index object
+ *
+ * @param indexStore the reference to the index store
+ */
+ExtremeBinIndex::ExtremeBinIndex(AbsDatabase* indexStore)
+    : PlainIndex(indexStore)
+{
+    lookupBatchNum_ = 0;
+    binLoadNum_ = 0;
+    foundDupNum_ = 0;
+    missedDupNum_ = 0;
+    pthread_rwlock_init(&binFileLck_, NULL);
+    binFileName_ = config.GetFp2ChunkDBName() + "-bin";
+    this->LoadBins();
+}
+
+/**
+ * @brief Destroy the Extreme Bin Index object
+ *
+ */
+ExtremeBinIndex::~ExtremeBinIndex()
+{
+    for (auto& it : fileBinMap_) {
+        delete it.second;
+    }
+    uint64_t foundNum = foundDupNum_.load();
+    uint64_t missedNum = missedDupNum_.load();
+
+    fprintf(stderr, "========ExtremeBinIndex Info========\n");
+    fprintf(stderr, "file num: %lu\n", fileNum_);
+    fprintf(stderr, "bin num: %lu\n", primaryIndex_.size());
+    fprintf(stderr, "primary index memory (MiB): %.2f\n",
+        (double)primaryIndex_.size() * (CHUNK_HASH_SIZE + sizeof(BinMeta_t)) / 1024 / 1024);
+    fprintf(stderr, "bin file size (MiB): %.2f\n", (double)binFileSize_ / 1024 / 1024);
+    fprintf(stderr, "bin update num: %lu\n", binUpdateNum_);
+    fprintf(stderr, "bin compaction num: %lu\n", binCompactNum_);
+    fprintf(stderr, "lookup batch num: %lu\n", lookupBatchNum_.load());
+    fprintf(stderr, "bin load num: %lu\n", binLoadNum_.load());
+    fprintf(stderr, "found duplicate num: %lu\n", foundNum);
+    if (dedupLossCheck_) {
+        fprintf(stderr, "missed duplicate num: %lu\n", missedNum);
+        fprintf(stderr, "dedup loss against the full index: %.4f\n",
+            foundNum + missedNum == 0 ? 0 : (double)missedNum / (foundNum + missedNum));
+        fprintf(stderr, "redundant stored chunk num: %lu\n", redundantChunkNum_.load());
+        fprintf(stderr, "redundant stored data size (MiB): %.2f\n",
+            (double)redundantDataSize_.load() / 1024 / 1024);
+    }
+    fprintf(stderr, "====================================\n");
+
+    if (binFd_ >= 0) {
+        close(binFd_);
+    }
+    pthread_rwlock_destroy(&binFileLck_);
+}
+
+/**
+ * @brief load the bin file and rebuild the primary index from it
+ *
+ */
+void ExtremeBinIndex::LoadBins()
+{
+    binFd_ = open(binFileName_.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat fileStat;
+    if (binFd_ < 0 || fstat(binFd_, &fileStat) != 0) {
+        tool::Logging(myName_.c_str(), "cannot open the bin file %s: %s\n",
+            binFileName_.c_str(), strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    // each record: the representative, the fingerprint num, the fingerprints,
+    // a later record of a representative replaces the earlier one
+    uint64_t fileSize = fileStat.st_size;
+    uint64_t offset = 0;
+    uint8_t binHeader[CHUNK_HASH_SIZE + sizeof(uint32_t)];
+    string repStr;
+    while (offset + sizeof(binHeader) <= fileSize) {
+        if (pread(binFd_, binHeader, sizeof(binHeader), offset) != sizeof(binHeader)) {
+            break;
+        }
+        uint32_t fpNum;
+        memcpy(&fpNum, binHeader + CHUNK_HASH_SIZE, sizeof(fpNum));
+        uint64_t recordSize = sizeof(binHeader) + (uint64_t)fpNum * CHUNK_HASH_SIZE;
+        // a bin is never empty, an empty one is a record not written before a crash
+        if (fpNum == 0 || offset + recordSize > fileSize) {
+            break;
+        }
+        repStr.assign((char*)binHeader, CHUNK_HASH_SIZE);
+        BinMeta_t& binMeta = primaryIndex_[repStr];
+        if (binMeta.fpNum != 0) {
+            liveBinSize_ -= sizeof(binHeader) + (uint64_t)binMeta.fpNum * CHUNK_HASH_SIZE;
+        }
+        binMeta = { offset, fpNum };
+        liveBinSize_ += recordSize;
+        offset += recordSize;
+    }
+    if (offset != fileSize) {
+        tool::Logging(myName_.c_str(), "drop the torn bins from offset %lu of the bin file.\n",
+            offset);
+        if (ftruncate(binFd_, offset) != 0) {
+            tool::Logging(myName_.c_str(), "cannot truncate the bin file: %s\n",
+                strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    binFileSize_ = offset;
+
+    // a bin is saved before the containers of its chunks, so after a crash it can
+    // hold the chunks of a lost container, which the full index does not keep (see
+    // NeedDurableValue). The latest versions are then rewritten without them
+    vector<uint8_t> fpBuffer;
+    vector<uint8_t> foundList;
+    for (auto& it : primaryIndex_) {
+        fpBuffer.clear();
+        this->ReadBinBuffer(it.second, fpBuffer);
+        foundList.resize(it.second.fpNum);
+        if (this->ReadIndexStoreBatch(fpBuffer.data(), it.second.fpNum, NULL, foundList.data())
+            != it.second.fpNum) {
+            this->RewriteBins(true);
+            return;
+        }
+    }
+    if (this->NeedCompaction()) {
+        this->RewriteBins(false);
+    }
+    return;
+}
+
+/**
+ * @brief rewrite the latest version of each bin to a new bin file and replace
+ * the bin file with it, the caller holds the write lock of the bin file
+ *
+ * @param isFiltered whether to drop the fingerprints missing from the full index
+ */
+void ExtremeBinIndex::RewriteBins(bool isFiltered)
+{
+    string newFileName = binFileName_ + ".new";
+    int newFd = open(newFileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (newFd < 0) {
+        tool::Logging(myName_.c_str(), "cannot open the bin file %s: %s\n",
+            newFileName.c_str(), strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t newOffset = 0;
+    uint64_t dropNum = 0;
+    vector<uint8_t> binBuffer;
+    vector<uint8_t> foundList;
+    for (auto it = primaryIndex_.begin(); it != primaryIndex_.end();) {
+        BinMeta_t& binMeta = it->second;
+        binBuffer.resize(CHUNK_HASH_SIZE + sizeof(uint32_t));
+        memcpy(binBuffer.data(), it->first.c_str(), CHUNK_HASH_SIZE);
+        this->ReadBinBuffer(binMeta, binBuffer);
+        uint8_t* fpList = binBuffer.data() + CHUNK_HASH_SIZE + sizeof(uint32_t);
+
+        foundList.assign(binMeta.fpNum, 1);
+        if (isFiltered) {
+            this->ReadIndexStoreBatch(fpList, binMeta.fpNum, NULL, foundList.data());
+        }
+        uint32_t fpNum = 0;
+        for (size_t i = 0; i < binMeta.fpNum; i++) {
+            if (foundList[i] != 0) {
+                memmove(fpList + fpNum * CHUNK_HASH_SIZE, fpList + i * CHUNK_HASH_SIZE,
+                    CHUNK_HASH_SIZE);
+                fpNum++;
+            }
+        }
+        dropNum += binMeta.fpNum - fpNum;
+        if (fpNum == 0) {
+            it = primaryIndex_.erase(it);
+            continue;
+        }
+        memcpy(binBuffer.data() + CHUNK_HASH_SIZE, &fpNum, sizeof(fpNum));
+        uint64_t recordSize = CHUNK_HASH_SIZE + sizeof(fpNum) + (uint64_t)fpNum * CHUNK_HASH_SIZE;
+        this->WriteBinFile(newFd, binBuffer.data(), recordSize, newOffset);
+        binMeta = { newOffset, fpNum };
+        newOffset += recordSize;
+        it++;
+    }
+
+    if (fsync(newFd) != 0 || rename(newFileName.c_str(), binFileName_.c_str()) != 0) {
+        tool::Logging(myName_.c_str(), "cannot replace the bin file: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    tool::SyncParentDir(binFileName_);
+    close(binFd_);
+    binFd_ = newFd;
+    binFileSize_ = newOffset;
+    liveBinSize_ = newOffset;
+    binEpoch_++;
+    binCompactNum_++;
+    if (isFiltered) {
+        tool::Logging(myName_.c_str(), "drop %lu fingerprints missing from the full index "
+                                       "from the bins.\n",
+            dropNum);
+    }
+    return;
+}
+
+/**
+ * @brief write a buffer to the bin file at an offset
+ *
+ * @param fd the file descriptor
+ * @param buffer the buffer
+ * @param bufferSize the buffer size
+ * @param offset the file offset
+ */
+void ExtremeBinIndex::WriteBinFile(int fd, const uint8_t* buffer, size_t bufferSize,
+    uint64_t offset)
+{
+    size_t writeOffset = 0;
+    while (writeOffset < bufferSize) {
+        ssize_t writeSize = pwrite(fd, buffer + writeOffset, bufferSize - writeOffset,
+            offset + writeOffset);
+        if (writeSize < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tool::Logging(myName_.c_str(), "cannot write the bin file: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        writeOffset += writeSize;
+    }
+    return;
+}
+
+/**
+ * @brief read the fingerprints of a bin and append them to a buffer
+ *
+ * @param binMeta the position of the bin
+ * @param fpBuffer the buffer
+ */
+void ExtremeBinIndex::ReadBinBuffer(const BinMeta_t& binMeta, vector<uint8_t>& fpBuffer)
+{
+    uint64_t fpSize = (uint64_t)binMeta.fpNum * CHUNK_HASH_SIZE;
+    size_t bufferSize = fpBuffer.size();
+    fpBuffer.resize(bufferSize + fpSize);
+    if (pread(binFd_, fpBuffer.data() + bufferSize, fpSize,
+            binMeta.offset + CHUNK_HASH_SIZE + sizeof(uint32_t))
+        != (ssize_t)fpSize) {
+        tool::Logging(myName_.c_str(), "cannot read the bin file: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    return;
+}
+
+/**
+ * @brief read a bin from the bin file
+ *
+ * @param binMeta the position of the bin
+ * @param binSet the fingerprints of the bin
+ */
+void ExtremeBinIndex::ReadBin(const BinMeta_t& binMeta, unordered_set<string>& binSet)
+{
+    vector<uint8_t> fpBuffer;
+    this->ReadBinBuffer(binMeta, fpBuffer);
+    binSet.reserve(binSet.size() + binMeta.fpNum);
+    for (size_t i = 0; i < binMeta.fpNum; i++) {
+        binSet.emplace((const char*)fpBuffer.data() + i * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+    }
+    return;
+}
+
+/**
+ * @brief pick the representative of a file and load its bin
+ *
+ * @param fileBin the bin of the file
+ * @param fpList the fingerprints of the first batch of the file (CHUNK_HASH_SIZE bytes each)
+ * @param fpNum the number of fingerprints
+ */
+void ExtremeBinIndex::LoadFileBin(FileBin_t* fileBin, const uint8_t* fpList, uint32_t fpNum)
+{
+    // the minimum fingerprint, similar files likely share it
+    const uint8_t* minFp = fpList;
+    for (size_t i = 1; i < fpNum; i++) {
+        const uint8_t* fp = fpList + i * CHUNK_HASH_SIZE;
+        if (memcmp(fp, minFp, CHUNK_HASH_SIZE) < 0) {
+            minFp = fp;
+        }
+    }
+    fileBin->rep.assign((const char*)minFp, CHUNK_HASH_SIZE);
+    fileBin->binOffset = UINT64_MAX;
+
+    BinMeta_t binMeta;
+    bool isFound = false;
+    pthread_rwlock_rdlock(&binFileLck_);
+    fileBin->binEpoch = binEpoch_;
+    {
+        lock_guard<mutex> lock(binLck_);
+        auto findResult = primaryIndex_.find(fileBin->rep);
+        if (findResult != primaryIndex_.end()) {
+            binMeta = findResult->second;
+            isFound = true;
+        }
+    }
+    // a record is never changed once written, read it without the lock
+    if (isFound) {
+        this->ReadBin(binMeta, fileBin->binSet);
+        fileBin->binOffset = binMeta.offset;
+        binLoadNum_++;
+    }
+    pthread_rwlock_unlock(&binFileLck_);
+    return;
+}
+
+/**
+ * @brief get the bin of the file under upload in a session
+ *
+ * @param curClient the current client var
+ * @return FileBin_t* the bin of the file
+ */
+FileBin_t* ExtremeBinIndex::GetFileBin(ClientVar* curClient)
+{
+    lock_guard<mutex> lock(fileLck_);
+    FileBin_t*& fileBin = fileBinMap_[curClient];
+    if (fileBin == NULL) {
+        fileBin = new FileBin_t();
+        fileBin->binOffset = UINT64_MAX;
+        fileBin->binEpoch = 0;
+    }
+    return fileBin;
+}
+
+/**
+ * @brief look up a batch of fingerprints against the bin of its file
+ *
+ * @param fpList the fingerprints (CHUNK_HASH_SIZE bytes each)
+ * @param fpNum the number of fingerprints
+ * @param foundList whether each fingerprint is a duplicate (1: duplicate, 0: new),
+ * the i-th one is written after the i-th fingerprint is read
+ * @param curClient the current client var (NULL: the batch is looked up as a file)
+ * @return uint32_t the number of duplicates
+ */
+uint32_t ExtremeBinIndex::LookupBatch(const uint8_t* fpList, uint32_t fpNum, uint8_t* foundList,
+    ClientVar* curClient)
+{
+    if (fpNum == 0) {
+        return 0;
+    }
+    lookupBatchNum_++;
+
+    // the first batch of a file picks its bin, the whole file for a file within a batch
+    FileBin_t batchBin;
+    FileBin_t* fileBin = &batchBin;
+    if (curClient != NULL) {
+        fileBin = this->GetFileBin(curClient);
+    }
+    if (fileBin->rep.empty()) {
+        this->LoadFileBin(fileBin, fpList, fpNum);
+    }
+
+    // deduplicate against the bin and the chunks of the file before
+    uint32_t dupNum = 0;
+    vector<uint32_t> newIdList;
+    vector<uint8_t> newHashList;
+    string fpStr;
+    for (size_t i = 0; i < fpNum; i++) {
+        fpStr.assign((const char*)fpList + i * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+        uint8_t isFound = (fileBin->binSet.count(fpStr) != 0
+            || fileBin->fileSet.count(fpStr) != 0);
+        if (isFound == 0 && dedupLossCheck_) {
+            newIdList.push_back(i);
+            newHashList.insert(newHashList.end(), fpStr.begin(), fpStr.end());
+        }
+        foundList[i] = isFound;
+        dupNum += isFound;
+    }
+    foundDupNum_ += dupNum;
+
+    // the dedup loss: the new ones in the full index
+    if (!newIdList.empty()) {
+        vector<uint8_t> fullFoundList(newIdList.size());
+        missedDupNum_ += this->ReadIndexStoreBatch(newHashList.data(), newIdList.size(), NULL,
+            fullFoundList.data());
+    }
+    return dupNum;
+}
+
+/**
+ * @brief process one batch of the current file
+ *
+ * @param recvChunkBuf the recv chunk buffer
+ * @param curClient the current client var
+ */
+void ExtremeBinIndex::ProcessOneBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient)
+{
+    if (!this->PrepareBatch(recvChunkBuf, curClient)) {
+        return;
+    }
+    // a chunk missing the bin is stored again even if another bin holds it
+    this->StoreNewChunks(curClient);
+
+    // all chunks of the batch are stored now
+    FileBin_t* fileBin = this->GetFileBin(curClient);
+    uint32_t chunkNum = curClient->_chunkAddrList.size();
+    const char* fpList = (const char*)curClient->_chunkHashList.data();
+    for (size_t i = 0; i < chunkNum; i++) {
+        fileBin->fileSet.emplace(fpList + i * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+    }
+    return;
+}
+
+/**
+ * @brief merge the chunks of the finished file into its bin
+ *
+ * @param curClient the current client var
+ */
+void ExtremeBinIndex::ProcessFileEnd(ClientVar* curClient)
+{
+    FileBin_t* fileBin = NULL;
+    {
+        lock_guard<mutex> lock(fileLck_);
+        auto findResult = fileBinMap_.find(curClient);
+        if (findResult == fileBinMap_.end()) {
+            return;
+        }
+        fileBin = findResult->second;
+        fileBinMap_.erase(findResult);
+        fileNum_++;
+    }
+    if (fileBin->rep.empty() || fileBin->fileSet.empty()) {
+        delete fileBin;
+        return;
+    }
+
+    // the bin is written again with the new chunks of the file, a lost bin
+    // only loses some deduplication, so it is not synced, and the chunks of the
+    // containers lost with a crash are dropped on the next startup. The record
+    // is built and written without the lock, which only guards the file offset
+    // and the primary index.
+    vector<uint8_t> binBuffer;
+    bool needCompaction = false;
+    pthread_rwlock_rdlock(&binFileLck_);
+    while (true) {
+        BinMeta_t binMeta;
+        bool isFound = false;
+        {
+            lock_guard<mutex> lock(binLck_);
+            auto findResult = primaryIndex_.find(fileBin->rep);
+            if (findResult != primaryIndex_.end()) {
+                binMeta = findResult->second;
+                isFound = true;
+            }
+        }
+        if (isFound && (binMeta.offset != fileBin->binOffset
+                || fileBin->binEpoch != binEpoch_)) {
+            // another file updates the bin meanwhile, or the compaction moves it,
+            // a version holds all before it
+            fileBin->binSet.clear();
+            this->ReadBin(binMeta, fileBin->binSet);
+            fileBin->binOffset = binMeta.offset;
+            fileBin->binEpoch = binEpoch_;
+        }
+        size_t oldNum = fileBin->binSet.size();
+        fileBin->binSet.insert(fileBin->fileSet.begin(), fileBin->fileSet.end());
+        if (fileBin->binSet.size() == oldNum && isFound) {
+            break;
+        }
+
+        uint32_t fpNum = fileBin->binSet.size();
+        binBuffer.resize(CHUNK_HASH_SIZE + sizeof(fpNum) + (uint64_t)fpNum * CHUNK_HASH_SIZE);
+        uint8_t* writePos = binBuffer.data();
+        memcpy(writePos, fileBin->rep.c_str(), CHUNK_HASH_SIZE);
+        writePos += CHUNK_HASH_SIZE;
+        memcpy(writePos, &fpNum, sizeof(fpNum));
+        writePos += sizeof(fpNum);
+        for (auto& fp : fileBin->binSet) {
+            memcpy(writePos, fp.c_str(), CHUNK_HASH_SIZE);
+            writePos += CHUNK_HASH_SIZE;
+        }
+
+        uint64_t binOffset;
+        {
+            lock_guard<mutex> lock(binLck_);
+            binOffset = binFileSize_;
+            binFileSize_ += binBuffer.size();
+        }
+        this->WriteBinFile(binFd_, binBuffer.data(), binBuffer.size(), binOffset);
+
+        // the new version replaces the one it is merged from, otherwise it is
+        // merged again with the version written meanwhile
+        lock_guard<mutex> lock(binLck_);
+        auto findResult = primaryIndex_.find(fileBin->rep);
+        uint64_t curOffset = (findResult == primaryIndex_.end()) ? UINT64_MAX
+                                                                 : findResult->second.offset;
+        if (curOffset == fileBin->binOffset) {
+            if (findResult != primaryIndex_.end()) {
+                liveBinSize_ -= CHUNK_HASH_SIZE + sizeof(fpNum)
+                    + (uint64_t)findResult->second.fpNum * CHUNK_HASH_SIZE;
+            }
+            liveBinSize_ += binBuffer.size();
+            primaryIndex_[fileBin->rep] = { binOffset, fpNum };
+            binUpdateNum_++;
+            needCompaction = this->NeedCompaction();
+            break;
+        }
+    }
+    pthread_rwlock_unlock(&binFileLck_);
+    delete fileBin;
+
+    // each update appends a whole version of the bin, the old ones are reclaimed
+    // by rewriting the latest ones once they take too much space
+    if (needCompaction) {
+        pthread_rwlock_wrlock(&binFileLck_);
+        if (this->NeedCompaction()) {
+            this->RewriteBins(false);
+        }
+        pthread_rwlock_unlock(&binFileLck_);
+    }
+    return;
+}
@@ -0,0 +1,189 @@
+/**
+ * @file fingerprintFilter.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement the versioned bloom filter of the fingerprint index
+ * @version 0.1
+ * @date 2022-06-24
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/fingerprintFilter.h"
+
+/**
+ * @brief Construct a new Fingerprint Filter object
+ *
+ * @param bitsPerKey the number of bits per key
+ */
+FingerprintFilter::FingerprintFilter(uint32_t bitsPerKey)
+{
+    bitsPerKey_ = bitsPerKey;
+    // k = ln2 * (m / n) minimizes the false positive rate
+    hashNum_ = (uint32_t)(bitsPerKey_ * 0.69);
+    if (hashNum_ == 0) {
+        hashNum_ = 1;
+    }
+}
+
+/**
+ * @brief Destroy the Fingerprint Filter object
+ *
+ */
+FingerprintFilter::~FingerprintFilter()
+{
+    fprintf(stderr, "========FingerprintFilter Info========\n");
+    fprintf(stderr, "filter epoch: %u\n", epoch_);
+    fprintf(stderr, "filter size: %lu KiB\n", bitNum_ / 8 / 1024);
+    fprintf(stderr, "filter key num: %lu\n", baseKeyNum_ + deltaLog_.size() / FILTER_KEY_SIZE);
+    fprintf(stderr, "rebuild num: %lu\n", rebuildNum_);
+    fprintf(stderr, "full filter send num: %lu\n", fullSendNum_);
+    fprintf(stderr, "delta filter send num: %lu\n", deltaSendNum_);
+    fprintf(stderr, "======================================\n");
+}
+
+/**
+ * @brief set the bits of a key
+ *
+ * @param bitArray the bit array
+ * @param bitNum the number of bits
+ * @param key the key (FILTER_KEY_SIZE bytes)
+ */
+void FingerprintFilter::SetKeyBits(uint8_t* bitArray, uint64_t bitNum, const uint8_t* key)
+{
+    // the fingerprint is uniform, split it into two hashes (double hashing)
+    uint64_t hash1;
+    uint64_t hash2;
+    memcpy(&hash1, key, sizeof(uint64_t));
+    memcpy(&hash2, key + sizeof(uint64_t), sizeof(uint64_t));
+    hash2 |= 1;
+    for (size_t i = 0; i < hashNum_; i++) {
+        uint64_t bitPos = (hash1 + i * hash2) % bitNum;
+        bitArray[bitPos >> 3] |= (1 << (bitPos & 0x7));
+    }
+    return;
+}
+
+/**
+ * @brief add a new fingerprint to the current filter
+ *
+ * @param fp the fingerprint
+ */
+void FingerprintFilter::Insert(const string& fp)
+{
+    if (fp.size() < FILTER_KEY_SIZE) {
+        return;
+    }
+    lock_guard<mutex> lock(filterLck_);
+    if (bitNum_ != 0) {
+        this->SetKeyBits(bitArray_.data(), bitNum_, (uint8_t*)fp.data());
+    }
+    // the edges in this epoch fetch it as a delta
+    deltaLog_.insert(deltaLog_.end(), fp.begin(), fp.begin() + FILTER_KEY_SIZE);
+    return;
+}
+
+/**
+ * @brief check whether the filter should be rebuilt with a larger size
+ *
+ * @return true the keys exceed the capacity of the filter
+ * @return false otherwise
+ */
+bool FingerprintFilter::NeedRebuild()
+{
+    lock_guard<mutex> lock(filterLck_);
+    return (epoch_ == 0) || (baseKeyNum_ + deltaLog_.size() / FILTER_KEY_SIZE > capacity_);
+}
+
+/**
+ * @brief start to rebuild the filter for a given number of keys
+ *
+ * @param keyNum the number of keys in the index
+ */
+void FingerprintFilter::BeginRebuild(uint64_t keyNum)
+{
+    lock_guard<mutex> lock(filterLck_);
+    keyNum = max(keyNum, baseKeyNum_ + deltaLog_.size() / FILTER_KEY_SIZE);
+    // leave the room for the keys added before the next rebuild
+    newCapacity_ = max(keyNum * 2, FILTER_MIN_KEY_NUM);
+    newBitNum_ = (newCapacity_ * bitsPerKey_ + 63) / 64 * 64;
+    newBitArray_.assign(newBitNum_ / 8, 0);
+    newKeyNum_ = 0;
+    rebuildLogMark_ = deltaLog_.size();
+    return;
+}
+
+/**
+ * @brief add a key of the index to the filter under rebuild
+ *
+ * @param fp the fingerprint
+ */
+void FingerprintFilter::AddRebuildKey(const string& fp)
+{
+    if (fp.size() < FILTER_KEY_SIZE) {
+        return;
+    }
+    this->SetKeyBits(newBitArray_.data(), newBitNum_, (uint8_t*)fp.data());
+    newKeyNum_++;
+    return;
+}
+
+/**
+ * @brief replace the current filter with the rebuilt one (a new epoch)
+ *
+ */
+void FingerprintFilter::FinishRebuild()
+{
+    lock_guard<mutex> lock(filterLck_);
+    // the keys added during the traversal
+    for (size_t offset = rebuildLogMark_; offset < deltaLog_.size(); offset += FILTER_KEY_SIZE) {
+        this->SetKeyBits(newBitArray_.data(), newBitNum_, deltaLog_.data() + offset);
+        newKeyNum_++;
+    }
+
+    bitArray_.swap(newBitArray_);
+    bitNum_ = newBitNum_;
+    capacity_ = newCapacity_;
+    baseKeyNum_ = newKeyNum_;
+    deltaLog_.clear();
+    epoch_++;
+    rebuildNum_++;
+    vector<uint8_t>().swap(newBitArray_);
+
+    tool::Logging(myName_.c_str(), "rebuild the filter (epoch %u): %lu keys in %lu KiB.\n",
+        epoch_, baseKeyNum_, bitNum_ / 8 / 1024);
+    return;
+}
+
+/**
+ * @brief build the filter message for an edge, a delta if the edge is in
+ * the current epoch and the delta is smaller than the filter
+ *
+ * @param edgeHead the filter version of the edge
+ * @param msgBuffer the message (filter head + bit array or delta keys)
+ * @return int CLOUD_SEND_FILTER or CLOUD_SEND_FILTER_DELTA
+ */
+int FingerprintFilter::GetFilterMsg(FilterHead_t* edgeHead, vector<uint8_t>& msgBuffer)
+{
+    lock_guard<mutex> lock(filterLck_);
+    FilterHead_t filterHead;
+    filterHead.epoch = epoch_;
+    filterHead.hashNum = hashNum_;
+    filterHead.seqNum = deltaLog_.size() / FILTER_KEY_SIZE;
+    filterHead.bitNum = bitNum_;
+    msgBuffer.insert(msgBuffer.end(), (uint8_t*)&filterHead,
+        (uint8_t*)&filterHead + sizeof(FilterHead_t));
+
+    if (epoch_ != 0 && edgeHead->epoch == epoch_ && edgeHead->seqNum <= filterHead.seqNum
+        && (filterHead.seqNum - edgeHead->seqNum) * FILTER_KEY_SIZE < bitArray_.size()) {
+        msgBuffer.insert(msgBuffer.end(), deltaLog_.begin() + edgeHead->seqNum * FILTER_KEY_SIZE,
+            deltaLog_.end());
+        deltaSendNum_++;
+        return CLOUD_SEND_FILTER_DELTA;
+    }
+
+    // the whole filter (empty before the first build)
+    msgBuffer.insert(msgBuffer.end(), bitArray_.begin(), bitArray_.end());
+    fullSendNum_++;
+    return CLOUD_SEND_FILTER;
+}
@@ -0,0 +1,211 @@
+/**
+ * @file localityCache.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement the locality cache
+ * @version 0.1
+ * @date 2022-07-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/localityCache.h"
+
+/**
+ * @brief Construct a new Locality Cache object
+ *
+ * @param maxContainerNum the max number of cached containers
+ */
+LocalityCache::LocalityCache(uint32_t maxContainerNum)
+{
+    maxContainerNum_ = maxContainerNum;
+    containerNamePrefix_ = config.GetContainerRootPath();
+    containerNameTail_ = config.GetContainerSuffix();
+    lookupNum_ = 0;
+    hitNum_ = 0;
+    prefetchNum_ = 0;
+    unwrittenNum_ = 0;
+    batchStamp_ = 0;
+    pthread_rwlock_init(&cacheLck_, NULL);
+}
+
+/**
+ * @brief Destroy the Locality Cache object
+ *
+ */
+LocalityCache::~LocalityCache()
+{
+    uint64_t lookupNum = lookupNum_.load();
+    uint64_t hitNum = hitNum_.load();
+    fprintf(stderr, "========LocalityCache Info========\n");
+    fprintf(stderr, "max cached container num: %u\n", maxContainerNum_);
+    fprintf(stderr, "cached container num: %lu\n", containerMap_.size());
+    fprintf(stderr, "cached fingerprint num: %lu\n", fpMap_.size());
+    fprintf(stderr, "prefetch container num: %lu\n", prefetchNum_.load());
+    fprintf(stderr, "unwritten container skip num: %lu\n", unwrittenNum_.load());
+    fprintf(stderr, "evict container num: %lu\n", evictNum_);
+    fprintf(stderr, "lookup num: %lu\n", lookupNum);
+    fprintf(stderr, "cache hit ratio: %.4f\n", lookupNum == 0 ? 0 : (double)hitNum / lookupNum);
+    fprintf(stderr, "index probe num: %lu\n", lookupNum - hitNum);
+    fprintf(stderr, "index probe rate: %.4f\n",
+        lookupNum == 0 ? 0 : (double)(lookupNum - hitNum) / lookupNum);
+    fprintf(stderr, "==================================\n");
+
+    for (auto& it : containerMap_) {
+        delete it.second;
+    }
+    pthread_rwlock_destroy(&cacheLck_);
+}
+
+/**
+ * @brief read the fingerprints in the metadata section of a container
+ *
+ * @param containerName the container name
+ * @param fpList the fingerprints (CHUNK_HASH_SIZE bytes each)
+ * @return true the container is read
+ * @return false the container is not on the disk yet (or not a valid container)
+ */
+bool LocalityCache::ReadContainerMeta(const string& containerName, vector<uint8_t>& fpList)
+{
+    string readFileNameStr = containerNamePrefix_ + containerName + containerNameTail_;
+    int containerFd = open(readFileNameStr.c_str(), O_RDONLY);
+    if (containerFd < 0) {
+        return false;
+    }
+
+    // the same layout as the restore reads: chunk num, then the entries of chunk
+    // hash + offset + length (big endian)
+    bool isRead = false;
+    uint8_t chunkNumChar[4];
+    struct stat fileStat;
+    if (fstat(containerFd, &fileStat) == 0
+        && pread(containerFd, chunkNumChar, sizeof(chunkNumChar), 0) == sizeof(chunkNumChar)) {
+        size_t chunkNum = (chunkNumChar[3]) + ((size_t)chunkNumChar[2] << 8) + ((size_t)chunkNumChar[1] << 16) + ((size_t)chunkNumChar[0] << 24);
+        size_t entrySize = CHUNK_HASH_SIZE + 8;
+        size_t metaSize = chunkNum * entrySize;
+        // a corrupted or foreign file is not prefetched
+        if (metaSize + sizeof(chunkNumChar) > (size_t)fileStat.st_size
+            || metaSize + sizeof(chunkNumChar) > MAX_CONTAINER_SIZE) {
+            close(containerFd);
+            return false;
+        }
+        vector<uint8_t> metaBuffer(metaSize);
+        if (pread(containerFd, metaBuffer.data(), metaSize, 4) == (ssize_t)metaSize) {
+            fpList.resize(chunkNum * CHUNK_HASH_SIZE);
+            for (size_t i = 0; i < chunkNum; i++) {
+                memcpy(fpList.data() + i * CHUNK_HASH_SIZE, metaBuffer.data() + i * entrySize,
+                    CHUNK_HASH_SIZE);
+            }
+            isRead = true;
+        }
+    }
+    close(containerFd);
+    return isRead;
+}
+
+/**
+ * @brief evict the least recently hit container, the caller holds the write lock
+ *
+ */
+void LocalityCache::EvictContainer()
+{
+    // the cache keeps a few hundred containers, a scan is cheaper than an LRU
+    // list touched by every hit
+    auto victim = containerMap_.begin();
+    for (auto it = containerMap_.begin(); it != containerMap_.end(); it++) {
+        if (it->second->hitStamp.load() < victim->second->hitStamp.load()) {
+            victim = it;
+        }
+    }
+    CachedContainer_t* container = victim->second;
+    string fpStr;
+    for (size_t i = 0; i < container->fpList.size(); i += CHUNK_HASH_SIZE) {
+        fpStr.assign((const char*)container->fpList.data() + i, CHUNK_HASH_SIZE);
+        auto fpResult = fpMap_.find(fpStr);
+        // a fingerprint also in a later container stays
+        if (fpResult != fpMap_.end() && fpResult->second == container) {
+            fpMap_.erase(fpResult);
+        }
+    }
+    containerMap_.erase(victim);
+    delete container;
+    evictNum_++;
+    return;
+}
+
+/**
+ * @brief look up a batch of fingerprints in the cache
+ *
+ * @param fpList the fingerprints (CHUNK_HASH_SIZE bytes each)
+ * @param fpNum the number of fingerprints
+ * @param foundList whether each fingerprint is cached (1: cached, 0: not)
+ * @return uint32_t the number of cached fingerprints
+ */
+uint32_t LocalityCache::LookupBatch(const uint8_t* fpList, uint32_t fpNum, uint8_t* foundList)
+{
+    uint64_t stamp = ++batchStamp_;
+    uint32_t hitNum = 0;
+    string fpStr;
+    pthread_rwlock_rdlock(&cacheLck_);
+    for (size_t i = 0; i < fpNum; i++) {
+        fpStr.assign((const char*)fpList + i * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+        auto findResult = fpMap_.find(fpStr);
+        if (findResult == fpMap_.end()) {
+            foundList[i] = 0;
+            continue;
+        }
+        // a hit keeps its container
+        findResult->second->hitStamp.store(stamp, boost::memory_order_relaxed);
+        foundList[i] = 1;
+        hitNum++;
+    }
+    pthread_rwlock_unlock(&cacheLck_);
+    lookupNum_ += fpNum;
+    hitNum_ += hitNum;
+    return hitNum;
+}
+
+/**
+ * @brief prefetch the fingerprints of the containers into the cache
+ *
+ * @param containerNameSet the container names
+ */
+void LocalityCache::Prefetch(const unordered_set<string>& containerNameSet)
+{
+    string fpStr;
+    for (auto& containerName : containerNameSet) {
+        pthread_rwlock_rdlock(&cacheLck_);
+        bool isCached = (containerMap_.count(containerName) != 0);
+        pthread_rwlock_unlock(&cacheLck_);
+        if (isCached) {
+            continue;
+        }
+
+        // read the disk without the lock, a container still in the memory is skipped
+        CachedContainer_t* container = new CachedContainer_t();
+        if (!this->ReadContainerMeta(containerName, container->fpList)) {
+            delete container;
+            unwrittenNum_++;
+            continue;
+        }
+        // newer than the hits so far, so that it is not evicted at once
+        container->hitStamp = batchStamp_.load() + 1;
+
+        pthread_rwlock_wrlock(&cacheLck_);
+        if (!containerMap_.emplace(containerName, container).second) {
+            pthread_rwlock_unlock(&cacheLck_);
+            delete container;
+            continue;
+        }
+        for (size_t i = 0; i < container->fpList.size(); i += CHUNK_HASH_SIZE) {
+            fpStr.assign((const char*)container->fpList.data() + i, CHUNK_HASH_SIZE);
+            fpMap_[fpStr] = container;
+        }
+        while (containerMap_.size() > maxContainerNum_) {
+            this->EvictContainer();
+        }
+        pthread_rwlock_unlock(&cacheLck_);
+        prefetchNum_++;
+    }
+    return;
+}
@@ -19,6 +19,13 @@
 PlainIndex::PlainIndex(AbsDatabase* indexStore)
     : AbsIndex(indexStore)
 {
+    redundantChunkNum_ = 0;
+    redundantDataSize_ = 0;
+    dedupLossCheck_ = config.GetIndexDedupLossCheck();
+    // the other index types look up without the full index
+    if (config.GetIndexType() == OUT_ENCLAVE && config.GetLocalityCacheContainerNum() != 0) {
+        localityCache_ = new LocalityCache(config.GetLocalityCacheContainerNum());
+    }
     // tool::Logging(myName_.c_str(), "init the PlainIndex.\n");
 }
 
@@ -32,19 +39,84 @@ PlainIndex::~PlainIndex()
     // fprintf(stderr, "recv data size: %lu\n", totalRecvDataSize_);
     // fprintf(stderr, "recv batch num: %lu\n", totalBatchNum_);
     // fprintf(stderr, "logical chunk num: %lu\n", _logicalChunkNum);
-    fprintf(stderr, "total logical data size: %lu MiB\n", _logicalDataSize / (1024 * 1024));
+    fprintf(stderr, "total logical data size: %lu MiB\n", _logicalDataSize.load() / (1024 * 1024));
     // fprintf(stderr, "physical chunk num: %lu\n", _uniqueChunkNum);
-    fprintf(stderr, "total write data size: %lu MiB\n", _uniqueDataSize / (1024 * 1024));
+    fprintf(stderr, "total write data size: %lu MiB\n", _uniqueDataSize.load() / (1024 * 1024));
+    fprintf(stderr, "skipped upload chunk num: %lu\n", _skippedChunkNum.load());
+    fprintf(stderr, "verified edge fingerprint num: %lu\n", _verifiedChunkNum.load());
+    fprintf(stderr, "trusted edge fingerprint num: %lu\n", _trustedChunkNum.load());
+    fprintf(stderr, "in-flight chunk wait num: %lu\n", inflightWaitNum_.load());
     fprintf(stderr, "===============================\n");
+    if (localityCache_ != NULL) {
+        delete localityCache_;
+    }
 }
 
 /**
- * @brief process one batch
+ * @brief look up a batch of fingerprints for deduplication
+ *
+ * @param fpList the fingerprints (CHUNK_HASH_SIZE bytes each)
+ * @param fpNum the number of fingerprints
+ * @param foundList whether each fingerprint is a duplicate (1: duplicate, 0: new),
+ * the i-th one is written after the i-th fingerprint is read
+ * @param curClient the current client var (NULL: a query without the session)
+ * @return uint32_t the number of duplicates
+ */
+uint32_t PlainIndex::LookupBatch(const uint8_t* fpList, uint32_t fpNum, uint8_t* foundList,
+    ClientVar* curClient)
+{
+    if (localityCache_ == NULL) {
+        // the full index answers each fingerprint
+        return this->ReadIndexStoreBatch(fpList, fpNum, NULL, foundList);
+    }
+
+    // the cache answers first, the misses go to the full index at once, and
+    // the containers they hit there are prefetched for the next batches
+    uint32_t dupNum = localityCache_->LookupBatch(fpList, fpNum, foundList);
+    if (dupNum == fpNum) {
+        return dupNum;
+    }
+    vector<uint32_t> missIdList;
+    vector<uint8_t> missHashList;
+    missIdList.reserve(fpNum - dupNum);
+    missHashList.reserve((fpNum - dupNum) * CHUNK_HASH_SIZE);
+    for (size_t i = 0; i < fpNum; i++) {
+        if (foundList[i] == 0) {
+            missIdList.push_back(i);
+            missHashList.insert(missHashList.end(), fpList + i * CHUNK_HASH_SIZE,
+                fpList + (i + 1) * CHUNK_HASH_SIZE);
+        }
+    }
+    uint32_t missNum = missIdList.size();
+    vector<uint8_t> missFoundList(missNum);
+    vector<uint8_t> containerNameList(missNum * CONTAINER_ID_LENGTH);
+    dupNum += this->ReadIndexStoreBatch(missHashList.data(), missNum, containerNameList.data(),
+        missFoundList.data());
+
+    unordered_set<string> prefetchSet;
+    for (size_t i = 0; i < missNum; i++) {
+        foundList[missIdList[i]] = missFoundList[i];
+        if (missFoundList[i] != 0) {
+            prefetchSet.emplace((char*)containerNameList.data() + i * CONTAINER_ID_LENGTH,
+                CONTAINER_ID_LENGTH);
+        }
+    }
+    if (!prefetchSet.empty()) {
+        localityCache_->Prefetch(prefetchSet);
+    }
+    return dupNum;
+}
+
+/**
+ * @brief locate, fingerprint and look up the chunks of a batch, and list
+ * its new chunks in the fingerprint order (each one once)
  *
  * @param recvChunkBuf the recv chunk buffer
  * @param curClient the current client var
+ * @return true the new chunks are listed
+ * @return false the session is rejected
  */
-void PlainIndex::ProcessOneBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient)
+bool PlainIndex::PrepareBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient)
 {
     // update statistic
     totalRecvDataSize_ += recvChunkBuf->header->dataSize;
@@ -57,47 +129,218 @@ void PlainIndex::ProcessOneBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* curCl
     uint32_t chunkNum = recvChunkBuf->header->currentItemNum;
     // tool::Logging(myName_.c_str(), "chunk num is %d\n", chunkNum);
 
-    // start to process each chunk
-    string containerNameStr;
-    containerNameStr.resize(CONTAINER_ID_LENGTH, 0);
+    // a session with a forged fingerprint stores nothing more
+    if (curClient->_fpRejected) {
+        return false;
+    }
+    bool withFp = (recvChunkBuf->header->messageType == EDGE_MIGRATION_CHUNK_FP);
+
+    // locate each chunk in the batch
+    vector<uint8_t*>& chunkAddrList = curClient->_chunkAddrList;
+    vector<uint32_t>& chunkSizeList = curClient->_chunkSizeList;
+    vector<uint8_t>& chunkHashList = curClient->_chunkHashList;
+    chunkAddrList.resize(chunkNum);
+    chunkSizeList.resize(chunkNum);
+    chunkHashList.resize(chunkNum * CHUNK_HASH_SIZE);
     size_t currentOffset = 0;
     uint32_t tmpChunkSize = 0;
+    for (size_t i = 0; i < chunkNum; i++) {
+        memcpy(&tmpChunkSize, recvChunkBuf->dataBuffer + currentOffset, sizeof(tmpChunkSize));
+        currentOffset += sizeof(tmpChunkSize);
+        if (withFp) {
+            memcpy(chunkHashList.data() + i * CHUNK_HASH_SIZE,
+                recvChunkBuf->dataBuffer + currentOffset, CHUNK_HASH_SIZE);
+            currentOffset += CHUNK_HASH_SIZE;
+        }
+        chunkAddrList[i] = recvChunkBuf->dataBuffer + currentOffset;
+        chunkSizeList[i] = tmpChunkSize;
+        currentOffset += tmpChunkSize;
+    }
+
+    if (!withFp) {
+        // compute the hash over the ciphertext chunks in parallel
+        hashPoolObj_->HashBatch(chunkAddrList.data(), chunkSizeList.data(), chunkNum,
+            chunkHashList.data(), mdCtx);
+    }
+
+    // look up the whole batch at once
+    vector<uint8_t>& foundList = curClient->_indexFoundList;
+    foundList.resize(chunkNum);
+    this->LookupBatch(chunkHashList.data(), chunkNum, foundList.data(), curClient);
+
+    if (withFp) {
+        // trust the fingerprints from the edge after the verification, the
+        // chunks missing the index are always verified
+        if (!this->VerifyBatchFp(curClient)) {
+            tool::Logging(myName_.c_str(), "client %u sends a forged fingerprint.\n",
+                curClient->_clientID);
+            curClient->_fpRejected = true;
+            return false;
+        }
+    }
+
     string tmpHashStr;
     tmpHashStr.resize(CHUNK_HASH_SIZE, 0);
-    bool status;
+    if (curClient->_chunkQueried) {
+        // verify the chunks against the fingerprints queried before
+        for (size_t i = 0; i < chunkNum; i++) {
+            memcpy(&tmpHashStr[0], chunkHashList.data() + i * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+            if (curClient->_pendingChunkSet.erase(tmpHashStr) == 0) {
+                curClient->_unexpectedChunkNum++;
+            }
+        }
+    }
 
+    // the new chunks in the fingerprint order, a chunk appearing twice in the batch is stored once
+    vector<uint32_t>& newChunkList = curClient->_newChunkList;
+    newChunkList.clear();
     for (size_t i = 0; i < chunkNum; i++) {
-        // compute the hash over the ciphertext chunk
-        memcpy(&tmpChunkSize, recvChunkBuf->dataBuffer + currentOffset, sizeof(tmpChunkSize));
-        currentOffset += sizeof(tmpChunkSize);
+        if (foundList[i] == 0) {
+            newChunkList.push_back(i);
+        }
+    }
+    const uint8_t* fpList = chunkHashList.data();
+    auto fpLess = [fpList](uint32_t a, uint32_t b) {
+        return memcmp(fpList + a * CHUNK_HASH_SIZE, fpList + b * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE) < 0;
+    };
+    std::stable_sort(newChunkList.begin(), newChunkList.end(), fpLess);
+    newChunkList.erase(std::unique(newChunkList.begin(), newChunkList.end(),
+                           [&fpLess](uint32_t a, uint32_t b) {
+                               return !fpLess(a, b) && !fpLess(b, a);
+                           }),
+        newChunkList.end());
+    return true;
+}
 
-        cryptoObj_->GenerateHash(mdCtx, recvChunkBuf->dataBuffer + currentOffset,
-            tmpChunkSize, (uint8_t*)&tmpHashStr[0]);
+/**
+ * @brief store the new chunks listed by PrepareBatch without the reservation,
+ * a chunk is stored again if the lookup misses it
+ *
+ * @param curClient the current client var
+ */
+void PlainIndex::StoreNewChunks(ClientVar* curClient)
+{
+    vector<uint32_t>& newChunkList = curClient->_newChunkList;
+    uint32_t newNum = newChunkList.size();
+    if (newNum == 0) {
+        return;
+    }
+    std::sort(newChunkList.begin(), newChunkList.end());
+
+    const uint8_t* fpList = curClient->_chunkHashList.data();
+    vector<uint8_t>& newHashList = curClient->_newHashList;
+    vector<uint8_t>& newValueList = curClient->_newValueList;
+    newHashList.resize(newNum * CHUNK_HASH_SIZE);
+    newValueList.resize(newNum * CONTAINER_ID_LENGTH);
+    for (size_t i = 0; i < newNum; i++) {
+        memcpy(newHashList.data() + i * CHUNK_HASH_SIZE,
+            fpList + newChunkList[i] * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+    }
+    // the chunks in the full index are stored again
+    vector<uint8_t>& fullFoundList = curClient->_reservedFoundList;
+    fullFoundList.assign(newNum, 0);
+    if (dedupLossCheck_) {
+        this->ReadIndexStoreBatch(newHashList.data(), newNum, NULL, fullFoundList.data());
+    }
+
+    string tmpHashStr;
+    tmpHashStr.resize(CHUNK_HASH_SIZE, 0);
+    string containerNameStr;
+    containerNameStr.resize(CONTAINER_ID_LENGTH, 0);
+    for (size_t i = 0; i < newNum; i++) {
+        uint32_t chunkId = newChunkList[i];
+        uint32_t chunkSize = curClient->_chunkSizeList[chunkId];
+        memcpy(&tmpHashStr[0], fpList + chunkId * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+        storageCoreObj_->SaveChunk((char*)curClient->_chunkAddrList[chunkId], chunkSize,
+            tmpHashStr, containerNameStr, curClient);
+        memcpy(newValueList.data() + i * CONTAINER_ID_LENGTH, containerNameStr.c_str(),
+            CONTAINER_ID_LENGTH);
+        _uniqueChunkNum++;
+        _uniqueDataSize += chunkSize;
+        if (fullFoundList[i] != 0) {
+            redundantChunkNum_++;
+            redundantDataSize_ += chunkSize;
+        }
+    }
+    // the full index locates the chunks for the restore
+    this->UpdateIndexStoreBatch(newHashList.data(), newNum, newValueList.data());
+    return;
+}
 
-#if (MULTI_CLIENT == 1)
-        pthread_rwlock_wrlock(&outIdxLck_);
-#endif
+/**
+ * @brief process one batch
+ *
+ * @param recvChunkBuf the recv chunk buffer
+ * @param curClient the current client var
+ */
+void PlainIndex::ProcessOneBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient)
+{
+    if (!this->PrepareBatch(recvChunkBuf, curClient)) {
+        return;
+    }
+    vector<uint32_t>& newChunkList = curClient->_newChunkList;
+    if (newChunkList.empty()) {
+        return;
+    }
+    vector<uint8_t*>& chunkAddrList = curClient->_chunkAddrList;
+    vector<uint32_t>& chunkSizeList = curClient->_chunkSizeList;
+    const uint8_t* fpList = curClient->_chunkHashList.data();
+    string tmpHashStr;
+    tmpHashStr.resize(CHUNK_HASH_SIZE, 0);
 
-        status = this->ReadIndexStore(tmpHashStr, containerNameStr);
-        if (!status) {
-            storageCoreObj_->SaveChunk((char*)recvChunkBuf->dataBuffer + currentOffset, tmpChunkSize,
-                tmpHashStr, containerNameStr, curClient);
+    // only one session stores a new chunk, the others find it in the index
+    // afterwards. The reservations follow the fingerprint order, so that two
+    // sessions never wait for each other.
+    uint32_t reservedNum = newChunkList.size();
+    vector<uint8_t>& reservedHashList = curClient->_reservedHashList;
+    vector<uint8_t>& reservedFoundList = curClient->_reservedFoundList;
+    reservedHashList.resize(reservedNum * CHUNK_HASH_SIZE);
+    reservedFoundList.resize(reservedNum);
+    for (size_t i = 0; i < reservedNum; i++) {
+        memcpy(&tmpHashStr[0], fpList + newChunkList[i] * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+        this->ReserveChunk(tmpHashStr);
+        memcpy(reservedHashList.data() + i * CHUNK_HASH_SIZE, tmpHashStr.c_str(), CHUNK_HASH_SIZE);
+    }
+    this->ReadIndexStoreBatch(reservedHashList.data(), reservedNum, NULL,
+        reservedFoundList.data());
 
-            this->UpdateIndexStore(tmpHashStr, containerNameStr);
-            _uniqueChunkNum++;
-            _uniqueDataSize += tmpChunkSize;
+    // store the chunks still missing the index in the order of the batch
+    uint32_t newNum = 0;
+    for (size_t i = 0; i < reservedNum; i++) {
+        if (reservedFoundList[i] == 0) {
+            newChunkList[newNum++] = newChunkList[i];
         }
-#if (MULTI_CLIENT == 1)
-        pthread_rwlock_unlock(&outIdxLck_);
-#endif
-        currentOffset += tmpChunkSize;
-        // update the statistic
-        // _logicalDataSize += tmpChunkSize;
-        // _logicalChunkNum++;
     }
+    newChunkList.resize(newNum);
+    std::sort(newChunkList.begin(), newChunkList.end());
+
+    vector<uint8_t>& newHashList = curClient->_newHashList;
+    vector<uint8_t>& newValueList = curClient->_newValueList;
+    newHashList.resize(newNum * CHUNK_HASH_SIZE);
+    newValueList.resize(newNum * CONTAINER_ID_LENGTH);
+    string containerNameStr;
+    containerNameStr.resize(CONTAINER_ID_LENGTH, 0);
+    for (size_t i = 0; i < newNum; i++) {
+        uint32_t chunkId = newChunkList[i];
+        memcpy(&tmpHashStr[0], fpList + chunkId * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+        // the container belongs to the session, append it outside the index locks
+        storageCoreObj_->SaveChunk((char*)chunkAddrList[chunkId], chunkSizeList[chunkId],
+            tmpHashStr, containerNameStr, curClient);
+        memcpy(newHashList.data() + i * CHUNK_HASH_SIZE, tmpHashStr.c_str(), CHUNK_HASH_SIZE);
+        memcpy(newValueList.data() + i * CONTAINER_ID_LENGTH, containerNameStr.c_str(),
+            CONTAINER_ID_LENGTH);
+        _uniqueChunkNum++;
+        _uniqueDataSize += chunkSizeList[chunkId];
+    }
+    this->UpdateIndexStoreBatch(newHashList.data(), newNum, newValueList.data());
 
-    // reset
-    memset(recvChunkBuf->dataBuffer, 0, sendChunkBatchSize_ * sizeof(Chunk_t));
+    for (size_t i = 0; i < reservedNum; i++) {
+        tmpHashStr.assign((char*)reservedHashList.data() + i * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+        this->ReleaseChunk(tmpHashStr);
+    }
+    // update the statistic
+    // _logicalDataSize += tmpChunkSize;
+    // _logicalChunkNum++;
     return;
 }
 
@@ -108,38 +351,84 @@ void PlainIndex::ProcessRecipeBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* cu
     // tool::Logging("sec recipe", "entry num is %d\n", entryNum);
     uint8_t* entryBase = recvChunkBuf->dataBuffer;
 
-    string tmpHashStr;
-    string tmpContainerNameStr;
-    tmpContainerNameStr.resize(CONTAINER_ID_LENGTH, 0);
-    bool status;
-    uint8_t* statusList;
-
-    statusList = (uint8_t*)malloc(sizeof(uint8_t) * entryNum);
+    // reuse the status list of the session
+    curClient->_queryStatusList.resize(entryNum);
+    uint8_t* statusList = curClient->_queryStatusList.data();
 
     // 首先写recipe
     curClient->_secureRecipeWriteHandler.write((char*)recvChunkBuf->dataBuffer,
         recvChunkBuf->header->dataSize);
     // tool::PrintBinaryArray(recvChunkBuf->sendBuffer, CHUNK_HASH_SIZE);
-    //  查询index
+    //  查询index, the lookup of the session knows its file
+    this->LookupBatch(entryBase, entryNum, statusList, curClient);
+    for (size_t i = 0; i < entryNum; i++) {
+        statusList[i] ^= 1;
+    }
+
+    // tool::PrintBinaryArray(statusList, sizeof(uint8_t) * entryNum);
+    recvChunkBuf->header->messageType = CLOUD_QUERY_RETURN;
+    recvChunkBuf->header->dataSize = this->EncodeQueryReply(statusList, entryNum,
+        curClient->_replyCap, recvChunkBuf->dataBuffer);
+
+    return;
+}
+
+/**
+ * @brief query the index for a batch of secure recipe entries
+ *
+ * @param entryBase the fingerprints of the entries
+ * @param entryNum the number of entries
+ * @param statusList the status of each entry (0: duplicate, 1: unique)
+ */
+void PlainIndex::QueryRecipeBatch(uint8_t* entryBase, uint32_t entryNum, uint8_t* statusList)
+{
+    // the found list turns into the status list in place
+    this->LookupBatch(entryBase, entryNum, statusList, NULL);
+    for (size_t i = 0; i < entryNum; i++) {
+        statusList[i] ^= 1;
+    }
+    return;
+}
+
+/**
+ * @brief answer which chunks of a batch of fingerprints need to be uploaded
+ *
+ * @param recvChunkBuf the recv chunk buffer (turned into the reply)
+ * @param curClient the current client var
+ */
+void PlainIndex::ProcessChunkQuery(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient)
+{
+    uint32_t entryNum = recvChunkBuf->header->currentItemNum;
+    uint8_t* entryBase = recvChunkBuf->dataBuffer;
+    if (recvChunkBuf->header->dataSize != (uint64_t)entryNum * CHUNK_HASH_SIZE) {
+        tool::Logging(myName_.c_str(), "wrong size of the chunk query.\n");
+        exit(EXIT_FAILURE);
+    }
+    curClient->_chunkQueried = true;
+
+    curClient->_queryStatusList.resize(entryNum);
+    uint8_t* statusList = curClient->_queryStatusList.data();
+    vector<uint8_t>& foundList = curClient->_indexFoundList;
+    foundList.resize(entryNum);
+    this->LookupBatch(entryBase, entryNum, foundList.data(), curClient);
+
+    string tmpHashStr;
     for (size_t i = 0; i < entryNum; i++) {
         tmpHashStr.assign((char*)(entryBase), CHUNK_HASH_SIZE);
         entryBase += CHUNK_HASH_SIZE;
-        status = this->ReadIndexStore(tmpHashStr, tmpContainerNameStr);
-        // std::cout << "secFP" << std::endl;
-        // tool::PrintBinaryArray((uint8_t*)&tmpHashStr[0], CHUNK_HASH_SIZE);
-        if (status == true) {
+        // the chunk is stored or already asked in this session
+        if (foundList[i]
+            || curClient->_pendingChunkSet.find(tmpHashStr) != curClient->_pendingChunkSet.end()) {
             statusList[i] = 0;
+            _skippedChunkNum++;
         } else {
-            // string emptyContainerName = " ";
-            // this->UpdateIndexStore(tmpHashStr, emptyContainerName);
             statusList[i] = 1;
+            curClient->_pendingChunkSet.insert(tmpHashStr);
         }
     }
 
-    // tool::PrintBinaryArray(statusList, sizeof(uint8_t) * entryNum);
-    memcpy(recvChunkBuf->dataBuffer, statusList, entryNum);
-    recvChunkBuf->header->messageType = CLOUD_QUERY_RETURN;
-    recvChunkBuf->header->dataSize = entryNum;
-
+    recvChunkBuf->header->messageType = CLOUD_CHUNK_QUERY_RETURN;
+    recvChunkBuf->header->dataSize = this->EncodeQueryReply(statusList, entryNum,
+        curClient->_replyCap, recvChunkBuf->dataBuffer);
     return;
 }
\ No newline at end of file
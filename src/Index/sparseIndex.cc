@@ -0,0 +1,452 @@
+/**
+ * @file sparseIndex.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement sparse index
+ * @version 0.1
+ * @date 2022-07-06
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/sparseIndex.h"
+
+/**
+ * @brief Construct a new Sparse Index object
+ *
+ * @param indexStore the reference to the index store
+ */
+SparseIndex::SparseIndex(AbsDatabase* indexStore)
+    : PlainIndex(indexStore)
+{
+    sampleMask_ = (1U << SPARSE_SAMPLE_RATE) - 1;
+    lookupBatchNum_ = 0;
+    championLoadNum_ = 0;
+    manifestReadNum_ = 0;
+    sparseDupNum_ = 0;
+    missedDupNum_ = 0;
+    pthread_rwlock_init(&hookLck_, NULL);
+    manifestCache_ = new ManifestCache_t(SPARSE_MANIFEST_CACHE_NUM);
+    manifestFileName_ = config.GetFp2ChunkDBName() + "-manifest";
+    this->LoadManifests();
+}
+
+/**
+ * @brief Destroy the Sparse Index object
+ *
+ */
+SparseIndex::~SparseIndex()
+{
+    // the memory of the hooks, without the overhead of the hash map
+    uint64_t hookMemSize = 0;
+    for (auto& it : hookIndex_) {
+        hookMemSize += CHUNK_HASH_SIZE + it.second.size() * sizeof(uint32_t);
+    }
+    uint64_t foundNum = sparseDupNum_.load();
+    uint64_t missedNum = missedDupNum_.load();
+    uint64_t lookupBatchNum = lookupBatchNum_.load();
+
+    fprintf(stderr, "========SparseIndex Info========\n");
+    fprintf(stderr, "manifest num: %lu\n", manifestList_.size());
+    fprintf(stderr, "manifest file size (MiB): %.2f\n", (double)manifestFileSize_ / 1024 / 1024);
+    fprintf(stderr, "hook num: %lu\n", hookIndex_.size());
+    fprintf(stderr, "hook memory (MiB): %.2f\n", (double)hookMemSize / 1024 / 1024);
+    fprintf(stderr, "lookup batch num: %lu\n", lookupBatchNum);
+    fprintf(stderr, "champions per batch: %.2f\n",
+        lookupBatchNum == 0 ? 0 : (double)championLoadNum_.load() / lookupBatchNum);
+    fprintf(stderr, "manifest read num: %lu\n", manifestReadNum_.load());
+    fprintf(stderr, "found duplicate num: %lu\n", foundNum);
+    if (dedupLossCheck_) {
+        fprintf(stderr, "missed duplicate num: %lu\n", missedNum);
+        fprintf(stderr, "dedup loss against the full index: %.4f\n",
+            foundNum + missedNum == 0 ? 0 : (double)missedNum / (foundNum + missedNum));
+        fprintf(stderr, "redundant stored chunk num: %lu\n", redundantChunkNum_.load());
+        fprintf(stderr, "redundant stored data size (MiB): %.2f\n",
+            (double)redundantDataSize_.load() / 1024 / 1024);
+    }
+    fprintf(stderr, "================================\n");
+
+    if (manifestFd_ >= 0) {
+        close(manifestFd_);
+    }
+    delete manifestCache_;
+    pthread_rwlock_destroy(&hookLck_);
+}
+
+/**
+ * @brief index the hooks of a manifest, the caller holds the write lock of the hooks
+ *
+ * @param fpList the fingerprints of the manifest (CHUNK_HASH_SIZE bytes each)
+ * @param fpNum the number of fingerprints
+ * @param manifestId the manifest id
+ */
+void SparseIndex::IndexHooks(const uint8_t* fpList, uint32_t fpNum, uint32_t manifestId)
+{
+    string hookStr;
+    for (size_t i = 0; i < fpNum; i++) {
+        const uint8_t* fp = fpList + i * CHUNK_HASH_SIZE;
+        if (!this->IsHook(fp)) {
+            continue;
+        }
+        hookStr.assign((const char*)fp, CHUNK_HASH_SIZE);
+        vector<uint32_t>& manifestIdList = hookIndex_[hookStr];
+        if (!manifestIdList.empty() && manifestIdList.back() == manifestId) {
+            // the hook appears twice in the segment
+            continue;
+        }
+        // only keep the latest manifests of a hook
+        if (manifestIdList.size() >= SPARSE_MANIFIEST_CAP_NUM) {
+            manifestIdList.erase(manifestIdList.begin());
+        }
+        manifestIdList.push_back(manifestId);
+    }
+    return;
+}
+
+/**
+ * @brief write a buffer to the manifest file at an offset
+ *
+ * @param fd the file descriptor
+ * @param buffer the buffer
+ * @param bufferSize the buffer size
+ * @param offset the file offset
+ */
+void SparseIndex::WriteManifestFile(int fd, const uint8_t* buffer, size_t bufferSize,
+    uint64_t offset)
+{
+    size_t writeOffset = 0;
+    while (writeOffset < bufferSize) {
+        ssize_t writeSize = pwrite(fd, buffer + writeOffset, bufferSize - writeOffset,
+            offset + writeOffset);
+        if (writeSize < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tool::Logging(myName_.c_str(), "cannot write the manifest file: %s\n",
+                strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        writeOffset += writeSize;
+    }
+    return;
+}
+
+/**
+ * @brief load the manifest file and rebuild the hooks from it, the fingerprints
+ * missing from the full index are dropped
+ *
+ */
+void SparseIndex::LoadManifests()
+{
+    manifestFd_ = open(manifestFileName_.c_str(), O_RDWR | O_CREAT, 0644);
+    struct stat fileStat;
+    if (manifestFd_ < 0 || fstat(manifestFd_, &fileStat) != 0) {
+        tool::Logging(myName_.c_str(), "cannot open the manifest file %s: %s\n",
+            manifestFileName_.c_str(), strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    // a manifest is saved before the containers of its chunks, so after a crash it
+    // can hold the chunks of a lost container, which the full index does not keep
+    // (see NeedDurableValue). Such chunks are dropped by rewriting the manifests to
+    // a new file, started at the first manifest losing a chunk
+    string newFileName = manifestFileName_ + ".new";
+    int newFd = -1;
+    uint64_t newOffset = 0;
+    uint64_t dropNum = 0;
+
+    // the hooks are sampled from the manifests, so they are not saved
+    uint64_t fileSize = fileStat.st_size;
+    uint64_t offset = 0;
+    vector<uint8_t> fpBuffer;
+    vector<uint8_t> foundList;
+    while (offset + sizeof(uint32_t) <= fileSize) {
+        uint32_t fpNum;
+        if (pread(manifestFd_, &fpNum, sizeof(fpNum), offset) != sizeof(fpNum)) {
+            break;
+        }
+        uint64_t fpSize = (uint64_t)fpNum * CHUNK_HASH_SIZE;
+        if (offset + sizeof(fpNum) + fpSize > fileSize) {
+            break;
+        }
+        fpBuffer.resize(sizeof(fpNum) + fpSize);
+        uint8_t* fpList = fpBuffer.data() + sizeof(fpNum);
+        if (pread(manifestFd_, fpList, fpSize, offset + sizeof(fpNum)) != (ssize_t)fpSize) {
+            break;
+        }
+        offset += sizeof(fpNum) + fpSize;
+
+        foundList.resize(fpNum);
+        uint32_t keepNum = this->ReadIndexStoreBatch(fpList, fpNum, NULL, foundList.data());
+        if (keepNum != fpNum) {
+            if (newFd < 0) {
+                newFd = open(newFileName.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+                if (newFd < 0) {
+                    tool::Logging(myName_.c_str(), "cannot open the manifest file %s: %s\n",
+                        newFileName.c_str(), strerror(errno));
+                    exit(EXIT_FAILURE);
+                }
+                // the manifests before are kept as they are
+                vector<uint8_t> copyBuffer(MAX_CONTAINER_SIZE);
+                for (uint64_t copyOffset = 0; copyOffset < newOffset;) {
+                    size_t copySize = std::min((uint64_t)copyBuffer.size(), newOffset - copyOffset);
+                    if (pread(manifestFd_, copyBuffer.data(), copySize, copyOffset)
+                        != (ssize_t)copySize) {
+                        tool::Logging(myName_.c_str(), "cannot read the manifest file: %s\n",
+                            strerror(errno));
+                        exit(EXIT_FAILURE);
+                    }
+                    this->WriteManifestFile(newFd, copyBuffer.data(), copySize, copyOffset);
+                    copyOffset += copySize;
+                }
+            }
+            uint32_t curNum = 0;
+            for (size_t i = 0; i < fpNum; i++) {
+                if (foundList[i] != 0) {
+                    memmove(fpList + curNum * CHUNK_HASH_SIZE, fpList + i * CHUNK_HASH_SIZE,
+                        CHUNK_HASH_SIZE);
+                    curNum++;
+                }
+            }
+            dropNum += fpNum - keepNum;
+            fpNum = keepNum;
+            if (fpNum == 0) {
+                continue;
+            }
+        }
+        memcpy(fpBuffer.data(), &fpNum, sizeof(fpNum));
+        uint64_t recordSize = sizeof(fpNum) + (uint64_t)fpNum * CHUNK_HASH_SIZE;
+        if (newFd >= 0) {
+            this->WriteManifestFile(newFd, fpBuffer.data(), recordSize, newOffset);
+        }
+        this->IndexHooks(fpList, fpNum, manifestList_.size());
+        manifestList_.push_back({ newOffset, fpNum });
+        newOffset += recordSize;
+    }
+
+    if (newFd >= 0) {
+        tool::Logging(myName_.c_str(), "drop %lu fingerprints missing from the full index "
+                                       "from the manifests.\n",
+            dropNum);
+        if (fsync(newFd) != 0 || rename(newFileName.c_str(), manifestFileName_.c_str()) != 0) {
+            tool::Logging(myName_.c_str(), "cannot replace the manifest file: %s\n",
+                strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        tool::SyncParentDir(manifestFileName_);
+        close(manifestFd_);
+        manifestFd_ = newFd;
+    } else if (offset != fileSize) {
+        tool::Logging(myName_.c_str(), "drop a torn manifest at the end of the manifest file.\n");
+        if (ftruncate(manifestFd_, offset) != 0) {
+            tool::Logging(myName_.c_str(), "cannot truncate the manifest file: %s\n",
+                strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+    }
+    manifestFileSize_ = newOffset;
+    return;
+}
+
+/**
+ * @brief get a manifest from the cache or the manifest file
+ *
+ * @param manifestId the manifest id
+ * @return std::shared_ptr<Manifest_t> the manifest
+ */
+std::shared_ptr<Manifest_t> SparseIndex::GetManifest(uint32_t manifestId)
+{
+    std::shared_ptr<Manifest_t> manifest;
+    if (manifestCache_->tryGet(manifestId, manifest)) {
+        return manifest;
+    }
+
+    ManifestMeta_t manifestMeta;
+    {
+        lock_guard<mutex> lock(manifestLck_);
+        manifestMeta = manifestList_[manifestId];
+    }
+    uint64_t fpSize = (uint64_t)manifestMeta.fpNum * CHUNK_HASH_SIZE;
+    vector<char> fpBuffer(fpSize);
+    if (pread(manifestFd_, fpBuffer.data(), fpSize, manifestMeta.offset + sizeof(uint32_t))
+        != (ssize_t)fpSize) {
+        tool::Logging(myName_.c_str(), "cannot read the manifest %u: %s\n", manifestId,
+            strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    manifest = std::make_shared<Manifest_t>();
+    manifest->reserve(manifestMeta.fpNum);
+    for (size_t i = 0; i < manifestMeta.fpNum; i++) {
+        manifest->emplace(fpBuffer.data() + i * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+    }
+    manifestReadNum_++;
+    manifestCache_->insert(manifestId, manifest);
+    return manifest;
+}
+
+/**
+ * @brief save the manifest of a segment and index its hooks
+ *
+ * @param fpList the fingerprints of the segment (CHUNK_HASH_SIZE bytes each)
+ * @param fpNum the number of fingerprints
+ */
+void SparseIndex::AddManifest(const uint8_t* fpList, uint32_t fpNum)
+{
+    vector<uint8_t> manifestBuffer(sizeof(fpNum) + (uint64_t)fpNum * CHUNK_HASH_SIZE);
+    memcpy(manifestBuffer.data(), &fpNum, sizeof(fpNum));
+    memcpy(manifestBuffer.data() + sizeof(fpNum), fpList, (uint64_t)fpNum * CHUNK_HASH_SIZE);
+
+    // a lost manifest only loses some deduplication, so it is not synced, and the
+    // chunks of the containers lost with a crash are dropped on the next startup
+    uint32_t manifestId;
+    {
+        lock_guard<mutex> lock(manifestLck_);
+        this->WriteManifestFile(manifestFd_, manifestBuffer.data(), manifestBuffer.size(),
+            manifestFileSize_);
+        manifestId = manifestList_.size();
+        manifestList_.push_back({ manifestFileSize_, fpNum });
+        manifestFileSize_ += manifestBuffer.size();
+    }
+
+    // the next segments of the stream likely pick it as a champion
+    std::shared_ptr<Manifest_t> manifest = std::make_shared<Manifest_t>();
+    manifest->reserve(fpNum);
+    for (size_t i = 0; i < fpNum; i++) {
+        manifest->emplace((const char*)fpList + i * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+    }
+    manifestCache_->insert(manifestId, manifest);
+
+    pthread_rwlock_wrlock(&hookLck_);
+    this->IndexHooks(fpList, fpNum, manifestId);
+    pthread_rwlock_unlock(&hookLck_);
+    return;
+}
+
+/**
+ * @brief look up a batch of fingerprints against the champion manifests of its hooks
+ *
+ * @param fpList the fingerprints (CHUNK_HASH_SIZE bytes each)
+ * @param fpNum the number of fingerprints
+ * @param foundList whether each fingerprint is a duplicate (1: duplicate, 0: new),
+ * the i-th one is written after the i-th fingerprint is read
+ * @param curClient the current client var (NULL: a query without the session)
+ * @return uint32_t the number of duplicates
+ */
+uint32_t SparseIndex::LookupBatch(const uint8_t* fpList, uint32_t fpNum, uint8_t* foundList,
+    ClientVar* curClient)
+{
+    lookupBatchNum_++;
+
+    // the hooks of the batch and the manifests holding them
+    vector<string> hookList;
+    vector<vector<uint32_t>> hookManifestList;
+    unordered_set<string> batchHookSet;
+    string fpStr;
+    pthread_rwlock_rdlock(&hookLck_);
+    for (size_t i = 0; i < fpNum; i++) {
+        const uint8_t* fp = fpList + i * CHUNK_HASH_SIZE;
+        if (!this->IsHook(fp)) {
+            continue;
+        }
+        fpStr.assign((const char*)fp, CHUNK_HASH_SIZE);
+        if (!batchHookSet.insert(fpStr).second) {
+            continue;
+        }
+        auto findResult = hookIndex_.find(fpStr);
+        if (findResult != hookIndex_.end()) {
+            hookList.push_back(fpStr);
+            hookManifestList.push_back(findResult->second);
+        }
+    }
+    pthread_rwlock_unlock(&hookLck_);
+
+    // pick the champions one by one: the manifest holding the most hooks not
+    // covered by the champions before (the newer one on a tie)
+    vector<std::shared_ptr<Manifest_t>> championList;
+    vector<uint8_t> coveredList(hookList.size(), 0);
+    unordered_map<uint32_t, uint32_t> scoreMap;
+    while (championList.size() < SPARSE_CHAMPION_NUM) {
+        scoreMap.clear();
+        for (size_t i = 0; i < hookList.size(); i++) {
+            if (coveredList[i] == 0) {
+                for (uint32_t manifestId : hookManifestList[i]) {
+                    scoreMap[manifestId]++;
+                }
+            }
+        }
+        if (scoreMap.empty()) {
+            break;
+        }
+        uint32_t championId = 0;
+        uint32_t championScore = 0;
+        for (auto& it : scoreMap) {
+            if (it.second > championScore
+                || (it.second == championScore && it.first > championId)) {
+                championId = it.first;
+                championScore = it.second;
+            }
+        }
+        std::shared_ptr<Manifest_t> champion = this->GetManifest(championId);
+        championList.push_back(champion);
+        for (size_t i = 0; i < hookList.size(); i++) {
+            if (coveredList[i] == 0 && champion->count(hookList[i]) != 0) {
+                coveredList[i] = 1;
+            }
+        }
+    }
+    championLoadNum_ += championList.size();
+
+    // deduplicate against the champions only
+    uint32_t dupNum = 0;
+    vector<uint32_t> newIdList;
+    vector<uint8_t> newHashList;
+    for (size_t i = 0; i < fpNum; i++) {
+        fpStr.assign((const char*)fpList + i * CHUNK_HASH_SIZE, CHUNK_HASH_SIZE);
+        uint8_t isFound = 0;
+        for (auto& champion : championList) {
+            if (champion->count(fpStr) != 0) {
+                isFound = 1;
+                break;
+            }
+        }
+        if (isFound == 0 && dedupLossCheck_) {
+            newIdList.push_back(i);
+            newHashList.insert(newHashList.end(), fpStr.begin(), fpStr.end());
+        }
+        foundList[i] = isFound;
+        dupNum += isFound;
+    }
+    sparseDupNum_ += dupNum;
+
+    // the dedup loss: the new ones in the full index
+    if (!newIdList.empty()) {
+        vector<uint8_t> fullFoundList(newIdList.size());
+        missedDupNum_ += this->ReadIndexStoreBatch(newHashList.data(), newIdList.size(), NULL,
+            fullFoundList.data());
+    }
+    return dupNum;
+}
+
+/**
+ * @brief process one batch as a segment
+ *
+ * @param recvChunkBuf the recv chunk buffer
+ * @param curClient the current client var
+ */
+void SparseIndex::ProcessOneBatch(SendMsgBuffer_t* recvChunkBuf, ClientVar* curClient)
+{
+    // the batch is a segment, look it up against its champions
+    if (!this->PrepareBatch(recvChunkBuf, curClient)) {
+        return;
+    }
+    // a chunk missing the champions is stored again even if an older segment
+    // holds it, no session waits for another
+    this->StoreNewChunks(curClient);
+
+    // all chunks of the segment are stored now
+    uint32_t chunkNum = curClient->_chunkAddrList.size();
+    if (chunkNum != 0) {
+        this->AddManifest(curClient->_chunkHashList.data(), chunkNum);
+    }
+    return;
+}
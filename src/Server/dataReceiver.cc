@@ -22,6 +22,24 @@ DataReceiver::DataReceiver(AbsIndex* absIndexObj, SSLConnection* serverChannel)
     // set up the connection and interface
     serverChannel_ = serverChannel;
     absIndexObj_ = absIndexObj;
+
+    recvBufferNum_ = config.GetRecvBufferNum();
+    if (recvBufferNum_ == 0) {
+        recvBufferNum_ = 1;
+    }
+    recvBufferSize_ = sizeof(NetworkHead_t) + config.GetSendChunkBatchSize() * (sizeof(uint32_t) + CHUNK_HASH_SIZE + MAX_CHUNK_SIZE);
+
+    queryThreadNum_ = config.GetQueryThreadNum();
+    if (queryThreadNum_ == 0) {
+        queryThreadNum_ = boost::thread::hardware_concurrency();
+        if (queryThreadNum_ == 0) {
+            queryThreadNum_ = 1;
+        }
+    }
+    for (size_t i = 0; i < queryThreadNum_; i++) {
+        queryThList_.push_back(new boost::thread(boost::bind(&DataReceiver::RunQueryThread,
+            this)));
+    }
     // tool::Logging(myName_.c_str(), "init the DataReceiver.\n");
 }
 
@@ -31,6 +49,15 @@ DataReceiver::DataReceiver(AbsIndex* absIndexObj, SSLConnection* serverChannel)
  */
 DataReceiver::~DataReceiver()
 {
+    {
+        lock_guard<mutex> lock(queryJobLck_);
+        queryDone_ = true;
+    }
+    queryJobCond_.notify_all();
+    for (auto it : queryThList_) {
+        it->join();
+        delete it;
+    }
     // fprintf(stderr, "========DataReceiver Info========\n");
     // fprintf(stderr, "total recv batch num: %lu\n", batchNum_);
     // fprintf(stderr, "total recv recipe end num: %lu\n", recipeEndNum_);
@@ -47,80 +74,254 @@ void DataReceiver::Run(ClientVar* curClient, EnclaveInfo_t* enclaveInfo)
 {
     uint32_t recvSize = 0;
     string clientIP;
-    SendMsgBuffer_t* recvChunkBuf = &curClient->_recvChunkBuf;
-    InmemoryContainer_t* curContainer = &curClient->_curContainer;
+    SendMsgBuffer_t* recvChunkBuf;
     SSL* clientSSL = curClient->_clientSSL;
-    absIndexObj_->_logicalDataSize += curClient->_fileSize;
-    absIndexObj_->_logicalChunkNum += curClient->_totalChunkNum;
-    tool::Logging(myName_.c_str(), "Start Migration...\n");
-    bool isEnd = false;
-    while (!isEnd) {
-        // receive data
-        if (!serverChannel_->ReceiveData(clientSSL, recvChunkBuf->sendBuffer,
-                recvSize)) {
-            tool::Logging(myName_.c_str(), "Migration Done!\n");
+    RecipeQuerySession_t querySession;
+    querySession.wakeFd = eventfd(0, EFD_NONBLOCK);
+    if (querySession.wakeFd < 0) {
+        tool::Logging(myName_.c_str(), "cannot init the query event: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+    querySession.pendingNum = 0;
+    querySession.replyCap = curClient->_replyCap;
+
+    // the ring of the batch buffers, the first one is the buffer of the client
+    vector<SendMsgBuffer_t*> freeBufList;
+    freeBufList.push_back(&curClient->_recvChunkBuf);
+    for (size_t i = 1; i < recvBufferNum_; i++) {
+        SendMsgBuffer_t* tmpBuf = new SendMsgBuffer_t();
+        tmpBuf->sendBuffer = (uint8_t*)malloc(recvBufferSize_);
+        tmpBuf->header = (NetworkHead_t*)tmpBuf->sendBuffer;
+        tmpBuf->dataBuffer = tmpBuf->sendBuffer + sizeof(NetworkHead_t);
+        freeBufList.push_back(tmpBuf);
+    }
+    vector<SendMsgBuffer_t*> ringBufList = freeBufList;
+    uint32_t inFlightNum = 0;
+
+    // the chunk batches are processed in another stage while the next ones are received
+    MessageQueue<SendMsgBuffer_t*> readyMQ(recvBufferNum_);
+    MessageQueue<SendMsgBuffer_t*> freeMQ(recvBufferNum_);
+    boost::thread* processThread = NULL;
+    if (recvBufferNum_ > 1) {
+        processThread = new boost::thread(boost::bind(&DataReceiver::RunProcessStage, this,
+            curClient, &readyMQ, &freeMQ));
+    }
+
+    this->StartSession(curClient);
+    while (true) {
+        // send the replies of the pipelined queries until the next message arrives
+        if (querySession.pendingNum != 0 && !this->WaitQueryEvent(clientSSL, &querySession)) {
+            continue;
+        }
+
+        // get a free buffer
+        if (freeBufList.empty()) {
+            freeMQ.PopWait(recvChunkBuf);
+            freeBufList.push_back(recvChunkBuf);
+            inFlightNum--;
+        }
+        recvChunkBuf = freeBufList.back();
+
+        // receive data, a session with a forged fingerprint is cut off
+        bool isRejected = curClient->_fpRejected;
+        if (isRejected || !serverChannel_->ReceiveData(clientSSL, recvChunkBuf->sendBuffer,
+                              recvSize)) {
+            // the queries in flight still refer to this session
+            while (querySession.pendingNum != 0) {
+                this->WaitQueryEvent(NULL, &querySession);
+            }
+            if (isRejected) {
+                tool::Logging(myName_.c_str(), "reject the upload of client %u.\n",
+                    curClient->_clientID);
+            } else {
+                tool::Logging(myName_.c_str(), "Migration Done!\n");
+            }
             serverChannel_->GetClientIp(clientIP, clientSSL);
             serverChannel_->ClearAcceptedClientSd(clientSSL);
-            isEnd = true;
             break;
-        } else {
-            switch (recvChunkBuf->header->messageType) {
-            case EDGE_MIGRATION_CHUNK: {
-                absIndexObj_->ProcessOneBatch(recvChunkBuf, curClient);
-                batchNum_++;
-                break;
-            }
-            case EDGE_MIGRATION_CHUNK_FINAL: {
-                // tool::Logging(myName_.c_str(), "migrate chunk done\n");
-                // isEnd = true;
-                // tool::Logging(myName_.c_str(), "EdgeServer-%d Upload Chunk Done...\n", curClient->_clientID);
-                break;
-            }
-            case EDGE_UPLOAD_SEC_RECIPE: {
-                absIndexObj_->ProcessRecipeBatch(recvChunkBuf, curClient);
-                serverChannel_->SendData(clientSSL, recvChunkBuf->sendBuffer,
-                    sizeof(NetworkHead_t) + recvChunkBuf->header->dataSize);
-                recipeBatchNum_++;
-                break;
-            }
-            case EDGE_UPLOAD_SEC_RECIPE_END: {
-                // tool::Logging(myName_.c_str(), "Upload Secure Recipe Done...\n");
-                break;
-            }
-            case EDGE_MIGRATION_NEWFILE: {
-                string fileName;
-                fileName.assign((char*)recvChunkBuf->dataBuffer, CHUNK_HASH_SIZE * 2);
-                FileRecipeHead_t* tmpRecipeHead = (FileRecipeHead_t*)(recvChunkBuf->dataBuffer + CHUNK_HASH_SIZE * 2);
-                curClient->ChangeFile(fileName, tmpRecipeHead->fileSize, tmpRecipeHead->totalChunkNum);
-                break;
-            }
-            case EDGE_UPLOAD_RECIPE: {
-                curClient->_recipeWriteHandler.write((char*)recvChunkBuf->dataBuffer,
-                    recvChunkBuf->header->currentItemNum * CHUNK_HASH_SIZE);
-                break;
-            }
-            case EDGE_UPLOAD_KEY_RECIPE: {
-                curClient->_keyRecipeWriteHandler.write((char*)recvChunkBuf->dataBuffer,
-                    recvChunkBuf->header->currentItemNum * CHUNK_HASH_SIZE);
-                break;
-            }
-            case EDGE_UPLOAD_RECIPE_END: {
-                // finalize the file recipe
-                recipeEndNum_++;
+        }
+        int messageType = recvChunkBuf->header->messageType;
+        if (processThread != NULL && (messageType == EDGE_MIGRATION_CHUNK || messageType == EDGE_MIGRATION_CHUNK_FP)) {
+            freeBufList.pop_back();
+            readyMQ.Push(recvChunkBuf);
+            inFlightNum++;
+            continue;
+        }
 
-                // update the upload data size
-                FileRecipeHead_t* tmpRecipeHead = (FileRecipeHead_t*)recvChunkBuf->dataBuffer;
-                curClient->_uploadDataSize = tmpRecipeHead->fileSize;
-                break;
-            }
-            default: {
-                // receive teh wrong message type
-                tool::Logging(myName_.c_str(), "wrong received message type.\n");
-                exit(EXIT_FAILURE);
-            }
-            }
+        // the other messages can touch the state of the chunk batches, wait for them
+        while (inFlightNum != 0) {
+            SendMsgBuffer_t* tmpBuf;
+            freeMQ.PopWait(tmpBuf);
+            freeBufList.push_back(tmpBuf);
+            inFlightNum--;
         }
+        if (recvChunkBuf->header->messageType == EDGE_UPLOAD_SEC_RECIPE_PIPE) {
+            this->DispatchRecipeQuery(curClient, &querySession, recvChunkBuf, recvSize);
+            continue;
+        }
+        this->ProcessMessage(curClient, recvChunkBuf);
+    }
+
+    // process the remaining batches before the last container
+    readyMQ.SetJobDoneFlag();
+    if (processThread != NULL) {
+        processThread->join();
+        delete processThread;
     }
+    SendMsgBuffer_t* tmpBuf;
+    while (freeMQ.Pop(tmpBuf)) {
+        ;
+    }
+    for (size_t i = 1; i < ringBufList.size(); i++) {
+        free(ringBufList[i]->sendBuffer);
+        delete ringBufList[i];
+    }
+
+    for (auto it : querySession.freeList) {
+        delete it;
+    }
+    close(querySession.wakeFd);
+
+    this->FinishSession(curClient, enclaveInfo);
+    return;
+}
+
+/**
+ * @brief prepare the statistic of a new upload session
+ *
+ * @param curClient the ptr to the current client
+ */
+void DataReceiver::StartSession(ClientVar* curClient)
+{
+    absIndexObj_->_logicalDataSize += curClient->_fileSize;
+    absIndexObj_->_logicalChunkNum += curClient->_totalChunkNum;
+    tool::Logging(myName_.c_str(), "Start Migration...\n");
+    return;
+}
+
+/**
+ * @brief process a received message
+ *
+ * @param curClient the ptr to the current client
+ * @param recvChunkBuf the buffer of the received message
+ */
+void DataReceiver::ProcessMessage(ClientVar* curClient, SendMsgBuffer_t* recvChunkBuf)
+{
+    SSL* clientSSL = curClient->_clientSSL;
+    switch (recvChunkBuf->header->messageType) {
+    case EDGE_MIGRATION_CHUNK:
+    case EDGE_MIGRATION_CHUNK_FP: {
+        absIndexObj_->ProcessOneBatch(recvChunkBuf, curClient);
+        batchNum_++;
+        break;
+    }
+    case EDGE_MIGRATION_CHUNK_QUERY: {
+        // only the missing chunks will be uploaded
+        absIndexObj_->ProcessChunkQuery(recvChunkBuf, curClient);
+        if (!serverChannel_->SendData(clientSSL, recvChunkBuf->sendBuffer,
+                sizeof(NetworkHead_t) + recvChunkBuf->header->dataSize)) {
+            tool::Logging(myName_.c_str(), "send the chunk query reply error.\n");
+        }
+        break;
+    }
+    case EDGE_DOWNLOAD_FILTER: {
+        if (recvChunkBuf->header->dataSize != sizeof(FilterHead_t)) {
+            tool::Logging(myName_.c_str(), "wrong size of the filter request.\n");
+            exit(EXIT_FAILURE);
+        }
+        vector<uint8_t> filterMsg(sizeof(NetworkHead_t));
+        int messageType = CLOUD_SEND_FILTER;
+        FingerprintFilter* fpFilter = absIndexObj_->GetFingerprintFilter();
+        if (fpFilter != NULL) {
+            messageType = fpFilter->GetFilterMsg((FilterHead_t*)recvChunkBuf->dataBuffer,
+                filterMsg);
+        } else {
+            // an empty filter, the edge queries all chunks
+            filterMsg.resize(sizeof(NetworkHead_t) + sizeof(FilterHead_t), 0);
+        }
+        NetworkHead_t* filterHeader = (NetworkHead_t*)filterMsg.data();
+        filterHeader->messageType = messageType;
+        filterHeader->clientID = curClient->_clientID;
+        filterHeader->dataSize = filterMsg.size() - sizeof(NetworkHead_t);
+        filterHeader->currentItemNum = 0;
+        if (messageType == CLOUD_SEND_FILTER_DELTA) {
+            filterHeader->currentItemNum = (filterHeader->dataSize - sizeof(FilterHead_t)) / FILTER_KEY_SIZE;
+        }
+        if (!serverChannel_->SendData(clientSSL, filterMsg.data(), filterMsg.size())) {
+            tool::Logging(myName_.c_str(), "send the filter error.\n");
+        }
+        break;
+    }
+    case EDGE_MIGRATION_CHUNK_FINAL: {
+        // tool::Logging(myName_.c_str(), "migrate chunk done\n");
+        // isEnd = true;
+        // tool::Logging(myName_.c_str(), "EdgeServer-%d Upload Chunk Done...\n", curClient->_clientID);
+        break;
+    }
+    case EDGE_UPLOAD_SEC_RECIPE: {
+        absIndexObj_->ProcessRecipeBatch(recvChunkBuf, curClient);
+        serverChannel_->SendData(clientSSL, recvChunkBuf->sendBuffer,
+            sizeof(NetworkHead_t) + recvChunkBuf->header->dataSize);
+        recipeBatchNum_++;
+        break;
+    }
+    case EDGE_UPLOAD_SEC_RECIPE_PIPE: {
+        // the reactor thread does not block on the edge, answer the batch here
+        this->WriteQueryRecipe(curClient, recvChunkBuf->sendBuffer);
+        uint32_t replySize = this->ProcessRecipeQuery(recvChunkBuf->sendBuffer,
+            curClient->_replyCap, curClient->_queryStatusList);
+        serverChannel_->SendData(clientSSL, recvChunkBuf->sendBuffer, replySize);
+        break;
+    }
+    case EDGE_UPLOAD_SEC_RECIPE_END: {
+        // tool::Logging(myName_.c_str(), "Upload Secure Recipe Done...\n");
+        break;
+    }
+    case EDGE_MIGRATION_NEWFILE: {
+        string fileName;
+        fileName.assign((char*)recvChunkBuf->dataBuffer, CHUNK_HASH_SIZE * 2);
+        FileRecipeHead_t* tmpRecipeHead = (FileRecipeHead_t*)(recvChunkBuf->dataBuffer + CHUNK_HASH_SIZE * 2);
+        absIndexObj_->ProcessFileEnd(curClient);
+        curClient->ChangeFile(fileName, tmpRecipeHead->fileSize, tmpRecipeHead->totalChunkNum);
+        break;
+    }
+    case EDGE_UPLOAD_RECIPE: {
+        curClient->_recipeWriteHandler.write((char*)recvChunkBuf->dataBuffer,
+            recvChunkBuf->header->currentItemNum * CHUNK_HASH_SIZE);
+        break;
+    }
+    case EDGE_UPLOAD_KEY_RECIPE: {
+        curClient->_keyRecipeWriteHandler.write((char*)recvChunkBuf->dataBuffer,
+            recvChunkBuf->header->currentItemNum * CHUNK_HASH_SIZE);
+        break;
+    }
+    case EDGE_UPLOAD_RECIPE_END: {
+        // finalize the file recipe
+        recipeEndNum_++;
+
+        // update the upload data size
+        FileRecipeHead_t* tmpRecipeHead = (FileRecipeHead_t*)recvChunkBuf->dataBuffer;
+        curClient->_uploadDataSize = tmpRecipeHead->fileSize;
+        break;
+    }
+    default: {
+        // receive teh wrong message type
+        tool::Logging(myName_.c_str(), "wrong received message type.\n");
+        exit(EXIT_FAILURE);
+    }
+    }
+    return;
+}
+
+/**
+ * @brief finalize the upload session after the connection is closed
+ *
+ * @param curClient the ptr to the current client
+ * @param enclaveInfo the ptr to the enclave info
+ */
+void DataReceiver::FinishSession(ClientVar* curClient, EnclaveInfo_t* enclaveInfo)
+{
+    InmemoryContainer_t* curContainer = &curClient->_curContainer;
 
     // process the last container
     if (curContainer->currentHeaderSize != 0) {
@@ -129,6 +330,23 @@ void DataReceiver::Run(ClientVar* curClient, EnclaveInfo_t* enclaveInfo)
         // tool::Logging(myName_.c_str(), "process last container done\n");
     }
     curClient->_inputMQ->done_ = true;
+    absIndexObj_->ProcessFileEnd(curClient);
+
+    // the uploaded chunks should match the queried ones
+    if (curClient->_chunkQueried) {
+        if (!curClient->_pendingChunkSet.empty()) {
+            tool::Logging(myName_.c_str(), "%lu queried chunks of client %u are not uploaded.\n",
+                curClient->_pendingChunkSet.size(), curClient->_clientID);
+        }
+        if (curClient->_unexpectedChunkNum != 0) {
+            tool::Logging(myName_.c_str(), "%lu uploaded chunks of client %u are not queried.\n",
+                curClient->_unexpectedChunkNum, curClient->_clientID);
+        }
+    }
+    if (curClient->_fpMismatchNum != 0) {
+        tool::Logging(myName_.c_str(), "%lu chunks of client %u do not match their fingerprints.\n",
+            curClient->_fpMismatchNum, curClient->_clientID);
+    }
 
     enclaveInfo->logicalDataSize = absIndexObj_->_logicalDataSize;
     enclaveInfo->logicalChunkNum = absIndexObj_->_logicalChunkNum;
@@ -136,4 +354,221 @@ void DataReceiver::Run(ClientVar* curClient, EnclaveInfo_t* enclaveInfo)
     enclaveInfo->uniqueChunkNum = absIndexObj_->_uniqueChunkNum;
     enclaveInfo->compressedSize = absIndexObj_->_compressedDataSize;
     return;
+}
+
+/**
+ * @brief the main loop of a query thread
+ *
+ */
+void DataReceiver::RunQueryThread()
+{
+    uint64_t wakeSignal = 1;
+    vector<uint8_t> statusList;
+    while (true) {
+        RecipeQueryJob_t queryJob;
+        {
+            unique_lock<mutex> lock(queryJobLck_);
+            queryJobCond_.wait(lock, [this] { return queryDone_ || !queryJobList_.empty(); });
+            if (queryJobList_.empty()) {
+                break;
+            }
+            queryJob = queryJobList_.front();
+            queryJobList_.pop_front();
+        }
+
+        uint32_t replySize = this->ProcessRecipeQuery(queryJob.queryMsg->data(),
+            queryJob.querySession->replyCap, statusList);
+        queryJob.queryMsg->resize(replySize);
+
+        // the session can exit once the lock is released, do not touch it after that
+        lock_guard<mutex> lock(queryJob.querySession->replyLck);
+        queryJob.querySession->replyList.push_back(queryJob.queryMsg);
+        if (write(queryJob.querySession->wakeFd, &wakeSignal, sizeof(wakeSignal)) < 0) {
+            tool::Logging(myName_.c_str(), "cannot wake up the session: %s\n", strerror(errno));
+        }
+    }
+    return;
+}
+
+/**
+ * @brief check a pipelined query batch and write its secure recipe in order
+ *
+ * @param curClient the ptr to the current client
+ * @param queryMsg the query message (header + seq id + fingerprints)
+ */
+void DataReceiver::WriteQueryRecipe(ClientVar* curClient, uint8_t* queryMsg)
+{
+    NetworkHead_t* queryHeader = (NetworkHead_t*)queryMsg;
+    uint8_t* entryBase = queryMsg + sizeof(NetworkHead_t) + sizeof(uint32_t);
+    if (queryHeader->dataSize < sizeof(uint32_t) || (queryHeader->dataSize - sizeof(uint32_t)) != (uint64_t)queryHeader->currentItemNum * CHUNK_HASH_SIZE) {
+        tool::Logging(myName_.c_str(), "wrong size of the query batch.\n");
+        exit(EXIT_FAILURE);
+    }
+
+    // only the replies can be reordered, the recipe follows the batch order
+    curClient->_secureRecipeWriteHandler.write((char*)entryBase,
+        queryHeader->dataSize - sizeof(uint32_t));
+    recipeBatchNum_++;
+    return;
+}
+
+/**
+ * @brief answer a pipelined query batch in place
+ *
+ * @param queryMsg the query message, turned into the reply (header + seq id + status)
+ * @param replyCap the reply formats the edge accepts
+ * @param statusList the buffer of the status list (reused by the caller)
+ * @return uint32_t the size of the reply
+ */
+uint32_t DataReceiver::ProcessRecipeQuery(uint8_t* queryMsg, uint32_t replyCap,
+    vector<uint8_t>& statusList)
+{
+    NetworkHead_t* queryHeader = (NetworkHead_t*)queryMsg;
+    uint8_t* entryBase = queryMsg + sizeof(NetworkHead_t) + sizeof(uint32_t);
+    uint32_t entryNum = queryHeader->currentItemNum;
+
+    // the seq id stays in front of the status list
+    statusList.resize(entryNum);
+    absIndexObj_->QueryRecipeBatch(entryBase, entryNum, statusList.data());
+    queryHeader->messageType = CLOUD_QUERY_RETURN_PIPE;
+    queryHeader->dataSize = sizeof(uint32_t) + absIndexObj_->EncodeQueryReply(statusList.data(),
+        entryNum, replyCap, entryBase);
+    return sizeof(NetworkHead_t) + queryHeader->dataSize;
+}
+
+/**
+ * @brief hand over a pipelined query batch to the query threads
+ *
+ * @param curClient the ptr to the current client
+ * @param querySession the query state of the session
+ * @param recvChunkBuf the buffer of the received message
+ * @param recvSize the size of the received message
+ */
+void DataReceiver::DispatchRecipeQuery(ClientVar* curClient, RecipeQuerySession_t* querySession,
+    SendMsgBuffer_t* recvChunkBuf, uint32_t recvSize)
+{
+    this->WriteQueryRecipe(curClient, recvChunkBuf->sendBuffer);
+
+    vector<uint8_t>* queryMsg;
+    if (querySession->freeList.empty()) {
+        queryMsg = new vector<uint8_t>();
+    } else {
+        queryMsg = querySession->freeList.back();
+        querySession->freeList.pop_back();
+    }
+    queryMsg->assign(recvChunkBuf->sendBuffer, recvChunkBuf->sendBuffer + recvSize);
+    // an empty batch still needs the room of the format byte
+    if (queryMsg->size() < sizeof(NetworkHead_t) + sizeof(uint32_t) + 1) {
+        queryMsg->resize(sizeof(NetworkHead_t) + sizeof(uint32_t) + 1);
+    }
+    querySession->pendingNum++;
+
+    RecipeQueryJob_t queryJob;
+    queryJob.querySession = querySession;
+    queryJob.queryMsg = queryMsg;
+    {
+        lock_guard<mutex> lock(queryJobLck_);
+        queryJobList_.push_back(queryJob);
+    }
+    queryJobCond_.notify_one();
+    return;
+}
+
+/**
+ * @brief wait until the connection is readable, the ready replies are sent meanwhile
+ *
+ * @param clientSSL the client ssl
+ * @param querySession the query state of the session
+ * @return true the connection is readable
+ * @return false only some replies are sent
+ */
+bool DataReceiver::WaitQueryEvent(SSL* clientSSL, RecipeQuerySession_t* querySession)
+{
+    // stop reading the next batches when the pipeline is full
+    bool readConn = (clientSSL != NULL) && (querySession->pendingNum < QUERY_PIPELINE_DEPTH);
+    if (readConn && SSL_has_pending(clientSSL)) {
+        return true;
+    }
+
+    struct pollfd fdList[2];
+    nfds_t fdNum = 1;
+    fdList[0].fd = querySession->wakeFd;
+    fdList[0].events = POLLIN;
+    fdList[0].revents = 0;
+    if (readConn) {
+        fdList[1].fd = SSL_get_fd(clientSSL);
+        fdList[1].events = POLLIN;
+        fdList[1].revents = 0;
+        fdNum = 2;
+    }
+    if (poll(fdList, fdNum, -1) < 0) {
+        if (errno == EINTR) {
+            return false;
+        }
+        tool::Logging(myName_.c_str(), "poll the session fails: %s\n", strerror(errno));
+        exit(EXIT_FAILURE);
+    }
+
+    if (fdList[0].revents & POLLIN) {
+        this->SendQueryReplies(clientSSL, querySession);
+    }
+    return readConn && (fdList[1].revents != 0);
+}
+
+/**
+ * @brief send the ready replies of the session
+ *
+ * @param clientSSL the client ssl (NULL: drop the replies)
+ * @param querySession the query state of the session
+ */
+void DataReceiver::SendQueryReplies(SSL* clientSSL, RecipeQuerySession_t* querySession)
+{
+    uint64_t wakeSignal;
+    vector<vector<uint8_t>*> replyList;
+    {
+        lock_guard<mutex> lock(querySession->replyLck);
+        while (read(querySession->wakeFd, &wakeSignal, sizeof(wakeSignal)) > 0) {
+            ;
+        }
+        replyList.swap(querySession->replyList);
+    }
+
+    if (clientSSL != NULL) {
+        // put the replies ready at the same time into the same records
+        serverChannel_->CorkData(clientSSL);
+        for (auto reply : replyList) {
+            if (!serverChannel_->SendData(clientSSL, reply->data(), reply->size())) {
+                tool::Logging(myName_.c_str(), "send the query reply error.\n");
+            }
+        }
+        if (!serverChannel_->UncorkData(clientSSL)) {
+            tool::Logging(myName_.c_str(), "send the query reply error.\n");
+        }
+    }
+
+    for (auto reply : replyList) {
+        querySession->freeList.push_back(reply);
+        querySession->pendingNum--;
+    }
+    return;
+}
+
+/**
+ * @brief the processing stage of a session, process the received chunk batches in order
+ *
+ * @param curClient the ptr to the current client
+ * @param readyMQ the received batches
+ * @param freeMQ the processed batch buffers
+ */
+void DataReceiver::RunProcessStage(ClientVar* curClient, MessageQueue<SendMsgBuffer_t*>* readyMQ,
+    MessageQueue<SendMsgBuffer_t*>* freeMQ)
+{
+    SendMsgBuffer_t* recvChunkBuf;
+    // sleep until the next batch comes, stop after the session ends
+    while (readyMQ->PopWait(recvChunkBuf)) {
+        absIndexObj_->ProcessOneBatch(recvChunkBuf, curClient);
+        batchNum_++;
+        freeMQ->Push(recvChunkBuf);
+    }
+    return;
 }
\ No newline at end of file
@@ -84,6 +84,22 @@ void DataWriter::Run(MessageQueue<Container_t>* inputMQ)
     return;
 }
 
+/**
+ * @brief write all the containers in the MQ in the caller thread
+ *
+ * @param inputMQ the input MQ
+ */
+void DataWriter::SaveQueuedContainers(MessageQueue<Container_t>* inputMQ)
+{
+    // store the container extract from the MQ
+    Container_t tmpContainer;
+    while (inputMQ->Pop(tmpContainer)) {
+        SaveToFile(tmpContainer);
+        containerNum_++;
+    }
+    return;
+}
+
 /**
  * @brief write the container to the storage backend
  *
@@ -102,6 +118,40 @@ void DataWriter::SaveToFile(Container_t& newContainer)
     }
     fwrite((char*)newContainer.body, newContainer.currentSize, 1,
         containerFile);
+    if (indexStore_ != NULL && indexStore_->NeedDurableValue()) {
+        // the index logs the entries of the container only after it is durable
+        if (fflush(containerFile) != 0 || fsync(fileno(containerFile)) != 0) {
+            tool::Logging(myName_.c_str(), "cannot sync container file: %s\n",
+                fileFullName.c_str());
+            exit(EXIT_FAILURE);
+        }
+        fclose(containerFile);
+        tool::SyncParentDir(fileFullName);
+        this->CommitContainer(newContainer);
+        return;
+    }
     fclose(containerFile);
     return;
+}
+
+/**
+ * @brief commit the fingerprints in the metadata section of a durable
+ * container to the index
+ *
+ * @param newContainer the container
+ */
+void DataWriter::CommitContainer(Container_t& newContainer)
+{
+    // chunk num, then the entries of chunk hash + offset + length (big endian)
+    uint8_t* chunkNumChar = newContainer.body;
+    uint32_t chunkNum = (chunkNumChar[3]) + (chunkNumChar[2] << 8) + (chunkNumChar[1] << 16) + (chunkNumChar[0] << 24);
+    size_t entrySize = CHUNK_HASH_SIZE + sizeof(uint32_t) * 2;
+    vector<char> fpList(chunkNum * CHUNK_HASH_SIZE);
+    for (size_t i = 0; i < chunkNum; i++) {
+        memcpy(fpList.data() + i * CHUNK_HASH_SIZE,
+            newContainer.body + sizeof(uint32_t) + i * entrySize, CHUNK_HASH_SIZE);
+    }
+    indexStore_->CommitValue(fpList.data(), chunkNum, CHUNK_HASH_SIZE,
+        (char*)newContainer.containerID, CONTAINER_ID_LENGTH);
+    return;
 }
\ No newline at end of file
@@ -4,6 +4,7 @@ RecipeSender::RecipeSender(SSLConnection* serverChannel)
 {
     serverChannel_ = serverChannel;
     sendRecipeBatchSize_ = config.GetSendRecipeBatchSize();
+    batchMsgSize_ = sizeof(NetworkHead_t) + sendRecipeBatchSize_ * max(sizeof(RecipeEntry_t), sizeof(KeyRecipeEntry_t));
 }
 
 RecipeSender::~RecipeSender()
@@ -16,154 +17,191 @@ void RecipeSender::Run(ClientVar* curClient)
     SSL* clientSSL = curClient->_clientSSL;
     uint32_t recvSize = 0;
 
-    // ------------------------
-    // 等待edge回应
-    // ------------------------
-    if (!serverChannel_->ReceiveData(clientSSL, sendRecipeBuffer->sendBuffer,
-            recvSize)) {
-        tool::Logging(myName_.c_str(), "recv the client ready error.\n");
-        exit(EXIT_FAILURE);
-    } else {
-        if (sendRecipeBuffer->header->messageType != EDGE_RECEIVE_READY) {
-            tool::Logging(myName_.c_str(), "wrong type of client ready reply.\n");
-            exit(EXIT_FAILURE);
-        }
-    }
-
-    uint8_t* tmpBuf = (uint8_t*)malloc(sizeof(FileRecipeHead_t));
+    this->StartSession(curClient);
 
-    // ------------------------
-    // 1.读取并发送plain recipe
-    // ------------------------
-    tool::Logging(myName_.c_str(), "start to read the file recipe.\n");
-    bool end = false;
-    while (!end) {
-        // read a batch of the recipe entries from the recipe file
-        curClient->_recipeReadHandler.read((char*)sendRecipeBuffer->dataBuffer,
-            sizeof(RecipeEntry_t) * sendRecipeBatchSize_);
-        size_t readCnt = curClient->_recipeReadHandler.gcount();
-        end = curClient->_recipeReadHandler.eof();
-        size_t recipeEntryNum = readCnt / sizeof(RecipeEntry_t);
-        if (readCnt == 0) {
-            break;
+    // read the next batches from disk while the current one is on the wire
+    MessageQueue<uint8_t*> readyMQ(RECIPE_PREFETCH_NUM);
+    MessageQueue<uint8_t*> freeMQ(RECIPE_PREFETCH_NUM);
+    vector<uint8_t*> batchBufferList(RECIPE_PREFETCH_NUM);
+    for (auto& batchBuffer : batchBufferList) {
+        batchBuffer = (uint8_t*)malloc(batchMsgSize_);
+        freeMQ.Push(batchBuffer);
+    }
+    boost::thread prefetchThread(boost::bind(&RecipeSender::PrefetchBatches, this,
+        curClient, &readyMQ, &freeMQ));
+
+    bool isEnd = false;
+    uint8_t* batchBuffer;
+    while (!isEnd) {
+        if (curClient->_recipeCredit == 0) {
+            // ------------------------
+            // 等待edge回应
+            // ------------------------
+            if (!serverChannel_->ReceiveData(clientSSL, sendRecipeBuffer->sendBuffer,
+                    recvSize)) {
+                tool::Logging(myName_.c_str(), "recv the client ready error.\n");
+                exit(EXIT_FAILURE);
+            } else {
+                if (sendRecipeBuffer->header->messageType != EDGE_RECEIVE_READY) {
+                    tool::Logging(myName_.c_str(), "wrong type of client ready reply.\n");
+                    exit(EXIT_FAILURE);
+                }
+            }
+            curClient->_recipeCredit += this->GetCredit(sendRecipeBuffer->header);
+            continue;
         }
-        sendRecipeBuffer->header->currentItemNum = recipeEntryNum;
-        sendRecipeBuffer->header->dataSize = readCnt;
-        sendRecipeBuffer->header->messageType = CLOUD_SEND_RECIPE;
 
-        // tool::PrintBinaryArray(sendRecipeBuffer->dataBuffer, 6);
-        if (!serverChannel_->SendData(clientSSL, sendRecipeBuffer->sendBuffer,
-                sizeof(NetworkHead_t) + sendRecipeBuffer->header->dataSize)) {
+        readyMQ.PopWait(batchBuffer);
+        NetworkHead_t* batchHeader = (NetworkHead_t*)batchBuffer;
+        isEnd = (batchHeader->messageType == CLOUD_SEND_RECIPE_END);
+        if (!serverChannel_->SendData(clientSSL, batchBuffer,
+                sizeof(NetworkHead_t) + batchHeader->dataSize)) {
             tool::Logging(myName_.c_str(), "send the batch of restored chunks error.\n");
             exit(EXIT_FAILURE);
         }
+        curClient->_recipeCredit--;
+        freeMQ.Push(batchBuffer);
+    }
 
-        if (!serverChannel_->ReceiveData(clientSSL, sendRecipeBuffer->sendBuffer,
-                recvSize)) {
-            tool::Logging(myName_.c_str(), "recv the client ready error.\n");
-            exit(EXIT_FAILURE);
-        } else {
-            if (sendRecipeBuffer->header->messageType != EDGE_RECEIVE_READY) {
-                tool::Logging(myName_.c_str(), "wrong type of client ready reply.\n");
-                exit(EXIT_FAILURE);
-            }
-        }
+    prefetchThread.join();
+    while (freeMQ.Pop(batchBuffer)) {
+        ;
+    }
+    for (auto it : batchBufferList) {
+        free(it);
     }
 
-    // ------------------------
-    // 2.读取并发送secure recipe
-    // ------------------------
-    tool::Logging(myName_.c_str(), "start to read the sec file recipe.\n");
-    end = false;
-    FileRecipeHead_t* tmpRecipeHead = (FileRecipeHead_t*)malloc(sizeof(FileRecipeHead_t));
-    curClient->_secureRecipeReadHandler.read((char*)tmpRecipeHead, sizeof(FileRecipeHead_t));
-    while (!end) {
-        // read a batch of the recipe entries from the recipe file
-        curClient->_secureRecipeReadHandler.read((char*)sendRecipeBuffer->dataBuffer,
-            sizeof(RecipeEntry_t) * sendRecipeBatchSize_);
-        size_t readCnt = curClient->_secureRecipeReadHandler.gcount();
-        end = curClient->_secureRecipeReadHandler.eof();
-        size_t recipeEntryNum = readCnt / sizeof(RecipeEntry_t);
-        if (readCnt == 0) {
-            break;
-        }
-        sendRecipeBuffer->header->currentItemNum = recipeEntryNum;
-        sendRecipeBuffer->header->dataSize = readCnt;
-        sendRecipeBuffer->header->messageType = CLOUD_SEND_SECURE_RECIPE;
+    // the edge may return the credits which are not used
+    string clientIP;
+    while (serverChannel_->ReceiveData(clientSSL, sendRecipeBuffer->sendBuffer, recvSize)) {
+        ;
+    }
+    tool::Logging(myName_.c_str(), "send recipes done.\n");
+    serverChannel_->GetClientIp(clientIP, clientSSL);
+    serverChannel_->ClearAcceptedClientSd(clientSSL);
 
-        // tool::PrintBinaryArray(sendRecipeBuffer->dataBuffer, 6);
-        if (!serverChannel_->SendData(clientSSL, sendRecipeBuffer->sendBuffer,
-                sizeof(NetworkHead_t) + sendRecipeBuffer->header->dataSize)) {
-            tool::Logging(myName_.c_str(), "send the batch of restored chunks error.\n");
-            exit(EXIT_FAILURE);
-        }
+    return;
+}
 
-        if (!serverChannel_->ReceiveData(clientSSL, sendRecipeBuffer->sendBuffer,
-                recvSize)) {
-            tool::Logging(myName_.c_str(), "recv the client ready error.\n");
-            exit(EXIT_FAILURE);
-        } else {
-            if (sendRecipeBuffer->header->messageType != EDGE_RECEIVE_READY) {
-                tool::Logging(myName_.c_str(), "wrong type of client ready reply.\n");
-                exit(EXIT_FAILURE);
-            }
-        }
+void RecipeSender::PrefetchBatches(ClientVar* curClient, MessageQueue<uint8_t*>* readyMQ,
+    MessageQueue<uint8_t*>* freeMQ)
+{
+    bool isEnd = false;
+    uint8_t* batchBuffer;
+    while (!isEnd) {
+        freeMQ->PopWait(batchBuffer);
+        this->ReadNextBatch(curClient, batchBuffer);
+        isEnd = (((NetworkHead_t*)batchBuffer)->messageType == CLOUD_SEND_RECIPE_END);
+        readyMQ->Push(batchBuffer);
     }
+    return;
+}
 
-    // ------------------------
-    // 3.读取并发送key recipe
-    // ------------------------
-    curClient->_keyRecipeReadHandler.read((char*)tmpRecipeHead, sizeof(FileRecipeHead_t));
-    free(tmpRecipeHead);
-    tool::Logging(myName_.c_str(), "start to read the key file recipe.\n");
-    end = false;
-    while (!end) {
-        // read a batch of the recipe entries from the recipe file
-        curClient->_keyRecipeReadHandler.read((char*)sendRecipeBuffer->dataBuffer,
-            sizeof(RecipeEntry_t) * sendRecipeBatchSize_);
-        size_t readCnt = curClient->_keyRecipeReadHandler.gcount();
-        end = curClient->_keyRecipeReadHandler.eof();
-        size_t recipeEntryNum = readCnt / sizeof(RecipeEntry_t);
-        if (readCnt == 0) {
-            break;
-        }
-        sendRecipeBuffer->header->currentItemNum = recipeEntryNum;
-        sendRecipeBuffer->header->dataSize = readCnt;
-        sendRecipeBuffer->header->messageType = CLOUD_SEND_KEY_RECIPE;
+void RecipeSender::StartSession(ClientVar* curClient)
+{
+    curClient->_recipeStage = SEND_PLAIN_RECIPE;
+    curClient->_recipeCredit = 0;
+    tool::Logging(myName_.c_str(), "start to read the file recipe.\n");
+    return;
+}
 
-        // tool::PrintBinaryArray(sendRecipeBuffer->dataBuffer, 6);
-        if (!serverChannel_->SendData(clientSSL, sendRecipeBuffer->sendBuffer,
-                sizeof(NetworkHead_t) + sendRecipeBuffer->header->dataSize)) {
-            tool::Logging(myName_.c_str(), "send the batch of restored chunks error.\n");
-            exit(EXIT_FAILURE);
-        }
+void RecipeSender::ProcessMessage(ClientVar* curClient)
+{
+    SendMsgBuffer_t* sendRecipeBuffer = &curClient->_sendRecipeBuf;
+    if (sendRecipeBuffer->header->messageType != EDGE_RECEIVE_READY) {
+        tool::Logging(myName_.c_str(), "wrong type of client ready reply.\n");
+        exit(EXIT_FAILURE);
+    }
 
-        if (!serverChannel_->ReceiveData(clientSSL, sendRecipeBuffer->sendBuffer,
-                recvSize)) {
-            tool::Logging(myName_.c_str(), "recv the client ready error.\n");
-            exit(EXIT_FAILURE);
-        } else {
-            if (sendRecipeBuffer->header->messageType != EDGE_RECEIVE_READY) {
-                tool::Logging(myName_.c_str(), "wrong type of client ready reply.\n");
-                exit(EXIT_FAILURE);
-            }
-        }
+    // keep the batches in flight up to the credits of the edge
+    curClient->_recipeCredit += this->GetCredit(sendRecipeBuffer->header);
+    while (curClient->_recipeCredit > 0 && curClient->_recipeStage != SEND_RECIPE_END) {
+        this->SendNextBatch(curClient);
+        curClient->_recipeCredit--;
     }
+    return;
+}
 
-    sendRecipeBuffer->header->currentItemNum = 0;
-    sendRecipeBuffer->header->dataSize = 0;
-    sendRecipeBuffer->header->messageType = CLOUD_SEND_RECIPE_END;
-    if (!serverChannel_->SendData(clientSSL, sendRecipeBuffer->sendBuffer, sizeof(NetworkHead_t))) {
+bool RecipeSender::SendNextBatch(ClientVar* curClient)
+{
+    SendMsgBuffer_t* sendRecipeBuffer = &curClient->_sendRecipeBuf;
+    uint32_t msgSize = this->ReadNextBatch(curClient, sendRecipeBuffer->sendBuffer);
+    if (!serverChannel_->SendData(curClient->_clientSSL, sendRecipeBuffer->sendBuffer, msgSize)) {
         tool::Logging(myName_.c_str(), "send the batch of restored chunks error.\n");
         exit(EXIT_FAILURE);
     }
+    return (sendRecipeBuffer->header->messageType != CLOUD_SEND_RECIPE_END);
+}
 
-    string clientIP;
-    if (!serverChannel_->ReceiveData(clientSSL, sendRecipeBuffer->sendBuffer, recvSize)) {
-        tool::Logging(myName_.c_str(), "send recipes done.\n");
-        serverChannel_->GetClientIp(clientIP, clientSSL);
-        serverChannel_->ClearAcceptedClientSd(clientSSL);
+uint32_t RecipeSender::ReadNextBatch(ClientVar* curClient, uint8_t* msgBuffer)
+{
+    NetworkHead_t* msgHeader = (NetworkHead_t*)msgBuffer;
+    uint8_t* dataBuffer = msgBuffer + sizeof(NetworkHead_t);
+    FileRecipeHead_t tmpRecipeHead;
+    msgHeader->clientID = curClient->_clientID;
+
+    while (curClient->_recipeStage != SEND_RECIPE_END) {
+        ifstream* recipeReadHandler;
+        int messageType;
+        switch (curClient->_recipeStage) {
+        case SEND_PLAIN_RECIPE: {
+            // ------------------------
+            // 1.读取并发送plain recipe
+            // ------------------------
+            recipeReadHandler = &curClient->_recipeReadHandler;
+            messageType = CLOUD_SEND_RECIPE;
+            break;
+        }
+        case SEND_SECURE_RECIPE: {
+            // ------------------------
+            // 2.读取并发送secure recipe
+            // ------------------------
+            recipeReadHandler = &curClient->_secureRecipeReadHandler;
+            messageType = CLOUD_SEND_SECURE_RECIPE;
+            break;
+        }
+        default: {
+            // ------------------------
+            // 3.读取并发送key recipe
+            // ------------------------
+            recipeReadHandler = &curClient->_keyRecipeReadHandler;
+            messageType = CLOUD_SEND_KEY_RECIPE;
+            break;
+        }
+        }
+
+        // read a batch of the recipe entries from the recipe file
+        recipeReadHandler->read((char*)dataBuffer,
+            sizeof(RecipeEntry_t) * sendRecipeBatchSize_);
+        size_t readCnt = recipeReadHandler->gcount();
+        size_t recipeEntryNum = readCnt / sizeof(RecipeEntry_t);
+        if (readCnt == 0) {
+            // this recipe is done, move to the next one
+            curClient->_recipeStage++;
+            switch (curClient->_recipeStage) {
+            case SEND_SECURE_RECIPE: {
+                tool::Logging(myName_.c_str(), "start to read the sec file recipe.\n");
+                curClient->_secureRecipeReadHandler.read((char*)&tmpRecipeHead,
+                    sizeof(FileRecipeHead_t));
+                break;
+            }
+            case SEND_KEY_RECIPE: {
+                curClient->_keyRecipeReadHandler.read((char*)&tmpRecipeHead,
+                    sizeof(FileRecipeHead_t));
+                tool::Logging(myName_.c_str(), "start to read the key file recipe.\n");
+                break;
+            }
+            }
+            continue;
+        }
+        msgHeader->currentItemNum = recipeEntryNum;
+        msgHeader->dataSize = readCnt;
+        msgHeader->messageType = messageType;
+        return sizeof(NetworkHead_t) + readCnt;
     }
 
-    return;
+    msgHeader->currentItemNum = 0;
+    msgHeader->dataSize = 0;
+    msgHeader->messageType = CLOUD_SEND_RECIPE_END;
+    return sizeof(NetworkHead_t);
 }
\ No newline at end of file
@@ -47,45 +47,59 @@ void RecvDecoder::Run(ClientVar* curClient)
     uint32_t recvSize = 0;
     string clientIP;
 
-    bool endFlag = false;
+    while (true) {
+        if (!serverChannel_->ReceiveData(clientSSL, sendChunkBuf->sendBuffer,
+                recvSize)) {
+            if (!curClient->_restoreReady) {
+                tool::Logging(myName_.c_str(), "recv the client ready error.\n");
+                exit(EXIT_FAILURE);
+            }
+            tool::Logging(myName_.c_str(), "download chunk finish.\n");
+            serverChannel_->GetClientIp(clientIP, clientSSL);
+            serverChannel_->ClearAcceptedClientSd(clientSSL);
+            break;
+        }
+        this->ProcessMessage(curClient);
+    }
+    return;
+}
+
+/**
+ * @brief process a received message in the chunk buffer of the client
+ *
+ * @param curClient the current client ptr
+ */
+void RecvDecoder::ProcessMessage(ClientVar* curClient)
+{
+    SendMsgBuffer_t* sendChunkBuf = &curClient->_sendChunkBuf;
 
     // ------------------------
     // 等待edge回应
     // ------------------------
-    if (!serverChannel_->ReceiveData(clientSSL, sendChunkBuf->sendBuffer,
-            recvSize)) {
-        tool::Logging(myName_.c_str(), "recv the client ready error.\n");
-        exit(EXIT_FAILURE);
-    } else {
+    if (!curClient->_restoreReady) {
         tool::Logging(myName_.c_str(), "01 Message type is %d\n", sendChunkBuf->header->messageType);
         if (sendChunkBuf->header->messageType != EDGE_RECEIVE_READY) {
             tool::Logging(myName_.c_str(), "wrong type of client ready reply.\n");
             exit(EXIT_FAILURE);
         }
-    }
-    tool::Logging(myName_.c_str(), "ready to recieve data \n");
-    recvSize = 0;
-    while (true) {
-        if (!serverChannel_->ReceiveData(clientSSL, sendChunkBuf->sendBuffer,
-                recvSize)) {
-            tool::Logging(myName_.c_str(), "download chunk finish.\n");
-            serverChannel_->GetClientIp(clientIP, clientSSL);
-            serverChannel_->ClearAcceptedClientSd(clientSSL);
-            break;
-        } else {
-            tool::Logging(myName_.c_str(), "02 Message type is %d\n", sendChunkBuf->header->messageType);
-            if (sendChunkBuf->header->messageType != EDGE_DOWNLOAD_CHUNK_READY) {
-                tool::Logging(myName_.c_str(), "wrong type of client ready reply.\n");
-                tool::Logging(myName_.c_str(), "data size is %d\n", sendChunkBuf->header->dataSize);
-                exit(EXIT_FAILURE);
-            } else {
-                uint32_t recipeNum = sendChunkBuf->header->currentItemNum;
-                sendChunkBuf->header->currentItemNum = 0;
-                sendChunkBuf->header->dataSize = 0;
-                this->ProcessRecipeBatch(sendChunkBuf->dataBuffer, recipeNum, curClient);
-            }
+        tool::Logging(myName_.c_str(), "ready to recieve data \n");
+        if (serverChannel_->IsKernelTLSSend(curClient->_clientSSL)) {
+            tool::Logging(myName_.c_str(), "send the chunks with kernel TLS sendfile.\n");
         }
+        curClient->_restoreReady = true;
+        return;
+    }
+
+    tool::Logging(myName_.c_str(), "02 Message type is %d\n", sendChunkBuf->header->messageType);
+    if (sendChunkBuf->header->messageType != EDGE_DOWNLOAD_CHUNK_READY) {
+        tool::Logging(myName_.c_str(), "wrong type of client ready reply.\n");
+        tool::Logging(myName_.c_str(), "data size is %d\n", sendChunkBuf->header->dataSize);
+        exit(EXIT_FAILURE);
     }
+    uint32_t recipeNum = sendChunkBuf->header->currentItemNum;
+    sendChunkBuf->header->currentItemNum = 0;
+    sendChunkBuf->header->dataSize = 0;
+    this->ProcessRecipeBatch(sendChunkBuf->dataBuffer, recipeNum, curClient);
     return;
 }
 
@@ -120,6 +134,11 @@ void RecvDecoder::RecoverOneChunk(DownloadChunkEntry_t* entry, uint8_t* chunkBuf
 void RecvDecoder::ProcessRecipeBatch(uint8_t* recipeBuffer, size_t recipeNum,
     ClientVar* curClient)
 {
+    if (serverChannel_->IsKernelTLSSend(curClient->_clientSSL)) {
+        this->ProcessRecipeBatchByFile(recipeBuffer, recipeNum, curClient);
+        return;
+    }
+
     ReqContainer_t* reqContainer = (ReqContainer_t*)&curClient->_reqContainer;
     uint8_t* idBuffer = reqContainer->idBuffer;
     uint8_t** containerArray = reqContainer->containerArray;
@@ -135,19 +154,24 @@ void RecvDecoder::ProcessRecipeBatch(uint8_t* recipeBuffer, size_t recipeNum,
 
     uint32_t offset = 0;
     string tmpContainerNameStr;
-    string tmpHashStr;
     tmpContainerNameStr.resize(CONTAINER_ID_LENGTH, 0);
-    tmpHashStr.resize(CHUNK_HASH_SIZE, 0);
+    // the tail batch and the end flag are sent in one record
+    serverChannel_->CorkData(curClient->_clientSSL);
+
     tool::Logging(myName_.c_str(), "read index store first \n");
+    vector<uint8_t>& foundList = curClient->_indexFoundList;
+    vector<uint8_t>& containerNameList = curClient->_indexValueList;
+    foundList.resize(recipeNum);
+    containerNameList.resize(recipeNum * CONTAINER_ID_LENGTH);
+    absIndexObj_->ReadIndexStoreBatch(recipeBuffer, recipeNum, containerNameList.data(),
+        foundList.data());
     for (size_t i = 0; i < recipeNum; i++) {
         memcpy(downloadChunkEntry->chunkHash, recipeBuffer + offset, CHUNK_HASH_SIZE);
-        tmpHashStr.assign((char*)downloadChunkEntry->chunkHash, CHUNK_HASH_SIZE);
-        auto result = absIndexObj_->ReadIndexStore(tmpHashStr, tmpContainerNameStr);
-        if (!result) {
+        if (!foundList[i]) {
             tool::Logging(myName_.c_str(), "no find\n");
         }
-        memcpy(downloadChunkEntry->containerName, tmpContainerNameStr.c_str(),
-            CONTAINER_ID_LENGTH);
+        memcpy(downloadChunkEntry->containerName,
+            containerNameList.data() + i * CONTAINER_ID_LENGTH, CONTAINER_ID_LENGTH);
         downloadChunkEntry++;
         offset += sizeof(RecipeEntry_t);
     }
@@ -181,6 +205,7 @@ void RecvDecoder::ProcessRecipeBatch(uint8_t* recipeBuffer, size_t recipeNum,
             while (startEntry != endEntry) {
                 string tmpHashStr;
                 tmpHashStr.assign((char*)startEntry->chunkHash, CHUNK_HASH_SIZE);
+                tmpHashStr.append((char*)&startEntry->containerID, sizeof(uint32_t));
                 auto findResult = restoreIndex.find(tmpHashStr);
                 startEntry->chunkOffset = findResult->second.offset;
                 startEntry->chunkSize = findResult->second.length;
@@ -221,10 +246,178 @@ void RecvDecoder::ProcessRecipeBatch(uint8_t* recipeBuffer, size_t recipeNum,
     }
 
     this->ProcessRecipeTailBatch(curClient);
+    if (!serverChannel_->UncorkData(curClient->_clientSSL)) {
+        tool::Logging(myName_.c_str(), "send the batch of restored chunks error.\n");
+        exit(EXIT_FAILURE);
+    }
 
     return;
 }
 
+/**
+ * @brief process a batch of recipe with kernel TLS, the chunks are sent
+ * from the container files without copying them to the user space
+ *
+ * @param recipeBuffer the read recipe buffer
+ * @param recipeNum the read recipe num
+ * @param curClient the current client var
+ */
+void RecvDecoder::ProcessRecipeBatchByFile(uint8_t* recipeBuffer, size_t recipeNum,
+    ClientVar* curClient)
+{
+    SSL* clientSSL = curClient->_clientSSL;
+    SendMsgBuffer_t* sendChunkBuf = &curClient->_sendChunkBuf;
+    DownloadChunkEntry_t* downloadChunkBase = curClient->_downloadChunkBase;
+
+    unordered_map<string, uint32_t> tmpContainerMap;
+    vector<int> containerFdList;
+    unordered_map<string, RestoreIndexEntry_t> restoreIndex;
+
+    // step-1: locate each chunk in the container files
+    vector<uint8_t>& foundList = curClient->_indexFoundList;
+    vector<uint8_t>& containerNameList = curClient->_indexValueList;
+    foundList.resize(recipeNum);
+    containerNameList.resize(recipeNum * CONTAINER_ID_LENGTH);
+    if (absIndexObj_->ReadIndexStoreBatch(recipeBuffer, recipeNum, containerNameList.data(),
+            foundList.data())
+        != recipeNum) {
+        tool::Logging(myName_.c_str(), "no find\n");
+        exit(EXIT_FAILURE);
+    }
+    string tmpContainerNameStr;
+    string tmpHashStr;
+    tmpContainerNameStr.resize(CONTAINER_ID_LENGTH, 0);
+    tmpHashStr.resize(CHUNK_HASH_SIZE, 0);
+    for (size_t i = 0; i < recipeNum; i++) {
+        DownloadChunkEntry_t* downloadChunkEntry = downloadChunkBase + i;
+        memcpy(downloadChunkEntry->chunkHash, recipeBuffer + i * sizeof(RecipeEntry_t),
+            CHUNK_HASH_SIZE);
+        tmpHashStr.assign((char*)downloadChunkEntry->chunkHash, CHUNK_HASH_SIZE);
+        tmpContainerNameStr.assign((char*)containerNameList.data() + i * CONTAINER_ID_LENGTH,
+            CONTAINER_ID_LENGTH);
+
+        auto findResult = tmpContainerMap.find(tmpContainerNameStr);
+        if (findResult == tmpContainerMap.end()) {
+            string readFileNameStr = containerNamePrefix_ + tmpContainerNameStr + containerNameTail_;
+            int containerFd = open(readFileNameStr.c_str(), O_RDONLY);
+            if (containerFd < 0) {
+                tool::Logging(myName_.c_str(), "cannot open the container: %s\n",
+                    readFileNameStr.c_str());
+                exit(EXIT_FAILURE);
+            }
+            // only the metadata section is read
+            if (!this->LoadContainerIndex(containerFd, containerFdList.size(), restoreIndex)) {
+                tool::Logging(myName_.c_str(), "read the metadata of container %s error.\n",
+                    readFileNameStr.c_str());
+                exit(EXIT_FAILURE);
+            }
+            downloadChunkEntry->containerID = containerFdList.size();
+            tmpContainerMap[tmpContainerNameStr] = containerFdList.size();
+            containerFdList.push_back(containerFd);
+            readFromContainerFileNum_++;
+        } else {
+            downloadChunkEntry->containerID = findResult->second;
+        }
+
+        tmpHashStr.append((char*)&downloadChunkEntry->containerID, sizeof(uint32_t));
+        auto indexResult = restoreIndex.find(tmpHashStr);
+        if (indexResult == restoreIndex.end()) {
+            tool::Logging(myName_.c_str(), "cannot find the chunk in container %s.\n",
+                tmpContainerNameStr.c_str());
+            exit(EXIT_FAILURE);
+        }
+        downloadChunkEntry->chunkOffset = indexResult->second.offset;
+        downloadChunkEntry->chunkSize = indexResult->second.length;
+    }
+
+    // step-2: send the chunks in batches, the message header and the chunk
+    // sizes are framed here, the chunk data comes from the files
+    serverChannel_->CorkData(clientSSL);
+    for (size_t startIdx = 0; startIdx < recipeNum; startIdx += sendChunkBatchSize_) {
+        size_t endIdx = min(recipeNum, (size_t)(startIdx + sendChunkBatchSize_));
+        uint32_t dataSize = 0;
+        for (size_t i = startIdx; i < endIdx; i++) {
+            dataSize += sizeof(uint32_t) + downloadChunkBase[i].chunkSize;
+        }
+        sendChunkBuf->header->messageType = CLOUD_SEND_CHUNK;
+        sendChunkBuf->header->currentItemNum = endIdx - startIdx;
+        sendChunkBuf->header->dataSize = dataSize;
+        uint32_t messageSize = sizeof(NetworkHead_t) + dataSize;
+
+        bool sendStatus = serverChannel_->SendRawData(clientSSL, (uint8_t*)&messageSize,
+                              sizeof(uint32_t))
+            && serverChannel_->SendRawData(clientSSL, sendChunkBuf->sendBuffer,
+                sizeof(NetworkHead_t));
+        for (size_t i = startIdx; i < endIdx && sendStatus; i++) {
+            DownloadChunkEntry_t* downloadChunkEntry = downloadChunkBase + i;
+            sendStatus = serverChannel_->SendRawData(clientSSL,
+                             (uint8_t*)&downloadChunkEntry->chunkSize, sizeof(uint32_t))
+                && serverChannel_->SendFileData(clientSSL,
+                    containerFdList[downloadChunkEntry->containerID],
+                    downloadChunkEntry->chunkOffset, downloadChunkEntry->chunkSize);
+        }
+        if (!sendStatus) {
+            tool::Logging(myName_.c_str(), "send the batch of restored chunks error.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    sendChunkBuf->header->dataSize = 0;
+    sendChunkBuf->header->currentItemNum = 0;
+
+    for (auto containerFd : containerFdList) {
+        close(containerFd);
+    }
+
+    this->ProcessRecipeTailBatch(curClient);
+    if (!serverChannel_->UncorkData(clientSSL)) {
+        tool::Logging(myName_.c_str(), "send the batch of restored chunks error.\n");
+        exit(EXIT_FAILURE);
+    }
+    return;
+}
+
+/**
+ * @brief read the metadata section of a container file to locate its chunks
+ *
+ * @param containerFd the container file
+ * @param containerId the id of the container in the batch
+ * @param restoreIndex the restore index (fp + container id -> offset/length in the file)
+ * @return true success
+ * @return false the container is broken
+ */
+bool RecvDecoder::LoadContainerIndex(int containerFd, uint32_t containerId,
+    unordered_map<string, RestoreIndexEntry_t>& restoreIndex)
+{
+    uint8_t chunkNumChar[4];
+    if (pread(containerFd, chunkNumChar, sizeof(chunkNumChar), 0) != sizeof(chunkNumChar)) {
+        return false;
+    }
+    size_t chunkNum = (chunkNumChar[3]) + (chunkNumChar[2] << 8) + (chunkNumChar[1] << 16) + (chunkNumChar[0] << 24);
+
+    // each entry: chunk hash + offset (4 bytes) + length (4 bytes), in big endian
+    size_t entrySize = CHUNK_HASH_SIZE + 8;
+    size_t metaSize = chunkNum * entrySize;
+    vector<uint8_t> metaBuffer(metaSize);
+    if (pread(containerFd, metaBuffer.data(), metaSize, 4) != (ssize_t)metaSize) {
+        return false;
+    }
+
+    string tmpChunkHash;
+    for (size_t j = 0; j < chunkNum; j++) {
+        uint8_t* entry = metaBuffer.data() + j * entrySize;
+        // a chunk may be stored in more than one container
+        tmpChunkHash.assign((char*)entry, CHUNK_HASH_SIZE);
+        tmpChunkHash.append((char*)&containerId, sizeof(containerId));
+        uint8_t* pos = entry + CHUNK_HASH_SIZE;
+        RestoreIndexEntry_t tmpRestoreEntry;
+        tmpRestoreEntry.offset = (pos[3] + (pos[2] << 8) + (pos[1] << 16) + (pos[0] << 24))
+            + metaSize + 4;
+        tmpRestoreEntry.length = pos[7] + (pos[6] << 8) + (pos[5] << 16) + (pos[4] << 24);
+        restoreIndex[tmpChunkHash] = tmpRestoreEntry;
+    }
+    return true;
+}
+
 /**
  * @brief process the tail batch of the recipe
  *
@@ -335,6 +528,9 @@ void RecvDecoder::IndexConstruct(unordered_map<string, RestoreIndexEntry_t>& res
             string tmpChunkHash;
             // tool::Logging(myName_.c_str(), "j is %d\n", j);
             tmpChunkHash.assign((char*)(containerArray[i] + 4) + (j * (CHUNK_HASH_SIZE + 8)), CHUNK_HASH_SIZE);
+            // a chunk may be stored in more than one container
+            uint32_t containerId = i;
+            tmpChunkHash.append((char*)&containerId, sizeof(containerId));
             // tool::PrintBinaryArray(containerArray[i] + (j * (CHUNK_HASH_SIZE + 8)), CHUNK_HASH_SIZE);
             RestoreIndexEntry_t tmpRestoreEntry;
             tmpRestoreEntry.offset = ((containerArray[i] + 4)[j * (CHUNK_HASH_SIZE + 8) + CHUNK_HASH_SIZE + 3]) + ((containerArray[i] + 4)[j * (CHUNK_HASH_SIZE + 8) + CHUNK_HASH_SIZE + 2] << 8) + ((containerArray[i] + 4)[j * (CHUNK_HASH_SIZE + 8) + CHUNK_HASH_SIZE + 1] << 16) + ((containerArray[i] + 4)[j * (CHUNK_HASH_SIZE + 8) + CHUNK_HASH_SIZE + 0] << 24) + chunkNum * (CHUNK_HASH_SIZE + 8) + 4;
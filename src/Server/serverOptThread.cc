@@ -28,7 +28,31 @@ ServerOptThread::ServerOptThread(SSLConnection* serverChannel, AbsDatabase* fp2C
     // init the upload
     dataWriterObj_ = new DataWriter();
     storageCoreObj_ = new StorageCore();
-    absIndexObj_ = new PlainIndex(fp2ChunkDB_);
+    dataWriterObj_->SetIndexStore(fp2ChunkDB_);
+    storageCoreObj_->SetIndexStore(fp2ChunkDB_);
+    switch (indexType_) {
+    case OUT_ENCLAVE:
+        absIndexObj_ = new PlainIndex(fp2ChunkDB_);
+        break;
+    case EXTREME_BIN:
+        fprintf(stderr, "Index: using extreme binning.\n");
+        absIndexObj_ = new ExtremeBinIndex(fp2ChunkDB_);
+        break;
+    case SPARSE_INDEX:
+        fprintf(stderr, "Index: using the sparse index.\n");
+        absIndexObj_ = new SparseIndex(fp2ChunkDB_);
+        break;
+    default:
+        tool::Logging(myName_.c_str(), "wrong index type %d.\n", indexType_);
+        exit(EXIT_FAILURE);
+    }
+    if (indexType_ != OUT_ENCLAVE && (config.GetFp2ChunkDBType() == IN_MEMORY
+            || config.GetFp2ChunkDBType() == FLAT_TABLE)) {
+        // the restore still locates the chunks with the full index
+        tool::Logging(myName_.c_str(), "the full index still keeps all fingerprints in the memory, "
+                                       "use a disk-backed fp2ChunkDBType_ with index type %d.\n",
+            indexType_);
+    }
     absIndexObj_->SetStorageCoreObj(storageCoreObj_);
     dataReceiverObj_ = new DataReceiver(absIndexObj_, serverChannel_);
     dataReceiverObj_->SetStorageCoreObj(storageCoreObj_);
@@ -104,22 +128,8 @@ void ServerOptThread::Run(SSL* clientSSL)
 
     // check the client lock here (ensure exist only one client with the same client ID)
     uint32_t clientID = recvBuf.header->clientID;
-    boost::mutex* tmpLock;
-    {
-        // ensure only one client ID can enter the process
-        lock_guard<mutex> lock(clientLockSetLock_);
-        auto clientLockRes = clientLockIndex_.find(clientID);
-        if (clientLockRes != clientLockIndex_.end()) {
-            // try to lock this mutex
-            tmpLock = clientLockRes->second;
-            tmpLock->lock();
-        } else {
-            // add a new lock to the current index
-            tmpLock = new boost::mutex();
-            clientLockIndex_[clientID] = tmpLock;
-            tmpLock->lock();
-        }
-    }
+    boost::mutex* tmpLock = this->GetClientLock(clientID);
+    tmpLock->lock();
 
     // ------------------------
     // 判断请求类型，如果是upload和download recipe则初始化文件名
@@ -152,6 +162,200 @@ void ServerOptThread::Run(SSL* clientSSL)
     return;
 }
 
+/**
+ * @brief Get the lock of the client ID (create it if not exist)
+ *
+ * @param clientID the client ID
+ * @return boost::mutex* the lock of this client ID
+ */
+boost::mutex* ServerOptThread::GetClientLock(uint32_t clientID)
+{
+    // ensure only one client ID can enter the process
+    lock_guard<mutex> lock(clientLockSetLock_);
+    auto clientLockRes = clientLockIndex_.find(clientID);
+    if (clientLockRes != clientLockIndex_.end()) {
+        return clientLockRes->second;
+    }
+    // add a new lock to the current index
+    boost::mutex* tmpLock = new boost::mutex();
+    clientLockIndex_[clientID] = tmpLock;
+    return tmpLock;
+}
+
+/**
+ * @brief try to lock the client ID without blocking (for the event-driven mode)
+ *
+ * @param clientID the client ID
+ * @return true the client ID is locked by the caller
+ * @return false another session of this client ID is running
+ */
+bool ServerOptThread::TryLockClient(uint32_t clientID)
+{
+    return this->GetClientLock(clientID)->try_lock();
+}
+
+/**
+ * @brief unlock the client ID (for the event-driven mode)
+ *
+ * @param clientID the client ID
+ */
+void ServerOptThread::UnlockClient(uint32_t clientID)
+{
+    this->GetClientLock(clientID)->unlock();
+    return;
+}
+
+/**
+ * @brief process the login message and open a session (for the event-driven mode)
+ *
+ * @param recvBuf the buffer of the login message
+ * @param clientSSL the client ssl
+ * @return ClientVar* the session of the client, NULL if the login is rejected
+ */
+ClientVar* ServerOptThread::OpenSession(SendMsgBuffer_t& recvBuf, SSL* clientSSL)
+{
+    uint32_t clientID = recvBuf.header->clientID;
+    ClientVar* curClient = NULL;
+
+    string fileName;
+    fileName.assign((char*)recvBuf.dataBuffer, CHUNK_HASH_SIZE * 2);
+    string recipePath = config.GetRecipeRootPath() + fileName + config.GetRecipeSuffix();
+    string secureRecipePath = config.GetRecipeRootPath() + fileName + config.GetSecureRecipeSuffix();
+    string keyRecipePath = config.GetRecipeRootPath() + fileName + config.GetKeyRecipeSuffix();
+    uint32_t responseSize = sizeof(NetworkHead_t);
+
+    switch (recvBuf.header->messageType) {
+    case EDGE_MIGRATE_LOGIN: {
+        FileRecipeHead_t* tmpRecipeHead = (FileRecipeHead_t*)(recvBuf.dataBuffer + CHUNK_HASH_SIZE * 2);
+        curClient = new ClientVar(clientID, clientSSL, UPLOAD_OPT, recipePath,
+            secureRecipePath, keyRecipePath, tmpRecipeHead->fileSize,
+            tmpRecipeHead->totalChunkNum);
+        curClient->_replyCap = recvBuf.header->currentItemNum & EDGE_CAP_SUPPORTED;
+        dataReceiverObj_->StartSession(curClient);
+        recvBuf.header->messageType = EDGE_LOGIN_RESPONSE;
+        // tell the edge the accepted reply formats
+        recvBuf.header->currentItemNum = curClient->_replyCap;
+        break;
+    }
+    case EDGE_DOWNLOAD_RECIPE_LOGIN: {
+        responseSize += sizeof(FileRecipeHead_t);
+        if (tool::FileExist(recipePath) && tool::FileExist(secureRecipePath)
+            && tool::FileExist(keyRecipePath)) {
+            tool::Logging(myName_.c_str(), "recv the download recipe request from client: %u\n",
+                clientID);
+            curClient = new ClientVar(clientID, clientSSL, DOWNLOAD_RECIPE_OPT, recipePath,
+                secureRecipePath, keyRecipePath, 0, 0);
+            recipeSenderObj_->StartSession(curClient);
+            // the restore-reponse includes the file recipe header
+            recvBuf.header->messageType = EDGE_LOGIN_RESPONSE;
+            curClient->_recipeReadHandler.read((char*)recvBuf.dataBuffer,
+                sizeof(FileRecipeHead_t));
+        } else {
+            recvBuf.header->messageType = CLOUD_FILE_NON_EXIST;
+        }
+        break;
+    }
+    case EDGE_DOWNLOAD_CHUNK_LOGIN: {
+        tool::Logging(myName_.c_str(), "recv the download chunk request from client: %u\n",
+            clientID);
+        string virtualStr = "";
+        curClient = new ClientVar(clientID, clientSSL, DOWNLOAD_CHUNK_OPT, virtualStr,
+            virtualStr, virtualStr, 0, 0);
+        recvBuf.header->messageType = EDGE_LOGIN_RESPONSE;
+        break;
+    }
+    default: {
+        tool::Logging(myName_.c_str(), "wrong client login type.\n");
+        exit(EXIT_FAILURE);
+    }
+    }
+
+    if (!serverChannel_->SendData(clientSSL, recvBuf.sendBuffer, responseSize)) {
+        tool::Logging(myName_.c_str(), "send the login response error.\n");
+    }
+    return curClient;
+}
+
+/**
+ * @brief Get the receive buffer of a session
+ *
+ * @param curClient the current client var
+ * @return uint8_t* the buffer to receive the next message
+ */
+uint8_t* ServerOptThread::GetSessionRecvBuffer(ClientVar* curClient)
+{
+    switch (curClient->GetOptType()) {
+    case UPLOAD_OPT:
+        return curClient->_recvChunkBuf.sendBuffer;
+    case DOWNLOAD_RECIPE_OPT:
+        return curClient->_sendRecipeBuf.sendBuffer;
+    default:
+        return curClient->_sendChunkBuf.sendBuffer;
+    }
+}
+
+/**
+ * @brief process a received message of a session (for the event-driven mode)
+ *
+ * @param curClient the current client var
+ * @return true the session goes on
+ * @return false the session is rejected
+ */
+bool ServerOptThread::ProcessSessionMessage(ClientVar* curClient)
+{
+    switch (curClient->GetOptType()) {
+    case UPLOAD_OPT: {
+        dataReceiverObj_->ProcessMessage(curClient, &curClient->_recvChunkBuf);
+        // no writer thread in this mode, the reactor worker running the message
+        // writes the sealed containers
+        dataWriterObj_->SaveQueuedContainers(curClient->_inputMQ);
+        if (curClient->_fpRejected) {
+            tool::Logging(myName_.c_str(), "reject the upload of client %u.\n",
+                curClient->_clientID);
+            return false;
+        }
+        break;
+    }
+    case DOWNLOAD_RECIPE_OPT: {
+        recipeSenderObj_->ProcessMessage(curClient);
+        break;
+    }
+    case DOWNLOAD_CHUNK_OPT: {
+        recvDecoderObj_->ProcessMessage(curClient);
+        break;
+    }
+    }
+    return true;
+}
+
+/**
+ * @brief close a session after its connection is closed (for the event-driven mode)
+ *
+ * @param curClient the current client var
+ */
+void ServerOptThread::CloseSession(ClientVar* curClient)
+{
+    switch (curClient->GetOptType()) {
+    case UPLOAD_OPT: {
+        EnclaveInfo_t enclaveInfo;
+        tool::Logging(myName_.c_str(), "Migration Done!\n");
+        dataReceiverObj_->FinishSession(curClient, &enclaveInfo);
+        dataWriterObj_->SaveQueuedContainers(curClient->_inputMQ);
+        break;
+    }
+    case DOWNLOAD_RECIPE_OPT: {
+        tool::Logging(myName_.c_str(), "download recipes done\n");
+        break;
+    }
+    case DOWNLOAD_CHUNK_OPT: {
+        tool::Logging(myName_.c_str(), "download chunk finish.\n");
+        break;
+    }
+    }
+    delete curClient;
+    return;
+}
+
 /**
  * @brief check the file status
  *
@@ -214,14 +418,16 @@ void ServerOptThread::EdgeUploadThread(SendMsgBuffer_t& recvBuf, SSL* clientSSL)
     curClient = new ClientVar(clientID, clientSSL, UPLOAD_OPT, recipePath,
         secureRecipePath, keyRecipePath, tmpRecipeHead->fileSize,
         tmpRecipeHead->totalChunkNum);
+    curClient->_replyCap = recvBuf.header->currentItemNum & EDGE_CAP_SUPPORTED;
 
     thTmp = new boost::thread(attrs, boost::bind(&DataReceiver::Run, dataReceiverObj_, curClient, &enclaveInfo));
     thList.push_back(thTmp);
     thTmp = new boost::thread(attrs, boost::bind(&DataWriter::Run, dataWriterObj_, curClient->_inputMQ));
     thList.push_back(thTmp);
 
-    // send the upload-response to the client
+    // send the upload-response to the client with the accepted reply formats
     recvBuf.header->messageType = EDGE_LOGIN_RESPONSE;
+    recvBuf.header->currentItemNum = curClient->_replyCap;
     if (!serverChannel_->SendData(clientSSL, recvBuf.sendBuffer,
             sizeof(NetworkHead_t))) {
         tool::Logging(myName_.c_str(), "send the upload-login response error.\n");
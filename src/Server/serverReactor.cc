@@ -0,0 +1,514 @@
+/**
+ * @file serverReactor.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement the epoll reactor
+ * @version 0.1
+ * @date 2022-06-10
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/serverReactor.h"
+
+/**
+ * @brief Construct a new Server Reactor object
+ *
+ * @param serverChannel server communication channel
+ * @param serverThreadObj the server main thread obj
+ * @param threadNum the number of reactor threads (0: one per core)
+ * @param workerNum the number of worker threads (0: one per core)
+ */
+ServerReactor::ServerReactor(SSLConnection* serverChannel, ServerOptThread* serverThreadObj,
+    uint32_t threadNum, uint32_t workerNum)
+{
+    serverChannel_ = serverChannel;
+    serverThreadObj_ = serverThreadObj;
+    threadNum_ = threadNum;
+    if (threadNum_ == 0) {
+        threadNum_ = boost::thread::hardware_concurrency();
+        if (threadNum_ == 0) {
+            threadNum_ = 1;
+        }
+    }
+    workerNum_ = workerNum;
+    if (workerNum_ == 0) {
+        workerNum_ = boost::thread::hardware_concurrency();
+        if (workerNum_ == 0) {
+            workerNum_ = 1;
+        }
+    }
+    nextReactor_ = 0;
+    done_ = false;
+    totalSessionNum_ = 0;
+    totalTaskNum_ = 0;
+
+    // the stack should hold a container when the worker writes it
+    boost::thread_attributes attrs;
+    attrs.set_stack_size(THREAD_STACK_SIZE);
+    for (size_t i = 0; i < workerNum_; i++) {
+        workerList_.push_back(new boost::thread(attrs,
+            boost::bind(&ServerReactor::RunWorker, this)));
+    }
+    for (size_t i = 0; i < threadNum_; i++) {
+        ReactorThread_t* reactor = new ReactorThread_t();
+        reactor->epollFd = epoll_create1(0);
+        reactor->wakeFd = eventfd(0, EFD_NONBLOCK);
+        if (reactor->epollFd < 0 || reactor->wakeFd < 0) {
+            tool::Logging(myName_.c_str(), "cannot init the epoll: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        struct epoll_event wakeEvent;
+        wakeEvent.events = EPOLLIN;
+        wakeEvent.data.ptr = NULL;
+        if (epoll_ctl(reactor->epollFd, EPOLL_CTL_ADD, reactor->wakeFd, &wakeEvent) < 0) {
+            tool::Logging(myName_.c_str(), "cannot add the wake fd: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        reactorList_.push_back(reactor);
+        thList_.push_back(new boost::thread(boost::bind(&ServerReactor::RunLoop, this,
+            reactor)));
+    }
+
+    tool::Logging(myName_.c_str(), "start %u reactor threads and %u worker threads.\n",
+        threadNum_, workerNum_);
+}
+
+/**
+ * @brief Destroy the Server Reactor object
+ *
+ */
+ServerReactor::~ServerReactor()
+{
+    done_ = true;
+    uint64_t wakeSignal = 1;
+    for (auto reactor : reactorList_) {
+        if (write(reactor->wakeFd, &wakeSignal, sizeof(wakeSignal)) < 0) {
+            tool::Logging(myName_.c_str(), "cannot wake up the reactor: %s\n", strerror(errno));
+        }
+    }
+    for (auto it : thList_) {
+        it->join();
+        delete it;
+    }
+
+    // the workers finish the tasks in the queue before they exit
+    {
+        lock_guard<mutex> lock(taskLck_);
+        taskDone_ = true;
+    }
+    taskCond_.notify_all();
+    for (auto it : workerList_) {
+        it->join();
+        delete it;
+    }
+
+    // finalize the sessions which are still alive
+    for (auto reactor : reactorList_) {
+        this->FinishTasks(reactor);
+        this->AcceptNewSessions(reactor);
+        vector<ReactorSession_t*> aliveSessionList(reactor->sessionSet.begin(),
+            reactor->sessionSet.end());
+        for (auto session : aliveSessionList) {
+            this->CloseSession(reactor, session);
+        }
+        close(reactor->wakeFd);
+        close(reactor->epollFd);
+        delete reactor;
+    }
+
+    fprintf(stderr, "========ServerReactor Info========\n");
+    fprintf(stderr, "reactor thread num: %u\n", threadNum_);
+    fprintf(stderr, "worker thread num: %u\n", workerNum_);
+    fprintf(stderr, "total session num: %lu\n", totalSessionNum_.load());
+    fprintf(stderr, "total worker task num: %lu\n", totalTaskNum_.load());
+    fprintf(stderr, "==================================\n");
+}
+
+/**
+ * @brief hand over an accepted connection to a reactor thread
+ *
+ * @param clientSSL the client ssl
+ */
+void ServerReactor::AddSession(SSL* clientSSL)
+{
+    ReactorSession_t* session = new ReactorSession_t();
+    session->clientSSL = clientSSL;
+    session->clientFd = SSL_get_fd(clientSSL);
+    session->loginBuf.sendBuffer = (uint8_t*)malloc(sizeof(NetworkHead_t) + CHUNK_HASH_SIZE * 2 + sizeof(FileRecipeHead_t));
+    session->loginBuf.header = (NetworkHead_t*)session->loginBuf.sendBuffer;
+    session->loginBuf.header->dataSize = 0;
+    session->loginBuf.dataBuffer = session->loginBuf.sendBuffer + sizeof(NetworkHead_t);
+    session->clientID = 0;
+    session->status = SESSION_WAIT_LOGIN;
+    session->events = 0;
+    session->curClient = NULL;
+    session->isBusy = false;
+    session->isClosing = false;
+    session->isRejected = false;
+
+    // round-robin over the reactor threads
+    ReactorThread_t* reactor = reactorList_[nextReactor_++ % threadNum_];
+    {
+        lock_guard<mutex> lock(reactor->newSessionLck);
+        reactor->newSessionList.push_back(session);
+    }
+    uint64_t wakeSignal = 1;
+    if (write(reactor->wakeFd, &wakeSignal, sizeof(wakeSignal)) < 0) {
+        tool::Logging(myName_.c_str(), "cannot wake up the reactor: %s\n", strerror(errno));
+    }
+    totalSessionNum_++;
+    return;
+}
+
+/**
+ * @brief the event loop of a reactor thread
+ *
+ * @param reactor the reactor of this thread
+ */
+void ServerReactor::RunLoop(ReactorThread_t* reactor)
+{
+    struct epoll_event eventList[REACTOR_MAX_EVENT_NUM];
+    uint64_t wakeSignal;
+
+    while (!done_) {
+        // poll the waiting sessions periodically for the client lock
+        int timeout = reactor->waitLockList.empty() ? -1 : REACTOR_LOCK_RETRY_MS;
+        int eventNum = epoll_wait(reactor->epollFd, eventList, REACTOR_MAX_EVENT_NUM, timeout);
+        if (eventNum < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            tool::Logging(myName_.c_str(), "epoll wait fails: %s\n", strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+
+        for (int i = 0; i < eventNum; i++) {
+            ReactorSession_t* session = (ReactorSession_t*)eventList[i].data.ptr;
+            if (session == NULL) {
+                // new sessions from the acceptor, or the sessions back from the workers
+                while (read(reactor->wakeFd, &wakeSignal, sizeof(wakeSignal)) > 0) {
+                    ;
+                }
+                this->AcceptNewSessions(reactor);
+                this->FinishTasks(reactor);
+                continue;
+            }
+            if (session->isBusy) {
+                // an error of the peer is handled after the worker hands it back
+                continue;
+            }
+            if (session->status == SESSION_WAIT_LOCK
+                && (eventList[i].events & (EPOLLERR | EPOLLHUP))) {
+                // the peer leaves before its turn
+                reactor->waitLockList.erase(find(reactor->waitLockList.begin(),
+                    reactor->waitLockList.end(), session));
+                this->CloseSession(reactor, session);
+                continue;
+            }
+            this->HandleSession(reactor, session);
+        }
+
+        // retry the sessions which wait for the client lock
+        if (!reactor->waitLockList.empty()) {
+            vector<ReactorSession_t*> waitLockList;
+            waitLockList.swap(reactor->waitLockList);
+            for (auto session : waitLockList) {
+                session->status = SESSION_WAIT_LOGIN;
+                this->DispatchMessage(reactor, session);
+                if (session->status != SESSION_WAIT_LOCK) {
+                    this->HandleSession(reactor, session);
+                }
+            }
+        }
+    }
+    return;
+}
+
+/**
+ * @brief the main loop of a worker thread
+ *
+ */
+void ServerReactor::RunWorker()
+{
+    uint64_t wakeSignal = 1;
+    while (true) {
+        ReactorTask_t task;
+        {
+            unique_lock<mutex> lock(taskLck_);
+            taskCond_.wait(lock, [this] { return taskDone_ || !taskList_.empty(); });
+            if (taskList_.empty()) {
+                break;
+            }
+            task = taskList_.front();
+            taskList_.pop_front();
+        }
+
+        ReactorSession_t* session = task.session;
+        if (session->isClosing) {
+            serverThreadObj_->CloseSession(session->curClient);
+            session->curClient = NULL;
+        } else if (!serverThreadObj_->ProcessSessionMessage(session->curClient)) {
+            session->isRejected = true;
+        }
+
+        // hand the session back to its reactor
+        {
+            lock_guard<mutex> lock(task.reactor->doneSessionLck);
+            task.reactor->doneSessionList.push_back(session);
+        }
+        if (write(task.reactor->wakeFd, &wakeSignal, sizeof(wakeSignal)) < 0) {
+            tool::Logging(myName_.c_str(), "cannot wake up the reactor: %s\n", strerror(errno));
+        }
+    }
+    return;
+}
+
+/**
+ * @brief hand over a session to the worker threads
+ *
+ * @param reactor the current reactor
+ * @param session the session
+ */
+void ServerReactor::SubmitTask(ReactorThread_t* reactor, ReactorSession_t* session)
+{
+    session->isBusy = true;
+    {
+        lock_guard<mutex> lock(taskLck_);
+        taskList_.push_back({ reactor, session });
+    }
+    taskCond_.notify_one();
+    totalTaskNum_++;
+    return;
+}
+
+/**
+ * @brief resume the sessions handed back by the worker threads
+ *
+ * @param reactor the current reactor
+ */
+void ServerReactor::FinishTasks(ReactorThread_t* reactor)
+{
+    vector<ReactorSession_t*> doneSessionList;
+    {
+        lock_guard<mutex> lock(reactor->doneSessionLck);
+        doneSessionList.swap(reactor->doneSessionList);
+    }
+
+    for (auto session : doneSessionList) {
+        session->isBusy = false;
+        if (session->isClosing) {
+            this->ReleaseSession(reactor, session);
+            continue;
+        }
+        if (session->isRejected) {
+            session->status = SESSION_REJECTED;
+        }
+        if (!done_) {
+            // send the replies and go on with the messages buffered in ssl
+            this->HandleSession(reactor, session);
+        }
+    }
+    return;
+}
+
+/**
+ * @brief register the new sessions handed over by the acceptor
+ *
+ * @param reactor the current reactor
+ */
+void ServerReactor::AcceptNewSessions(ReactorThread_t* reactor)
+{
+    vector<ReactorSession_t*> newSessionList;
+    {
+        lock_guard<mutex> lock(reactor->newSessionLck);
+        newSessionList.swap(reactor->newSessionList);
+    }
+
+    for (auto session : newSessionList) {
+        reactor->sessionSet.insert(session);
+        if (!serverChannel_->SetNonBlocking(session->clientSSL, &session->sessionState)) {
+            this->CloseSession(reactor, session);
+            continue;
+        }
+        struct epoll_event sessionEvent;
+        sessionEvent.events = EPOLLIN;
+        sessionEvent.data.ptr = session;
+        if (epoll_ctl(reactor->epollFd, EPOLL_CTL_ADD, session->clientFd, &sessionEvent) < 0) {
+            tool::Logging(myName_.c_str(), "cannot add the session: %s\n", strerror(errno));
+            this->CloseSession(reactor, session);
+            continue;
+        }
+        session->events = EPOLLIN;
+        if (!done_) {
+            // the login message may be already buffered in ssl
+            this->HandleSession(reactor, session);
+        }
+    }
+    return;
+}
+
+/**
+ * @brief handle the events of a session
+ *
+ * @param reactor the current reactor
+ * @param session the session
+ * @return true the session is alive
+ * @return false the session is closed
+ */
+bool ServerReactor::HandleSession(ReactorThread_t* reactor, ReactorSession_t* session)
+{
+    SSL* clientSSL = session->clientSSL;
+    uint32_t recvSize = 0;
+
+    // step-1: flush the pending output
+    if (serverChannel_->HasPendingData(clientSSL)) {
+        if (serverChannel_->FlushData(clientSSL) == SSL_IO_FAIL) {
+            this->CloseSession(reactor, session);
+            return false;
+        }
+    }
+
+    // step-2: process the incoming messages until the output blocks or a worker
+    // takes the session
+    while ((session->status == SESSION_WAIT_LOGIN || session->status == SESSION_ACTIVE)
+        && !session->isBusy && !serverChannel_->HasPendingData(clientSSL)) {
+        uint8_t* recvBuffer;
+        if (session->status == SESSION_WAIT_LOGIN) {
+            recvBuffer = session->loginBuf.sendBuffer;
+        } else {
+            recvBuffer = serverThreadObj_->GetSessionRecvBuffer(session->curClient);
+        }
+        int recvStatus = serverChannel_->TryReceiveData(clientSSL, recvBuffer, recvSize);
+        if (recvStatus == SSL_IO_WANT) {
+            break;
+        }
+        if (recvStatus == SSL_IO_FAIL) {
+            this->CloseSession(reactor, session);
+            return false;
+        }
+        this->DispatchMessage(reactor, session);
+    }
+
+    this->UpdateEvents(reactor, session);
+    if (session->isBusy) {
+        return true;
+    }
+
+    // step-3: a rejected session is closed after its response is sent
+    if (session->status == SESSION_REJECTED && !serverChannel_->HasPendingData(clientSSL)) {
+        this->CloseSession(reactor, session);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief process a complete message of a session
+ *
+ * @param reactor the current reactor
+ * @param session the session
+ */
+void ServerReactor::DispatchMessage(ReactorThread_t* reactor, ReactorSession_t* session)
+{
+    switch (session->status) {
+    case SESSION_WAIT_LOGIN: {
+        // ensure exist only one session with the same client ID
+        session->clientID = session->loginBuf.header->clientID;
+        if (!serverThreadObj_->TryLockClient(session->clientID)) {
+            session->status = SESSION_WAIT_LOCK;
+            reactor->waitLockList.push_back(session);
+            break;
+        }
+        session->curClient = serverThreadObj_->OpenSession(session->loginBuf,
+            session->clientSSL);
+        if (session->curClient != NULL) {
+            session->status = SESSION_ACTIVE;
+        } else {
+            session->status = SESSION_REJECTED;
+        }
+        break;
+    }
+    case SESSION_ACTIVE: {
+        // the message can write the containers or read them, run it on a worker
+        this->SubmitTask(reactor, session);
+        break;
+    }
+    }
+    return;
+}
+
+/**
+ * @brief update the interested events of a session
+ *
+ * @param reactor the current reactor
+ * @param session the session
+ */
+void ServerReactor::UpdateEvents(ReactorThread_t* reactor, ReactorSession_t* session)
+{
+    uint32_t events = 0;
+    if (session->isBusy) {
+        // the worker owns the ssl, only an error of the peer is reported, once
+        events = EPOLLONESHOT;
+    } else if (serverChannel_->HasPendingData(session->clientSSL)) {
+        // stop reading until the output is drained
+        events = EPOLLOUT;
+    } else if (session->status == SESSION_WAIT_LOGIN || session->status == SESSION_ACTIVE) {
+        events = EPOLLIN;
+    }
+
+    if (events != session->events) {
+        struct epoll_event sessionEvent;
+        sessionEvent.events = events;
+        sessionEvent.data.ptr = session;
+        if (epoll_ctl(reactor->epollFd, EPOLL_CTL_MOD, session->clientFd, &sessionEvent) < 0) {
+            tool::Logging(myName_.c_str(), "cannot modify the session events: %s\n",
+                strerror(errno));
+            exit(EXIT_FAILURE);
+        }
+        session->events = events;
+    }
+    return;
+}
+
+/**
+ * @brief close a session, the session of a client is closed on a worker thread
+ *
+ * @param reactor the current reactor
+ * @param session the session
+ */
+void ServerReactor::CloseSession(ReactorThread_t* reactor, ReactorSession_t* session)
+{
+    epoll_ctl(reactor->epollFd, EPOLL_CTL_DEL, session->clientFd, NULL);
+    if (session->curClient != NULL) {
+        if (!done_) {
+            // the last containers of an upload are written and synced there
+            session->isClosing = true;
+            this->SubmitTask(reactor, session);
+            return;
+        }
+        // the workers are stopped in the destructor
+        serverThreadObj_->CloseSession(session->curClient);
+        session->curClient = NULL;
+    }
+    this->ReleaseSession(reactor, session);
+    return;
+}
+
+/**
+ * @brief release the resource of a closed session
+ *
+ * @param reactor the current reactor
+ * @param session the session
+ */
+void ServerReactor::ReleaseSession(ReactorThread_t* reactor, ReactorSession_t* session)
+{
+    if (session->status == SESSION_ACTIVE || session->status == SESSION_REJECTED) {
+        serverThreadObj_->UnlockClient(session->clientID);
+    }
+    serverChannel_->ClearAcceptedClientSd(session->clientSSL);
+    free(session->loginBuf.sendBuffer);
+    reactor->sessionSet.erase(session);
+    delete session;
+    return;
+}
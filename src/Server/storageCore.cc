@@ -20,6 +20,8 @@ extern Configure config;
 StorageCore::StorageCore()
 {
     // tool::Logging(myName_.c_str(), "Init the StorageCore\n");
+    writtenDataSize_ = 0;
+    writtenChunkNum_ = 0;
 }
 
 /**
@@ -69,6 +71,10 @@ void StorageCore::WriteContainer(string& containerName, char* data, uint32_t dat
         currentHeaderOffset = curContainer->currentHeaderSize;
         writeHeaderOffset = currentHeaderOffset;
     }
+    if (curContainer->chunkNum == 0 && indexStore_ != NULL) {
+        // hold the container before any index entry points to it
+        indexStore_->HoldValue(curContainer->containerID, CONTAINER_ID_LENGTH);
+    }
     // 把int转换为4*char
     uint8_t offsetChar[4];
     // 写offset
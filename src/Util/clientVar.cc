@@ -90,9 +90,12 @@ void ClientVar::InitUploadBuffer()
     tool::CreateUUID(_curContainer.containerID, CONTAINER_ID_LENGTH);
     _curContainer.currentBodySize = 0;
     _curContainer.currentHeaderSize = 0;
+    _curContainer.chunkNum = 0;
 
-    // init the recv buffer
-    _recvChunkBuf.sendBuffer = (uint8_t*)malloc(sizeof(NetworkHead_t) + sendChunkBatchSize_ * (sizeof(uint32_t) + MAX_CHUNK_SIZE));
+    _sampleRng.seed(tool::GetStrongSeed() ^ _clientID);
+
+    // init the recv buffer (an entry may carry the fingerprint of the chunk)
+    _recvChunkBuf.sendBuffer = (uint8_t*)malloc(sizeof(NetworkHead_t) + sendChunkBatchSize_ * (sizeof(uint32_t) + CHUNK_HASH_SIZE + MAX_CHUNK_SIZE));
     _recvChunkBuf.header = (NetworkHead_t*)_recvChunkBuf.sendBuffer;
     _recvChunkBuf.header->clientID = _clientID;
     _recvChunkBuf.header->currentItemNum = 0;
@@ -51,6 +51,20 @@ void Configure::ReadConf(std::string path)
     recipeRootPath_ = root.get<std::string>("StorageCore.recipeRootPath_");
     containerRootPath_ = root.get<std::string>("StorageCore.containerRootPath_");
     fp2ChunkDBName_ = root.get<std::string>("StorageCore.fp2ChunkDBName_");
+    fp2ChunkDBType_ = root.get<uint32_t>("StorageCore.fp2ChunkDBType_", 3);
+    indexType_ = root.get<uint32_t>("StorageCore.indexType_", 0);
+    indexDedupLossCheck_ = root.get<bool>("StorageCore.indexDedupLossCheck_", false);
+    indexLogCommitMs_ = root.get<uint32_t>("StorageCore.indexLogCommitMs_", 100);
+    indexSnapshotSec_ = root.get<uint32_t>("StorageCore.indexSnapshotSec_", 600);
+    indexWarmUpThreadNum_ = root.get<uint32_t>("StorageCore.indexWarmUpThreadNum_", 4);
+    levelDBCacheMiB_ = root.get<uint64_t>("StorageCore.levelDBCacheMiB_", 256);
+    levelDBBloomBits_ = root.get<uint32_t>("StorageCore.levelDBBloomBits_", 10);
+    levelDBWriteBufferMiB_ = root.get<uint64_t>("StorageCore.levelDBWriteBufferMiB_", 64);
+    levelDBBlockSizeKiB_ = root.get<uint32_t>("StorageCore.levelDBBlockSizeKiB_", 4);
+    levelDBCompression_ = root.get<bool>("StorageCore.levelDBCompression_", false);
+    indexCacheMiB_ = root.get<uint64_t>("StorageCore.indexCacheMiB_", 256);
+    indexStashKeyNum_ = root.get<uint64_t>("StorageCore.indexStashKeyNum_", 1048576);
+    localityCacheContainerNum_ = root.get<uint32_t>("StorageCore.localityCacheContainerNum_", 0);
 
     // restore writer
     readCacheSize_ = root.get<uint64_t>("RestoreWriter.readCacheSize_");
@@ -71,6 +85,29 @@ void Configure::ReadConf(std::string path)
     keyServerIp_ = root.get<string>("KeyServer.keyServerIp_");
     keyServerPort_ = root.get<int>("KeyServer.keyServerPort_");
 
+    // for cloud server (optional)
+    serverMode_ = root.get<uint32_t>("CloudServer.serverMode_", THREAD_PER_CONNECTION);
+    reactorThreadNum_ = root.get<uint32_t>("CloudServer.reactorThreadNum_", 0);
+    reactorWorkerNum_ = root.get<uint32_t>("CloudServer.reactorWorkerNum_", 0);
+    listenBacklog_ = root.get<uint32_t>("CloudServer.listenBacklog_", 10);
+    listenerThreadNum_ = root.get<uint32_t>("CloudServer.listenerThreadNum_", 1);
+    handshakeThreadNum_ = root.get<uint32_t>("CloudServer.handshakeThreadNum_", 0);
+    handshakeTimeoutSec_ = root.get<uint32_t>("CloudServer.handshakeTimeoutSec_", 10);
+    sessionCacheSize_ = root.get<uint32_t>("CloudServer.sessionCacheSize_", 20480);
+    sessionTimeout_ = root.get<uint32_t>("CloudServer.sessionTimeout_", 7200);
+    enableKTLS_ = root.get<bool>("CloudServer.enableKTLS_", false);
+    queryThreadNum_ = root.get<uint32_t>("CloudServer.queryThreadNum_", 0);
+    recvBufferNum_ = root.get<uint32_t>("CloudServer.recvBufferNum_", 2);
+    hashThreadNum_ = root.get<uint32_t>("CloudServer.hashThreadNum_", 0);
+    filterBitsPerKey_ = root.get<uint32_t>("CloudServer.filterBitsPerKey_", 10);
+    filterRefreshSec_ = root.get<uint32_t>("CloudServer.filterRefreshSec_", 60);
+    fpSampleRate_ = root.get<double>("CloudServer.fpSampleRate_", 1.0);
+
+    if (fpSampleRate_ < 0 || fpSampleRate_ > 1) {
+        tool::Logging(myName_.c_str(), "fingerprint sample rate should be in [0, 1].\n");
+        exit(EXIT_FAILURE);
+    }
+
     if (sendRecipeBatchSize_ % sendChunkBatchSize_ != 0) {
         tool::Logging(myName_.c_str(), "recipe batch size should be a multple "
                                        "of chunk batch size.\n");
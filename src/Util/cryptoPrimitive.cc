@@ -16,6 +16,57 @@ CryptoPrimitive::CryptoPrimitive(int cipherType, int hashType)
         exit(EXIT_FAILURE);
     }
     memset(iv_, 0, sizeof(uint8_t) * CRYPTO_BLOCK_SIZE);
+
+    // pick the fastest batch hash kernel of the cpu, the AVX2 kernel only if
+    // it is measured faster than OpenSSL (once per process)
+    hashKernel_ = HASH_KERNEL_OPENSSL;
+    if (!this->SetHashKernel(HASH_KERNEL_SHA_NI) && this->SetHashKernel(HASH_KERNEL_AVX2)) {
+        static const bool isAVX2Faster = this->IsAVX2Faster();
+        if (!isAVX2Faster) {
+            hashKernel_ = HASH_KERNEL_OPENSSL;
+        }
+    }
+}
+
+/**
+ * @brief measure whether the AVX2 kernel hashes a batch faster than OpenSSL
+ * (which may use the SHA extensions or tuned assembly of the cpu)
+ *
+ * @return true the AVX2 kernel is faster
+ * @return false otherwise
+ */
+bool CryptoPrimitive::IsAVX2Faster()
+{
+    vector<uint8_t> dataBuffer((size_t)AVX2_PROBE_NUM * AVX2_PROBE_SIZE);
+    for (size_t i = 0; i < dataBuffer.size(); i++) {
+        dataBuffer[i] = (uint8_t)(i * 131 + (i >> 13));
+    }
+    vector<uint8_t*> dataBufferList(AVX2_PROBE_NUM);
+    vector<uint32_t> dataSizeList(AVX2_PROBE_NUM, AVX2_PROBE_SIZE);
+    for (size_t i = 0; i < AVX2_PROBE_NUM; i++) {
+        dataBufferList[i] = dataBuffer.data() + i * AVX2_PROBE_SIZE;
+    }
+    vector<uint8_t> hashList(AVX2_PROBE_NUM * CHUNK_HASH_SIZE);
+    EVP_MD_CTX* mdCtx = EVP_MD_CTX_new();
+
+    // the best of a few rounds of each kernel, interleaved
+    HASH_KERNEL kernelList[2] = { HASH_KERNEL_AVX2, HASH_KERNEL_OPENSSL };
+    double bestTime[2] = { DBL_MAX, DBL_MAX };
+    struct timeval sTime;
+    struct timeval eTime;
+    for (size_t r = 0; r < AVX2_PROBE_ROUND; r++) {
+        for (size_t k = 0; k < 2; k++) {
+            hashKernel_ = kernelList[k];
+            gettimeofday(&sTime, NULL);
+            this->GenerateHashBatch(mdCtx, dataBufferList.data(), dataSizeList.data(),
+                AVX2_PROBE_NUM, hashList.data());
+            gettimeofday(&eTime, NULL);
+            bestTime[k] = min(bestTime[k], tool::GetTimeDiff(sTime, eTime));
+        }
+    }
+    EVP_MD_CTX_free(mdCtx);
+    hashKernel_ = HASH_KERNEL_AVX2;
+    return bestTime[0] < bestTime[1];
 }
 
 /**
@@ -82,6 +133,84 @@ void CryptoPrimitive::GenerateHash(EVP_MD_CTX* mdCtx, uint8_t* dataBuffer, const
     return;
 }
 
+/**
+ * @brief Generate the hashes of a batch of input data with the batch kernel
+ *
+ * @param mdCtx hasher ctx (for the openssl kernel)
+ * @param dataBufferList input data buffers
+ * @param dataSizeList input data sizes
+ * @param dataNum the number of input data buffers
+ * @param hashList output hashes (dataNum * CHUNK_HASH_SIZE)
+ */
+void CryptoPrimitive::GenerateHashBatch(EVP_MD_CTX* mdCtx, uint8_t** dataBufferList,
+    const uint32_t* dataSizeList, uint32_t dataNum, uint8_t* hashList)
+{
+    switch (hashKernel_) {
+    case HASH_KERNEL_SHA_NI:
+        sha256Kernel::HashBatchSHANI(dataBufferList, dataSizeList, dataNum, hashList);
+        return;
+    case HASH_KERNEL_AVX2:
+        // the idle lanes cost more than the lanes save for a few buffers
+        if (dataNum >= AVX2_HASH_MIN_NUM) {
+            sha256Kernel::HashBatchAVX2(dataBufferList, dataSizeList, dataNum, hashList);
+            return;
+        }
+        break;
+    default:
+        break;
+    }
+
+    // keep the digest bound to the ctx across the batch, only reset it at the end
+    const EVP_MD* mdType;
+    switch (hashType_) {
+    case SHA_1:
+        mdType = EVP_sha1();
+        break;
+    case MD5:
+        mdType = EVP_md5();
+        break;
+    default:
+        mdType = EVP_sha256();
+        break;
+    }
+    uint32_t hashSize;
+    for (size_t i = 0; i < dataNum; i++) {
+        if (!EVP_DigestInit_ex(mdCtx, mdType, NULL)) {
+            fprintf(stderr, "CryptoTool: Hash init error.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (!EVP_DigestUpdate(mdCtx, dataBufferList[i], dataSizeList[i])) {
+            fprintf(stderr, "CryptoTool: Hash error.\n");
+            exit(EXIT_FAILURE);
+        }
+        if (!EVP_DigestFinal_ex(mdCtx, hashList + i * CHUNK_HASH_SIZE, &hashSize)) {
+            fprintf(stderr, "CryptoTool: Hash error.\n");
+            exit(EXIT_FAILURE);
+        }
+    }
+    EVP_MD_CTX_reset(mdCtx);
+    return;
+}
+
+/**
+ * @brief Set the kernel of the batch hash
+ *
+ * @param hashKernel the kernel (HASH_KERNEL)
+ * @return true the kernel is used
+ * @return false the cpu or the hash type does not support it
+ */
+bool CryptoPrimitive::SetHashKernel(int hashKernel)
+{
+    if (hashKernel != HASH_KERNEL_OPENSSL && hashType_ != SHA_256) {
+        return false;
+    }
+    if (!sha256Kernel::IsSupported(hashKernel)) {
+        return false;
+    }
+    hashKernel_ = static_cast<HASH_KERNEL>(hashKernel);
+    return true;
+}
+
 /**
  * @brief Encrypt the data with the encryption key
  *
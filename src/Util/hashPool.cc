@@ -0,0 +1,176 @@
+/**
+ * @file hashPool.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement the shared worker pool to compute the chunk fingerprints of a batch
+ * @version 0.1
+ * @date 2022-06-26
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/hashPool.h"
+
+/**
+ * @brief Construct a new Hash Pool object
+ *
+ * @param cryptoObj the crypto primitive
+ * @param workerNum the number of worker threads (0: one per core)
+ */
+HashPool::HashPool(CryptoPrimitive* cryptoObj, uint32_t workerNum)
+{
+    cryptoObj_ = cryptoObj;
+    workerNum_ = workerNum;
+    if (workerNum_ == 0) {
+        workerNum_ = boost::thread::hardware_concurrency();
+        if (workerNum_ == 0) {
+            workerNum_ = 1;
+        }
+    }
+    parallelBatchNum_ = 0;
+    inlineBatchNum_ = 0;
+    workerTaskNum_ = 0;
+
+    for (size_t i = 0; i < workerNum_; i++) {
+        thList_.push_back(new boost::thread(boost::bind(&HashPool::RunWorker, this)));
+    }
+}
+
+/**
+ * @brief Destroy the Hash Pool object
+ *
+ */
+HashPool::~HashPool()
+{
+    {
+        lock_guard<mutex> lock(jobLck_);
+        done_ = true;
+    }
+    jobCond_.notify_all();
+    for (auto it : thList_) {
+        it->join();
+        delete it;
+    }
+
+    fprintf(stderr, "========HashPool Info========\n");
+    fprintf(stderr, "worker thread num: %u\n", workerNum_);
+    fprintf(stderr, "parallel batch num: %lu\n", parallelBatchNum_.load());
+    fprintf(stderr, "inline batch num: %lu\n", inlineBatchNum_.load());
+    fprintf(stderr, "worker task num: %lu\n", workerTaskNum_.load());
+    fprintf(stderr, "=============================\n");
+}
+
+/**
+ * @brief compute the fingerprints of a batch of chunks, the caller works
+ * on the batch together with the workers and returns when all are done
+ *
+ * @param chunkAddrList the address of each chunk
+ * @param chunkSizeList the size of each chunk
+ * @param chunkNum the number of chunks
+ * @param hashList the output fingerprints (chunkNum * CHUNK_HASH_SIZE)
+ * @param mdCtx the hash ctx of the caller
+ */
+void HashPool::HashBatch(uint8_t** chunkAddrList, uint32_t* chunkSizeList, uint32_t chunkNum,
+    uint8_t* hashList, EVP_MD_CTX* mdCtx)
+{
+    HashJob_t hashJob;
+    hashJob.chunkAddrList = chunkAddrList;
+    hashJob.chunkSizeList = chunkSizeList;
+    hashJob.hashList = hashList;
+    hashJob.chunkNum = chunkNum;
+    hashJob.taskNum = (chunkNum + HASH_TASK_CHUNK_NUM - 1) / HASH_TASK_CHUNK_NUM;
+    hashJob.nextTask = 0;
+    hashJob.workerRefNum = 0;
+
+    if (hashJob.taskNum <= 1) {
+        // not worth the handover
+        this->RunTasks(&hashJob, mdCtx);
+        inlineBatchNum_++;
+        return;
+    }
+
+    {
+        lock_guard<mutex> lock(jobLck_);
+        jobList_.push_back(&hashJob);
+    }
+    jobCond_.notify_all();
+
+    this->RunTasks(&hashJob, mdCtx);
+
+    // all tasks are claimed, no more worker can pick up the batch
+    {
+        lock_guard<mutex> lock(jobLck_);
+        auto it = std::find(jobList_.begin(), jobList_.end(), &hashJob);
+        if (it != jobList_.end()) {
+            jobList_.erase(it);
+        }
+    }
+    // the workers may still hash the last tasks
+    {
+        unique_lock<mutex> lock(hashJob.doneLck);
+        hashJob.doneCond.wait(lock, [&hashJob] { return hashJob.workerRefNum == 0; });
+    }
+    parallelBatchNum_++;
+    return;
+}
+
+/**
+ * @brief claim and hash the tasks of a batch until no task is left
+ *
+ * @param hashJob the batch
+ * @param mdCtx the hash ctx of the caller
+ * @return uint32_t the number of tasks done by the caller
+ */
+uint32_t HashPool::RunTasks(HashJob_t* hashJob, EVP_MD_CTX* mdCtx)
+{
+    uint32_t taskDoneNum = 0;
+    while (true) {
+        uint32_t taskId = hashJob->nextTask++;
+        if (taskId >= hashJob->taskNum) {
+            break;
+        }
+        uint32_t beginIdx = taskId * HASH_TASK_CHUNK_NUM;
+        uint32_t endIdx = std::min(beginIdx + HASH_TASK_CHUNK_NUM, hashJob->chunkNum);
+        cryptoObj_->GenerateHashBatch(mdCtx, hashJob->chunkAddrList + beginIdx,
+            hashJob->chunkSizeList + beginIdx, endIdx - beginIdx,
+            hashJob->hashList + beginIdx * CHUNK_HASH_SIZE);
+        taskDoneNum++;
+    }
+    return taskDoneNum;
+}
+
+/**
+ * @brief the main loop of a worker thread
+ *
+ */
+void HashPool::RunWorker()
+{
+    EVP_MD_CTX* mdCtx = EVP_MD_CTX_new();
+    while (true) {
+        HashJob_t* hashJob;
+        {
+            unique_lock<mutex> lock(jobLck_);
+            jobCond_.wait(lock, [this] { return done_ || !jobList_.empty(); });
+            if (jobList_.empty()) {
+                break;
+            }
+            hashJob = jobList_.front();
+            // no task left to claim, the caller is finishing it
+            if (hashJob->nextTask >= hashJob->taskNum) {
+                jobList_.pop_front();
+                continue;
+            }
+            // the caller waits for this worker before the batch goes away
+            lock_guard<mutex> refLock(hashJob->doneLck);
+            hashJob->workerRefNum++;
+        }
+        workerTaskNum_ += this->RunTasks(hashJob, mdCtx);
+        {
+            lock_guard<mutex> lock(hashJob->doneLck);
+            hashJob->workerRefNum--;
+            hashJob->doneCond.notify_all();
+        }
+    }
+    EVP_MD_CTX_free(mdCtx);
+    return;
+}
@@ -0,0 +1,476 @@
+/**
+ * @file sha256Kernel.cc
+ * @author Zuoru YANG (zryang@cse.cuhk.edu.hk)
+ * @brief implement the batch SHA-256 kernels (SHA-NI and multi-buffer AVX2)
+ * @version 0.1
+ * @date 2022-06-27
+ *
+ * @copyright Copyright (c) 2022
+ *
+ */
+
+#include "../../include/sha256Kernel.h"
+#include "../../include/constVar.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+namespace sha256Kernel {
+
+#if defined(__x86_64__)
+
+static const uint32_t SHA256_BLOCK_SIZE = 64;
+static const uint32_t SHA256_LANE_NUM = 8;
+
+alignas(64) static const uint32_t roundConst[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static const uint32_t initState[8] = {
+    0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a, 0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
+/**
+ * @brief build the padded tail blocks of a buffer
+ *
+ * @param dataBuffer the input data buffer
+ * @param dataSize the input data size
+ * @param tailBuffer the output tail blocks (2 * SHA256_BLOCK_SIZE bytes)
+ * @return uint32_t the number of tail blocks
+ */
+static uint32_t BuildTail(const uint8_t* dataBuffer, uint32_t dataSize, uint8_t* tailBuffer)
+{
+    uint32_t restSize = dataSize % SHA256_BLOCK_SIZE;
+    uint32_t tailBlockNum = (restSize + 1 + sizeof(uint64_t) > SHA256_BLOCK_SIZE) ? 2 : 1;
+    memset(tailBuffer, 0, tailBlockNum * SHA256_BLOCK_SIZE);
+    memcpy(tailBuffer, dataBuffer + dataSize - restSize, restSize);
+    tailBuffer[restSize] = 0x80;
+    uint64_t bitNum = (uint64_t)dataSize * 8;
+    uint8_t* lenPos = tailBuffer + tailBlockNum * SHA256_BLOCK_SIZE - sizeof(uint64_t);
+    for (size_t i = 0; i < sizeof(uint64_t); i++) {
+        lenPos[i] = (uint8_t)(bitNum >> (56 - 8 * i));
+    }
+    return tailBlockNum;
+}
+
+/**
+ * @brief write the state as a big-endian hash
+ *
+ * @param state the state words
+ * @param hash the output hash
+ */
+static inline void StoreHash(const uint32_t* state, uint8_t* hash)
+{
+    for (size_t i = 0; i < 8; i++) {
+        hash[4 * i] = (uint8_t)(state[i] >> 24);
+        hash[4 * i + 1] = (uint8_t)(state[i] >> 16);
+        hash[4 * i + 2] = (uint8_t)(state[i] >> 8);
+        hash[4 * i + 3] = (uint8_t)state[i];
+    }
+    return;
+}
+
+bool IsSupported(int hashKernel)
+{
+    uint32_t eax, ebx, ecx, edx;
+    switch (hashKernel) {
+    case HASH_KERNEL_OPENSSL:
+        return true;
+    case HASH_KERNEL_SHA_NI:
+        if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+            return false;
+        }
+        // SHA (ebx bit 29), the kernel also uses SSE4.1 and SSSE3
+        return (ebx & (1u << 29)) && __builtin_cpu_supports("sse4.1");
+    case HASH_KERNEL_AVX2:
+        return __builtin_cpu_supports("avx2");
+    }
+    return false;
+}
+
+// the SHA-NI rounds work on the state in the ABEF/CDGH layout
+#define SHANI_LOAD_STATE(state, state0, state1)                                 \
+    do {                                                                        \
+        __m128i tmpState = _mm_loadu_si128((const __m128i*)&(state)[0]);        \
+        state1 = _mm_loadu_si128((const __m128i*)&(state)[4]);                  \
+        tmpState = _mm_shuffle_epi32(tmpState, 0xB1); /* CDAB */                \
+        state1 = _mm_shuffle_epi32(state1, 0x1B); /* EFGH */                    \
+        state0 = _mm_alignr_epi8(tmpState, state1, 8); /* ABEF */               \
+        state1 = _mm_blend_epi16(state1, tmpState, 0xF0); /* CDGH */            \
+    } while (0)
+
+#define SHANI_STORE_STATE(state, state0, state1)                                \
+    do {                                                                        \
+        __m128i tmpState = _mm_shuffle_epi32(state0, 0x1B); /* FEBA */          \
+        state1 = _mm_shuffle_epi32(state1, 0xB1); /* DCHG */                    \
+        state0 = _mm_blend_epi16(tmpState, state1, 0xF0); /* DCBA */            \
+        state1 = _mm_alignr_epi8(state1, tmpState, 8); /* ABEF */               \
+        _mm_storeu_si128((__m128i*)&(state)[0], state0);                        \
+        _mm_storeu_si128((__m128i*)&(state)[4], state1);                        \
+    } while (0)
+
+/**
+ * @brief the 4 rounds of group j of a SHA-NI stream, W[t] = s1(W[t-2]) +
+ * W[t-7] + s0(W[t-15]) + W[t-16] is computed four words at a time
+ */
+#define SHANI_ROUNDS(j, block, msgList, state0, state1)                                    \
+    do {                                                                                   \
+        if ((j) < 4) {                                                                     \
+            msgList[(j)] = _mm_shuffle_epi8(                                               \
+                _mm_loadu_si128((const __m128i*)((block) + 16 * (j))), byteMask);          \
+        } else {                                                                           \
+            __m128i sched = _mm_sha256msg1_epu32(msgList[(j)&3], msgList[((j) + 1) & 3]);  \
+            sched = _mm_add_epi32(sched,                                                   \
+                _mm_alignr_epi8(msgList[((j) + 3) & 3], msgList[((j) + 2) & 3], 4));       \
+            msgList[(j)&3] = _mm_sha256msg2_epu32(sched, msgList[((j) + 3) & 3]);          \
+        }                                                                                  \
+        __m128i msg = _mm_add_epi32(msgList[(j)&3],                                        \
+            _mm_load_si128((const __m128i*)&roundConst[4 * (j)]));                         \
+        state1 = _mm_sha256rnds2_epu32(state1, state0, msg);                               \
+        msg = _mm_shuffle_epi32(msg, 0x0E);                                                \
+        state0 = _mm_sha256rnds2_epu32(state0, state1, msg);                               \
+    } while (0)
+
+/**
+ * @brief compress the blocks of a buffer with the SHA-NI instructions
+ *
+ * @param state the state words
+ * @param blockBuffer the blocks
+ * @param blockNum the number of blocks
+ */
+__attribute__((target("sha,sse4.1,ssse3"))) static void CompressSHANI(uint32_t* state,
+    const uint8_t* blockBuffer, size_t blockNum)
+{
+    const __m128i byteMask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i state0;
+    __m128i state1;
+    __m128i msgList[4];
+    SHANI_LOAD_STATE(state, state0, state1);
+    for (size_t i = 0; i < blockNum; i++) {
+        const uint8_t* block = blockBuffer + i * SHA256_BLOCK_SIZE;
+        __m128i abefSave = state0;
+        __m128i cdghSave = state1;
+#pragma GCC unroll 16
+        for (size_t j = 0; j < 16; j++) {
+            SHANI_ROUNDS(j, block, msgList, state0, state1);
+        }
+        state0 = _mm_add_epi32(state0, abefSave);
+        state1 = _mm_add_epi32(state1, cdghSave);
+    }
+    SHANI_STORE_STATE(state, state0, state1);
+    return;
+}
+
+/**
+ * @brief compress the blocks of two buffers together, the rounds of one
+ * stream fill the latency of the other
+ *
+ * @param stateA the state words of the first buffer
+ * @param blockBufferA the blocks of the first buffer
+ * @param stateB the state words of the second buffer
+ * @param blockBufferB the blocks of the second buffer
+ * @param blockNum the number of blocks of each buffer
+ */
+__attribute__((target("sha,sse4.1,ssse3"))) static void CompressSHANIx2(uint32_t* stateA,
+    const uint8_t* blockBufferA, uint32_t* stateB, const uint8_t* blockBufferB, size_t blockNum)
+{
+    const __m128i byteMask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+    __m128i stateA0;
+    __m128i stateA1;
+    __m128i stateB0;
+    __m128i stateB1;
+    __m128i msgListA[4];
+    __m128i msgListB[4];
+    SHANI_LOAD_STATE(stateA, stateA0, stateA1);
+    SHANI_LOAD_STATE(stateB, stateB0, stateB1);
+    for (size_t i = 0; i < blockNum; i++) {
+        const uint8_t* blockA = blockBufferA + i * SHA256_BLOCK_SIZE;
+        const uint8_t* blockB = blockBufferB + i * SHA256_BLOCK_SIZE;
+        __m128i abefSaveA = stateA0;
+        __m128i cdghSaveA = stateA1;
+        __m128i abefSaveB = stateB0;
+        __m128i cdghSaveB = stateB1;
+#pragma GCC unroll 16
+        for (size_t j = 0; j < 16; j++) {
+            SHANI_ROUNDS(j, blockA, msgListA, stateA0, stateA1);
+            SHANI_ROUNDS(j, blockB, msgListB, stateB0, stateB1);
+        }
+        stateA0 = _mm_add_epi32(stateA0, abefSaveA);
+        stateA1 = _mm_add_epi32(stateA1, cdghSaveA);
+        stateB0 = _mm_add_epi32(stateB0, abefSaveB);
+        stateB1 = _mm_add_epi32(stateB1, cdghSaveB);
+    }
+    SHANI_STORE_STATE(stateA, stateA0, stateA1);
+    SHANI_STORE_STATE(stateB, stateB0, stateB1);
+    return;
+}
+
+void HashBatchSHANI(uint8_t** dataBufferList, const uint32_t* dataSizeList, uint32_t dataNum,
+    uint8_t* hashList)
+{
+    uint8_t tailBuffer[2 * SHA256_BLOCK_SIZE];
+    uint32_t stateA[8];
+    uint32_t stateB[8];
+    size_t i = 0;
+    // two buffers at a time, the common blocks go through the interleaved rounds
+    for (; i + 1 < dataNum; i += 2) {
+        size_t blockNumA = dataSizeList[i] / SHA256_BLOCK_SIZE;
+        size_t blockNumB = dataSizeList[i + 1] / SHA256_BLOCK_SIZE;
+        size_t commonNum = std::min(blockNumA, blockNumB);
+        memcpy(stateA, initState, sizeof(stateA));
+        memcpy(stateB, initState, sizeof(stateB));
+        CompressSHANIx2(stateA, dataBufferList[i], stateB, dataBufferList[i + 1], commonNum);
+        CompressSHANI(stateA, dataBufferList[i] + commonNum * SHA256_BLOCK_SIZE,
+            blockNumA - commonNum);
+        CompressSHANI(stateB, dataBufferList[i + 1] + commonNum * SHA256_BLOCK_SIZE,
+            blockNumB - commonNum);
+
+        uint32_t tailBlockNum = BuildTail(dataBufferList[i], dataSizeList[i], tailBuffer);
+        CompressSHANI(stateA, tailBuffer, tailBlockNum);
+        StoreHash(stateA, hashList + i * CHUNK_HASH_SIZE);
+        tailBlockNum = BuildTail(dataBufferList[i + 1], dataSizeList[i + 1], tailBuffer);
+        CompressSHANI(stateB, tailBuffer, tailBlockNum);
+        StoreHash(stateB, hashList + (i + 1) * CHUNK_HASH_SIZE);
+    }
+    for (; i < dataNum; i++) {
+        memcpy(stateA, initState, sizeof(stateA));
+        CompressSHANI(stateA, dataBufferList[i], dataSizeList[i] / SHA256_BLOCK_SIZE);
+        uint32_t tailBlockNum = BuildTail(dataBufferList[i], dataSizeList[i], tailBuffer);
+        CompressSHANI(stateA, tailBuffer, tailBlockNum);
+        StoreHash(stateA, hashList + i * CHUNK_HASH_SIZE);
+    }
+    return;
+}
+
+#define ROTR_AVX2(x, n) _mm256_or_si256(_mm256_srli_epi32((x), (n)), _mm256_slli_epi32((x), 32 - (n)))
+
+/**
+ * @brief load 8 words of 8 lanes and transpose them, the i-th output holds
+ * the i-th word of each lane
+ *
+ * @param blockList the source of each lane
+ * @param wordOffset the byte offset of the first word
+ * @param outList the output words
+ */
+__attribute__((target("avx2"))) static inline void LoadWordsAVX2(const uint8_t* const* blockList,
+    size_t wordOffset, __m256i* outList)
+{
+    const __m256i byteMask = _mm256_set_epi8(12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3,
+        12, 13, 14, 15, 8, 9, 10, 11, 4, 5, 6, 7, 0, 1, 2, 3);
+    __m256i rowList[8];
+    for (size_t i = 0; i < SHA256_LANE_NUM; i++) {
+        rowList[i] = _mm256_loadu_si256((const __m256i*)(blockList[i] + wordOffset));
+    }
+    __m256i t0 = _mm256_unpacklo_epi32(rowList[0], rowList[1]);
+    __m256i t1 = _mm256_unpackhi_epi32(rowList[0], rowList[1]);
+    __m256i t2 = _mm256_unpacklo_epi32(rowList[2], rowList[3]);
+    __m256i t3 = _mm256_unpackhi_epi32(rowList[2], rowList[3]);
+    __m256i t4 = _mm256_unpacklo_epi32(rowList[4], rowList[5]);
+    __m256i t5 = _mm256_unpackhi_epi32(rowList[4], rowList[5]);
+    __m256i t6 = _mm256_unpacklo_epi32(rowList[6], rowList[7]);
+    __m256i t7 = _mm256_unpackhi_epi32(rowList[6], rowList[7]);
+    __m256i u0 = _mm256_unpacklo_epi64(t0, t2);
+    __m256i u1 = _mm256_unpackhi_epi64(t0, t2);
+    __m256i u2 = _mm256_unpacklo_epi64(t1, t3);
+    __m256i u3 = _mm256_unpackhi_epi64(t1, t3);
+    __m256i u4 = _mm256_unpacklo_epi64(t4, t6);
+    __m256i u5 = _mm256_unpackhi_epi64(t4, t6);
+    __m256i u6 = _mm256_unpacklo_epi64(t5, t7);
+    __m256i u7 = _mm256_unpackhi_epi64(t5, t7);
+    outList[0] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u0, u4, 0x20), byteMask);
+    outList[1] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u1, u5, 0x20), byteMask);
+    outList[2] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u2, u6, 0x20), byteMask);
+    outList[3] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u3, u7, 0x20), byteMask);
+    outList[4] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u0, u4, 0x31), byteMask);
+    outList[5] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u1, u5, 0x31), byteMask);
+    outList[6] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u2, u6, 0x31), byteMask);
+    outList[7] = _mm256_shuffle_epi8(_mm256_permute2x128_si256(u3, u7, 0x31), byteMask);
+    return;
+}
+
+/**
+ * @brief compress one block of each lane
+ *
+ * @param laneState the state words (word-major, 8 lanes per word)
+ * @param blockList the block of each lane
+ */
+__attribute__((target("avx2"))) static void CompressAVX2(uint32_t* laneState,
+    const uint8_t* const* blockList)
+{
+    __m256i msgList[16];
+    LoadWordsAVX2(blockList, 0, msgList);
+    LoadWordsAVX2(blockList, 32, msgList + 8);
+
+    __m256i a = _mm256_loadu_si256((const __m256i*)(laneState + 0 * SHA256_LANE_NUM));
+    __m256i b = _mm256_loadu_si256((const __m256i*)(laneState + 1 * SHA256_LANE_NUM));
+    __m256i c = _mm256_loadu_si256((const __m256i*)(laneState + 2 * SHA256_LANE_NUM));
+    __m256i d = _mm256_loadu_si256((const __m256i*)(laneState + 3 * SHA256_LANE_NUM));
+    __m256i e = _mm256_loadu_si256((const __m256i*)(laneState + 4 * SHA256_LANE_NUM));
+    __m256i f = _mm256_loadu_si256((const __m256i*)(laneState + 5 * SHA256_LANE_NUM));
+    __m256i g = _mm256_loadu_si256((const __m256i*)(laneState + 6 * SHA256_LANE_NUM));
+    __m256i h = _mm256_loadu_si256((const __m256i*)(laneState + 7 * SHA256_LANE_NUM));
+
+#pragma GCC unroll 64
+    for (size_t t = 0; t < 64; t++) {
+        __m256i w;
+        if (t < 16) {
+            w = msgList[t];
+        } else {
+            __m256i w15 = msgList[(t + 1) & 15];
+            __m256i w2 = msgList[(t + 14) & 15];
+            __m256i s0 = _mm256_xor_si256(_mm256_xor_si256(ROTR_AVX2(w15, 7), ROTR_AVX2(w15, 18)),
+                _mm256_srli_epi32(w15, 3));
+            __m256i s1 = _mm256_xor_si256(_mm256_xor_si256(ROTR_AVX2(w2, 17), ROTR_AVX2(w2, 19)),
+                _mm256_srli_epi32(w2, 10));
+            w = _mm256_add_epi32(_mm256_add_epi32(msgList[t & 15], s0),
+                _mm256_add_epi32(msgList[(t + 9) & 15], s1));
+            msgList[t & 15] = w;
+        }
+        __m256i bigS1 = _mm256_xor_si256(_mm256_xor_si256(ROTR_AVX2(e, 6), ROTR_AVX2(e, 11)),
+            ROTR_AVX2(e, 25));
+        __m256i ch = _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g));
+        __m256i t1 = _mm256_add_epi32(_mm256_add_epi32(h, bigS1),
+            _mm256_add_epi32(_mm256_add_epi32(ch, _mm256_set1_epi32(roundConst[t])), w));
+        __m256i bigS0 = _mm256_xor_si256(_mm256_xor_si256(ROTR_AVX2(a, 2), ROTR_AVX2(a, 13)),
+            ROTR_AVX2(a, 22));
+        __m256i maj = _mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b)));
+        __m256i t2 = _mm256_add_epi32(bigS0, maj);
+        h = g;
+        g = f;
+        f = e;
+        e = _mm256_add_epi32(d, t1);
+        d = c;
+        c = b;
+        b = a;
+        a = _mm256_add_epi32(t1, t2);
+    }
+
+    __m256i* stateVec = (__m256i*)laneState;
+    _mm256_storeu_si256(stateVec + 0, _mm256_add_epi32(_mm256_loadu_si256(stateVec + 0), a));
+    _mm256_storeu_si256(stateVec + 1, _mm256_add_epi32(_mm256_loadu_si256(stateVec + 1), b));
+    _mm256_storeu_si256(stateVec + 2, _mm256_add_epi32(_mm256_loadu_si256(stateVec + 2), c));
+    _mm256_storeu_si256(stateVec + 3, _mm256_add_epi32(_mm256_loadu_si256(stateVec + 3), d));
+    _mm256_storeu_si256(stateVec + 4, _mm256_add_epi32(_mm256_loadu_si256(stateVec + 4), e));
+    _mm256_storeu_si256(stateVec + 5, _mm256_add_epi32(_mm256_loadu_si256(stateVec + 5), f));
+    _mm256_storeu_si256(stateVec + 6, _mm256_add_epi32(_mm256_loadu_si256(stateVec + 6), g));
+    _mm256_storeu_si256(stateVec + 7, _mm256_add_epi32(_mm256_loadu_si256(stateVec + 7), h));
+    return;
+}
+
+typedef struct {
+    bool isActive;
+    uint32_t dataIdx;
+    const uint8_t* dataBuffer;
+    size_t dataBlockNum;
+    size_t nextBlock;
+    uint32_t tailBlockNum;
+    uint8_t tailBuffer[2 * SHA256_BLOCK_SIZE];
+} LaneJob_t;
+
+void HashBatchAVX2(uint8_t** dataBufferList, const uint32_t* dataSizeList, uint32_t dataNum,
+    uint8_t* hashList)
+{
+    alignas(32) uint32_t laneState[8 * SHA256_LANE_NUM];
+    LaneJob_t laneList[SHA256_LANE_NUM];
+    const uint8_t* blockList[SHA256_LANE_NUM];
+    static const uint8_t idleBlock[SHA256_BLOCK_SIZE] = { 0 };
+    uint32_t nextData = 0;
+    uint32_t activeNum = 0;
+
+    // a lane takes the next buffer once its current one is done
+    auto startLane = [&](size_t lane) {
+        LaneJob_t* laneJob = &laneList[lane];
+        if (nextData == dataNum) {
+            laneJob->isActive = false;
+            return;
+        }
+        laneJob->isActive = true;
+        laneJob->dataIdx = nextData;
+        laneJob->dataBuffer = dataBufferList[nextData];
+        laneJob->dataBlockNum = dataSizeList[nextData] / SHA256_BLOCK_SIZE;
+        laneJob->nextBlock = 0;
+        laneJob->tailBlockNum = BuildTail(dataBufferList[nextData], dataSizeList[nextData],
+            laneJob->tailBuffer);
+        for (size_t i = 0; i < 8; i++) {
+            laneState[i * SHA256_LANE_NUM + lane] = initState[i];
+        }
+        nextData++;
+        activeNum++;
+        return;
+    };
+
+    for (size_t lane = 0; lane < SHA256_LANE_NUM; lane++) {
+        startLane(lane);
+    }
+
+    uint32_t digestState[8];
+    while (activeNum != 0) {
+        for (size_t lane = 0; lane < SHA256_LANE_NUM; lane++) {
+            LaneJob_t* laneJob = &laneList[lane];
+            if (!laneJob->isActive) {
+                blockList[lane] = idleBlock;
+            } else if (laneJob->nextBlock < laneJob->dataBlockNum) {
+                blockList[lane] = laneJob->dataBuffer + laneJob->nextBlock * SHA256_BLOCK_SIZE;
+            } else {
+                blockList[lane] = laneJob->tailBuffer
+                    + (laneJob->nextBlock - laneJob->dataBlockNum) * SHA256_BLOCK_SIZE;
+            }
+        }
+        CompressAVX2(laneState, blockList);
+
+        for (size_t lane = 0; lane < SHA256_LANE_NUM; lane++) {
+            LaneJob_t* laneJob = &laneList[lane];
+            if (!laneJob->isActive) {
+                continue;
+            }
+            laneJob->nextBlock++;
+            if (laneJob->nextBlock == laneJob->dataBlockNum + laneJob->tailBlockNum) {
+                for (size_t i = 0; i < 8; i++) {
+                    digestState[i] = laneState[i * SHA256_LANE_NUM + lane];
+                }
+                StoreHash(digestState, hashList + laneJob->dataIdx * CHUNK_HASH_SIZE);
+                activeNum--;
+                startLane(lane);
+            }
+        }
+    }
+    return;
+}
+
+#else
+
+// the kernels use the x86 instructions, the other cpus keep the OpenSSL batch path
+bool IsSupported(int hashKernel)
+{
+    return hashKernel == HASH_KERNEL_OPENSSL;
+}
+
+void HashBatchSHANI(uint8_t** dataBufferList, const uint32_t* dataSizeList, uint32_t dataNum,
+    uint8_t* hashList)
+{
+    fprintf(stderr, "sha256Kernel: the SHA-NI kernel is not built for this cpu.\n");
+    exit(EXIT_FAILURE);
+}
+
+void HashBatchAVX2(uint8_t** dataBufferList, const uint32_t* dataSizeList, uint32_t dataNum,
+    uint8_t* hashList)
+{
+    fprintf(stderr, "sha256Kernel: the AVX2 kernel is not built for this cpu.\n");
+    exit(EXIT_FAILURE);
+}
+
+#endif
+} // namespace sha256Kernel